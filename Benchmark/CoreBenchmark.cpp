@@ -0,0 +1,548 @@
+// CoreBenchmark.cpp - ドキュメントコアの性能計測（Windows / Linux 共通）
+// 使い方: AweditBench [--size=<MB>] [項目...]  項目を省略するとすべて実行する
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "CaseFold.h"
+#include "FileIO.h"
+#include "TextDocument.h"
+#include "TextEncoding.h"
+#include "LiteralMatcher.h"
+#include "SimdScan.h"
+#include "SearchEngine.h"
+#include "WorkerPool.h"
+
+// 計測の繰り返し回数（最も速かった回を採る）
+static const int REPEAT_COUNT = 3;
+static const size_t DEFAULT_CORPUS_MEGABYTES = 32;
+
+// 計測用の文書。UTF-8 で一時ファイルに書き出しておき、各項目で読み込んで使う
+struct Corpus
+{
+    const char* name;
+    std::wstring filePath;
+    uint64_t fileBytes;
+
+    Corpus() : name(""), fileBytes(0) {}
+};
+
+template <typename Func>
+static double MeasureBestSeconds(Func func)
+{
+    double best = 0.0;
+    for (int i = 0; i < REPEAT_COUNT; ++i)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        func();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (i == 0 || seconds < best)
+        {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+static void PrintResult(const char* label, const char* corpus, double seconds, uint64_t bytes)
+{
+    const double gigabytesPerSecond = seconds > 0.0 ? static_cast<double>(bytes) / seconds / 1e9 : 0.0;
+    printf("%-32s %-6s %10.2f ms %8.2f GB/s\n", label, corpus, seconds * 1000.0, gigabytesPerSecond);
+}
+
+// 英文風の ASCII の行
+static std::wstring CreateAsciiLine(std::mt19937& random)
+{
+    static const wchar_t* const WORDS[] = {
+        L"the", L"quick", L"brown", L"fox", L"jumps", L"over", L"lazy", L"dog", L"error", L"value",
+        L"return", L"index", L"buffer", L"search", L"document", L"line", L"count", L"static", L"const", L"size",
+    };
+    std::wstring line;
+    const size_t wordCount = 4 + random() % 12;
+    for (size_t i = 0; i < wordCount; ++i)
+    {
+        if (i > 0)
+        {
+            line += L' ';
+        }
+        line += WORDS[random() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+    }
+    return line;
+}
+
+// ひらがな・カタカナ・漢字の混じった日本語の行
+static std::wstring CreateCjkLine(std::mt19937& random)
+{
+    std::wstring line;
+    const size_t length = 10 + random() % 40;
+    for (size_t i = 0; i < length; ++i)
+    {
+        switch (random() % 4)
+        {
+        case 0:
+            line += static_cast<wchar_t>(0x3041 + random() % 83);   // ひらがな
+            break;
+        case 1:
+            line += static_cast<wchar_t>(0x30A1 + random() % 86);   // カタカナ
+            break;
+        case 2:
+            line += L"、。"[random() % 2];
+            break;
+        default:
+            line += static_cast<wchar_t>(0x4E00 + random() % 2000); // 漢字
+            break;
+        }
+    }
+    return line;
+}
+
+static bool WriteCorpus(Corpus& corpus, const char* name, size_t targetBytes,
+                        std::wstring (*createLine)(std::mt19937&))
+{
+    corpus.name = name;
+    if (!CreateTempFile(L"awb", corpus.filePath))
+    {
+        return false;
+    }
+
+    CFile file;
+    if (!file.Open(corpus.filePath.c_str(), CFile::CreateAlways, FileAccessHint::Sequential))
+    {
+        return false;
+    }
+
+    std::mt19937 random(12345);
+    std::string buffer;
+    std::string utf8;
+    corpus.fileBytes = 0;
+    while (corpus.fileBytes + buffer.size() < targetBytes)
+    {
+        if (!ConvertWideToUtf8(createLine(random), utf8))
+        {
+            return false;
+        }
+        buffer += utf8;
+        buffer += "\r\n";
+        if (buffer.size() >= 1024 * 1024)
+        {
+            if (!file.Write(buffer.data(), buffer.size()))
+            {
+                return false;
+            }
+            corpus.fileBytes += buffer.size();
+            buffer.clear();
+        }
+    }
+    if (!file.Write(buffer.data(), buffer.size()))
+    {
+        return false;
+    }
+    corpus.fileBytes += buffer.size();
+    return true;
+}
+
+static bool LoadCorpus(const Corpus& corpus, CTextDocument& document)
+{
+    if (!document.LoadFromFile(corpus.filePath.c_str()))
+    {
+        fprintf(stderr, "failed to load the %s corpus\n", corpus.name);
+        return false;
+    }
+    return true;
+}
+
+// 照合する文字列のバイト数（メモリ上の wchar_t の大きさで数える）
+static uint64_t GetTextBytes(const CTextDocument& document)
+{
+    uint64_t bytes = 0;
+    for (size_t line = 0; line < document.GetLineCount(); ++line)
+    {
+        bytes += document.GetLine(line).length() * sizeof(wchar_t);
+    }
+    return bytes;
+}
+
+// 全行の一致を数える（一致の後ろから続けて探す）
+// 特殊化前の CLiteralMatcher::Find と同じ検索。文字や候補ごとに大文字小文字の区別と単語単位を判定する（kernels での比較用）
+class CGenericLiteralMatcher
+{
+public:
+    CGenericLiteralMatcher() : m_caseSensitive(false), m_wholeWord(false), m_usePrefilter(false) {}
+
+    void Compile(const std::wstring& pattern, bool caseSensitive, bool wholeWord)
+    {
+        m_caseSensitive = caseSensitive;
+        m_wholeWord = wholeWord;
+        m_pattern = pattern;
+        for (wchar_t& ch : m_pattern)
+        {
+            ch = Fold(ch);
+        }
+
+        const size_t m = m_pattern.length();
+        for (size_t& shift : m_shift)
+        {
+            shift = m > 0 ? m : 1;
+        }
+        for (size_t i = 0; i + 1 < m; ++i)
+        {
+            m_shift[static_cast<unsigned long>(m_pattern[i]) & 0xFF] = m - 1 - i;
+        }
+        m_usePrefilter = IsVectorScanAvailable() && BuildCandidateSpec(m_pattern, caseSensitive, m_candidates);
+    }
+
+    bool Find(const wchar_t* text, size_t length, size_t from, size_t& matchStart, size_t& matchEnd) const
+    {
+        const size_t m = m_pattern.length();
+        if (m == 0 || from > length || length - from < m)
+        {
+            return false;
+        }
+
+        const wchar_t last = m_pattern[m - 1];
+        if (m_usePrefilter)
+        {
+            const size_t lastStart = length - m;
+            size_t pos = from;
+            while ((pos = FindCandidate(text, lastStart, pos, m_candidates)) != CANDIDATE_NOT_FOUND)
+            {
+                if (Fold(text[pos + m - 1]) == last && MatchesAt(text + pos) &&
+                    (!m_wholeWord || IsWholeWordAt(text, length, pos)))
+                {
+                    matchStart = pos;
+                    matchEnd = pos + m;
+                    return true;
+                }
+                pos++;
+            }
+            return false;
+        }
+
+        size_t pos = from;
+        while (pos <= length - m)
+        {
+            const wchar_t ch = Fold(text[pos + m - 1]);
+            if (ch == last && MatchesAt(text + pos))
+            {
+                if (!m_wholeWord || IsWholeWordAt(text, length, pos))
+                {
+                    matchStart = pos;
+                    matchEnd = pos + m;
+                    return true;
+                }
+                pos++;
+                continue;
+            }
+            pos += m_shift[static_cast<unsigned long>(ch) & 0xFF];
+        }
+        return false;
+    }
+
+private:
+    wchar_t Fold(wchar_t ch) const { return m_caseSensitive ? ch : FoldCase(ch); }
+
+    bool MatchesAt(const wchar_t* text) const
+    {
+        for (size_t i = 0; i + 1 < m_pattern.length(); ++i)
+        {
+            if (Fold(text[i]) != m_pattern[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool IsWholeWordAt(const wchar_t* text, size_t length, size_t start) const
+    {
+        const size_t end = start + m_pattern.length();
+        return (start == 0 || !IsWordChar(text[start - 1])) && (end >= length || !IsWordChar(text[end]));
+    }
+
+    std::wstring m_pattern;
+    bool m_caseSensitive;
+    bool m_wholeWord;
+    size_t m_shift[256];
+    CandidateSpec m_candidates;
+    bool m_usePrefilter;
+};
+
+template <typename Matcher>
+static size_t CountLiteralMatches(const CTextDocument& document, const Matcher& matcher)
+{
+    size_t count = 0;
+    for (size_t line = 0; line < document.GetLineCount(); ++line)
+    {
+        const std::wstring& text = document.GetLine(line);
+        size_t from = 0;
+        size_t matchStart = 0;
+        size_t matchEnd = 0;
+        while (matcher.Find(text.data(), text.length(), from, matchStart, matchEnd))
+        {
+            ++count;
+            from = matchEnd > matchStart ? matchEnd : matchStart + 1;
+        }
+    }
+    return count;
+}
+
+// ファイルの読み込みと保存（大きなファイルはメモリマップで読む）
+static void RunLoadSaveBenchmark(const std::vector<Corpus>& corpora)
+{
+    for (const Corpus& corpus : corpora)
+    {
+        CTextDocument document;
+        const double loadSeconds = MeasureBestSeconds([&]() { document.LoadFromFile(corpus.filePath.c_str()); });
+        PrintResult("load", corpus.name, loadSeconds, corpus.fileBytes);
+
+        std::wstring savePath;
+        if (!CreateTempFile(L"awb", savePath))
+        {
+            continue;
+        }
+        const double saveSeconds = MeasureBestSeconds([&]() { document.SaveToFile(savePath.c_str()); });
+        FileStat stat;
+        GetFileStat(savePath.c_str(), stat);
+        PrintResult("save", corpus.name, saveSeconds, stat.size);
+        DeleteFilePath(savePath.c_str());
+    }
+}
+
+// リテラル検索（候補スキャナによる事前絞り込み付き）。出現しない語で走査そのものの速さを、
+// よく出る語で一致ごとの照合を含めた速さを測る
+static void RunLiteralBenchmark(const std::vector<Corpus>& corpora)
+{
+    struct LiteralCase
+    {
+        const char* corpus;
+        const char* label;
+        const wchar_t* pattern;
+        bool caseSensitive;
+    };
+    static const LiteralCase CASES[] = {
+        { "ascii", "literal rare (case)", L"timeout", true },
+        { "ascii", "literal rare (nocase)", L"Timeout", false },
+        { "ascii", "literal frequent (case)", L"search", true },
+        { "ascii", "literal frequent (nocase)", L"Search", false },
+        { "cjk", "literal rare (case)", L"検索結果", true },
+        { "cjk", "literal rare (nocase)", L"検索結果", false },
+        { "cjk", "literal frequent (case)", L"、", true },
+    };
+
+    printf("candidate scanner: %s\n", GetCandidateScannerName());
+    for (const Corpus& corpus : corpora)
+    {
+        CTextDocument document;
+        if (!LoadCorpus(corpus, document))
+        {
+            continue;
+        }
+        const uint64_t bytes = GetTextBytes(document);
+        for (const LiteralCase& literalCase : CASES)
+        {
+            if (strcmp(literalCase.corpus, corpus.name) != 0)
+            {
+                continue;
+            }
+            CLiteralMatcher matcher;
+            matcher.Compile(literalCase.pattern, literalCase.caseSensitive, false);
+            size_t matches = 0;
+            const double seconds = MeasureBestSeconds([&]() { matches = CountLiteralMatches(document, matcher); });
+            PrintResult(literalCase.label, corpus.name, seconds, bytes);
+            printf("%-32s %-6s %10zu matches\n", "", "", matches);
+        }
+    }
+}
+
+// 大文字小文字の区別と単語単位の組ごとに、特殊化した検索関数と特殊化前の検索を比べる。
+// どの組でも一致する語を使い、一致ごとの照合も計測に含める
+static void RunKernelBenchmark(const std::vector<Corpus>& corpora)
+{
+    struct KernelCase
+    {
+        const char* corpus;
+        const wchar_t* pattern;
+    };
+    static const KernelCase CASES[] = {
+        { "ascii", L"line" },
+        { "cjk", L"。" },
+    };
+
+    for (const Corpus& corpus : corpora)
+    {
+        CTextDocument document;
+        if (!LoadCorpus(corpus, document))
+        {
+            continue;
+        }
+        const uint64_t bytes = GetTextBytes(document);
+        for (const KernelCase& kernelCase : CASES)
+        {
+            if (strcmp(kernelCase.corpus, corpus.name) != 0)
+            {
+                continue;
+            }
+            for (int combination = 0; combination < 4; ++combination)
+            {
+                const bool caseSensitive = (combination & 1) != 0;
+                const bool wholeWord = (combination & 2) != 0;
+                CLiteralMatcher specialized;
+                specialized.Compile(kernelCase.pattern, caseSensitive, wholeWord);
+                CGenericLiteralMatcher generic;
+                generic.Compile(kernelCase.pattern, caseSensitive, wholeWord);
+
+                size_t matches = 0;
+                size_t genericMatches = 0;
+                const double seconds = MeasureBestSeconds([&]() { matches = CountLiteralMatches(document, specialized); });
+                const double genericSeconds = MeasureBestSeconds([&]() { genericMatches = CountLiteralMatches(document, generic); });
+
+                char label[64];
+                snprintf(label, sizeof(label), "kernel %s%s", caseSensitive ? "case" : "nocase", wholeWord ? " word" : "");
+                PrintResult(label, corpus.name, seconds, bytes);
+                snprintf(label, sizeof(label), "kernel %s%s (generic)", caseSensitive ? "case" : "nocase", wholeWord ? " word" : "");
+                PrintResult(label, corpus.name, genericSeconds, bytes);
+                printf("%-32s %-6s %10zu matches %6.2fx%s\n", "", "", matches,
+                       seconds > 0.0 ? genericSeconds / seconds : 0.0, matches == genericMatches ? "" : " MISMATCH");
+            }
+        }
+    }
+}
+
+// FindAll のスレッド数による伸び（1 から共有ワーカープールと呼び出しスレッドの合計まで倍々に増やす）
+static void RunThreadScalingBenchmark(const std::vector<Corpus>& corpora)
+{
+    struct ScalingCase
+    {
+        const char* corpus;
+        const char* label;
+        const wchar_t* pattern;
+        bool useRegex;
+    };
+    static const ScalingCase CASES[] = {
+        { "ascii", "findall literal", L"value", false },
+        { "ascii", "findall regex", L"\\b(err|ind)\\w*", true },
+        { "cjk", "findall literal", L"。", false },
+        { "cjk", "findall regex", L"[ァ-ヶ]{3}", true },
+    };
+
+    const size_t maxThreads = CWorkerPool::GetShared().GetThreadCount() + 1;
+    printf("max threads: %zu\n", maxThreads);
+    for (const Corpus& corpus : corpora)
+    {
+        CTextDocument document;
+        if (!LoadCorpus(corpus, document))
+        {
+            continue;
+        }
+        const uint64_t bytes = GetTextBytes(document);
+        for (const ScalingCase& scalingCase : CASES)
+        {
+            if (strcmp(scalingCase.corpus, corpus.name) != 0)
+            {
+                continue;
+            }
+            CSearchEngine engine;
+            SearchOptions options;
+            options.useRegex = scalingCase.useRegex;
+            options.caseSensitive = true;
+            engine.SetOptions(options);
+
+            double singleSeconds = 0.0;
+            for (size_t threads = 1; ; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads)
+            {
+                engine.SetThreadCount(threads);
+                size_t matches = 0;
+                const double seconds = MeasureBestSeconds([&]() { matches = engine.FindAll(&document, scalingCase.pattern).size(); });
+                if (threads == 1)
+                {
+                    singleSeconds = seconds;
+                }
+                char label[64];
+                snprintf(label, sizeof(label), "%s x%zu", scalingCase.label, threads);
+                PrintResult(label, corpus.name, seconds, bytes);
+                printf("%-32s %-6s %10zu matches %6.2fx\n", "", "", matches, seconds > 0.0 ? singleSeconds / seconds : 0.0);
+                if (threads >= maxThreads)
+                {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+struct BenchmarkSection
+{
+    const char* name;
+    void (*run)(const std::vector<Corpus>& corpora);
+};
+
+static const BenchmarkSection SECTIONS[] = {
+    { "loadsave", RunLoadSaveBenchmark },
+    { "literal", RunLiteralBenchmark },
+    { "kernels", RunKernelBenchmark },
+    { "threads", RunThreadScalingBenchmark },
+};
+
+int main(int argc, char* argv[])
+{
+    size_t corpusMegabytes = DEFAULT_CORPUS_MEGABYTES;
+    std::vector<const BenchmarkSection*> selected;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--size=", 7) == 0)
+        {
+            corpusMegabytes = static_cast<size_t>(strtoul(argv[i] + 7, nullptr, 10));
+            continue;
+        }
+        const BenchmarkSection* pSection = nullptr;
+        for (const BenchmarkSection& section : SECTIONS)
+        {
+            if (strcmp(argv[i], section.name) == 0)
+            {
+                pSection = &section;
+            }
+        }
+        if (!pSection)
+        {
+            fprintf(stderr, "unknown benchmark: %s\n", argv[i]);
+            return 1;
+        }
+        selected.push_back(pSection);
+    }
+    if (selected.empty())
+    {
+        for (const BenchmarkSection& section : SECTIONS)
+        {
+            selected.push_back(&section);
+        }
+    }
+
+    std::vector<Corpus> corpora(2);
+    const size_t targetBytes = (corpusMegabytes > 0 ? corpusMegabytes : 1) * 1024 * 1024;
+    bool written = WriteCorpus(corpora[0], "ascii", targetBytes, CreateAsciiLine) &&
+                   WriteCorpus(corpora[1], "cjk", targetBytes, CreateCjkLine);
+    if (written)
+    {
+        for (const BenchmarkSection* pSection : selected)
+        {
+            printf("[%s]\n", pSection->name);
+            pSection->run(corpora);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "failed to write the benchmark corpus\n");
+    }
+
+    for (const Corpus& corpus : corpora)
+    {
+        if (!corpus.filePath.empty())
+        {
+            DeleteFilePath(corpus.filePath.c_str());
+        }
+    }
+    return written ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+// CaseFold.cpp - 大文字小文字の畳み込みテーブル
+#include "CaseFold.h"
+#include <vector>
+#include <cstdint>
+
+const wchar_t* GetCaseFoldTable()
+{
+    static const std::vector<wchar_t> table = []
+    {
+        std::vector<wchar_t> entries(0x10000);
+        for (unsigned long ch = 0; ch < 0x10000; ++ch)
+        {
+            entries[ch] = static_cast<wchar_t>(std::towlower(static_cast<wint_t>(ch)));
+        }
+        return entries;
+    }();
+    return table.data();
+}
+
+const wchar_t* GetCaseVariants(wchar_t folded, size_t& count)
+{
+    // 畳み込み後の値ごとに元のコード単位を並べる（offsets[v]..offsets[v+1] が値 v の範囲）
+    struct ReverseTable
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<wchar_t> codes;
+    };
+    static const ReverseTable reverse = []
+    {
+        const wchar_t* table = GetCaseFoldTable();
+        ReverseTable result;
+        result.offsets.assign(0x10001, 0);
+        for (unsigned long code = 0; code < 0x10000; ++code)
+        {
+            const unsigned long value = static_cast<unsigned long>(table[code]);
+            if (value < 0x10000)
+            {
+                result.offsets[value + 1]++;
+            }
+        }
+        for (size_t value = 0; value < 0x10000; ++value)
+        {
+            result.offsets[value + 1] += result.offsets[value];
+        }
+        result.codes.resize(result.offsets[0x10000]);
+        std::vector<uint32_t> next(result.offsets.begin(), result.offsets.end() - 1);
+        for (unsigned long code = 0; code < 0x10000; ++code)
+        {
+            const unsigned long value = static_cast<unsigned long>(table[code]);
+            if (value < 0x10000)
+            {
+                result.codes[next[value]++] = static_cast<wchar_t>(code);
+            }
+        }
+        return result;
+    }();
+
+    const unsigned long value = static_cast<unsigned long>(folded);
+    if (value >= 0x10000)
+    {
+        count = 0;
+        return nullptr;
+    }
+    count = reverse.offsets[value + 1] - reverse.offsets[value];
+    return reverse.codes.data() + reverse.offsets[value];
+}
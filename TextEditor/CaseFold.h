@@ -0,0 +1,27 @@
+// CaseFold.h - 大文字小文字の畳み込み（検索用）
+#pragma once
+#include <cstddef>
+#include <cwctype>
+
+// BMP全体の畳み込みテーブル（towlower相当）。初回呼び出し時に構築
+const wchar_t* GetCaseFoldTable();
+// GetCaseFoldTable の逆引き。畳み込むと folded になるBMPのコード単位を昇順で返し、個数を count に入れる
+// （BMP外の値や、どの文字を畳み込んでも得られない値では0）。初回呼び出し時に構築
+const wchar_t* GetCaseVariants(wchar_t folded, size_t& count);
+
+// 1文字を畳み込む。テーブル参照のみで分岐やロケール呼び出しを伴わない
+inline wchar_t FoldCase(wchar_t ch)
+{
+    static const wchar_t* const table = GetCaseFoldTable();
+    if (static_cast<unsigned long>(ch) < 0x10000)
+    {
+        return table[static_cast<unsigned long>(ch)];
+    }
+    return static_cast<wchar_t>(std::towlower(static_cast<wint_t>(ch)));
+}
+
+// 単語構成文字か（単語単位検索の境界判定用）
+inline bool IsWordChar(wchar_t ch)
+{
+    return std::iswalnum(static_cast<wint_t>(ch)) != 0;
+}
@@ -266,19 +266,27 @@ void CEditController::InsertChar(CTextDocument* pDocument, wchar_t ch, CUndoMana
         return;
     }
 
+    // 選択範囲の上書きや複数カーソルへの入力は、1つの履歴にまとめる
+    const bool useTransaction = pUndoManager && (HasSelection() || m_cursors.size() > 1);
+    if (useTransaction)
+    {
+        pUndoManager->BeginTransaction(pDocument);
+    }
+
     // 選択範囲があれば削除
     if (HasSelection())
     {
         DeleteSelection(pDocument, pUndoManager);
     }
 
-    // 各カーソル位置に文字を挿入
+    // 各カーソル位置に文字を挿入。カーソルが1つなら続けて入力した文字を1つの履歴にまとめる
+    const bool coalesce = m_cursors.size() == 1;
     for (auto& cursor : m_cursors)
     {
         if (pUndoManager)
         {
             std::wstring text(1, ch);
-            pUndoManager->ExecuteCommand(std::make_unique<CInsertTextCommand>(cursor, text), pDocument);
+            pUndoManager->ExecuteInsert(cursor, text, pDocument, coalesce);
         }
         else
         {
@@ -296,6 +304,11 @@ void CEditController::InsertChar(CTextDocument* pDocument, wchar_t ch, CUndoMana
             cursor.column++;
         }
     }
+
+    if (useTransaction)
+    {
+        pUndoManager->EndTransaction();
+    }
 }
 
 void CEditController::InsertText(CTextDocument* pDocument, const std::wstring& text, CUndoManager* pUndoManager)
@@ -305,6 +318,13 @@ void CEditController::InsertText(CTextDocument* pDocument, const std::wstring& t
         return;
     }
 
+    // 選択範囲の上書きや複数カーソルへの入力は、1つの履歴にまとめる
+    const bool useTransaction = pUndoManager && (HasSelection() || m_cursors.size() > 1);
+    if (useTransaction)
+    {
+        pUndoManager->BeginTransaction(pDocument);
+    }
+
     // 選択範囲があれば削除
     if (HasSelection())
     {
@@ -316,7 +336,7 @@ void CEditController::InsertText(CTextDocument* pDocument, const std::wstring& t
     {
         if (pUndoManager)
         {
-            pUndoManager->ExecuteCommand(std::make_unique<CInsertTextCommand>(cursor, text), pDocument);
+            pUndoManager->ExecuteInsert(cursor, text, pDocument);
         }
         else
         {
@@ -345,6 +365,11 @@ void CEditController::InsertText(CTextDocument* pDocument, const std::wstring& t
             cursor.column += text.length();
         }
     }
+
+    if (useTransaction)
+    {
+        pUndoManager->EndTransaction();
+    }
 }
 
 void CEditController::DeleteSelection(CTextDocument* pDocument, CUndoManager* pUndoManager)
@@ -354,6 +379,13 @@ void CEditController::DeleteSelection(CTextDocument* pDocument, CUndoManager* pU
         return;
     }
 
+    // 複数の選択範囲（矩形選択など）の削除は1つの履歴にまとめる
+    const bool useTransaction = pUndoManager && m_selections.size() > 1;
+    if (useTransaction)
+    {
+        pUndoManager->BeginTransaction(pDocument);
+    }
+
     // 選択範囲を削除（後ろから削除して位置ずれを防ぐ）
     for (auto it = m_selections.rbegin(); it != m_selections.rend(); ++it)
     {
@@ -361,7 +393,7 @@ void CEditController::DeleteSelection(CTextDocument* pDocument, CUndoManager* pU
         {
             if (pUndoManager)
             {
-                pUndoManager->ExecuteCommand(std::make_unique<CDeleteTextCommand>(it->start, it->end), pDocument);
+                pUndoManager->ExecuteDelete(it->start, it->end, pDocument);
             }
             else
             {
@@ -370,6 +402,11 @@ void CEditController::DeleteSelection(CTextDocument* pDocument, CUndoManager* pU
         }
     }
 
+    if (useTransaction)
+    {
+        pUndoManager->EndTransaction();
+    }
+
     // カーソルを選択開始位置に移動
     if (!m_selections.empty())
     {
@@ -396,7 +433,14 @@ void CEditController::DeleteChar(CTextDocument* pDocument, bool forward, CUndoMa
         return;
     }
 
-    // 各カーソル位置で文字を削除
+    // 各カーソル位置で文字を削除。カーソルが1つなら続けて削除した文字を1つの履歴にまとめ、
+    // 複数なら全カーソルの削除を1つの履歴にする
+    const bool coalesce = m_cursors.size() == 1;
+    const bool useTransaction = pUndoManager && !coalesce;
+    if (useTransaction)
+    {
+        pUndoManager->BeginTransaction(pDocument);
+    }
     for (auto& cursor : m_cursors)
     {
         TextPosition startPos = cursor;
@@ -449,7 +493,7 @@ void CEditController::DeleteChar(CTextDocument* pDocument, bool forward, CUndoMa
         {
             if (pUndoManager)
             {
-                pUndoManager->ExecuteCommand(std::make_unique<CDeleteTextCommand>(startPos, endPos), pDocument);
+                pUndoManager->ExecuteDelete(startPos, endPos, pDocument, coalesce);
             }
             else
             {
@@ -462,6 +506,11 @@ void CEditController::DeleteChar(CTextDocument* pDocument, bool forward, CUndoMa
             }
         }
     }
+
+    if (useTransaction)
+    {
+        pUndoManager->EndTransaction();
+    }
 }
 
 void CEditController::MoveCursor(int dx, int dy, CTextDocument* pDocument)
@@ -5,18 +5,6 @@
 #include "TextDocument.h"
 #include "UndoManager.h"
 
-// 選択範囲を表す構造体
-struct Selection
-{
-    TextPosition start;
-    TextPosition end;
-
-    Selection() {}
-    Selection(const TextPosition& s, const TextPosition& e) : start(s), end(e) {}
-
-    bool IsEmpty() const { return start == end; }
-};
-
 class CEditController
 {
 public:
@@ -42,6 +30,8 @@ public:
     void SelectAll(CTextDocument* pDocument);
     bool HasSelection() const;
     void GetSelection(TextPosition& start, TextPosition& end) const;
+    // すべての選択範囲（矩形選択では行ごとの範囲）。選択範囲内の検索・置換の範囲に使う
+    const std::vector<Selection>& GetSelections() const { return m_selections; }
     std::wstring GetSelectedText(CTextDocument* pDocument) const;
 
     // 編集操作
@@ -0,0 +1,529 @@
+// EditJournal.cpp - 編集ジャーナル実装
+#include "EditJournal.h"
+#include "TextEncoding.h"
+#include <chrono>
+#include <cstring>
+
+// ファイル形式
+//   ヘッダ: "AWJ1" | 形式バージョン(u32) | 元ファイルサイズ(u64) | 元ファイル更新時刻(i64)
+//   レコード: タグ(u8) + 可変長整数のフィールド
+//     挿入:           行, 列, UTF-8バイト数, UTF-8テキスト
+//     削除:           開始行, 開始列, 行数差, 終了列
+//     チェックポイント: 区間のレコード数, 区間のCRC32(u32)
+static const char JOURNAL_MAGIC[4] = { 'A', 'W', 'J', '1' };
+static const uint32_t JOURNAL_FORMAT_VERSION = 1;
+static const size_t JOURNAL_HEADER_SIZE = 24;
+
+static const uint8_t RECORD_INSERT = 1;
+static const uint8_t RECORD_DELETE = 2;
+static const uint8_t RECORD_CHECKPOINT = 3;
+
+static const size_t FLUSH_THRESHOLD = 64 * 1024;         // この量が溜まったら即座に書き込む
+static const int FLUSH_INTERVAL_MS = 500;                 // 定期チェックポイントの間隔
+
+// --- Encoding helpers ---
+static void AppendVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static bool ReadVarint(const uint8_t* data, size_t size, size_t& offset, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (offset >= size)
+        {
+            return false;
+        }
+        uint8_t b = data[offset++];
+        value |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void AppendFixed(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+static uint64_t ReadFixed(const uint8_t* data, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        value |= static_cast<uint64_t>(data[i]) << (i * 8);
+    }
+    return value;
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t size)
+{
+    struct CrcTable
+    {
+        uint32_t entries[256];
+        CrcTable()
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                }
+                entries[i] = c;
+            }
+        }
+    };
+    static const CrcTable table; // 書き込みスレッドからも呼ばれるためスレッドセーフに初期化
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// --- Journal parsing ---
+// 1レコードを読み飛ばす。チェックポイントの場合はisCheckpointをtrueにする
+static bool SkipRecord(const uint8_t* data, size_t size, size_t& offset, bool& isCheckpoint,
+                       uint64_t& checkpointCount, uint32_t& checkpointCrc)
+{
+    isCheckpoint = false;
+    if (offset >= size)
+    {
+        return false;
+    }
+
+    uint8_t tag = data[offset++];
+    uint64_t a, b, c, d;
+    switch (tag)
+    {
+    case RECORD_INSERT:
+        if (!ReadVarint(data, size, offset, a) || !ReadVarint(data, size, offset, b) ||
+            !ReadVarint(data, size, offset, c) || c > size - offset)
+        {
+            return false;
+        }
+        offset += static_cast<size_t>(c);
+        return true;
+
+    case RECORD_DELETE:
+        return ReadVarint(data, size, offset, a) && ReadVarint(data, size, offset, b) &&
+               ReadVarint(data, size, offset, c) && ReadVarint(data, size, offset, d);
+
+    case RECORD_CHECKPOINT:
+        if (!ReadVarint(data, size, offset, checkpointCount) || size - offset < 4)
+        {
+            return false;
+        }
+        checkpointCrc = static_cast<uint32_t>(ReadFixed(data + offset, 4));
+        offset += 4;
+        isCheckpoint = true;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+// CRCが一致する最後のチェックポイントの直後までの長さを返す
+static size_t FindValidLength(const uint8_t* data, size_t size)
+{
+    size_t validEnd = JOURNAL_HEADER_SIZE;
+    size_t segmentStart = JOURNAL_HEADER_SIZE;
+    size_t offset = JOURNAL_HEADER_SIZE;
+    uint64_t records = 0;
+
+    while (offset < size)
+    {
+        size_t recordStart = offset;
+        bool isCheckpoint = false;
+        uint64_t checkpointCount = 0;
+        uint32_t checkpointCrc = 0;
+        if (!SkipRecord(data, size, offset, isCheckpoint, checkpointCount, checkpointCrc))
+        {
+            break;
+        }
+
+        if (!isCheckpoint)
+        {
+            records++;
+            continue;
+        }
+
+        if (checkpointCount != records ||
+            Crc32(data + segmentStart, recordStart - segmentStart) != checkpointCrc)
+        {
+            break;
+        }
+        validEnd = offset;
+        segmentStart = offset;
+        records = 0;
+    }
+    return validEnd;
+}
+
+static void AppendCheckpoint(std::vector<uint8_t>& out, uint64_t records, uint32_t crc)
+{
+    out.push_back(RECORD_CHECKPOINT);
+    AppendVarint(out, records);
+    AppendFixed(out, crc, 4);
+}
+
+// レコードを順に再生する。壊れたレコード（読めないフィールド、不正なUTF-8、文書の範囲外の位置）があれば
+// その手前で止めてfalseを返す。appliedLength は再生した末尾、segmentStart と segmentRecords は
+// 最後のチェックポイントより後に再生したレコードの範囲と数
+static bool ApplyRecords(const uint8_t* data, size_t size, CTextDocument* pDocument,
+                         size_t& appliedLength, size_t& segmentStart, uint64_t& segmentRecords)
+{
+    size_t offset = JOURNAL_HEADER_SIZE;
+    segmentStart = offset;
+    segmentRecords = 0;
+    std::wstring text;
+
+    while (offset < size)
+    {
+        appliedLength = offset;
+        uint8_t tag = data[offset++];
+        uint64_t line = 0, column = 0, a = 0, b = 0;
+        if (tag == RECORD_INSERT)
+        {
+            if (!ReadVarint(data, size, offset, line) || !ReadVarint(data, size, offset, column) ||
+                !ReadVarint(data, size, offset, a) || a > size - offset ||
+                !ConvertUtf8ToWide(reinterpret_cast<const char*>(data + offset), static_cast<size_t>(a), text))
+            {
+                return false;
+            }
+            const TextPosition pos(static_cast<size_t>(line), static_cast<size_t>(column));
+            if (!pDocument->IsValidPosition(pos))
+            {
+                return false;
+            }
+            offset += static_cast<size_t>(a);
+            pDocument->InsertText(pos, text);
+            segmentRecords++;
+        }
+        else if (tag == RECORD_DELETE)
+        {
+            if (!ReadVarint(data, size, offset, line) || !ReadVarint(data, size, offset, column) ||
+                !ReadVarint(data, size, offset, a) || !ReadVarint(data, size, offset, b))
+            {
+                return false;
+            }
+            const TextPosition start(static_cast<size_t>(line), static_cast<size_t>(column));
+            const TextPosition end(static_cast<size_t>(line + a), static_cast<size_t>(b));
+            if (!pDocument->IsValidPosition(start) || !pDocument->IsValidPosition(end) || end < start)
+            {
+                return false;
+            }
+            pDocument->DeleteRange(start, end);
+            segmentRecords++;
+        }
+        else if (tag == RECORD_CHECKPOINT)
+        {
+            if (!ReadVarint(data, size, offset, a) || size - offset < 4)
+            {
+                return false;
+            }
+            offset += 4;
+            segmentStart = offset;
+            segmentRecords = 0;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    appliedLength = offset;
+    return true;
+}
+
+static bool ReadHeader(const CMappedFile& journal, const wchar_t* baseFilePath)
+{
+    if (!journal.IsOpen() || journal.GetSize() < JOURNAL_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(journal.GetData());
+    if (std::memcmp(data, JOURNAL_MAGIC, 4) != 0 || ReadFixed(data + 4, 4) != JOURNAL_FORMAT_VERSION)
+    {
+        return false;
+    }
+
+    // 元ファイルがジャーナル開始後に変更されていれば再生できない
+    FileStat stat;
+    if (!GetFileStat(baseFilePath, stat))
+    {
+        return false;
+    }
+    return ReadFixed(data + 8, 8) == stat.size &&
+           static_cast<int64_t>(ReadFixed(data + 16, 8)) == stat.lastWriteTime;
+}
+
+// CEditJournal実装
+CEditJournal::CEditJournal()
+    : m_active(false)
+    , m_failed(false)
+    , m_pendingRecords(0)
+    , m_stopRequested(false)
+{
+}
+
+CEditJournal::~CEditJournal()
+{
+    Stop(false);
+}
+
+std::wstring CEditJournal::GetJournalPath(const wchar_t* baseFilePath)
+{
+    return std::wstring(baseFilePath) + L".awjournal";
+}
+
+bool CEditJournal::Start(const wchar_t* baseFilePath)
+{
+    Stop(false);
+    return OpenForAppend(baseFilePath, 0, true, std::vector<uint8_t>());
+}
+
+void CEditJournal::Stop(bool deleteFile)
+{
+    if (m_writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopRequested = true;
+        }
+        m_wake.notify_one();
+        m_writer.join();
+    }
+
+    m_active = false;
+    m_file.Close();
+    if (deleteFile && !m_journalPath.empty())
+    {
+        DeleteFilePath(m_journalPath.c_str());
+    }
+    m_journalPath.clear();
+}
+
+bool CEditJournal::HasRecoverableJournal(const wchar_t* baseFilePath)
+{
+    CMappedFile journal;
+    if (!journal.Open(GetJournalPath(baseFilePath).c_str(), FileAccessHint::Sequential) ||
+        !ReadHeader(journal, baseFilePath))
+    {
+        return false;
+    }
+
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(journal.GetData());
+    return FindValidLength(data, journal.GetSize()) > JOURNAL_HEADER_SIZE;
+}
+
+bool CEditJournal::Recover(const wchar_t* baseFilePath, CTextDocument* pDocument, bool& complete)
+{
+    complete = false;
+    if (!pDocument)
+    {
+        return false;
+    }
+
+    Stop(false);
+
+    size_t validLength = 0;
+    std::vector<uint8_t> checkpoint;
+    {
+        CMappedFile journal;
+        if (!journal.Open(GetJournalPath(baseFilePath).c_str(), FileAccessHint::Sequential) ||
+            !ReadHeader(journal, baseFilePath))
+        {
+            return false;
+        }
+
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(journal.GetData());
+        validLength = FindValidLength(data, journal.GetSize());
+
+        // 元ファイルを（大きければマップして）読み込み、編集を順に再生
+        if (!pDocument->LoadFromFile(baseFilePath))
+        {
+            return false;
+        }
+        size_t appliedLength = 0;
+        size_t segmentStart = 0;
+        uint64_t segmentRecords = 0;
+        complete = ApplyRecords(data, validLength, pDocument, appliedLength, segmentStart, segmentRecords);
+        if (!complete)
+        {
+            // 再生できた途中までのレコードをチェックポイントで確定させ、次回の復旧でも同じ内容になるようにする
+            validLength = appliedLength;
+            if (segmentRecords > 0)
+            {
+                AppendCheckpoint(checkpoint, segmentRecords, Crc32(data + segmentStart, appliedLength - segmentStart));
+            }
+        }
+    }
+
+    // 壊れた末尾を切り捨てて追記を再開
+    return OpenForAppend(baseFilePath, validLength, false, checkpoint);
+}
+
+bool CEditJournal::OpenForAppend(const wchar_t* baseFilePath, uint64_t validLength, bool writeHeader,
+                                 const std::vector<uint8_t>& checkpoint)
+{
+    FileStat stat;
+    if (!baseFilePath || !GetFileStat(baseFilePath, stat))
+    {
+        return false;
+    }
+
+    m_journalPath = GetJournalPath(baseFilePath);
+    if (!m_file.Open(m_journalPath.c_str(), CFile::OpenOrCreate, FileAccessHint::Sequential))
+    {
+        m_journalPath.clear();
+        return false;
+    }
+
+    bool ok;
+    if (writeHeader)
+    {
+        std::vector<uint8_t> header(JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+        AppendFixed(header, JOURNAL_FORMAT_VERSION, 4);
+        AppendFixed(header, stat.size, 8);
+        AppendFixed(header, static_cast<uint64_t>(stat.lastWriteTime), 8);
+        ok = m_file.Truncate(0) && m_file.Write(header.data(), header.size()) && m_file.Flush();
+    }
+    else
+    {
+        ok = m_file.Truncate(validLength) &&
+             (checkpoint.empty() || (m_file.Write(checkpoint.data(), checkpoint.size()) && m_file.Flush()));
+    }
+
+    if (!ok)
+    {
+        m_file.Close();
+        m_journalPath.clear();
+        return false;
+    }
+
+    m_pending.clear();
+    m_pendingRecords = 0;
+    m_stopRequested = false;
+    m_failed = false;
+    m_active = true;
+    m_writer = std::thread(&CEditJournal::WriterThread, this);
+    return true;
+}
+
+void CEditJournal::OnTextInserted(const TextPosition& pos, const std::wstring& text)
+{
+    if (!m_active)
+    {
+        return;
+    }
+
+    std::string utf8;
+    ConvertWideToUtf8(text, utf8);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.push_back(RECORD_INSERT);
+    AppendVarint(m_pending, pos.line);
+    AppendVarint(m_pending, pos.column);
+    AppendVarint(m_pending, utf8.size());
+    m_pending.insert(m_pending.end(), utf8.begin(), utf8.end());
+    m_pendingRecords++;
+    if (m_pending.size() >= FLUSH_THRESHOLD)
+    {
+        m_wake.notify_one();
+    }
+}
+
+void CEditJournal::OnTextDeleted(const TextPosition& start, const TextPosition& end)
+{
+    if (!m_active)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.push_back(RECORD_DELETE);
+    AppendVarint(m_pending, start.line);
+    AppendVarint(m_pending, start.column);
+    AppendVarint(m_pending, end.line - start.line);
+    AppendVarint(m_pending, end.column);
+    m_pendingRecords++;
+    if (m_pending.size() >= FLUSH_THRESHOLD)
+    {
+        m_wake.notify_one();
+    }
+}
+
+void CEditJournal::WriterThread()
+{
+    std::vector<uint8_t> buffer;
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        m_wake.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this]
+        {
+            return m_stopRequested || m_pending.size() >= FLUSH_THRESHOLD;
+        });
+
+        bool stopping = m_stopRequested;
+        uint32_t records = m_pendingRecords;
+        buffer.swap(m_pending);
+        m_pending.clear();
+        m_pendingRecords = 0;
+
+        if (records > 0)
+        {
+            // 書き込み中もUIスレッドが追記できるようにロックを外す
+            lock.unlock();
+            const bool written = FlushPending(buffer, records);
+            lock.lock();
+            if (!written)
+            {
+                // 以後の編集は記録できないので止める（最後に確定したチェックポイントまでは復旧できる）
+                m_active = false;
+                m_failed = true;
+                m_pending.clear();
+                m_pendingRecords = 0;
+                lock.unlock();
+                if (m_onFailure)
+                {
+                    m_onFailure();
+                }
+                return;
+            }
+        }
+        buffer.clear();
+
+        if (stopping)
+        {
+            break;
+        }
+    }
+}
+
+bool CEditJournal::FlushPending(std::vector<uint8_t>& buffer, uint32_t records)
+{
+    // 区間の末尾にチェックポイントを付けて書き込み、ディスクへ確定させる
+    uint32_t crc = Crc32(buffer.data(), buffer.size());
+    AppendCheckpoint(buffer, records, crc);
+
+    return m_file.Write(buffer.data(), buffer.size()) && m_file.Flush();
+}
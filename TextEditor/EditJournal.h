@@ -0,0 +1,70 @@
+// EditJournal.h - クラッシュ復旧用の編集ジャーナル（追記専用）
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include "TextDocument.h"
+#include "FileIO.h"
+
+// ドキュメントの編集をバイナリ形式で追記し、異常終了後に再生する。
+// 書き込みはバックグラウンドスレッドで行い、フラッシュごとにチェックポイント
+// （直前区間のレコード数とCRC32）を書き込む。復旧時は最後の正しい
+// チェックポイントまでを元ファイルに再生する。元ファイルを読み込み直してから再生するので、
+// 時間は元ファイルの長さとジャーナル長の和に比例する。
+// 書き込みに失敗したら（ディスクの空き不足など）記録を止め、SetFailureCallback の関数で知らせる
+class CEditJournal : public IDocumentEditListener
+{
+public:
+    typedef std::function<void()> FailureCallback;
+
+    CEditJournal();
+    ~CEditJournal();
+
+    // 元ファイルに対する新しいジャーナルを開始（既存のジャーナルは破棄）
+    bool Start(const wchar_t* baseFilePath);
+    // ジャーナルを停止。deleteFileがtrueならファイルも削除
+    void Stop(bool deleteFile);
+    bool IsActive() const { return m_active; }
+    // 書き込みに失敗して記録を止めたか（次の Start で元に戻る）
+    bool HasFailed() const { return m_failed; }
+    // 書き込みに失敗したときに書き込みスレッドから呼ばれる（UIスレッドへはメッセージなどで渡す）
+    void SetFailureCallback(const FailureCallback& onFailure) { m_onFailure = onFailure; }
+
+    // 元ファイルに対応する有効なジャーナルが残っているか
+    static bool HasRecoverableJournal(const wchar_t* baseFilePath);
+    // 元ファイルを読み込みジャーナルを再生。成功時は同じジャーナルへの追記を再開。
+    // 壊れたレコードがあればその手前までを再生し、complete をfalseにする（ジャーナルもそこで切り詰める）
+    bool Recover(const wchar_t* baseFilePath, CTextDocument* pDocument, bool& complete);
+
+    static std::wstring GetJournalPath(const wchar_t* baseFilePath);
+
+    // IDocumentEditListener
+    void OnTextInserted(const TextPosition& pos, const std::wstring& text) override;
+    void OnTextDeleted(const TextPosition& start, const TextPosition& end) override;
+    void OnDocumentReset() override {}
+
+private:
+    bool OpenForAppend(const wchar_t* baseFilePath, uint64_t validLength, bool writeHeader,
+                       const std::vector<uint8_t>& checkpoint);
+    void WriterThread();
+    bool FlushPending(std::vector<uint8_t>& buffer, uint32_t records);
+
+    CFile m_file;
+    std::wstring m_journalPath;
+    std::atomic<bool> m_active;     // 書き込みスレッドも失敗時に書き換える
+    std::atomic<bool> m_failed;
+    FailureCallback m_onFailure;
+
+    // UIスレッドが追記し、書き込みスレッドが取り出すバッファ
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<uint8_t> m_pending;
+    uint32_t m_pendingRecords;
+    bool m_stopRequested;
+    std::thread m_writer;
+};
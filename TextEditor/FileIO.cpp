@@ -0,0 +1,586 @@
+// FileIO.cpp - プラットフォーム非依存のファイルI/O実装
+#include "FileIO.h"
+
+#ifndef _WIN32
+#include "TextEncoding.h"
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <cstdlib>
+#endif
+
+#ifndef _WIN32
+// POSIXではワイド文字パスをUTF-8に変換して使用する
+static std::string ToNativePath(const wchar_t* filePath)
+{
+    std::string path;
+    if (filePath)
+    {
+        ConvertWideToUtf8(std::wstring(filePath), path);
+    }
+    return path;
+}
+
+static int ToMadvise(FileAccessHint hint)
+{
+    switch (hint)
+    {
+    case FileAccessHint::Sequential:
+        return MADV_SEQUENTIAL;
+    case FileAccessHint::Random:
+        return MADV_RANDOM;
+    default:
+        return MADV_NORMAL;
+    }
+}
+#endif
+
+bool GetFileStat(const wchar_t* filePath, FileStat& stat)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+    if (!GetFileAttributesEx(filePath, GetFileExInfoStandard, &fileInfo))
+    {
+        return false;
+    }
+
+    ULARGE_INTEGER fileSize;
+    fileSize.LowPart = fileInfo.nFileSizeLow;
+    fileSize.HighPart = fileInfo.nFileSizeHigh;
+    ULARGE_INTEGER writeTime;
+    writeTime.LowPart = fileInfo.ftLastWriteTime.dwLowDateTime;
+    writeTime.HighPart = fileInfo.ftLastWriteTime.dwHighDateTime;
+
+    stat.size = fileSize.QuadPart;
+    stat.lastWriteTime = static_cast<int64_t>(writeTime.QuadPart);
+    return true;
+#else
+    struct stat st;
+    if (::stat(ToNativePath(filePath).c_str(), &st) != 0)
+    {
+        return false;
+    }
+
+    stat.size = static_cast<uint64_t>(st.st_size);
+    stat.lastWriteTime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    return true;
+#endif
+}
+
+bool DeleteFilePath(const wchar_t* filePath)
+{
+#ifdef _WIN32
+    return DeleteFile(filePath) != FALSE;
+#else
+    return ::unlink(ToNativePath(filePath).c_str()) == 0;
+#endif
+}
+
+bool CreateTempFile(const wchar_t* prefix, std::wstring& filePath)
+{
+#ifdef _WIN32
+    wchar_t directory[MAX_PATH + 1];
+    DWORD length = GetTempPathW(MAX_PATH + 1, directory);
+    if (length == 0 || length > MAX_PATH)
+    {
+        return false;
+    }
+    // GetTempFileName は一意な名前の空のファイルを作る（接頭辞は先頭3文字のみ使われる）
+    wchar_t path[MAX_PATH + 1];
+    if (GetTempFileNameW(directory, prefix, 0, path) == 0)
+    {
+        return false;
+    }
+    filePath = path;
+    return true;
+#else
+    const char* directory = ::getenv("TMPDIR");
+    std::string path = (directory && directory[0] != '\0') ? directory : "/tmp";
+    path += "/" + ToNativePath(prefix) + "XXXXXX";
+    std::vector<char> buffer(path.begin(), path.end());
+    buffer.push_back('\0');
+    int fd = ::mkstemp(buffer.data());
+    if (fd < 0)
+    {
+        return false;
+    }
+    ::close(fd);
+    const std::string created(buffer.data());
+    return ConvertUtf8ToWide(created.data(), created.size(), filePath);
+#endif
+}
+
+static bool IsDotEntry(const wchar_t* name)
+{
+    return name[0] == L'.' && (name[1] == L'\0' || (name[1] == L'.' && name[2] == L'\0'));
+}
+
+bool ListDirectory(const wchar_t* directoryPath, std::vector<DirectoryEntry>& entries)
+{
+    entries.clear();
+#ifdef _WIN32
+    std::wstring query = JoinPath(directoryPath, L"*");
+    WIN32_FIND_DATAW findData;
+    HANDLE hFind = FindFirstFileExW(query.c_str(), FindExInfoBasic, &findData,
+                                    FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    do
+    {
+        if (IsDotEntry(findData.cFileName))
+        {
+            continue;
+        }
+        const bool isDirectory = (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        if (isDirectory && (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+        {
+            continue;
+        }
+
+        ULARGE_INTEGER fileSize;
+        fileSize.LowPart = findData.nFileSizeLow;
+        fileSize.HighPart = findData.nFileSizeHigh;
+
+        DirectoryEntry entry;
+        entry.name = findData.cFileName;
+        entry.isDirectory = isDirectory;
+        entry.size = isDirectory ? 0 : fileSize.QuadPart;
+        entries.push_back(entry);
+    } while (FindNextFileW(hFind, &findData));
+
+    FindClose(hFind);
+    return true;
+#else
+    const std::string path = ToNativePath(directoryPath);
+    DIR* dir = ::opendir(path.c_str());
+    if (!dir)
+    {
+        return false;
+    }
+
+    while (struct dirent* item = ::readdir(dir))
+    {
+        DirectoryEntry entry;
+        if (!ConvertUtf8ToWide(item->d_name, std::char_traits<char>::length(item->d_name), entry.name) ||
+            IsDotEntry(entry.name.c_str()))
+        {
+            continue;
+        }
+
+        // サイズも必要なので d_type ではなく lstat で種類を調べる（リンク先はまだたどらない）
+        struct stat st;
+        const std::string itemPath = path + "/" + item->d_name;
+        if (::lstat(itemPath.c_str(), &st) != 0)
+        {
+            continue;
+        }
+        if (S_ISLNK(st.st_mode))
+        {
+            // ファイルへのリンクは通常のファイルとして扱う
+            if (::stat(itemPath.c_str(), &st) != 0 || S_ISDIR(st.st_mode))
+            {
+                continue;
+            }
+        }
+        if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+
+        entry.isDirectory = S_ISDIR(st.st_mode);
+        entry.size = entry.isDirectory ? 0 : static_cast<uint64_t>(st.st_size);
+        entries.push_back(entry);
+    }
+
+    ::closedir(dir);
+    return true;
+#endif
+}
+
+std::wstring JoinPath(const std::wstring& directoryPath, const std::wstring& name)
+{
+#ifdef _WIN32
+    const wchar_t separator = L'\\';
+#else
+    const wchar_t separator = L'/';
+#endif
+    if (directoryPath.empty())
+    {
+        return name;
+    }
+    const wchar_t last = directoryPath.back();
+    if (last == separator || last == L'/')
+    {
+        return directoryPath + name;
+    }
+    return directoryPath + separator + name;
+}
+
+// CFile実装
+CFile::CFile()
+#ifdef _WIN32
+    : m_hFile(INVALID_HANDLE_VALUE)
+#else
+    : m_fd(-1)
+#endif
+{
+}
+
+CFile::~CFile()
+{
+    Close();
+}
+
+bool CFile::Open(const wchar_t* filePath, OpenMode mode, FileAccessHint hint)
+{
+    Close();
+
+#ifdef _WIN32
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (hint == FileAccessHint::Sequential)
+    {
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+    else if (hint == FileAccessHint::Random)
+    {
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+    }
+
+    if (mode == ReadOnly)
+    {
+        m_hFile = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+    }
+    else if (mode == CreateAlways)
+    {
+        m_hFile = CreateFile(filePath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, flags, NULL);
+    }
+    else
+    {
+        m_hFile = CreateFile(filePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, flags, NULL);
+    }
+    return m_hFile != INVALID_HANDLE_VALUE;
+#else
+    std::string path = ToNativePath(filePath);
+    if (mode == ReadOnly)
+    {
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    else if (mode == CreateAlways)
+    {
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    else
+    {
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (hint == FileAccessHint::Sequential)
+    {
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    else if (hint == FileAccessHint::Random)
+    {
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_RANDOM);
+    }
+#endif
+    return true;
+#endif
+}
+
+void CFile::Close()
+{
+#ifdef _WIN32
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+bool CFile::IsOpen() const
+{
+#ifdef _WIN32
+    return m_hFile != INVALID_HANDLE_VALUE;
+#else
+    return m_fd >= 0;
+#endif
+}
+
+bool CFile::Read(void* buffer, size_t size, size_t& bytesRead)
+{
+    bytesRead = 0;
+    char* dest = static_cast<char*>(buffer);
+
+    // 1回のシステムコールで扱える上限があるため分割して読む
+    while (bytesRead < size)
+    {
+        size_t chunk = size - bytesRead;
+        if (chunk > 0x40000000)
+        {
+            chunk = 0x40000000;
+        }
+
+#ifdef _WIN32
+        DWORD read = 0;
+        if (!ReadFile(m_hFile, dest + bytesRead, static_cast<DWORD>(chunk), &read, NULL))
+        {
+            return false;
+        }
+#else
+        ssize_t read = ::read(m_fd, dest + bytesRead, chunk);
+        if (read < 0)
+        {
+            return false;
+        }
+#endif
+        if (read == 0)
+        {
+            break; // EOF
+        }
+        bytesRead += static_cast<size_t>(read);
+    }
+    return true;
+}
+
+bool CFile::Write(const void* data, size_t size)
+{
+    const char* src = static_cast<const char*>(data);
+    size_t written = 0;
+
+    while (written < size)
+    {
+        size_t chunk = size - written;
+        if (chunk > 0x40000000)
+        {
+            chunk = 0x40000000;
+        }
+
+#ifdef _WIN32
+        DWORD result = 0;
+        if (!WriteFile(m_hFile, src + written, static_cast<DWORD>(chunk), &result, NULL))
+        {
+            return false;
+        }
+#else
+        ssize_t result = ::write(m_fd, src + written, chunk);
+        if (result < 0)
+        {
+            return false;
+        }
+#endif
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+bool CFile::Seek(uint64_t offset)
+{
+#ifdef _WIN32
+    LARGE_INTEGER pos;
+    pos.QuadPart = static_cast<LONGLONG>(offset);
+    return SetFilePointerEx(m_hFile, pos, NULL, FILE_BEGIN) != FALSE;
+#else
+    return ::lseek(m_fd, static_cast<off_t>(offset), SEEK_SET) >= 0;
+#endif
+}
+
+bool CFile::Truncate(uint64_t size)
+{
+    // ファイルを指定サイズに切り詰め、書き込み位置を末尾へ移動
+    if (!Seek(size))
+    {
+        return false;
+    }
+#ifdef _WIN32
+    return SetEndOfFile(m_hFile) != FALSE;
+#else
+    return ::ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+bool CFile::Flush()
+{
+#ifdef _WIN32
+    return FlushFileBuffers(m_hFile) != FALSE;
+#else
+    return ::fsync(m_fd) == 0;
+#endif
+}
+
+uint64_t CFile::GetSize() const
+{
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_hFile, &size))
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(size.QuadPart);
+#else
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_size);
+#endif
+}
+
+// CMappedFile実装
+CMappedFile::CMappedFile()
+#ifdef _WIN32
+    : m_hFile(INVALID_HANDLE_VALUE)
+    , m_hMapping(NULL)
+#else
+    : m_fd(-1)
+#endif
+    , m_pView(nullptr)
+    , m_size(0)
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+    Close();
+}
+
+bool CMappedFile::Open(const wchar_t* filePath, FileAccessHint hint)
+{
+    Close();
+
+#ifdef _WIN32
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (hint == FileAccessHint::Sequential)
+    {
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    }
+    else if (hint == FileAccessHint::Random)
+    {
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+    }
+
+    m_hFile = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_hFile, &size) || size.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+
+    m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m_hMapping)
+    {
+        Close();
+        return false;
+    }
+
+    m_pView = MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_pView)
+    {
+        Close();
+        return false;
+    }
+#else
+    m_fd = ::open(ToNativePath(filePath).c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0 || st.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+    m_size = static_cast<size_t>(st.st_size);
+
+    void* view = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (view == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+    m_pView = view;
+#endif
+
+    Advise(hint);
+    return true;
+}
+
+void CMappedFile::Close()
+{
+#ifdef _WIN32
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+    }
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_pView)
+    {
+        ::munmap(m_pView, m_size);
+    }
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+    m_pView = nullptr;
+    m_size = 0;
+}
+
+void CMappedFile::Advise(FileAccessHint hint)
+{
+    if (!m_pView)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    // Windowsにはmadvise相当が無いため、順次アクセス時のみ先読みを要求する
+    if (hint == FileAccessHint::Sequential)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range;
+        range.VirtualAddress = m_pView;
+        range.NumberOfBytes = m_size;
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+#else
+    ::madvise(m_pView, m_size, ToMadvise(hint));
+#endif
+}
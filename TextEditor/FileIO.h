@@ -0,0 +1,114 @@
+// FileIO.h - プラットフォーム非依存のファイルI/O（Win32 / POSIX）
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// ファイル情報
+struct FileStat
+{
+    uint64_t size;
+    int64_t lastWriteTime; // プラットフォーム固有の単位（同一環境内での比較用）
+
+    FileStat() : size(0), lastWriteTime(0) {}
+};
+
+// アクセスパターンのヒント（POSIXではmadviseに対応）
+enum class FileAccessHint
+{
+    Normal,
+    Sequential,
+    Random
+};
+
+// ディレクトリ内の項目（"." と ".." は含まない）
+struct DirectoryEntry
+{
+    std::wstring name;
+    bool isDirectory;
+    uint64_t size;
+
+    DirectoryEntry() : isDirectory(false), size(0) {}
+};
+
+bool GetFileStat(const wchar_t* filePath, FileStat& stat);
+bool DeleteFilePath(const wchar_t* filePath);
+// 一時ファイル用のディレクトリに空のファイルを新しく作り、そのパスを返す（不要になったら DeleteFilePath で消す）
+bool CreateTempFile(const wchar_t* prefix, std::wstring& filePath);
+
+// ディレクトリの直下の項目を列挙する。ディレクトリへのシンボリックリンク（再解析ポイント）は
+// 循環を避けるため列挙しない
+bool ListDirectory(const wchar_t* directoryPath, std::vector<DirectoryEntry>& entries);
+// ディレクトリパスと名前をプラットフォームの区切り文字で連結する
+std::wstring JoinPath(const std::wstring& directoryPath, const std::wstring& name);
+
+// 通常のファイルハンドル
+class CFile
+{
+public:
+    enum OpenMode
+    {
+        ReadOnly,
+        CreateAlways,   // 書き込み（既存ファイルは切り詰め）
+        OpenOrCreate    // 読み書き（既存の内容は保持）
+    };
+
+    CFile();
+    ~CFile();
+
+    bool Open(const wchar_t* filePath, OpenMode mode, FileAccessHint hint = FileAccessHint::Normal);
+    void Close();
+    bool IsOpen() const;
+
+    bool Read(void* buffer, size_t size, size_t& bytesRead);
+    bool Write(const void* data, size_t size);
+    bool Seek(uint64_t offset);
+    bool Truncate(uint64_t size);
+    bool Flush();
+    uint64_t GetSize() const;
+
+private:
+    CFile(const CFile&) = delete;
+    CFile& operator=(const CFile&) = delete;
+
+#ifdef _WIN32
+    HANDLE m_hFile;
+#else
+    int m_fd;
+#endif
+};
+
+// 読み取り専用のメモリマップドファイル
+class CMappedFile
+{
+public:
+    CMappedFile();
+    ~CMappedFile();
+
+    bool Open(const wchar_t* filePath, FileAccessHint hint = FileAccessHint::Normal);
+    void Close();
+    bool IsOpen() const { return m_pView != nullptr; }
+
+    void Advise(FileAccessHint hint);
+
+    const char* GetData() const { return static_cast<const char*>(m_pView); }
+    size_t GetSize() const { return m_size; }
+
+private:
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+#ifdef _WIN32
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+#else
+    int m_fd;
+#endif
+    void* m_pView;
+    size_t m_size;
+};
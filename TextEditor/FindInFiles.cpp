@@ -0,0 +1,297 @@
+// FindInFiles.cpp - ディレクトリ以下のファイルの一括検索実装
+#include "FindInFiles.h"
+#include "FileIO.h"
+#include "MappedFileSearch.h"
+#include "CaseFold.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cstring>
+
+// バイナリ判定のために読む先頭のバイト数
+static const size_t BINARY_PROBE_SIZE = 8192;
+// 単一行モードで取り消しを確認する間隔（行数）
+static const size_t CANCEL_CHECK_LINES = 4096;
+// これ以上のファイルは復号せずにバイト列のまま検索する（単一行モード）
+static const uint64_t MAPPED_SEARCH_THRESHOLD = 10 * 1024 * 1024;
+
+// 先頭にNULを含むファイルはバイナリとみなす（UTF-16はBOMがあれば読む）。開けなければfalse
+static bool IsTextFile(const std::wstring& filePath)
+{
+    CFile file;
+    if (!file.Open(filePath.c_str(), CFile::ReadOnly))
+    {
+        return false;
+    }
+
+    char buffer[BINARY_PROBE_SIZE];
+    size_t bytesRead = 0;
+    if (!file.Read(buffer, sizeof(buffer), bytesRead))
+    {
+        return false;
+    }
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(buffer);
+    if (bytesRead >= 2 && ((bytes[0] == 0xFF && bytes[1] == 0xFE) || (bytes[0] == 0xFE && bytes[1] == 0xFF)))
+    {
+        return true;
+    }
+    return std::memchr(buffer, 0, bytesRead) == nullptr;
+}
+
+// ワイルドカード（* と ?）の照合。* の位置を覚えておき、失敗したらその * を1文字延ばす
+static bool MatchWildcard(const std::wstring& mask, const std::wstring& name)
+{
+    size_t m = 0;
+    size_t n = 0;
+    size_t starMask = std::wstring::npos;
+    size_t starName = 0;
+    while (n < name.length())
+    {
+        if (m < mask.length() && mask[m] == L'*')
+        {
+            starMask = m++;
+            starName = n;
+        }
+        else if (m < mask.length() && (mask[m] == L'?' || FoldCase(mask[m]) == FoldCase(name[n])))
+        {
+            ++m;
+            ++n;
+        }
+        else if (starMask != std::wstring::npos)
+        {
+            m = starMask + 1;
+            n = ++starName;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (m < mask.length() && mask[m] == L'*')
+    {
+        ++m;
+    }
+    return m == mask.length();
+}
+
+CFindInFiles::CFindInFiles()
+    : m_threadCount(0)
+{
+}
+
+bool CFindInFiles::Run(const std::wstring& pattern, const SearchOptions& options,
+                       const FindInFilesOptions& fileOptions, const ResultCallback& onResult)
+{
+    m_cancel.Reset();
+    m_summary = FindInFilesSummary();
+    m_error.clear();
+
+    if (!m_compiled.IsCompiledFor(pattern, options))
+    {
+        m_compiled.Compile(pattern, options);
+    }
+    if (!m_compiled.IsValid())
+    {
+        m_error = m_compiled.GetError();
+        return false;
+    }
+
+    m_fileOptions = fileOptions;
+    m_onResult = onResult;
+
+    // 1階層ずつ、ディレクトリの列挙とファイルの検索をそれぞれ並列に行う
+    std::vector<std::wstring> directories(1, fileOptions.rootDirectory);
+    bool isRoot = true;
+    while (!directories.empty() && !m_cancel.IsCancelled())
+    {
+        std::vector<std::wstring> subdirectories;
+        std::vector<FileEntry> files;
+        ListLevel(directories, subdirectories, files);
+        if (isRoot && m_summary.directoryCount == 0)
+        {
+            m_error = L"フォルダを開けません: " + fileOptions.rootDirectory;
+            m_onResult = nullptr;
+            return false;
+        }
+        isRoot = false;
+
+        SearchFiles(files);
+        if (!fileOptions.recursive)
+        {
+            break;
+        }
+        directories.swap(subdirectories);
+    }
+
+    m_summary.cancelled = m_cancel.IsCancelled();
+    m_onResult = nullptr;
+    return true;
+}
+
+size_t CFindInFiles::GetConcurrency(size_t taskCount) const
+{
+    size_t concurrency = m_threadCount ? m_threadCount : CWorkerPool::GetShared().GetThreadCount() + 1;
+    return std::max<size_t>(1, std::min(concurrency, taskCount));
+}
+
+bool CFindInFiles::MatchesFileMask(const std::wstring& name) const
+{
+    if (m_fileOptions.fileMasks.empty())
+    {
+        return true;
+    }
+    for (const std::wstring& mask : m_fileOptions.fileMasks)
+    {
+        if (MatchWildcard(mask, name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CFindInFiles::ListLevel(const std::vector<std::wstring>& directories,
+                             std::vector<std::wstring>& subdirectories, std::vector<FileEntry>& files)
+{
+    std::vector<std::vector<DirectoryEntry>> listed(directories.size());
+    std::vector<char> succeeded(directories.size(), 0);
+    auto listDirectory = [&](size_t index)
+    {
+        if (!m_cancel.IsCancelled())
+        {
+            succeeded[index] = ListDirectory(directories[index].c_str(), listed[index]) ? 1 : 0;
+        }
+    };
+
+    const size_t concurrency = GetConcurrency(directories.size());
+    if (concurrency <= 1)
+    {
+        for (size_t i = 0; i < directories.size(); ++i)
+        {
+            listDirectory(i);
+        }
+    }
+    else
+    {
+        CWorkerPool::GetShared().ParallelFor(directories.size(), listDirectory, concurrency);
+    }
+
+    // 列挙順が実行ごとに変わらないよう、ディレクトリの順に集める
+    for (size_t i = 0; i < directories.size(); ++i)
+    {
+        if (!succeeded[i])
+        {
+            continue;
+        }
+        ++m_summary.directoryCount;
+
+        for (const DirectoryEntry& entry : listed[i])
+        {
+            if (entry.isDirectory)
+            {
+                subdirectories.push_back(JoinPath(directories[i], entry.name));
+            }
+            else if (!MatchesFileMask(entry.name))
+            {
+                continue;
+            }
+            else if (m_fileOptions.maxFileSize != 0 && entry.size > m_fileOptions.maxFileSize)
+            {
+                ++m_summary.skippedFileCount;
+            }
+            else
+            {
+                FileEntry file;
+                file.path = JoinPath(directories[i], entry.name);
+                file.size = entry.size;
+                files.push_back(file);
+            }
+        }
+    }
+}
+
+void CFindInFiles::SearchFiles(const std::vector<FileEntry>& files)
+{
+    // スレッドごとにパターンの複製を1つ使い、ファイルは空いたスレッドが順に取る
+    const size_t concurrency = GetConcurrency(files.size());
+    std::vector<CCompiledPattern> copies(concurrency - 1, m_compiled);
+    std::atomic<size_t> nextFile(0);
+
+    auto searchLoop = [&](size_t slot)
+    {
+        const CCompiledPattern& pattern = (slot == 0) ? m_compiled : copies[slot - 1];
+        FileSearchResult result;
+        for (size_t i = nextFile++; i < files.size() && !m_cancel.IsCancelled(); i = nextFile++)
+        {
+            const bool searched = SearchFile(pattern, files[i], result);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!searched)
+            {
+                ++m_summary.skippedFileCount;
+                continue;
+            }
+            ++m_summary.fileCount;
+            m_summary.byteCount += files[i].size;
+            if (result.matches.empty() || m_cancel.IsCancelled())
+            {
+                continue;
+            }
+            ++m_summary.matchedFileCount;
+            m_summary.matchCount += result.matches.size();
+            if (m_onResult)
+            {
+                m_onResult(result);
+            }
+        }
+    };
+
+    if (concurrency <= 1)
+    {
+        searchLoop(0);
+        return;
+    }
+    CWorkerPool::GetShared().ParallelFor(concurrency, searchLoop, concurrency);
+}
+
+bool CFindInFiles::SearchFile(const CCompiledPattern& pattern, const FileEntry& file, FileSearchResult& result)
+{
+    result.filePath = file.path;
+    result.matches.clear();
+
+    if (file.size >= MAPPED_SEARCH_THRESHOLD && !pattern.IsMultiLine() && IsTextFile(file.path))
+    {
+        // ワーカースレッドの中なので並列化しない。UTF-16のファイルは開けないので通常の読み込みで検索する
+        CMappedFileSearch search;
+        search.SetThreadCount(1);
+        if (search.Open(file.path.c_str()))
+        {
+            return search.FindAll(pattern, result.matches, &m_cancel);
+        }
+    }
+
+    CTextDocument document;
+    if (!IsTextFile(file.path) || !document.LoadFromFile(file.path.c_str()))
+    {
+        return false;
+    }
+
+    if (pattern.IsMultiLine())
+    {
+        SearchResult match;
+        TextPosition pos;
+        while (!m_cancel.IsCancelled() && FindMatchAcrossLines(&document, pattern, pos, match))
+        {
+            result.matches.push_back(match);
+            pos = GetNextSearchPosition(&document, match);
+        }
+        return true;
+    }
+
+    const size_t lineCount = document.GetLineCount();
+    for (size_t line = 0; line < lineCount && !m_cancel.IsCancelled(); line += CANCEL_CHECK_LINES)
+    {
+        FindMatchesInLines(&document, pattern, line, std::min(lineCount, line + CANCEL_CHECK_LINES), result.matches);
+    }
+    return true;
+}
@@ -0,0 +1,105 @@
+// FindInFiles.h - ディレクトリ以下のファイルの一括検索
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include "SearchEngine.h"
+
+// 検索するファイルの指定
+struct FindInFilesOptions
+{
+    std::wstring rootDirectory;
+    std::vector<std::wstring> fileMasks;    // "*.log" など（* と ?、大文字小文字を区別しない）。空ならすべて
+    bool recursive;                         // サブディレクトリも検索する
+    uint64_t maxFileSize;                   // これより大きいファイルは読まない（0なら無制限）
+
+    FindInFilesOptions()
+        : recursive(true)
+        , maxFileSize(0)
+    {}
+};
+
+// 1ファイル分の結果。位置はそのファイルを CTextDocument::LoadFromFile で開いたときの位置
+struct FileSearchResult
+{
+    std::wstring filePath;
+    std::vector<SearchResult> matches;      // 文書順
+};
+
+// 直近の Run の集計
+struct FindInFilesSummary
+{
+    size_t directoryCount;      // 列挙したディレクトリ数
+    size_t fileCount;           // 検索したファイル数
+    size_t skippedFileCount;    // 読めない・大きすぎる・バイナリのため飛ばしたファイル数
+    size_t matchedFileCount;
+    size_t matchCount;
+    uint64_t byteCount;         // 検索したファイルの合計サイズ
+    bool cancelled;
+
+    FindInFilesSummary()
+        : directoryCount(0)
+        , fileCount(0)
+        , skippedFileCount(0)
+        , matchedFileCount(0)
+        , matchCount(0)
+        , byteCount(0)
+        , cancelled(false)
+    {}
+};
+
+// ディレクトリを階層ごとに共有ワーカープールで列挙し、見つかったファイルを並列に検索する。
+// 各ファイルは CTextDocument と同じ方法で読み込む（エンコーディングは自動判別）か、
+// 大きいUTF-8のファイルでは CMappedFileSearch で復号せずに検索するので、結果の位置をそのまま開いたドキュメントで使える。
+// 一致のあったファイルごとに結果をコールバックへ渡す（呼び出しは直列化されるが、順序はファイルの完了順）。
+// コールバックはワーカースレッドからも呼ばれるので、その中で共有ワーカープールを使う処理をしないこと
+class CFindInFiles
+{
+public:
+    typedef std::function<void(const FileSearchResult& result)> ResultCallback;
+
+    CFindInFiles();
+
+    // 検索が終わるか取り消されるまで戻らない。パターンが不正か、ルートを列挙できなければfalse
+    bool Run(const std::wstring& pattern, const SearchOptions& options,
+             const FindInFilesOptions& fileOptions, const ResultCallback& onResult);
+
+    // 実行中の Run を取り消す（任意のスレッドやコールバックから呼べる）。
+    // 検索中のファイルも途中で打ち切る（単一行モードでは数千行か数MBごと、複数行モードでは一致ごとに確認）
+    void Cancel() { m_cancel.Cancel(); }
+    bool IsCancelled() const { return m_cancel.IsCancelled(); }
+
+    const FindInFilesSummary& GetSummary() const { return m_summary; }
+    const std::wstring& GetError() const { return m_error; }
+
+    // 最大同時実行スレッド数（0: 共有ワーカープールに合わせる、1: 並列化しない）
+    void SetThreadCount(size_t threadCount) { m_threadCount = threadCount; }
+    size_t GetThreadCount() const { return m_threadCount; }
+
+private:
+    struct FileEntry
+    {
+        std::wstring path;
+        uint64_t size;
+    };
+
+    size_t GetConcurrency(size_t taskCount) const;
+    bool MatchesFileMask(const std::wstring& name) const;
+    void ListLevel(const std::vector<std::wstring>& directories,
+                   std::vector<std::wstring>& subdirectories, std::vector<FileEntry>& files);
+    void SearchFiles(const std::vector<FileEntry>& files);
+    bool SearchFile(const CCompiledPattern& pattern, const FileEntry& file, FileSearchResult& result);
+
+    FindInFilesOptions m_fileOptions;
+    CCompiledPattern m_compiled;
+    ResultCallback m_onResult;
+    size_t m_threadCount;
+    CSearchCancelToken m_cancel;
+
+    std::mutex m_mutex;         // m_summary とコールバックの呼び出しを保護
+    FindInFilesSummary m_summary;
+    std::wstring m_error;
+};
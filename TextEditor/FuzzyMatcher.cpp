@@ -0,0 +1,283 @@
+// FuzzyMatcher.cpp - 近似検索実装
+#include "FuzzyMatcher.h"
+#include "CaseFold.h"
+#include <algorithm>
+
+static const size_t WORD_BITS = 64;
+// 断片がこれより短いと出現が多すぎて絞り込みにならない
+static const size_t MIN_PIECE_LENGTH = 2;
+
+CFuzzyMatcher::CFuzzyMatcher()
+    : m_length(0)
+    , m_maxEdits(0)
+    , m_caseSensitive(false)
+    , m_wholeWord(false)
+    , m_classCount(1)
+    , m_blockCount(0)
+    , m_lastBit(0)
+{
+}
+
+uint32_t CFuzzyMatcher::ClassOf(wchar_t ch) const
+{
+    if (static_cast<unsigned long>(ch) < 0x10000)
+    {
+        uint32_t cls = m_bmpClass[static_cast<unsigned long>(ch)];
+        if (cls != 0 || m_otherClass.empty())
+        {
+            return cls;
+        }
+    }
+    auto it = m_otherClass.find(ch);
+    return (it != m_otherClass.end()) ? it->second : 0;
+}
+
+void CFuzzyMatcher::Compile(const std::wstring& pattern, bool caseSensitive, bool wholeWord, size_t maxEdits)
+{
+    m_length = pattern.length();
+    m_maxEdits = (m_length > 0) ? std::min(maxEdits, m_length - 1) : 0;
+    m_caseSensitive = caseSensitive;
+    m_wholeWord = wholeWord;
+    m_bmpClass.assign(0x10000, 0);
+    m_otherClass.clear();
+    m_classCount = 1;
+    m_pieces.Reset();
+
+    // パターン中の文字に番号を振る（16bitに収まらない番号は別表に入れる）
+    std::vector<uint32_t> classes;
+    classes.reserve(m_length);
+    for (wchar_t ch : pattern)
+    {
+        wchar_t folded = caseSensitive ? ch : FoldCase(ch);
+        uint32_t cls = ClassOf(folded);
+        if (cls == 0)
+        {
+            cls = static_cast<uint32_t>(m_classCount++);
+            if (static_cast<unsigned long>(folded) < 0x10000 && cls < 0x10000)
+            {
+                m_bmpClass[static_cast<unsigned long>(folded)] = static_cast<uint16_t>(cls);
+            }
+            else
+            {
+                m_otherClass[folded] = cls;
+            }
+        }
+        classes.push_back(cls);
+    }
+
+    m_blockCount = (m_length + WORD_BITS - 1) / WORD_BITS;
+    m_lastBit = (m_length > 0) ? uint64_t(1) << ((m_length - 1) % WORD_BITS) : 0;
+    BuildPeq(classes, m_peq);
+    std::reverse(classes.begin(), classes.end());
+    BuildPeq(classes, m_reversePeq);
+
+    // maxEdits + 1 個の断片に分ける（編集は高々 maxEdits 個の断片にしか及ばない）
+    const size_t pieceCount = m_maxEdits + 1;
+    if (m_maxEdits > 0 && m_length / pieceCount >= MIN_PIECE_LENGTH)
+    {
+        std::vector<std::wstring> pieces;
+        for (size_t i = 0; i < pieceCount; ++i)
+        {
+            size_t first = m_length * i / pieceCount;
+            size_t last = m_length * (i + 1) / pieceCount;
+            pieces.push_back(pattern.substr(first, last - first));
+        }
+        m_pieces.Compile(pieces, caseSensitive, false);
+    }
+}
+
+void CFuzzyMatcher::BuildPeq(const std::vector<uint32_t>& classes, std::vector<uint64_t>& peq) const
+{
+    peq.assign(m_classCount * m_blockCount, 0);
+    for (size_t i = 0; i < classes.size(); ++i)
+    {
+        peq[classes[i] * m_blockCount + i / WORD_BITS] |= uint64_t(1) << (i % WORD_BITS);
+    }
+}
+
+const uint64_t* CFuzzyMatcher::PeqRow(const std::vector<uint64_t>& peq, wchar_t ch) const
+{
+    wchar_t folded = m_caseSensitive ? ch : FoldCase(ch);
+    return &peq[ClassOf(folded) * m_blockCount];
+}
+
+// 1列進める（Myers 1999）。hin は0行目の水平方向の差分で、近似検索では0（どこから始めてもよい）、
+// 始点を固定する場合は+1。戻り値は最下行の差分（-1, 0, +1）
+int CFuzzyMatcher::AdvanceColumn(const uint64_t* eq, uint64_t* pv, uint64_t* mv, int hin) const
+{
+    for (size_t block = 0; block < m_blockCount; ++block)
+    {
+        const uint64_t highBit = (block + 1 == m_blockCount) ? m_lastBit : uint64_t(1) << (WORD_BITS - 1);
+        uint64_t e = eq[block];
+        const uint64_t xv = e | mv[block];
+        if (hin < 0)
+        {
+            e |= 1;
+        }
+        const uint64_t xh = (((e & pv[block]) + pv[block]) ^ pv[block]) | e;
+        uint64_t ph = mv[block] | ~(xh | pv[block]);
+        uint64_t mh = pv[block] & xh;
+
+        int hout = (ph & highBit) ? 1 : ((mh & highBit) ? -1 : 0);
+        ph <<= 1;
+        mh <<= 1;
+        if (hin < 0)
+        {
+            mh |= 1;
+        }
+        else if (hin > 0)
+        {
+            ph |= 1;
+        }
+        pv[block] = mh | ~(xv | ph);
+        mv[block] = ph & xv;
+        hin = hout;
+    }
+    return hin;
+}
+
+bool CFuzzyMatcher::FindEnd(const wchar_t* text, size_t length, size_t from,
+                            size_t& matchEnd, size_t& distance) const
+{
+    // パターンが1ブロックなら作業領域を確保しない
+    uint64_t singlePv = ~uint64_t(0);
+    uint64_t singleMv = 0;
+    std::vector<uint64_t> blockPv;
+    std::vector<uint64_t> blockMv;
+    uint64_t* pv = &singlePv;
+    uint64_t* mv = &singleMv;
+
+    size_t scanPos = length;    // 次に読む文字（length なら未開始）
+    size_t score = m_length;
+    size_t pieceFrom = from;
+    for (;;)
+    {
+        // 次の断片の出現の近くから照合する。断片がなければ from から最後まで
+        size_t windowStart = from;
+        size_t windowEnd = length;
+        if (!m_pieces.IsEmpty())
+        {
+            size_t pieceStart = 0;
+            size_t pieceEnd = 0;
+            size_t pieceIndex = 0;
+            if (!m_pieces.Find(text, length, pieceFrom, pieceStart, pieceEnd, pieceIndex))
+            {
+                return false;
+            }
+            // 断片を含む一致は [pieceStart - (m + k), pieceStart + m + k] に収まる
+            const size_t reach = m_length + m_maxEdits;
+            windowStart = std::max(from, (pieceStart > reach) ? pieceStart - reach : 0);
+            windowEnd = std::min(length, pieceStart + reach);
+            pieceFrom = pieceStart + 1;
+        }
+
+        // 照合済みの範囲と重なるなら状態を引き継ぐ（始点の候補が増えるだけで結果は変わらない）
+        if (scanPos == length || windowStart > scanPos)
+        {
+            scanPos = windowStart;
+            score = m_length;
+            if (m_blockCount == 1)
+            {
+                singlePv = ~uint64_t(0);
+                singleMv = 0;
+            }
+            else
+            {
+                blockPv.assign(m_blockCount, ~uint64_t(0));
+                blockMv.assign(m_blockCount, 0);
+                pv = blockPv.data();
+                mv = blockMv.data();
+            }
+        }
+
+        for (; scanPos < windowEnd; ++scanPos)
+        {
+            score += AdvanceColumn(PeqRow(m_peq, text[scanPos]), pv, mv, 0);
+            if (score > m_maxEdits)
+            {
+                continue;
+            }
+
+            // 最初の一致の終点から、距離が縮む間は終点を延ばす
+            matchEnd = scanPos + 1;
+            distance = score;
+            for (size_t pos = scanPos + 1; pos < length && pos < matchEnd + m_length && distance > 0; ++pos)
+            {
+                score += AdvanceColumn(PeqRow(m_peq, text[pos]), pv, mv, 0);
+                if (score > m_maxEdits)
+                {
+                    break;
+                }
+                if (score < distance)
+                {
+                    distance = score;
+                    matchEnd = pos + 1;
+                }
+            }
+            return true;
+        }
+
+        if (m_pieces.IsEmpty() || windowEnd >= length)
+        {
+            return false;
+        }
+    }
+}
+
+size_t CFuzzyMatcher::FindStart(const wchar_t* text, size_t from, size_t matchEnd, size_t distance) const
+{
+    // 反転したパターンを終点から左へ、始点を固定して照合する（各列が [pos, matchEnd) との距離）
+    std::vector<uint64_t> pv(m_blockCount, ~uint64_t(0));
+    std::vector<uint64_t> mv(m_blockCount, 0);
+    const size_t reach = m_length + m_maxEdits;
+    const size_t limit = std::max(from, (matchEnd > reach) ? matchEnd - reach : 0);
+
+    size_t score = m_length;
+    for (size_t pos = matchEnd; pos > limit;)
+    {
+        --pos;
+        score += AdvanceColumn(PeqRow(m_reversePeq, text[pos]), pv.data(), mv.data(), 1);
+        if (score <= distance)
+        {
+            return pos;
+        }
+    }
+    return (matchEnd > m_length) ? std::max(from, matchEnd - m_length) : from;
+}
+
+bool CFuzzyMatcher::IsWholeWordAt(const wchar_t* text, size_t length, size_t start, size_t end) const
+{
+    bool startOk = (start == 0) || !IsWordChar(text[start - 1]);
+    bool endOk = (end >= length) || !IsWordChar(text[end]);
+    return startOk && endOk;
+}
+
+bool CFuzzyMatcher::Find(const wchar_t* text, size_t length, size_t from,
+                         size_t& matchStart, size_t& matchEnd, size_t& distance) const
+{
+    if (m_length == 0)
+    {
+        return false;
+    }
+
+    // 単語境界を満たさなければ、その始点の次から探し直す
+    while (from < length)
+    {
+        size_t end = 0;
+        size_t best = 0;
+        if (!FindEnd(text, length, from, end, best))
+        {
+            return false;
+        }
+        size_t start = FindStart(text, from, end, best);
+        if (!m_wholeWord || IsWholeWordAt(text, length, start, end))
+        {
+            matchStart = start;
+            matchEnd = end;
+            distance = best;
+            return true;
+        }
+        from = start + 1;
+    }
+    return false;
+}
@@ -0,0 +1,57 @@
+// FuzzyMatcher.h - 編集距離による近似検索（Myers のビット並列アルゴリズム）
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include "MultiPatternMatcher.h"
+
+// パターンとの編集距離（挿入・削除・置換の回数）が maxEdits 以下の部分文字列を探す。
+// 動的計画法の表の1列を64行ずつビットベクトルで持ち、1文字あたり数回のビット演算で列を進める。
+// 64コード単位を超えるパターンは64行ごとのブロックに分けて、ブロック間で境界の差分を受け渡す。
+// maxEdits + 1 個に分けたパターンの断片のどれかは一致箇所にそのまま現れるので、
+// 断片が長ければその出現位置の近くだけを照合する（断片の同時検索は Aho-Corasick）
+class CFuzzyMatcher
+{
+public:
+    CFuzzyMatcher();
+
+    // maxEdits はパターン長 - 1 までに切り詰める（空の一致を認めない）
+    void Compile(const std::wstring& pattern, bool caseSensitive, bool wholeWord, size_t maxEdits);
+
+    // text[from..length) 内で終点が最も左の一致を探す。終点は直後に距離が縮む限り延ばし、
+    // 始点はその終点で距離が最小になる最も短い範囲にする
+    bool Find(const wchar_t* text, size_t length, size_t from,
+              size_t& matchStart, size_t& matchEnd, size_t& distance) const;
+
+    bool IsEmpty() const { return m_length == 0; }
+    size_t GetMaxEdits() const { return m_maxEdits; }
+
+private:
+    uint32_t ClassOf(wchar_t ch) const;
+    void BuildPeq(const std::vector<uint32_t>& classes, std::vector<uint64_t>& peq) const;
+    const uint64_t* PeqRow(const std::vector<uint64_t>& peq, wchar_t ch) const;
+    int AdvanceColumn(const uint64_t* eq, uint64_t* pv, uint64_t* mv, int hin) const;
+    bool FindEnd(const wchar_t* text, size_t length, size_t from, size_t& matchEnd, size_t& distance) const;
+    size_t FindStart(const wchar_t* text, size_t from, size_t matchEnd, size_t distance) const;
+    bool IsWholeWordAt(const wchar_t* text, size_t length, size_t start, size_t end) const;
+
+    size_t m_length;            // パターン長（コード単位）
+    size_t m_maxEdits;
+    bool m_caseSensitive;
+    bool m_wholeWord;
+
+    // 文字クラス: パターンに現れる文字ごとの番号（0 はパターンに現れない文字）
+    std::vector<uint16_t> m_bmpClass;
+    std::unordered_map<wchar_t, uint32_t> m_otherClass;
+    size_t m_classCount;
+
+    // 文字クラスごとの一致ビット（パターンの i 文字目が一致すれば bit i）。[class * m_blockCount + block]
+    size_t m_blockCount;
+    uint64_t m_lastBit;                 // 最後のブロックでパターン末尾に当たるビット
+    std::vector<uint64_t> m_peq;
+    std::vector<uint64_t> m_reversePeq; // 反転したパターン（始点を求める用）
+
+    CMultiPatternMatcher m_pieces;      // 断片の同時検索（断片が短すぎる場合は空）
+};
@@ -0,0 +1,238 @@
+// IncrementalSearch.cpp - インクリメンタル検索セッション実装
+#include "IncrementalSearch.h"
+#include <algorithm>
+
+// 1文字目など出現数が多すぎる場合は記録をやめ、次の入力では走査し直す
+static const size_t MAX_TRACKED_OCCURRENCES = 4 * 1024 * 1024;
+
+CIncrementalSearch::CIncrementalSearch()
+    : m_pDocument(nullptr)
+    , m_trackOccurrences(false)
+    , m_scannedLines(0)
+{
+}
+
+void CIncrementalSearch::Start(const CTextDocument* pDocument, const SearchOptions& options)
+{
+    m_pDocument = pDocument;
+    m_options = options;
+    m_compiled.Reset();
+    m_occurrences.clear();
+    m_trackOccurrences = false;
+    m_results.clear();
+    m_scannedLines = 0;
+    m_scanPos = TextPosition();
+}
+
+void CIncrementalSearch::Stop()
+{
+    Start(nullptr, m_options);
+    m_occurrences.shrink_to_fit();
+    m_results.shrink_to_fit();
+}
+
+bool CIncrementalSearch::Update(const std::wstring& pattern)
+{
+    if (!m_pDocument)
+    {
+        return false;
+    }
+    if (m_compiled.IsCompiledFor(pattern, m_options))
+    {
+        return m_compiled.IsValid();
+    }
+
+    bool narrow = CanNarrow(pattern);
+    if (!m_compiled.Compile(pattern, m_options))
+    {
+        m_occurrences.clear();
+        m_trackOccurrences = false;
+        m_results.clear();
+        m_scannedLines = 0;
+        return false;
+    }
+
+    if (narrow)
+    {
+        Narrow();
+    }
+    else
+    {
+        Restart();
+    }
+    return true;
+}
+
+bool CIncrementalSearch::CanNarrow(const std::wstring& pattern) const
+{
+    // 延長後のパターンの一致位置では、必ず延長前のパターンも出現している
+    const std::wstring& previous = m_compiled.GetPattern();
+    return !m_options.useRegex
+        && m_compiled.IsValid()
+        && m_trackOccurrences
+        && pattern.length() > previous.length()
+        && pattern.compare(0, previous.length(), previous) == 0;
+}
+
+void CIncrementalSearch::Restart()
+{
+    m_results.clear();
+    m_occurrences.clear();
+    m_scannedLines = 0;
+    m_scanPos = TextPosition();
+
+    // あいまい検索の一致は延長前のパターンの出現位置に限られないので記録しない
+    m_trackOccurrences = !m_options.useRegex && m_options.maxEdits == 0;
+    if (m_trackOccurrences)
+    {
+        const std::wstring& pattern = m_compiled.GetPattern();
+        m_occurrenceMatcher.Compile(pattern, m_options.caseSensitive, false);
+        m_resultMatcher.Compile(pattern, m_options.caseSensitive, m_options.wholeWord);
+    }
+}
+
+void CIncrementalSearch::Narrow()
+{
+    const std::wstring& pattern = m_compiled.GetPattern();
+    m_occurrenceMatcher.Compile(pattern, m_options.caseSensitive, false);
+    m_resultMatcher.Compile(pattern, m_options.caseSensitive, m_options.wholeWord);
+
+    // 記録済みの出現位置だけを新しいパターンで再検証する（文書は読み直さない）
+    size_t kept = 0;
+    for (size_t i = 0; i < m_occurrences.size(); ++i)
+    {
+        const TextPosition& pos = m_occurrences[i];
+        const std::wstring& lineText = m_pDocument->GetLine(pos.line);
+        if (m_occurrenceMatcher.IsMatchAt(lineText.data(), lineText.length(), pos.column))
+        {
+            m_occurrences[kept++] = pos;
+        }
+    }
+    m_occurrences.resize(kept);
+
+    m_results.clear();
+    size_t i = 0;
+    while (i < m_occurrences.size())
+    {
+        size_t line = m_occurrences[i].line;
+        SelectResultsInLine(line, i);
+        while (i < m_occurrences.size() && m_occurrences[i].line == line)
+        {
+            ++i;
+        }
+    }
+}
+
+bool CIncrementalSearch::Continue(size_t maxLines)
+{
+    if (IsComplete())
+    {
+        return true;
+    }
+
+    if (m_compiled.IsMultiLine())
+    {
+        ScanMultiLine(maxLines);
+        return IsComplete();
+    }
+
+    const size_t lineCount = m_pDocument->GetLineCount();
+    size_t lastLine = lineCount;
+    if (maxLines != 0 && lineCount - m_scannedLines > maxLines)
+    {
+        lastLine = m_scannedLines + maxLines;
+    }
+
+    if (m_trackOccurrences)
+    {
+        ScanLinesTracked(m_scannedLines, lastLine);
+    }
+    else
+    {
+        FindMatchesInLines(m_pDocument, m_compiled, m_scannedLines, lastLine, m_results);
+    }
+    m_scannedLines = lastLine;
+    return IsComplete();
+}
+
+bool CIncrementalSearch::IsComplete() const
+{
+    return !m_pDocument || !m_compiled.IsValid() || m_scannedLines >= m_pDocument->GetLineCount();
+}
+
+void CIncrementalSearch::ScanLinesTracked(size_t firstLine, size_t lastLine)
+{
+    for (size_t line = firstLine; line < lastLine; ++line)
+    {
+        const std::wstring& lineText = m_pDocument->GetLine(line);
+        const size_t firstOccurrence = m_occurrences.size();
+
+        // 重なる出現も記録する（延長後のパターンは重なった位置で一致し得る）
+        size_t searchPos = 0;
+        size_t matchStart = 0;
+        size_t matchEnd = 0;
+        while (m_occurrenceMatcher.Find(lineText.data(), lineText.length(), searchPos, matchStart, matchEnd))
+        {
+            m_occurrences.push_back(TextPosition(line, matchStart));
+            searchPos = matchStart + 1;
+        }
+
+        if (m_occurrences.size() > MAX_TRACKED_OCCURRENCES)
+        {
+            // 記録をやめ、この行から通常の走査に切り替える
+            m_occurrences.clear();
+            m_occurrences.shrink_to_fit();
+            m_trackOccurrences = false;
+            FindMatchesInLines(m_pDocument, m_compiled, line, lastLine, m_results);
+            return;
+        }
+
+        if (m_occurrences.size() > firstOccurrence)
+        {
+            SelectResultsInLine(line, firstOccurrence);
+        }
+    }
+}
+
+void CIncrementalSearch::SelectResultsInLine(size_t line, size_t firstOccurrence)
+{
+    // 出現位置から、通常の検索と同じく左から重ならない一致を選ぶ
+    const std::wstring& lineText = m_pDocument->GetLine(line);
+    const size_t patternLength = m_resultMatcher.GetPatternLength();
+    size_t nextFree = 0;
+    for (size_t i = firstOccurrence; i < m_occurrences.size() && m_occurrences[i].line == line; ++i)
+    {
+        size_t column = m_occurrences[i].column;
+        if (column < nextFree || !m_resultMatcher.IsMatchAt(lineText.data(), lineText.length(), column))
+        {
+            continue;
+        }
+
+        SearchResult result;
+        result.start = TextPosition(line, column);
+        result.end = TextPosition(line, column + patternLength);
+        result.matchedText = lineText.substr(column, patternLength);
+        m_results.push_back(result);
+        nextFree = column + patternLength;
+    }
+}
+
+void CIncrementalSearch::ScanMultiLine(size_t maxLines)
+{
+    // 一致は行をまたぐので、行数の上限は走査位置の行で判定する
+    const size_t lineCount = m_pDocument->GetLineCount();
+    const size_t lineLimit = (maxLines != 0) ? m_scanPos.line + maxLines : lineCount;
+
+    SearchResult result;
+    while (m_scanPos.line < lineCount && m_scanPos.line < lineLimit)
+    {
+        if (!FindMatchAcrossLines(m_pDocument, m_compiled, m_scanPos, result))
+        {
+            m_scanPos = TextPosition(lineCount, 0);
+            break;
+        }
+        m_results.push_back(result);
+        m_scanPos = GetNextSearchPosition(m_pDocument, result);
+    }
+    m_scannedLines = std::min(m_scanPos.line, lineCount);
+}
@@ -0,0 +1,61 @@
+// IncrementalSearch.h - 入力中の検索（インクリメンタル検索）セッション
+#pragma once
+#include <string>
+#include <vector>
+#include "TextDocument.h"
+#include "SearchEngine.h"
+
+// 検索ボックスへの入力ごとにパターンを更新し、結果を絞り込む。
+// リテラル検索では走査済み範囲の出現位置（重なりを含む）を記録しておき、
+// 直前のパターンを後ろへ延長した入力ではその位置だけを再検証する（コストは出現数に比例）。
+// 走査は Continue で少しずつ進めるため、途中で Update すれば走査中の結果はその場で破棄される。
+// セッション中にドキュメントが編集された場合は Start からやり直すこと
+class CIncrementalSearch
+{
+public:
+    CIncrementalSearch();
+
+    // セッションを開始する（パターンは空、結果もなし）
+    void Start(const CTextDocument* pDocument, const SearchOptions& options);
+    void Stop();
+    bool IsActive() const { return m_pDocument != nullptr; }
+
+    // 入力が変わったときに呼ぶ。パターンが不正（空を含む）ならfalseで、結果は空になる
+    bool Update(const std::wstring& pattern);
+
+    // 未走査の行を最大 maxLines 行（0なら最後まで）照合する。走査が完了していればtrue。
+    // UIスレッドのタイマーなどから少しずつ呼べば、次の入力をすぐに受け付けられる
+    bool Continue(size_t maxLines = 0);
+    bool IsComplete() const;
+
+    // 走査済みの範囲の一致（文書順）
+    const std::vector<SearchResult>& GetResults() const { return m_results; }
+    size_t GetScannedLineCount() const { return m_scannedLines; }
+    const std::wstring& GetPattern() const { return m_compiled.GetPattern(); }
+    const std::wstring& GetError() const { return m_compiled.GetError(); }
+    // 走査完了後は CMatchIndex::Attach(pDocument, GetCompiledPattern(), GetResults()) で
+    // 照合し直さずに編集追従の索引へ引き継げる
+    const CCompiledPattern& GetCompiledPattern() const { return m_compiled; }
+
+private:
+    bool CanNarrow(const std::wstring& pattern) const;
+    void Restart();
+    void Narrow();
+    void ScanLinesTracked(size_t firstLine, size_t lastLine);
+    void ScanMultiLine(size_t maxLines);
+    void SelectResultsInLine(size_t line, size_t firstOccurrence);
+
+    const CTextDocument* m_pDocument;
+    SearchOptions m_options;
+    CCompiledPattern m_compiled;
+
+    // リテラル検索の出現位置の記録（単語単位の指定は結果を選ぶときに確認する）
+    CLiteralMatcher m_occurrenceMatcher;    // 単語単位の指定なし
+    CLiteralMatcher m_resultMatcher;        // 検索オプションどおり
+    std::vector<TextPosition> m_occurrences;
+    bool m_trackOccurrences;
+
+    std::vector<SearchResult> m_results;
+    size_t m_scannedLines;
+    TextPosition m_scanPos;     // 複数行モードの次の走査位置
+};
@@ -0,0 +1,216 @@
+// LiteralMatcher.cpp - リテラル検索実装
+#include "LiteralMatcher.h"
+#include "CaseFold.h"
+#include <algorithm>
+
+CLiteralMatcher::CLiteralMatcher()
+    : m_caseSensitive(false)
+    , m_wholeWord(false)
+    , m_usePrefilter(false)
+    , m_find(&FindKernelImpl<false, false>)
+    , m_findLast(&FindLastKernelImpl<false, false>)
+{
+    for (size_t i = 0; i < 256; ++i)
+    {
+        m_shift[i] = 1;
+        m_reverseShift[i] = 1;
+    }
+}
+
+void CLiteralMatcher::Compile(const std::wstring& pattern, bool caseSensitive, bool wholeWord)
+{
+    m_caseSensitive = caseSensitive;
+    m_wholeWord = wholeWord;
+    m_pattern = pattern;
+
+    if (!caseSensitive)
+    {
+        for (wchar_t& ch : m_pattern)
+        {
+            ch = FoldCase(ch);
+        }
+    }
+
+    // Horspoolの不一致文字表。wchar_tは下位8bitでバケット化し、
+    // 衝突した場合は小さい方のずらし量を採用する（安全側）
+    size_t m = m_pattern.length();
+    for (size_t& shift : m_shift)
+    {
+        shift = m > 0 ? m : 1;
+    }
+    for (size_t i = 0; i + 1 < m; ++i)
+    {
+        m_shift[static_cast<unsigned long>(m_pattern[i]) & 0xFF] = m - 1 - i;
+    }
+
+    // 後方検索用の鏡像の表（窓の先頭の文字で左へずらす）
+    for (size_t& shift : m_reverseShift)
+    {
+        shift = m > 0 ? m : 1;
+    }
+    for (size_t i = m; i-- > 1;)
+    {
+        m_reverseShift[static_cast<unsigned long>(m_pattern[i]) & 0xFF] = i;
+    }
+
+    // まれな文字（と2文字目）の両ケースをベクトル命令でまとめて探す
+    m_usePrefilter = IsVectorScanAvailable() && BuildCandidateSpec(m_pattern, caseSensitive, m_candidates);
+
+    // オプションの判定は検索ごとではなくここで一度だけ行う
+    if (caseSensitive)
+    {
+        m_find = wholeWord ? &FindKernelImpl<true, true> : &FindKernelImpl<true, false>;
+        m_findLast = wholeWord ? &FindLastKernelImpl<true, true> : &FindLastKernelImpl<true, false>;
+    }
+    else
+    {
+        m_find = wholeWord ? &FindKernelImpl<false, true> : &FindKernelImpl<false, false>;
+        m_findLast = wholeWord ? &FindLastKernelImpl<false, true> : &FindLastKernelImpl<false, false>;
+    }
+}
+
+template <bool CaseSensitive>
+static inline wchar_t FoldChar(wchar_t ch)
+{
+    return CaseSensitive ? ch : FoldCase(ch);
+}
+
+wchar_t CLiteralMatcher::Fold(wchar_t ch) const
+{
+    return m_caseSensitive ? ch : FoldCase(ch);
+}
+
+template <bool CaseSensitive>
+bool CLiteralMatcher::MatchesAt(const wchar_t* text) const
+{
+    size_t m = m_pattern.length();
+    for (size_t i = 0; i + 1 < m; ++i)
+    {
+        if (FoldChar<CaseSensitive>(text[i]) != m_pattern[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CLiteralMatcher::IsWholeWordAt(const wchar_t* text, size_t length, size_t start) const
+{
+    size_t end = start + m_pattern.length();
+    bool startOk = (start == 0) || !IsWordChar(text[start - 1]);
+    bool endOk = (end >= length) || !IsWordChar(text[end]);
+    return startOk && endOk;
+}
+
+bool CLiteralMatcher::IsMatchAt(const wchar_t* text, size_t length, size_t pos) const
+{
+    size_t m = m_pattern.length();
+    if (m == 0 || pos > length || length - pos < m)
+    {
+        return false;
+    }
+    // MatchesAt は末尾の1文字を照合済みとみなすので、ここで確認する
+    const bool matches = m_caseSensitive ? MatchesAt<true>(text + pos) : MatchesAt<false>(text + pos);
+    return Fold(text[pos + m - 1]) == m_pattern[m - 1] && matches &&
+           (!m_wholeWord || IsWholeWordAt(text, length, pos));
+}
+
+bool CLiteralMatcher::Find(const wchar_t* text, size_t length, size_t from,
+                           size_t& matchStart, size_t& matchEnd) const
+{
+    size_t m = m_pattern.length();
+    if (m == 0 || from > length || length - from < m)
+    {
+        return false;
+    }
+    return m_find(*this, text, length, from, matchStart, matchEnd);
+}
+
+template <bool CaseSensitive, bool WholeWord>
+bool CLiteralMatcher::FindKernelImpl(const CLiteralMatcher& matcher, const wchar_t* text, size_t length, size_t from,
+                                     size_t& matchStart, size_t& matchEnd)
+{
+    const size_t m = matcher.m_pattern.length();
+    const wchar_t last = matcher.m_pattern[m - 1];
+
+    if (matcher.m_usePrefilter)
+    {
+        // 候補位置でのみ全体を照合
+        const size_t lastStart = length - m;
+        size_t pos = from;
+        while ((pos = FindCandidate(text, lastStart, pos, matcher.m_candidates)) != CANDIDATE_NOT_FOUND)
+        {
+            if (FoldChar<CaseSensitive>(text[pos + m - 1]) == last && matcher.MatchesAt<CaseSensitive>(text + pos) &&
+                (!WholeWord || matcher.IsWholeWordAt(text, length, pos)))
+            {
+                matchStart = pos;
+                matchEnd = pos + m;
+                return true;
+            }
+            pos++;
+        }
+        return false;
+    }
+
+    size_t pos = from;
+    while (pos <= length - m)
+    {
+        wchar_t ch = FoldChar<CaseSensitive>(text[pos + m - 1]);
+        if (ch == last && matcher.MatchesAt<CaseSensitive>(text + pos))
+        {
+            // 単語境界を満たさなければ1文字ずらして継続（再帰しない）
+            if (!WholeWord || matcher.IsWholeWordAt(text, length, pos))
+            {
+                matchStart = pos;
+                matchEnd = pos + m;
+                return true;
+            }
+            pos++;
+            continue;
+        }
+        pos += matcher.m_shift[static_cast<unsigned long>(ch) & 0xFF];
+    }
+    return false;
+}
+
+bool CLiteralMatcher::FindLast(const wchar_t* text, size_t length, size_t limit,
+                               size_t& matchStart, size_t& matchEnd) const
+{
+    size_t m = m_pattern.length();
+    if (m == 0 || length < m || limit == 0)
+    {
+        return false;
+    }
+    return m_findLast(*this, text, length, limit, matchStart, matchEnd);
+}
+
+template <bool CaseSensitive, bool WholeWord>
+bool CLiteralMatcher::FindLastKernelImpl(const CLiteralMatcher& matcher, const wchar_t* text, size_t length, size_t limit,
+                                         size_t& matchStart, size_t& matchEnd)
+{
+    const size_t m = matcher.m_pattern.length();
+
+    // 始点が limit より前の窓を右から左へ調べる（一致は limit をまたいでもよい）
+    const wchar_t first = matcher.m_pattern[0];
+    const wchar_t last = matcher.m_pattern[m - 1];
+    size_t pos = std::min(limit - 1, length - m);
+    for (;;)
+    {
+        wchar_t ch = FoldChar<CaseSensitive>(text[pos]);
+        if (ch == first && FoldChar<CaseSensitive>(text[pos + m - 1]) == last &&
+            matcher.MatchesAt<CaseSensitive>(text + pos) &&
+            (!WholeWord || matcher.IsWholeWordAt(text, length, pos)))
+        {
+            matchStart = pos;
+            matchEnd = pos + m;
+            return true;
+        }
+
+        size_t shift = matcher.m_reverseShift[static_cast<unsigned long>(ch) & 0xFF];
+        if (pos < shift)
+        {
+            return false;
+        }
+        pos -= shift;
+    }
+}
@@ -0,0 +1,57 @@
+// LiteralMatcher.h - 事前コンパイル済みリテラル検索（Boyer-Moore-Horspool）
+#pragma once
+#include <string>
+#include <cstddef>
+#include "SimdScan.h"
+
+// パターンの畳み込みとスキップ表を検索ごとに一度だけ構築し、
+// 行テキストをコピーせずにその場で照合する。
+// SIMDが使える環境では、まれなコード単位を候補スキャナで探してから照合する。
+// 大文字小文字の区別と単語単位の組ごとに特殊化した検索関数を Compile で選ぶので、走査のループにオプションの分岐は無い
+class CLiteralMatcher
+{
+public:
+    CLiteralMatcher();
+
+    void Compile(const std::wstring& pattern, bool caseSensitive, bool wholeWord);
+
+    // text[from..length) 内の最初の一致を探す
+    bool Find(const wchar_t* text, size_t length, size_t from, size_t& matchStart, size_t& matchEnd) const;
+
+    // 始点が limit より前にある最後の一致を探す（後方検索。終点は limit を越えてもよい）
+    bool FindLast(const wchar_t* text, size_t length, size_t limit, size_t& matchStart, size_t& matchEnd) const;
+
+    // text[pos] から始まる一致か（単語単位の指定も確認する）
+    bool IsMatchAt(const wchar_t* text, size_t length, size_t pos) const;
+
+    bool IsEmpty() const { return m_pattern.empty(); }
+    size_t GetPatternLength() const { return m_pattern.length(); }
+
+private:
+    typedef bool (*FindKernel)(const CLiteralMatcher& matcher, const wchar_t* text, size_t length, size_t from,
+                               size_t& matchStart, size_t& matchEnd);
+    typedef bool (*FindLastKernel)(const CLiteralMatcher& matcher, const wchar_t* text, size_t length, size_t limit,
+                                   size_t& matchStart, size_t& matchEnd);
+
+    template <bool CaseSensitive, bool WholeWord>
+    static bool FindKernelImpl(const CLiteralMatcher& matcher, const wchar_t* text, size_t length, size_t from,
+                               size_t& matchStart, size_t& matchEnd);
+    template <bool CaseSensitive, bool WholeWord>
+    static bool FindLastKernelImpl(const CLiteralMatcher& matcher, const wchar_t* text, size_t length, size_t limit,
+                                   size_t& matchStart, size_t& matchEnd);
+    template <bool CaseSensitive>
+    bool MatchesAt(const wchar_t* text) const;
+
+    bool IsWholeWordAt(const wchar_t* text, size_t length, size_t start) const;
+    wchar_t Fold(wchar_t ch) const;
+
+    std::wstring m_pattern;     // 大文字小文字を区別しない場合は畳み込み済み
+    bool m_caseSensitive;
+    bool m_wholeWord;
+    size_t m_shift[256];        // 末尾文字（下位8bit）ごとのずらし量
+    size_t m_reverseShift[256]; // 後方検索用。先頭文字ごとのずらし量
+    CandidateSpec m_candidates; // ベクトル化プレフィルタの条件
+    bool m_usePrefilter;
+    FindKernel m_find;          // オプションの組に合わせて Compile で選んだ検索関数
+    FindLastKernel m_findLast;
+};
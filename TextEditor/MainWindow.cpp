@@ -14,10 +14,21 @@
 
 const wchar_t CLASS_NAME[] = L"TextEditorWindowClass";
 
+// 3文字組索引はこの大きさ以上のファイルにだけ作る
+static const uint64_t TRIGRAM_INDEX_MIN_FILE_SIZE = 10 * 1024 * 1024;
+// 索引はタイマーで少しずつ作る（1回あたりのブロック数）
+static const UINT_PTR TRIGRAM_INDEX_TIMER_ID = 1;
+static const UINT TRIGRAM_INDEX_INTERVAL_MS = 50;
+static const size_t TRIGRAM_INDEX_BLOCKS_PER_TICK = 16;
+
+// 編集ジャーナルの書き込みスレッドが書き込みに失敗したことを知らせるメッセージ
+static const UINT WM_JOURNAL_FAILED = WM_APP + 1;
+
 CMainWindow::CMainWindow()
     : m_hwnd(nullptr)
     , m_hInstance(nullptr)
     , m_isModified(false)
+    , m_trigramIndexSaved(false)
     , m_isRectSelectionMode(false)
     , m_hFindReplaceDlg(nullptr)
     , m_hasLastSearchResult(false)
@@ -124,6 +135,14 @@ LRESULT CMainWindow::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
         OnDestroy();
         return 0;
 
+    case WM_TIMER:
+        OnTimer(static_cast<UINT_PTR>(wParam));
+        return 0;
+
+    case WM_JOURNAL_FAILED:
+        OnJournalFailed();
+        return 0;
+
     case WM_SIZE:
         OnSize(LOWORD(lParam), HIWORD(lParam));
         return 0;
@@ -170,9 +189,10 @@ LRESULT CMainWindow::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
         wchar_t filePath[MAX_PATH];
         if (DragQueryFile(hDrop, 0, filePath, MAX_PATH))
         {
-            m_pDocument->LoadFromFile(filePath);
-            m_currentFilePath = filePath;
-            InvalidateRect(m_hwnd, NULL, TRUE);
+            if (!OpenDocumentFile(filePath))
+            {
+                MessageBox(m_hwnd, L"ファイルを開けませんでした。", L"エラー", MB_OK | MB_ICONERROR);
+            }
         }
         DragFinish(hDrop);
         return 0;
@@ -219,6 +239,14 @@ void CMainWindow::OnCreate()
     m_pSearchEngine = std::make_unique<CSearchEngine>();
     m_pUndoManager = std::make_unique<CUndoManager>();
     m_pKeyboardHandler = std::make_unique<CKeyboardHandler>();
+    m_pJournal = std::make_unique<CEditJournal>();
+    m_pTrigramIndex = std::make_unique<CTrigramIndex>();
+    m_pSearchEngine->SetTrigramIndex(m_pTrigramIndex.get());
+
+    // 編集内容をジャーナルへ記録（ファイルに関連付くまでは記録しない）
+    m_pDocument->AddEditListener(m_pJournal.get());
+    HWND hwnd = m_hwnd;
+    m_pJournal->SetFailureCallback([hwnd]() { PostMessage(hwnd, WM_JOURNAL_FAILED, 0, 0); });
 
     // レンダラーの初期化
     m_pRenderer->Initialize(m_hwnd);
@@ -267,6 +295,17 @@ void CMainWindow::OnCreate()
 
 void CMainWindow::OnDestroy()
 {
+    // 正常終了時はジャーナルは不要
+    if (m_pJournal)
+    {
+        m_pDocument->RemoveEditListener(m_pJournal.get());
+        m_pJournal->Stop(true);
+    }
+    KillTimer(m_hwnd, TRIGRAM_INDEX_TIMER_ID);
+    if (m_pTrigramIndex)
+    {
+        m_pTrigramIndex->Detach();
+    }
     PostQuitMessage(0);
 }
 
@@ -389,6 +428,13 @@ void CMainWindow::OnKeyDown(WPARAM wParam, LPARAM lParam)
         m_pKeyboardHandler->HandleKeyDown(wParam, lParam, this);
     }
 
+    // カーソルを動かすキーで、続けて入力した文字の履歴のまとまりを区切る
+    if (m_pUndoManager && (wParam == VK_LEFT || wParam == VK_RIGHT || wParam == VK_UP || wParam == VK_DOWN ||
+                           wParam == VK_HOME || wParam == VK_END || wParam == VK_PRIOR || wParam == VK_NEXT))
+    {
+        m_pUndoManager->BreakCoalescing();
+    }
+
     // カーソル移動とその他のキー処理
     if (m_pEditController && m_pDocument)
     {
@@ -558,6 +604,10 @@ void CMainWindow::OnMouseMove(int x, int y, WPARAM wParam)
 
 void CMainWindow::OnLButtonDown(int x, int y, WPARAM wParam)
 {
+    if (m_pUndoManager)
+    {
+        m_pUndoManager->BreakCoalescing();
+    }
     if (m_pEditController)
     {
         bool isAltPressed = (GetKeyState(VK_MENU) & 0x8000) != 0;
@@ -768,7 +818,9 @@ void CMainWindow::OnFileNew()
             m_pUndoManager->Clear();
         }
         m_currentFilePath.clear();
+        RestartJournal();
         m_isModified = false;
+        RestartTrigramIndex();
         UpdateScrollBars();
         InvalidateRect(m_hwnd, NULL, TRUE);
         UpdateWindowTitle();
@@ -790,24 +842,138 @@ void CMainWindow::OnFileOpen()
 
     if (GetOpenFileName(&ofn))
     {
-        if (m_pDocument->LoadFromFile(fileName))
+        if (!OpenDocumentFile(fileName))
         {
-            m_currentFilePath = fileName;
-            ResetSearchState();
-            if (m_pUndoManager)
-            {
-                m_pUndoManager->Clear();
-            }
-            m_isModified = false;
-            UpdateScrollBars();
-            InvalidateRect(m_hwnd, NULL, TRUE);
-            UpdateWindowTitle();
+            MessageBox(m_hwnd, L"ファイルを開けませんでした。", L"エラー", MB_OK | MB_ICONERROR);
         }
-        else
+    }
+}
+
+bool CMainWindow::OpenDocumentFile(const wchar_t* filePath)
+{
+    if (!m_pDocument || !filePath)
+    {
+        return false;
+    }
+
+    // 前回異常終了したときのジャーナルが残っていれば復元を提案
+    bool recovered = false;
+    if (m_pJournal && CEditJournal::HasRecoverableJournal(filePath))
+    {
+        int answer = MessageBox(m_hwnd,
+            L"前回保存されなかった編集内容が見つかりました。復元しますか？",
+            L"復元", MB_YESNO | MB_ICONQUESTION);
+        if (answer == IDYES)
         {
-            MessageBox(m_hwnd, L"ファイルを開けませんでした。", L"エラー", MB_OK | MB_ICONERROR);
+            bool complete = false;
+            recovered = m_pJournal->Recover(filePath, m_pDocument.get(), complete);
+            if (recovered && !complete)
+            {
+                MessageBox(m_hwnd,
+                    L"編集ジャーナルの一部が壊れていたため、壊れた箇所より前の編集だけを復元しました。",
+                    L"復元", MB_OK | MB_ICONWARNING);
+            }
         }
     }
+
+    if (!recovered && !m_pDocument->LoadFromFile(filePath))
+    {
+        return false;
+    }
+
+    m_currentFilePath = filePath;
+    ResetSearchState();
+    if (m_pUndoManager)
+    {
+        m_pUndoManager->Clear();
+    }
+    if (!recovered)
+    {
+        RestartJournal();
+    }
+    m_isModified = recovered;
+    RestartTrigramIndex();
+    UpdateScrollBars();
+    InvalidateRect(m_hwnd, NULL, TRUE);
+    UpdateWindowTitle();
+    return true;
+}
+
+void CMainWindow::RestartJournal()
+{
+    if (!m_pJournal)
+    {
+        return;
+    }
+
+    // 以前のジャーナルを破棄し、現在のファイル内容を基準に記録し直す
+    m_pJournal->Stop(true);
+    if (!m_currentFilePath.empty())
+    {
+        m_pJournal->Start(m_currentFilePath.c_str());
+    }
+}
+
+void CMainWindow::OnJournalFailed()
+{
+    if (!m_pJournal || !m_pJournal->HasFailed())
+    {
+        return;
+    }
+    MessageBox(m_hwnd,
+        L"編集ジャーナルを書き込めなかったため、クラッシュ復旧用の記録を停止しました。\n"
+        L"ディスクの空き容量を確認し、早めに保存してください。",
+        L"警告", MB_OK | MB_ICONWARNING);
+}
+
+void CMainWindow::RestartTrigramIndex()
+{
+    if (!m_pTrigramIndex)
+    {
+        return;
+    }
+
+    KillTimer(m_hwnd, TRIGRAM_INDEX_TIMER_ID);
+    m_pTrigramIndex->Detach();
+    m_trigramIndexSaved = false;
+
+    // 何度も検索する大きなファイルにだけ作る
+    FileStat stat;
+    if (m_currentFilePath.empty() || !GetFileStat(m_currentFilePath.c_str(), stat) ||
+        stat.size < TRIGRAM_INDEX_MIN_FILE_SIZE)
+    {
+        return;
+    }
+
+    // 保存済みの索引がファイルと一致すれば使い、なければ編集の合間に作る
+    m_pTrigramIndex->Attach(m_pDocument.get());
+    if (!m_isModified &&
+        m_pTrigramIndex->LoadFromFile(CTrigramIndex::GetIndexPath(m_currentFilePath.c_str()).c_str(), stat))
+    {
+        m_trigramIndexSaved = true;
+    }
+    SetTimer(m_hwnd, TRIGRAM_INDEX_TIMER_ID, TRIGRAM_INDEX_INTERVAL_MS, NULL);
+}
+
+void CMainWindow::OnTimer(UINT_PTR timerId)
+{
+    if (timerId != TRIGRAM_INDEX_TIMER_ID || !m_pTrigramIndex || !m_pTrigramIndex->IsAttached())
+    {
+        return;
+    }
+
+    // 編集されたブロックも索引し直すので、ファイルを開いている間は続ける
+    if (!m_pTrigramIndex->Continue(TRIGRAM_INDEX_BLOCKS_PER_TICK) || m_trigramIndexSaved || m_isModified)
+    {
+        return;
+    }
+
+    FileStat stat;
+    if (GetFileStat(m_currentFilePath.c_str(), stat))
+    {
+        m_pTrigramIndex->SaveToFile(CTrigramIndex::GetIndexPath(m_currentFilePath.c_str()).c_str(), stat);
+    }
+    m_trigramIndexSaved = true;
 }
 
 void CMainWindow::OnFileSave()
@@ -821,6 +987,7 @@ void CMainWindow::OnFileSave()
         if (m_pDocument->SaveToFile(m_currentFilePath.c_str()))
         {
             m_isModified = false;
+            RestartJournal();
             UpdateWindowTitle();
         }
         else
@@ -849,6 +1016,7 @@ void CMainWindow::OnFileSaveAs()
         {
             m_currentFilePath = fileName;
             m_isModified = false;
+            RestartJournal();
             UpdateWindowTitle();
         }
         else
@@ -1073,6 +1241,10 @@ void CMainWindow::HandleFindReplaceMessage(LPFINDREPLACE pFindReplace)
     {
         std::wstring replacement = pFindReplace->lpstrReplaceWith ? pFindReplace->lpstrReplaceWith : L"";
         int replaced = ReplaceAllOccurrences(pattern, replacement);
+        if (replaced < 0)
+        {
+            return;
+        }
         wchar_t buffer[128];
         swprintf_s(buffer, L"%d 件置換しました。", replaced);
         MessageBox(m_hwnd, buffer, L"置換", MB_OK | MB_ICONINFORMATION);
@@ -1107,7 +1279,8 @@ bool CMainWindow::PerformSearch(const std::wstring& pattern, bool searchDown)
     if (!found)
     {
         TextPosition startPos = GetSearchStartPosition(searchDown);
-        found = m_pSearchEngine->Find(m_pDocument.get(), pattern, startPos, result);
+        found = searchDown ? m_pSearchEngine->Find(m_pDocument.get(), pattern, startPos, result)
+                           : m_pSearchEngine->FindBackward(m_pDocument.get(), pattern, startPos, result);
     }
 
     if (found)
@@ -1116,6 +1289,11 @@ bool CMainWindow::PerformSearch(const std::wstring& pattern, bool searchDown)
         m_hasLastSearchResult = true;
         HighlightSearchResult(result);
     }
+    else if (m_pSearchEngine->HasPatternError())
+    {
+        m_hasLastSearchResult = false;
+        MessageBox(m_hwnd, m_pSearchEngine->GetPatternError().c_str(), L"検索", MB_OK | MB_ICONWARNING);
+    }
     else
     {
         m_hasLastSearchResult = false;
@@ -1134,19 +1312,21 @@ bool CMainWindow::ReplaceCurrentSelection(const std::wstring& replacement)
 
     TextPosition start = m_lastSearchResult.start;
     TextPosition end = m_lastSearchResult.end;
+    // 正規表現では $1 などを一致の内容に展開する
+    std::wstring text = m_pSearchEngine->ExpandReplacement(m_pDocument.get(), m_lastSearchResult, replacement);
 
     if (m_pUndoManager)
     {
-        m_pUndoManager->ExecuteCommand(std::make_unique<CReplaceTextCommand>(start, end, replacement), m_pDocument.get());
+        m_pUndoManager->ExecuteReplace(start, end, text, m_pDocument.get());
     }
     else
     {
-        m_pSearchEngine->Replace(m_pDocument.get(), m_lastSearchResult, replacement);
+        m_pDocument->ReplaceRange(start, end, text);
     }
 
-    TextPosition newEnd = CalculateEndPosition(start, replacement);
+    TextPosition newEnd = CalculateEndPosition(start, text);
     m_lastSearchResult.end = newEnd;
-    m_lastSearchResult.matchedText = replacement;
+    m_lastSearchResult.matchedText = text;
     m_hasLastSearchResult = false;
 
     if (m_pEditController)
@@ -1172,24 +1352,26 @@ int CMainWindow::ReplaceAllOccurrences(const std::wstring& pattern, const std::w
     m_pSearchEngine->SetOptions(m_searchOptions);
     m_pSearchEngine->SetPattern(pattern);
 
-    std::vector<SearchResult> results = m_pSearchEngine->FindAll(m_pDocument.get(), pattern);
-    int replacedCount = 0;
+    std::vector<LineBlock> blocks;
+    int replacedCount = m_pSearchEngine->BuildReplaceAll(m_pDocument.get(), pattern, replacement, blocks);
+    if (m_pSearchEngine->HasPatternError())
+    {
+        MessageBox(m_hwnd, m_pSearchEngine->GetPatternError().c_str(), L"置換", MB_OK | MB_ICONWARNING);
+        return -1;
+    }
 
-    for (auto it = results.rbegin(); it != results.rend(); ++it)
+    // すべての置換を1つのコマンドにまとめ、1回の元に戻すで戻せるようにする
+    if (replacedCount > 0)
     {
         if (m_pUndoManager)
         {
-            m_pUndoManager->ExecuteCommand(std::make_unique<CReplaceTextCommand>(it->start, it->end, replacement), m_pDocument.get());
+            m_pUndoManager->ExecuteCommand(std::make_unique<CReplaceLinesCommand>(std::move(blocks)), m_pDocument.get());
         }
         else
         {
-            m_pSearchEngine->Replace(m_pDocument.get(), *it, replacement);
+            m_pDocument->SwapLineBlocks(blocks);
         }
-        replacedCount++;
-    }
 
-    if (replacedCount > 0)
-    {
         m_isModified = true;
         UpdateScrollBars();
         InvalidateRect(m_hwnd, NULL, TRUE);
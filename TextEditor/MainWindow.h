@@ -8,6 +8,8 @@
 #include "SearchEngine.h"
 #include "UndoManager.h"
 #include "KeyboardHandler.h"
+#include "EditJournal.h"
+#include "TrigramIndex.h"
 
 class CMainWindow
 {
@@ -58,6 +60,11 @@ private:
     void OnSearchFindNext(bool searchDown);
     void OnHelpAbout();
     void OnHelpContents();
+    bool OpenDocumentFile(const wchar_t* filePath);
+    void RestartJournal();
+    void RestartTrigramIndex();
+    void OnTimer(UINT_PTR timerId);
+    void OnJournalFailed();
     void UpdateFontSizeMenuCheck(UINT id);
     void UpdateWindowTitle();
     void InitializeSearchDialog();
@@ -80,10 +87,13 @@ private:
     std::unique_ptr<CSearchEngine> m_pSearchEngine;
     std::unique_ptr<CUndoManager> m_pUndoManager;
     std::unique_ptr<CKeyboardHandler> m_pKeyboardHandler;
+    std::unique_ptr<CEditJournal> m_pJournal;
+    std::unique_ptr<CTrigramIndex> m_pTrigramIndex;
 
     // 状態
     std::wstring m_currentFilePath;
     bool m_isModified;
+    bool m_trigramIndexSaved;   // 索引をファイルの隣に保存済み（または保存済みの索引を読み込んだ）
     bool m_isRectSelectionMode;
     std::wstring m_imeCompositionString;  // IME入力中の未確定文字列
     CompositionInfo m_imeInfo;            // IME未確定の詳細（ターゲット範囲含む）
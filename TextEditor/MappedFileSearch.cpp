@@ -0,0 +1,451 @@
+// MappedFileSearch.cpp - マップしたUTF-8ファイルを復号せずに検索する実装
+#include "MappedFileSearch.h"
+#include "TextEncoding.h"
+#include "CaseFold.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cstring>
+
+// 1つのタスクで走査するおよそのバイト数（実際の区切りは次の行の先頭）
+static const size_t CHUNK_BYTES = 4 * 1024 * 1024;
+// 一度にまとめて走査するまとまりの数（スレッドあたり）
+static const size_t CHUNKS_PER_THREAD = 4;
+
+static unsigned char FoldByte(unsigned char ch, bool fold)
+{
+    return (fold && ch >= 'A' && ch <= 'Z') ? static_cast<unsigned char>(ch - 'A' + 'a') : ch;
+}
+
+// 大文字小文字を区別しない照合で、ASCII以外の文字が同じ文字に畳み込まれるASCII文字（K と KELVIN SIGN など）。
+// こうした文字はバイト列の比較では見つけられないので、走査するリテラルに含めない
+static const bool* GetAsciiFoldTargets()
+{
+    static const struct Targets
+    {
+        bool ascii[0x80];
+
+        Targets()
+        {
+            std::fill(ascii, ascii + 0x80, false);
+            for (unsigned long ch = 0x80; ch < 0x10000; ++ch)
+            {
+                const unsigned long folded = static_cast<unsigned long>(FoldCase(static_cast<wchar_t>(ch)));
+                if (folded < 0x80)
+                {
+                    ascii[folded] = true;
+                }
+            }
+        }
+    } targets;
+    return targets.ascii;
+}
+
+// リテラルの文字をそのままUTF-8のバイト列として探せるか
+static bool IsByteSearchable(wchar_t ch, bool caseSensitive)
+{
+    const unsigned long code = static_cast<unsigned long>(ch);
+    if (ch == L'\r' || ch == L'\n')
+    {
+        return false;
+    }
+    if (!caseSensitive)
+    {
+        return code < 0x80 && !GetAsciiFoldTargets()[static_cast<unsigned long>(FoldCase(ch))];
+    }
+    // 不正なバイト列は U+FFFD に復号されるので、バイト列としては探せない
+    return code != 0xFFFD && (code < 0xD800 || code >= 0xE000);
+}
+
+// 必須リテラルのうちバイト列として探せる最長の部分を、UTF-8に符号化して返す
+static std::string SelectNeedle(const std::wstring& literal, bool caseSensitive)
+{
+    size_t bestStart = 0;
+    size_t bestLength = 0;
+    size_t runStart = 0;
+    for (size_t i = 0; i <= literal.length(); ++i)
+    {
+        if (i < literal.length() && IsByteSearchable(literal[i], caseSensitive))
+        {
+            continue;
+        }
+        if (i - runStart > bestLength)
+        {
+            bestStart = runStart;
+            bestLength = i - runStart;
+        }
+        runStart = i + 1;
+    }
+
+    std::string needle;
+    if (bestLength > 0)
+    {
+        ConvertWideToUtf8(literal.data() + bestStart, bestLength, needle);
+    }
+    return needle;
+}
+
+// [pos, end) 内の次の改行バイト（'\n' か '\r'）。なければ end
+static const char* FindLineBreak(const char* pos, const char* end, bool hasCarriageReturn)
+{
+    if (!hasCarriageReturn)
+    {
+        const void* found = std::memchr(pos, '\n', static_cast<size_t>(end - pos));
+        return found ? static_cast<const char*>(found) : end;
+    }
+    while (pos < end && *pos != '\n' && *pos != '\r')
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+CMappedFileSearch::CMappedFileSearch()
+    : m_dataOffset(0)
+    , m_foldNeedle(false)
+    , m_threadCount(0)
+{
+}
+
+bool CMappedFileSearch::Open(const wchar_t* filePath)
+{
+    Close();
+    if (!m_file.Open(filePath, FileAccessHint::Sequential))
+    {
+        m_error = L"ファイルを開けません";
+        return false;
+    }
+
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(m_file.GetData());
+    const size_t size = m_file.GetSize();
+    if (size >= 2 && ((bytes[0] == 0xFF && bytes[1] == 0xFE) || (bytes[0] == 0xFE && bytes[1] == 0xFF)))
+    {
+        Close();
+        m_error = L"UTF-16のファイルには対応していません";
+        return false;
+    }
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF)
+    {
+        m_dataOffset = 3;
+    }
+    return true;
+}
+
+void CMappedFileSearch::Close()
+{
+    m_file.Close();
+    m_dataOffset = 0;
+    m_error.clear();
+}
+
+bool CMappedFileSearch::FindAll(const CCompiledPattern& pattern, std::vector<SearchResult>& results,
+                                const CSearchCancelToken* pCancel)
+{
+    results.clear();
+    MatchStreamOptions options;
+    options.pCancel = pCancel;
+    MatchStreamSummary summary;
+    return Scan(pattern, options, true,
+        [&](size_t firstLine, ChunkResult& chunk)
+    {
+        for (size_t i = 0; i < chunk.spans.size(); ++i)
+        {
+            const MatchSpan& span = chunk.spans[i];
+            SearchResult result(TextPosition(firstLine + span.line, span.column),
+                                TextPosition(firstLine + span.line, span.column + span.length),
+                                chunk.texts[i]);
+            result.editDistance = span.editDistance;
+            results.push_back(result);
+        }
+        return true;
+    }, summary);
+}
+
+bool CMappedFileSearch::FindStream(const CCompiledPattern& pattern, const MatchStreamOptions& options,
+                                   MatchStreamSummary& summary)
+{
+    return Scan(pattern, options, false,
+        [&](size_t firstLine, ChunkResult& chunk)
+    {
+        if (options.countOnly || chunk.spans.empty() || !options.onMatches)
+        {
+            return true;
+        }
+        for (MatchSpan& span : chunk.spans)
+        {
+            span.line += firstLine;
+        }
+        return options.onMatches(chunk.spans.data(), chunk.spans.size());
+    }, summary);
+}
+
+size_t CMappedFileSearch::GetConcurrency() const
+{
+    return m_threadCount ? m_threadCount : CWorkerPool::GetShared().GetThreadCount() + 1;
+}
+
+bool CMappedFileSearch::Scan(const CCompiledPattern& pattern, const MatchStreamOptions& options, bool keepText,
+                             const ChunkCallback& onChunk, MatchStreamSummary& summary)
+{
+    summary = MatchStreamSummary();
+    m_error.clear();
+    if (!IsOpen())
+    {
+        m_error = L"ファイルが開かれていません";
+        return false;
+    }
+    if (!pattern.IsValid())
+    {
+        m_error = pattern.GetError();
+        return false;
+    }
+    if (pattern.IsMultiLine())
+    {
+        m_error = L"複数行モードの検索には対応していません";
+        return false;
+    }
+    PrepareNeedle(pattern);
+
+    // まとまりの区切りを行の先頭に合わせて決め、複数のまとまりを並列に走査してから文書順に通知する
+    const size_t concurrency = std::max<size_t>(1, GetConcurrency());
+    const size_t waveSize = (concurrency == 1) ? 1 : concurrency * CHUNKS_PER_THREAD;
+    std::vector<CCompiledPattern> copies(concurrency - 1, pattern);
+    std::vector<ChunkResult> chunks(waveSize);
+    std::vector<const char*> bounds;
+
+    const char* const dataEnd = m_file.GetData() + m_file.GetSize();
+    const char* chunkStart = m_file.GetData() + m_dataOffset;
+    const bool keepSpans = !options.countOnly;
+    size_t lineBase = 0;
+    while (chunkStart < dataEnd)
+    {
+        if (options.pCancel && options.pCancel->IsCancelled())
+        {
+            summary.cancelled = true;
+            break;
+        }
+
+        bounds.assign(1, chunkStart);
+        while (bounds.size() <= waveSize && chunkStart < dataEnd)
+        {
+            chunkStart = FindNextLineStart(chunkStart + std::min(CHUNK_BYTES, static_cast<size_t>(dataEnd - chunkStart)));
+            bounds.push_back(chunkStart);
+        }
+        const size_t chunkCount = bounds.size() - 1;
+        const size_t maxMatches = options.maxResults ? options.maxResults - summary.matchCount : 0;
+
+        std::atomic<size_t> nextChunk(0);
+        auto scanLoop = [&](size_t slot)
+        {
+            const CCompiledPattern& slotPattern = (slot == 0) ? pattern : copies[slot - 1];
+            for (size_t i = nextChunk++; i < chunkCount; i = nextChunk++)
+            {
+                ScanChunk(slotPattern, bounds[i], bounds[i + 1], maxMatches, keepSpans, keepText, chunks[i]);
+            }
+        };
+        const size_t slotCount = std::min(concurrency, chunkCount);
+        if (slotCount <= 1)
+        {
+            scanLoop(0);
+        }
+        else
+        {
+            CWorkerPool::GetShared().ParallelFor(slotCount, scanLoop, slotCount);
+        }
+
+        for (size_t i = 0; i < chunkCount && !summary.cancelled && !summary.limitReached; ++i)
+        {
+            ChunkResult& chunk = chunks[i];
+            if (options.maxResults && chunk.matchCount >= options.maxResults - summary.matchCount)
+            {
+                chunk.matchCount = options.maxResults - summary.matchCount;
+                chunk.spans.resize(std::min(chunk.spans.size(), chunk.matchCount));
+                chunk.texts.resize(std::min(chunk.texts.size(), chunk.matchCount));
+                summary.limitReached = true;
+            }
+            summary.matchCount += chunk.matchCount;
+            if (!onChunk(lineBase, chunk))
+            {
+                summary.cancelled = true;
+            }
+            lineBase += chunk.lineBreakCount;
+            summary.scannedLines = lineBase;
+            if (options.onProgress)
+            {
+                options.onProgress(summary.scannedLines, 0, summary.matchCount);
+            }
+        }
+        if (summary.cancelled || summary.limitReached)
+        {
+            return true;
+        }
+    }
+
+    if (!summary.cancelled)
+    {
+        // 最後の改行の後にも1行ある
+        summary.scannedLines = lineBase + 1;
+        summary.completed = true;
+    }
+    return true;
+}
+
+void CMappedFileSearch::ScanChunk(const CCompiledPattern& pattern, const char* begin, const char* end,
+                                  size_t maxMatches, bool keepSpans, bool keepText, ChunkResult& result) const
+{
+    result.lineBreakCount = 0;
+    result.matchCount = 0;
+    result.spans.clear();
+    result.texts.clear();
+
+    const bool hasCarriageReturn = std::memchr(begin, '\r', static_cast<size_t>(end - begin)) != nullptr;
+    std::wstring lineText;
+    const char* lineStart = begin;
+    size_t line = 0;
+    while (lineStart < end)
+    {
+        // リテラルを含む行まで、改行を数えながら進める
+        const char* hit = lineStart;
+        if (!m_needle.empty())
+        {
+            hit = FindNeedle(lineStart, end);
+            if (!hit)
+            {
+                break;
+            }
+            const size_t lineBreaks = CountLineBreaks(lineStart, static_cast<size_t>(hit - lineStart));
+            if (lineBreaks > 0)
+            {
+                line += lineBreaks;
+                lineStart = hit;
+                while (lineStart[-1] != '\n' && lineStart[-1] != '\r')
+                {
+                    --lineStart;
+                }
+            }
+        }
+
+        // その行だけを復号して照合する
+        const char* lineEnd = FindLineBreak(hit, end, hasCarriageReturn);
+        ConvertUtf8ToWide(lineStart, static_cast<size_t>(lineEnd - lineStart), lineText);
+        size_t searchPos = 0;
+        while (searchPos < lineText.length())
+        {
+            size_t startCol = 0;
+            size_t endCol = 0;
+            size_t editDistance = 0;
+            if (!pattern.Match(lineText.data(), lineText.length(), searchPos, startCol, endCol, editDistance))
+            {
+                break;
+            }
+
+            ++result.matchCount;
+            if (keepSpans)
+            {
+                MatchSpan span;
+                span.line = line;
+                span.column = startCol;
+                span.length = endCol - startCol;
+                span.editDistance = editDistance;
+                result.spans.push_back(span);
+            }
+            if (keepText)
+            {
+                result.texts.push_back(lineText.substr(startCol, endCol - startCol));
+            }
+            if (result.matchCount == maxMatches)
+            {
+                // 呼び出し側はここで打ち切るので、以降の行数は数えなくてよい
+                result.lineBreakCount = line;
+                return;
+            }
+
+            // 空一致での無限ループを避けつつ、直後から次の一致を探す
+            searchPos = (endCol > startCol) ? endCol : endCol + 1;
+        }
+
+        if (lineEnd == end)
+        {
+            lineStart = end;
+            break;
+        }
+        lineStart = (*lineEnd == '\r' && lineEnd + 1 < end && lineEnd[1] == '\n') ? lineEnd + 2 : lineEnd + 1;
+        ++line;
+    }
+    result.lineBreakCount = line + CountLineBreaks(lineStart, static_cast<size_t>(end - lineStart));
+}
+
+void CMappedFileSearch::PrepareNeedle(const CCompiledPattern& pattern)
+{
+    const bool caseSensitive = pattern.GetOptions().caseSensitive;
+    m_foldNeedle = !caseSensitive;
+    m_needle = SelectNeedle(pattern.GetRequiredLiteral(), caseSensitive);
+
+    // まれなバイト（と2番目）の候補条件はワイド文字列と同じ方法で選ぶ。バイトを1文字ずつ広げて渡す
+    std::wstring units;
+    for (char& ch : m_needle)
+    {
+        ch = static_cast<char>(FoldByte(static_cast<unsigned char>(ch), m_foldNeedle));
+        units += static_cast<wchar_t>(static_cast<unsigned char>(ch));
+    }
+    if (!units.empty() && !BuildCandidateSpec(units, caseSensitive, m_needleSpec))
+    {
+        m_needleSpec = CandidateSpec();
+        m_needleSpec.unit1[0] = m_needleSpec.unit1[1] = units[0];
+    }
+}
+
+const char* CMappedFileSearch::FindNeedle(const char* pos, const char* end) const
+{
+    const size_t length = m_needle.length();
+    if (static_cast<size_t>(end - pos) < length)
+    {
+        return nullptr;
+    }
+
+    const size_t lastStart = static_cast<size_t>(end - pos) - length;
+    for (size_t from = 0; ; ++from)
+    {
+        from = FindByteCandidate(pos, lastStart, from, m_needleSpec);
+        if (from == CANDIDATE_NOT_FOUND)
+        {
+            return nullptr;
+        }
+
+        size_t i = 0;
+        while (i < length && FoldByte(static_cast<unsigned char>(pos[from + i]), m_foldNeedle)
+                             == static_cast<unsigned char>(m_needle[i]))
+        {
+            ++i;
+        }
+        if (i == length)
+        {
+            return pos + from;
+        }
+    }
+}
+
+const char* CMappedFileSearch::FindNextLineStart(const char* pos) const
+{
+    const char* const dataBegin = m_file.GetData() + m_dataOffset;
+    const char* const dataEnd = m_file.GetData() + m_file.GetSize();
+    if (pos <= dataBegin || pos >= dataEnd)
+    {
+        return std::min(std::max(pos, dataBegin), dataEnd);
+    }
+    if (pos[-1] == '\n' || (pos[-1] == '\r' && *pos != '\n'))
+    {
+        return pos;
+    }
+    for (; pos < dataEnd; ++pos)
+    {
+        if (*pos == '\n')
+        {
+            return pos + 1;
+        }
+        if (*pos == '\r')
+        {
+            return (pos + 1 < dataEnd && pos[1] == '\n') ? pos + 2 : pos + 1;
+        }
+    }
+    return dataEnd;
+}
@@ -0,0 +1,66 @@
+// MappedFileSearch.h - マップしたUTF-8ファイルを復号せずに検索
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "FileIO.h"
+#include "SimdScan.h"
+#include "SearchEngine.h"
+
+// ファイルをマップしたまま、バイト列の上でパターンの必須リテラル（UTF-8に符号化したもの）を探し、
+// それを含む行だけをワイド文字列に復号して照合する。必須リテラルの無いパターンではすべての行を復号する。
+// 行番号は改行（\r\n、\r、\n）を数えて求めるので、位置は同じファイルを CTextDocument::LoadFromFile で
+// 開いたときの位置と一致する。ファイルは一定のバイト数のまとまりに分けて共有ワーカープールで並列に走査する。
+// UTF-16（BOM付き）のファイルと複数行モードには対応しない
+class CMappedFileSearch
+{
+public:
+    CMappedFileSearch();
+
+    // UTF-16のBOMがあるか、開けなければfalse
+    bool Open(const wchar_t* filePath);
+    void Close();
+    bool IsOpen() const { return m_file.IsOpen(); }
+    uint64_t GetFileSize() const { return m_file.GetSize(); }
+
+    // CSearchEngine::FindAll と同じ一致（単一行モード）。取り消された場合はそれまでの一致を返す
+    bool FindAll(const CCompiledPattern& pattern, std::vector<SearchResult>& results,
+                 const CSearchCancelToken* pCancel = nullptr);
+    // CSearchEngine::FindStream と同じ通知。onProgress の totalLines は走査を終えるまで分からないので0
+    bool FindStream(const CCompiledPattern& pattern, const MatchStreamOptions& options, MatchStreamSummary& summary);
+
+    const std::wstring& GetError() const { return m_error; }
+
+    // 最大同時実行スレッド数（0: 共有ワーカープールに合わせる、1: 並列化しない）。
+    // 共有ワーカープールのタスクの中から使う場合は1にすること
+    void SetThreadCount(size_t threadCount) { m_threadCount = threadCount; }
+    size_t GetThreadCount() const { return m_threadCount; }
+
+private:
+    // 1つのまとまり（行の先頭から次のまとまりの行の先頭まで）の走査結果。行番号はまとまりの先頭行からの相対
+    struct ChunkResult
+    {
+        size_t lineBreakCount;
+        size_t matchCount;
+        std::vector<MatchSpan> spans;
+        std::vector<std::wstring> texts;    // 一致文字列（FindAll のときのみ）
+    };
+    typedef std::function<bool(size_t firstLine, ChunkResult& chunk)> ChunkCallback;
+
+    bool Scan(const CCompiledPattern& pattern, const MatchStreamOptions& options, bool keepText,
+              const ChunkCallback& onChunk, MatchStreamSummary& summary);
+    void ScanChunk(const CCompiledPattern& pattern, const char* begin, const char* end,
+                   size_t maxMatches, bool keepSpans, bool keepText, ChunkResult& result) const;
+    void PrepareNeedle(const CCompiledPattern& pattern);
+    const char* FindNeedle(const char* pos, const char* end) const;
+    const char* FindNextLineStart(const char* pos) const;
+    size_t GetConcurrency() const;
+
+    CMappedFile m_file;
+    size_t m_dataOffset;        // UTF-8のBOMを飛ばした本文の先頭
+    std::string m_needle;       // 走査するバイト列（畳み込み済み）
+    bool m_foldNeedle;          // ASCIIの大文字小文字を区別せずに照合する
+    CandidateSpec m_needleSpec; // ベクトル化スキャナで探す候補の条件
+    size_t m_threadCount;
+    std::wstring m_error;
+};
@@ -0,0 +1,366 @@
+// MatchIndex.cpp - 一致位置の索引実装
+#include "MatchIndex.h"
+#include <algorithm>
+
+// ブロックの行数の目安。行の挿入・削除で番号をずらす範囲はブロック内に限られる
+static const size_t BLOCK_LINES = 1024;
+
+CMatchIndex::CMatchIndex()
+    : m_pDocument(nullptr)
+    , m_matchCount(0)
+    , m_stale(false)
+{
+}
+
+CMatchIndex::~CMatchIndex()
+{
+    Detach();
+}
+
+bool CMatchIndex::Attach(CTextDocument* pDocument, const CCompiledPattern& pattern)
+{
+    if (!pDocument || !pattern.IsValid())
+    {
+        Detach();
+        return false;
+    }
+
+    std::vector<SearchResult> results;
+    if (pattern.IsMultiLine())
+    {
+        SearchResult result;
+        TextPosition pos;
+        while (FindMatchAcrossLines(pDocument, pattern, pos, result))
+        {
+            results.push_back(result);
+            pos = GetNextSearchPosition(pDocument, result);
+        }
+    }
+    else
+    {
+        FindMatchesInLines(pDocument, pattern, 0, pDocument->GetLineCount(), results);
+    }
+    return Attach(pDocument, pattern, results);
+}
+
+bool CMatchIndex::Attach(CTextDocument* pDocument, const CCompiledPattern& pattern,
+                         const std::vector<SearchResult>& results)
+{
+    Detach();
+    if (!pDocument || !pattern.IsValid())
+    {
+        return false;
+    }
+
+    m_pDocument = pDocument;
+    m_pattern = pattern;
+    Build(results);
+    m_pDocument->AddEditListener(this);
+    return true;
+}
+
+void CMatchIndex::Detach()
+{
+    if (m_pDocument)
+    {
+        m_pDocument->RemoveEditListener(this);
+    }
+    m_pDocument = nullptr;
+    m_blocks.clear();
+    m_matchCount = 0;
+    m_stale = false;
+}
+
+void CMatchIndex::Build(const std::vector<SearchResult>& results)
+{
+    m_blocks.clear();
+    m_matchCount = results.size();
+    m_stale = false;
+
+    const size_t lineCount = m_pDocument->GetLineCount();
+    size_t next = 0;
+    for (size_t firstLine = 0; firstLine < lineCount; firstLine += BLOCK_LINES)
+    {
+        MatchBlock block;
+        block.lineCount = std::min(BLOCK_LINES, lineCount - firstLine);
+        for (; next < results.size() && results[next].start.line < firstLine + block.lineCount; ++next)
+        {
+            const SearchResult& result = results[next];
+            IndexedMatch match;
+            match.line = result.start.line - firstLine;
+            match.startColumn = result.start.column;
+            match.endLineOffset = result.end.line - result.start.line;
+            match.endColumn = result.end.column;
+            block.matches.push_back(match);
+        }
+        m_blocks.push_back(std::move(block));
+    }
+}
+
+void CMatchIndex::Refresh()
+{
+    if (m_stale && m_pDocument)
+    {
+        CTextDocument* pDocument = m_pDocument;
+        CCompiledPattern pattern(m_pattern);
+        Attach(pDocument, pattern);
+    }
+}
+
+size_t CMatchIndex::GetMatchCount()
+{
+    Refresh();
+    return m_matchCount;
+}
+
+bool CMatchIndex::GetMatch(size_t index, SearchResult& result)
+{
+    Refresh();
+    size_t blockFirstLine = 0;
+    for (const MatchBlock& block : m_blocks)
+    {
+        if (index < block.matches.size())
+        {
+            result = MakeResult(blockFirstLine, block.matches[index]);
+            return true;
+        }
+        index -= block.matches.size();
+        blockFirstLine += block.lineCount;
+    }
+    return false;
+}
+
+size_t CMatchIndex::FindMatchIndex(const TextPosition& pos)
+{
+    Refresh();
+    size_t index = 0;
+    size_t blockFirstLine = 0;
+    for (const MatchBlock& block : m_blocks)
+    {
+        if (pos.line < blockFirstLine + block.lineCount)
+        {
+            for (const IndexedMatch& match : block.matches)
+            {
+                if (!(TextPosition(blockFirstLine + match.line, match.startColumn) < pos))
+                {
+                    break;
+                }
+                ++index;
+            }
+            return index;
+        }
+        index += block.matches.size();
+        blockFirstLine += block.lineCount;
+    }
+    return index;
+}
+
+void CMatchIndex::GetMatchesInLines(size_t firstLine, size_t lastLine, std::vector<SearchResult>& results)
+{
+    Refresh();
+    size_t blockFirstLine = 0;
+    for (const MatchBlock& block : m_blocks)
+    {
+        if (blockFirstLine >= lastLine)
+        {
+            break;
+        }
+        if (blockFirstLine + block.lineCount > firstLine)
+        {
+            for (const IndexedMatch& match : block.matches)
+            {
+                size_t line = blockFirstLine + match.line;
+                if (line >= firstLine && line < lastLine)
+                {
+                    results.push_back(MakeResult(blockFirstLine, match));
+                }
+            }
+        }
+        blockFirstLine += block.lineCount;
+    }
+}
+
+SearchResult CMatchIndex::MakeResult(size_t blockFirstLine, const IndexedMatch& match) const
+{
+    SearchResult result;
+    result.start = TextPosition(blockFirstLine + match.line, match.startColumn);
+    result.end = TextPosition(result.start.line + match.endLineOffset, match.endColumn);
+    if (match.endLineOffset == 0)
+    {
+        const std::wstring& line = m_pDocument->GetLine(result.start.line);
+        result.matchedText = line.substr(std::min(match.startColumn, line.length()),
+                                         match.endColumn - match.startColumn);
+    }
+    else
+    {
+        result.matchedText = m_pDocument->GetTextRange(result.start, result.end);
+    }
+    return result;
+}
+
+void CMatchIndex::OnTextInserted(const TextPosition& pos, const std::wstring& text)
+{
+    // 挿入位置の行が、改行の数だけ増えた行に置き換わる（\r はドキュメント側で捨てられる）
+    size_t newLines = static_cast<size_t>(std::count(text.begin(), text.end(), L'\n'));
+    ReplaceLines(pos.line, 1, newLines + 1);
+}
+
+void CMatchIndex::OnTextDeleted(const TextPosition& start, const TextPosition& end)
+{
+    // 削除範囲にかかる行が1行にまとまる
+    ReplaceLines(start.line, end.line - start.line + 1, 1);
+}
+
+void CMatchIndex::OnDocumentReset()
+{
+    // 内容全体が変わったので、次の参照で照合し直す
+    m_stale = true;
+}
+
+void CMatchIndex::ReplaceLines(size_t firstLine, size_t oldLineCount, size_t newLineCount)
+{
+    if (m_stale)
+    {
+        return;
+    }
+    if (m_pattern.IsMultiLine() || m_blocks.empty())
+    {
+        m_stale = true;
+        return;
+    }
+
+    RemoveLines(firstLine, oldLineCount);
+
+    // 空いた位置に新しい行を差し込み、その行だけを照合する
+    size_t blockFirstLine = 0;
+    size_t blockIndex = FindBlock(firstLine, blockFirstLine);
+    MatchBlock& block = m_blocks[blockIndex];
+    const size_t relative = firstLine - blockFirstLine;
+    for (IndexedMatch& match : block.matches)
+    {
+        if (match.line >= relative)
+        {
+            match.line += newLineCount;
+        }
+    }
+    block.lineCount += newLineCount;
+    RescanLines(blockIndex, blockFirstLine, firstLine, newLineCount);
+
+    NormalizeBlocks();
+}
+
+size_t CMatchIndex::FindBlock(size_t line, size_t& blockFirstLine) const
+{
+    // 最後のブロックより後ろの行は最後のブロックに含める（末尾への追加）
+    blockFirstLine = 0;
+    for (size_t i = 0; i + 1 < m_blocks.size(); ++i)
+    {
+        if (line < blockFirstLine + m_blocks[i].lineCount)
+        {
+            return i;
+        }
+        blockFirstLine += m_blocks[i].lineCount;
+    }
+    return m_blocks.size() - 1;
+}
+
+void CMatchIndex::RemoveLines(size_t firstLine, size_t lineCount)
+{
+    size_t blockFirstLine = 0;
+    for (size_t i = 0; i < m_blocks.size() && lineCount > 0; ++i)
+    {
+        MatchBlock& block = m_blocks[i];
+        const size_t blockEnd = blockFirstLine + block.lineCount;
+        if (firstLine >= blockEnd)
+        {
+            blockFirstLine = blockEnd;
+            continue;
+        }
+
+        // このブロック内の相対行 [from, from + count) を取り除き、後ろの行を詰める
+        const size_t from = firstLine - blockFirstLine;
+        const size_t count = std::min(lineCount, block.lineCount - from);
+        size_t kept = 0;
+        for (size_t j = 0; j < block.matches.size(); ++j)
+        {
+            IndexedMatch match = block.matches[j];
+            if (match.line >= from && match.line < from + count)
+            {
+                continue;
+            }
+            if (match.line >= from + count)
+            {
+                match.line -= count;
+            }
+            block.matches[kept++] = match;
+        }
+        m_matchCount -= block.matches.size() - kept;
+        block.matches.resize(kept);
+        block.lineCount -= count;
+        lineCount -= count;
+
+        // 後続の行は firstLine に詰められるので、次のブロックは同じ位置から始まる
+        blockFirstLine += block.lineCount;
+    }
+}
+
+void CMatchIndex::RescanLines(size_t blockIndex, size_t blockFirstLine, size_t firstLine, size_t lineCount)
+{
+    std::vector<SearchResult> found;
+    FindMatchesInLines(m_pDocument, m_pattern, firstLine, firstLine + lineCount, found);
+    if (found.empty())
+    {
+        return;
+    }
+
+    std::vector<IndexedMatch> inserted;
+    inserted.reserve(found.size());
+    for (const SearchResult& result : found)
+    {
+        IndexedMatch match;
+        match.line = result.start.line - blockFirstLine;
+        match.startColumn = result.start.column;
+        match.endLineOffset = 0;
+        match.endColumn = result.end.column;
+        inserted.push_back(match);
+    }
+
+    std::vector<IndexedMatch>& matches = m_blocks[blockIndex].matches;
+    const size_t relative = firstLine - blockFirstLine;
+    auto it = std::lower_bound(matches.begin(), matches.end(), relative,
+        [](const IndexedMatch& match, size_t line) { return match.line < line; });
+    matches.insert(it, inserted.begin(), inserted.end());
+    m_matchCount += inserted.size();
+}
+
+void CMatchIndex::NormalizeBlocks()
+{
+    // 大きくなりすぎたブロックは分割し、空のブロックは取り除く
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+    {
+        if (m_blocks[i].lineCount == 0 && m_blocks.size() > 1)
+        {
+            m_blocks.erase(m_blocks.begin() + i);
+            --i;
+            continue;
+        }
+
+        if (m_blocks[i].lineCount > BLOCK_LINES * 2)
+        {
+            MatchBlock tail;
+            tail.lineCount = m_blocks[i].lineCount - BLOCK_LINES;
+            std::vector<IndexedMatch>& matches = m_blocks[i].matches;
+            auto split = std::lower_bound(matches.begin(), matches.end(), BLOCK_LINES,
+                [](const IndexedMatch& match, size_t line) { return match.line < line; });
+            for (auto it = split; it != matches.end(); ++it)
+            {
+                IndexedMatch match = *it;
+                match.line -= BLOCK_LINES;
+                tail.matches.push_back(match);
+            }
+            matches.erase(split, matches.end());
+            m_blocks[i].lineCount = BLOCK_LINES;
+            m_blocks.insert(m_blocks.begin() + i + 1, std::move(tail));
+        }
+    }
+}
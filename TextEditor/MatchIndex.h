@@ -0,0 +1,70 @@
+// MatchIndex.h - 編集に追従する一致位置の索引（ハイライト・件数表示用）
+#pragma once
+#include <string>
+#include <vector>
+#include "TextDocument.h"
+#include "SearchEngine.h"
+
+// 検索パターンのすべての一致を保持し、ドキュメントの編集通知を受けて更新する。
+// 単一行モードのパターンは一致が行をまたがないので、編集された行だけを照合し直し、
+// 後続の一致は行番号をずらすだけで済む（行はブロック単位で管理し、ずらす範囲をブロック内に限る）。
+// 複数行モードでは一致の届く範囲が決まらないため、編集後の最初の参照で全体を照合し直す。
+// Attach したドキュメントより先に破棄するか、Detach してからドキュメントを破棄すること
+class CMatchIndex : public IDocumentEditListener
+{
+public:
+    CMatchIndex();
+    ~CMatchIndex();
+
+    // パターンで文書全体を照合し、以後の編集を追跡する
+    bool Attach(CTextDocument* pDocument, const CCompiledPattern& pattern);
+    // 求め済みの一致（インクリメンタル検索の結果など）から索引を作る。results は文書順であること
+    bool Attach(CTextDocument* pDocument, const CCompiledPattern& pattern, const std::vector<SearchResult>& results);
+    void Detach();
+    bool IsAttached() const { return m_pDocument != nullptr; }
+
+    // 「n 件中 k 件目」の表示用
+    size_t GetMatchCount();
+    bool GetMatch(size_t index, SearchResult& result);
+    // pos 以降で始まる最初の一致の番号（なければ GetMatchCount()）
+    size_t FindMatchIndex(const TextPosition& pos);
+
+    // 行範囲 [firstLine, lastLine) で始まる一致（表示中の行のハイライト用）
+    void GetMatchesInLines(size_t firstLine, size_t lastLine, std::vector<SearchResult>& results);
+
+    // IDocumentEditListener
+    void OnTextInserted(const TextPosition& pos, const std::wstring& text) override;
+    void OnTextDeleted(const TextPosition& start, const TextPosition& end) override;
+    void OnDocumentReset() override;
+
+private:
+    // 行はブロックの先頭からの相対行番号で持つ
+    struct IndexedMatch
+    {
+        size_t line;
+        size_t startColumn;
+        size_t endLineOffset;   // 終点の行 - 始点の行（単一行モードでは常に0）
+        size_t endColumn;
+    };
+
+    struct MatchBlock
+    {
+        size_t lineCount;
+        std::vector<IndexedMatch> matches;  // (line, startColumn) 順
+    };
+
+    void Build(const std::vector<SearchResult>& results);
+    void Refresh();
+    void ReplaceLines(size_t firstLine, size_t oldLineCount, size_t newLineCount);
+    size_t FindBlock(size_t line, size_t& blockFirstLine) const;
+    void RemoveLines(size_t firstLine, size_t lineCount);
+    void RescanLines(size_t blockIndex, size_t blockFirstLine, size_t firstLine, size_t lineCount);
+    void NormalizeBlocks();
+    SearchResult MakeResult(size_t blockFirstLine, const IndexedMatch& match) const;
+
+    CTextDocument* m_pDocument;
+    CCompiledPattern m_pattern;
+    std::vector<MatchBlock> m_blocks;
+    size_t m_matchCount;
+    bool m_stale;   // 複数行モードで編集があり、全体の照合し直しが必要
+};
@@ -0,0 +1,216 @@
+// MultiPatternMatcher.cpp - 複数リテラルの同時検索実装
+#include "MultiPatternMatcher.h"
+#include "CaseFold.h"
+
+CMultiPatternMatcher::CMultiPatternMatcher()
+    : m_caseSensitive(false)
+    , m_wholeWord(false)
+    , m_classCount(1)
+    , m_stateCount(0)
+{
+}
+
+void CMultiPatternMatcher::Reset()
+{
+    m_patterns.clear();
+    m_bmpClass.clear();
+    m_otherClass.clear();
+    m_classCount = 1;
+    m_stateCount = 0;
+    m_next.clear();
+    m_depth.clear();
+    m_output.clear();
+    m_outputLink.clear();
+}
+
+bool CMultiPatternMatcher::IsCompiledFor(const std::vector<std::wstring>& patterns, bool caseSensitive, bool wholeWord) const
+{
+    return m_stateCount > 0 && m_caseSensitive == caseSensitive && m_wholeWord == wholeWord && m_patterns == patterns;
+}
+
+uint32_t CMultiPatternMatcher::ClassOf(wchar_t ch) const
+{
+    if (static_cast<unsigned long>(ch) < 0x10000)
+    {
+        return m_bmpClass[static_cast<unsigned long>(ch)];
+    }
+    auto it = m_otherClass.find(ch);
+    return (it != m_otherClass.end()) ? it->second : 0;
+}
+
+uint32_t CMultiPatternMatcher::AddClass(wchar_t ch)
+{
+    uint32_t cls = ClassOf(ch);
+    if (cls != 0)
+    {
+        return cls;
+    }
+
+    cls = static_cast<uint32_t>(m_classCount++);
+    if (static_cast<unsigned long>(ch) < 0x10000)
+    {
+        m_bmpClass[static_cast<unsigned long>(ch)] = static_cast<uint16_t>(cls);
+    }
+    else
+    {
+        m_otherClass[ch] = cls;
+    }
+    return cls;
+}
+
+bool CMultiPatternMatcher::Compile(const std::vector<std::wstring>& patterns, bool caseSensitive, bool wholeWord)
+{
+    Reset();
+    m_patterns = patterns;
+    m_caseSensitive = caseSensitive;
+    m_wholeWord = wholeWord;
+
+    // 大文字小文字を区別しない場合は、パターンと走査する文字の両方を畳み込む
+    std::vector<std::vector<uint32_t>> folded(patterns.size());
+    m_bmpClass.assign(0x10000, 0);
+    for (size_t i = 0; i < patterns.size(); ++i)
+    {
+        for (wchar_t ch : patterns[i])
+        {
+            if (m_classCount >= 0xFFFF)
+            {
+                // 文字の種類が多すぎる（クラス番号が16bitに収まらない）
+                Reset();
+                return false;
+            }
+            folded[i].push_back(AddClass(caseSensitive ? ch : FoldCase(ch)));
+        }
+    }
+
+    // パターンの木（トライ）を作る。遷移表の0は「子なし」を表す（根に戻る遷移と同じ値）
+    m_stateCount = 1;
+    m_next.assign(m_classCount, 0);
+    m_depth.assign(1, 0);
+    m_output.assign(1, NO_PATTERN_INDEX);
+    for (size_t i = 0; i < folded.size(); ++i)
+    {
+        if (folded[i].empty())
+        {
+            continue;
+        }
+
+        uint32_t state = 0;
+        for (uint32_t cls : folded[i])
+        {
+            uint32_t& next = m_next[state * m_classCount + cls];
+            if (next == 0)
+            {
+                next = static_cast<uint32_t>(m_stateCount++);
+                m_next.resize(m_stateCount * m_classCount, 0);
+                m_depth.push_back(m_depth[state] + 1);
+                m_output.push_back(NO_PATTERN_INDEX);
+                // resize で参照が無効になっているので取り直す
+                state = m_next[state * m_classCount + cls];
+            }
+            else
+            {
+                state = next;
+            }
+        }
+        if (m_output[state] == NO_PATTERN_INDEX)
+        {
+            m_output[state] = i;
+        }
+    }
+
+    if (m_stateCount <= 1)
+    {
+        Reset();
+        return false;
+    }
+
+    // 浅い状態から順に失敗遷移を求め、子のない遷移を失敗先の遷移で埋める
+    std::vector<uint32_t> fail(m_stateCount, 0);
+    m_outputLink.assign(m_stateCount, 0);
+    std::vector<uint32_t> queue;
+    queue.reserve(m_stateCount);
+    queue.push_back(0);
+    for (size_t head = 0; head < queue.size(); ++head)
+    {
+        const uint32_t state = queue[head];
+        uint32_t* row = &m_next[state * m_classCount];
+        const uint32_t* failRow = &m_next[fail[state] * m_classCount];
+        for (size_t cls = 1; cls < m_classCount; ++cls)
+        {
+            if (row[cls] == 0)
+            {
+                row[cls] = (state == 0) ? 0 : failRow[cls];
+                continue;
+            }
+
+            const uint32_t child = row[cls];
+            const uint32_t childFail = (state == 0) ? 0 : failRow[cls];
+            fail[child] = childFail;
+            m_outputLink[child] = (m_output[childFail] != NO_PATTERN_INDEX) ? childFail : m_outputLink[childFail];
+            queue.push_back(child);
+        }
+    }
+    return true;
+}
+
+bool CMultiPatternMatcher::IsWholeWordAt(const wchar_t* text, size_t length, size_t start, size_t end) const
+{
+    bool startOk = (start == 0) || !IsWordChar(text[start - 1]);
+    bool endOk = (end >= length) || !IsWordChar(text[end]);
+    return startOk && endOk;
+}
+
+bool CMultiPatternMatcher::Find(const wchar_t* text, size_t length, size_t from,
+                                size_t& matchStart, size_t& matchEnd, size_t& patternIndex) const
+{
+    if (IsEmpty() || from >= length)
+    {
+        return false;
+    }
+
+    size_t bestStart = NO_PATTERN_INDEX;
+    size_t bestEnd = 0;
+    size_t bestPattern = NO_PATTERN_INDEX;
+    uint32_t state = 0;
+    for (size_t pos = from; pos < length; ++pos)
+    {
+        wchar_t ch = m_caseSensitive ? text[pos] : FoldCase(text[pos]);
+        state = m_next[state * m_classCount + ClassOf(ch)];
+
+        // 今の状態の文字列より後ろで始まる一致は、見つけた一致より左にはならない
+        const size_t end = pos + 1;
+        if (bestStart != NO_PATTERN_INDEX && end - m_depth[state] > bestStart)
+        {
+            break;
+        }
+
+        // この位置で終わる一致を長い順にたどる
+        uint32_t out = (m_output[state] != NO_PATTERN_INDEX) ? state : m_outputLink[state];
+        for (; out != 0; out = m_outputLink[out])
+        {
+            const size_t start = end - m_depth[out];
+            if (bestStart != NO_PATTERN_INDEX && start > bestStart)
+            {
+                break;
+            }
+            if (m_wholeWord && !IsWholeWordAt(text, length, start, end))
+            {
+                continue;
+            }
+            // 同じ始点ならより後ろで終わる（長い）一致に置き換わる
+            bestStart = start;
+            bestEnd = end;
+            bestPattern = m_output[out];
+            break;
+        }
+    }
+
+    if (bestStart == NO_PATTERN_INDEX)
+    {
+        return false;
+    }
+    matchStart = bestStart;
+    matchEnd = bestEnd;
+    patternIndex = bestPattern;
+    return true;
+}
@@ -0,0 +1,55 @@
+// MultiPatternMatcher.h - 複数リテラルの同時検索（Aho-Corasick）
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+// 一致したパターンの番号がないことを表す
+const size_t NO_PATTERN_INDEX = static_cast<size_t>(-1);
+
+// パターンの集合から Aho-Corasick オートマトンを構築し、テキストを1回走査するだけで
+// いずれかのパターンに一致する箇所を探す（ログから既知のエラー文字列を洗い出すなど）。
+// 失敗遷移は構築時に解決済みの密な遷移表に畳み込むので、走査は1文字あたり表引き1回。
+// 構築後は読み取り専用なので、複数のスレッドから同時に Find してよい
+class CMultiPatternMatcher
+{
+public:
+    CMultiPatternMatcher();
+
+    // 空のパターンは無視する。有効なパターンが1つもなければfalse
+    bool Compile(const std::vector<std::wstring>& patterns, bool caseSensitive, bool wholeWord);
+    bool IsCompiledFor(const std::vector<std::wstring>& patterns, bool caseSensitive, bool wholeWord) const;
+    void Reset();
+
+    // text[from..length) 内で最も左から始まる一致（同じ位置なら最長）を探す。
+    // patternIndex は Compile に渡した配列での番号（同じパターンが複数あれば最初のもの）
+    bool Find(const wchar_t* text, size_t length, size_t from,
+              size_t& matchStart, size_t& matchEnd, size_t& patternIndex) const;
+
+    bool IsEmpty() const { return m_stateCount <= 1; }
+    size_t GetPatternCount() const { return m_patterns.size(); }
+    size_t GetStateCount() const { return m_stateCount; }
+
+private:
+    uint32_t ClassOf(wchar_t ch) const;
+    uint32_t AddClass(wchar_t ch);
+    bool IsWholeWordAt(const wchar_t* text, size_t length, size_t start, size_t end) const;
+
+    std::vector<std::wstring> m_patterns;   // Compile に渡されたまま（再構築の判定用）
+    bool m_caseSensitive;
+    bool m_wholeWord;
+
+    // 文字クラス: パターンに現れる文字ごとの番号（0 はパターンに現れない文字）
+    std::vector<uint16_t> m_bmpClass;                   // U+0000〜U+FFFF
+    std::unordered_map<wchar_t, uint32_t> m_otherClass; // それ以外（wchar_t が32bitの環境）
+    size_t m_classCount;
+
+    // 状態ごとの表。状態0が根
+    size_t m_stateCount;
+    std::vector<uint32_t> m_next;       // m_next[state * m_classCount + class]
+    std::vector<uint32_t> m_depth;      // 根からの文字数
+    std::vector<size_t> m_output;       // この状態で終わるパターン（なければ NO_PATTERN_INDEX）
+    std::vector<uint32_t> m_outputLink; // 出力を持つ最も深い真の接尾辞の状態（なければ0）
+};
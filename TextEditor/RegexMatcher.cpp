@@ -0,0 +1,1862 @@
+// RegexMatcher.cpp - 線形時間正規表現エンジン実装
+#include "RegexMatcher.h"
+#include "LiteralMatcher.h"
+#include "CaseFold.h"
+#include <map>
+#include <algorithm>
+#include <cwctype>
+
+// --- Limits ---
+static const int REPEAT_INFINITE = -1;
+static const int MAX_REPEAT_COUNT = 1000;
+static const size_t MAX_PROGRAM_SIZE = 50000;
+static const int MAX_NESTING_DEPTH = 500;
+static const size_t MAX_EXACT_LITERAL = 256;
+static const size_t DFA_CACHE_LIMIT_BYTES = 8 * 1024 * 1024;
+
+// --- Character predicates（ECMAScript の \w は '_' を含む。非ASCIIの英数字も単語として扱う）---
+static bool IsRegexWordChar(wchar_t ch)
+{
+    return ch == L'_' || IsWordChar(ch);
+}
+
+static bool IsRegexDigit(wchar_t ch)
+{
+    return ch >= L'0' && ch <= L'9';
+}
+
+static bool IsRegexSpace(wchar_t ch)
+{
+    switch (ch)
+    {
+    case L'\t': case L'\n': case L'\v': case L'\f': case L'\r': case L' ':
+    case 0x00A0: case 0x1680: case 0x2028: case 0x2029: case 0x202F:
+    case 0x205F: case 0x3000: case 0xFEFF:
+        return true;
+    }
+    return ch >= 0x2000 && ch <= 0x200A;
+}
+
+static bool IsLineTerminator(wchar_t ch)
+{
+    return ch == L'\n' || ch == L'\r' || ch == 0x2028 || ch == 0x2029;
+}
+
+// --- Character classes ---
+enum ClassEscape
+{
+    CLASS_DIGIT = 1,
+    CLASS_NOT_DIGIT = 2,
+    CLASS_WORD = 4,
+    CLASS_NOT_WORD = 8,
+    CLASS_SPACE = 16,
+    CLASS_NOT_SPACE = 32
+};
+
+struct CharClass
+{
+    std::vector<std::pair<wchar_t, wchar_t>> ranges;
+    int escapes;
+    bool negated;
+
+    CharClass() : escapes(0), negated(false) {}
+};
+
+static bool ClassContains(const CharClass& cls, wchar_t ch)
+{
+    for (const auto& range : cls.ranges)
+    {
+        if (ch >= range.first && ch <= range.second)
+        {
+            return true;
+        }
+    }
+    if (cls.escapes)
+    {
+        if ((cls.escapes & CLASS_DIGIT) && IsRegexDigit(ch)) return true;
+        if ((cls.escapes & CLASS_NOT_DIGIT) && !IsRegexDigit(ch)) return true;
+        if ((cls.escapes & CLASS_WORD) && IsRegexWordChar(ch)) return true;
+        if ((cls.escapes & CLASS_NOT_WORD) && !IsRegexWordChar(ch)) return true;
+        if ((cls.escapes & CLASS_SPACE) && IsRegexSpace(ch)) return true;
+        if ((cls.escapes & CLASS_NOT_SPACE) && !IsRegexSpace(ch)) return true;
+    }
+    return false;
+}
+
+static bool ClassMatches(const CharClass& cls, wchar_t ch, bool caseSensitive)
+{
+    bool contains = ClassContains(cls, ch);
+    if (!contains && !caseSensitive)
+    {
+        // [A-Z] が 'a' にも一致するよう、小文字化・大文字化した文字でも判定
+        wchar_t lower = FoldCase(ch);
+        wchar_t upper = static_cast<wchar_t>(std::towupper(static_cast<wint_t>(ch)));
+        contains = (lower != ch && ClassContains(cls, lower))
+                || (upper != ch && ClassContains(cls, upper));
+    }
+    return contains != cls.negated;
+}
+
+// --- Syntax tree ---
+enum RegexNodeType
+{
+    NODE_EMPTY,
+    NODE_CHAR,
+    NODE_ANY,
+    NODE_CLASS,
+    NODE_ASSERT,
+    NODE_CONCAT,
+    NODE_ALTERNATE,
+    NODE_REPEAT,
+    NODE_GROUP
+};
+
+struct RegexNode
+{
+    RegexNodeType type;
+    wchar_t ch;
+    int index;      // NODE_CLASS: クラス番号 / NODE_GROUP: グループ番号（非キャプチャは-1）/ NODE_ASSERT: 命令
+    int min;
+    int max;
+    bool greedy;
+    std::vector<std::unique_ptr<RegexNode>> children;
+
+    explicit RegexNode(RegexNodeType t)
+        : type(t), ch(0), index(-1), min(0), max(0), greedy(true) {}
+};
+
+// --- Program ---
+enum RegexOp
+{
+    OP_CHAR,
+    OP_ANY,
+    OP_CLASS,
+    OP_MATCH,
+    OP_SPLIT,       // x を優先、次に y
+    OP_JUMP,
+    OP_SAVE,
+    OP_LINE_START,
+    OP_LINE_END,
+    OP_WORD_BOUNDARY,
+    OP_NOT_WORD_BOUNDARY,
+    OP_REPEAT_BEGIN,    // 省略できる繰り返しの1回分の始まり
+    OP_REPEAT_END       // 同じ位置で始まった繰り返しがここに来たら（空の繰り返し）失敗
+};
+
+struct RegexInst
+{
+    RegexOp op;
+    wchar_t ch;
+    int x;
+    int y;
+};
+
+struct RegexProgram
+{
+    std::vector<RegexInst> insts;
+    std::vector<CharClass> classes;
+    bool caseSensitive;
+    bool multiLine;         // ^ と $ が行末文字の前後でも成立する
+    bool hasWordBoundary;
+    size_t groupCount;
+
+    // BMPの文字 → 等価クラス（どの命令に対しても同じ振る舞いをする文字の集合）
+    std::vector<unsigned short> classMap;
+    std::vector<wchar_t> classRepresentative;
+
+    // 一致の先頭になり得る等価クラス（空一致があり得る場合は使わない）
+    std::vector<bool> canStart;
+    bool startCanBeEmpty;
+
+    std::wstring requiredLiteral;
+    CLiteralMatcher prefilter;
+
+    // 後方検索用に右から左へ読むプログラム（等価クラスは共通）
+    std::unique_ptr<RegexProgram> reversed;
+
+    RegexProgram()
+        : caseSensitive(true), multiLine(false), hasWordBoundary(false), groupCount(1), startCanBeEmpty(true) {}
+};
+
+static bool InstMatches(const RegexProgram& program, const RegexInst& inst, wchar_t ch)
+{
+    switch (inst.op)
+    {
+    case OP_CHAR:
+        return (program.caseSensitive ? ch : FoldCase(ch)) == inst.ch;
+    case OP_ANY:
+        return !IsLineTerminator(ch);
+    case OP_CLASS:
+        return ClassMatches(program.classes[inst.x], ch, program.caseSensitive);
+    default:
+        return false;
+    }
+}
+
+// --- Parser ---
+// ECMAScriptのサブセット。線形時間で扱えない構文や判断に迷う構文はfalseを返し、
+// std::wregex に判定を任せる（構文エラーのメッセージもそちらで得る）
+class CRegexParser
+{
+public:
+    CRegexParser(const std::wstring& pattern, std::vector<CharClass>& classes)
+        : m_pattern(pattern), m_pos(0), m_classes(classes), m_groupCount(1), m_depth(0) {}
+
+    bool Parse(std::unique_ptr<RegexNode>& root, size_t& groupCount)
+    {
+        if (!ParseAlternation(root) || !AtEnd())
+        {
+            return false;
+        }
+        groupCount = m_groupCount;
+        return true;
+    }
+
+private:
+    bool AtEnd() const { return m_pos >= m_pattern.length(); }
+    wchar_t Peek() const { return m_pattern[m_pos]; }
+
+    static bool IsQuantifier(wchar_t ch)
+    {
+        return ch == L'*' || ch == L'+' || ch == L'?' || ch == L'{';
+    }
+
+    bool ParseAlternation(std::unique_ptr<RegexNode>& node)
+    {
+        if (++m_depth > MAX_NESTING_DEPTH)
+        {
+            return false;
+        }
+
+        std::unique_ptr<RegexNode> first;
+        if (!ParseConcat(first))
+        {
+            return false;
+        }
+
+        if (AtEnd() || Peek() != L'|')
+        {
+            node = std::move(first);
+        }
+        else
+        {
+            node.reset(new RegexNode(NODE_ALTERNATE));
+            node->children.push_back(std::move(first));
+            while (!AtEnd() && Peek() == L'|')
+            {
+                ++m_pos;
+                std::unique_ptr<RegexNode> next;
+                if (!ParseConcat(next))
+                {
+                    return false;
+                }
+                node->children.push_back(std::move(next));
+            }
+        }
+
+        --m_depth;
+        return true;
+    }
+
+    bool ParseConcat(std::unique_ptr<RegexNode>& node)
+    {
+        std::unique_ptr<RegexNode> concat(new RegexNode(NODE_CONCAT));
+        while (!AtEnd() && Peek() != L'|' && Peek() != L')')
+        {
+            std::unique_ptr<RegexNode> item;
+            if (!ParseRepeat(item))
+            {
+                return false;
+            }
+            concat->children.push_back(std::move(item));
+        }
+
+        if (concat->children.empty())
+        {
+            node.reset(new RegexNode(NODE_EMPTY));
+        }
+        else if (concat->children.size() == 1)
+        {
+            node = std::move(concat->children[0]);
+        }
+        else
+        {
+            node = std::move(concat);
+        }
+        return true;
+    }
+
+    bool ParseNumber(int& value)
+    {
+        size_t start = m_pos;
+        value = 0;
+        while (!AtEnd() && IsRegexDigit(Peek()))
+        {
+            if (value <= MAX_REPEAT_COUNT)
+            {
+                value = value * 10 + (Peek() - L'0');
+            }
+            ++m_pos;
+        }
+        return m_pos > start;
+    }
+
+    bool ParseBraces(int& min, int& max)
+    {
+        ++m_pos; // '{'
+        if (!ParseNumber(min))
+        {
+            return false;
+        }
+        max = min;
+        if (!AtEnd() && Peek() == L',')
+        {
+            ++m_pos;
+            max = REPEAT_INFINITE;
+            if (!AtEnd() && IsRegexDigit(Peek()) && !ParseNumber(max))
+            {
+                return false;
+            }
+        }
+        if (AtEnd() || Peek() != L'}')
+        {
+            return false;
+        }
+        ++m_pos;
+        return true;
+    }
+
+    bool ParseRepeat(std::unique_ptr<RegexNode>& node)
+    {
+        if (!ParseAtom(node))
+        {
+            return false;
+        }
+        if (AtEnd() || !IsQuantifier(Peek()))
+        {
+            return true;
+        }
+        if (node->type == NODE_ASSERT)
+        {
+            return false;
+        }
+
+        int min = 0;
+        int max = REPEAT_INFINITE;
+        switch (Peek())
+        {
+        case L'*': min = 0; max = REPEAT_INFINITE; ++m_pos; break;
+        case L'+': min = 1; max = REPEAT_INFINITE; ++m_pos; break;
+        case L'?': min = 0; max = 1; ++m_pos; break;
+        default:
+            if (!ParseBraces(min, max))
+            {
+                return false;
+            }
+            break;
+        }
+
+        bool greedy = true;
+        if (!AtEnd() && Peek() == L'?')
+        {
+            greedy = false;
+            ++m_pos;
+        }
+        if (!AtEnd() && IsQuantifier(Peek()))
+        {
+            return false; // 量指定子の連続
+        }
+        if (min > MAX_REPEAT_COUNT || max > MAX_REPEAT_COUNT || (max != REPEAT_INFINITE && max < min))
+        {
+            return false;
+        }
+
+        std::unique_ptr<RegexNode> repeat(new RegexNode(NODE_REPEAT));
+        repeat->min = min;
+        repeat->max = max;
+        repeat->greedy = greedy;
+        repeat->children.push_back(std::move(node));
+        node = std::move(repeat);
+        return true;
+    }
+
+    static int HexValue(wchar_t ch)
+    {
+        if (ch >= L'0' && ch <= L'9') return ch - L'0';
+        if (ch >= L'a' && ch <= L'f') return ch - L'a' + 10;
+        if (ch >= L'A' && ch <= L'F') return ch - L'A' + 10;
+        return -1;
+    }
+
+    bool ParseHex(size_t digits, wchar_t& ch)
+    {
+        unsigned long value = 0;
+        for (size_t i = 0; i < digits; ++i)
+        {
+            if (AtEnd() || HexValue(Peek()) < 0)
+            {
+                return false;
+            }
+            value = value * 16 + static_cast<unsigned long>(HexValue(Peek()));
+            ++m_pos;
+        }
+        ch = static_cast<wchar_t>(value);
+        return true;
+    }
+
+    // '\' の直後から1文字分のエスケープを読む
+    bool ParseCharEscape(wchar_t& ch)
+    {
+        wchar_t e = m_pattern[m_pos++];
+        switch (e)
+        {
+        case L't': ch = L'\t'; return true;
+        case L'n': ch = L'\n'; return true;
+        case L'r': ch = L'\r'; return true;
+        case L'v': ch = L'\v'; return true;
+        case L'f': ch = L'\f'; return true;
+        case L'0':
+            ch = 0;
+            return AtEnd() || !IsRegexDigit(Peek());
+        case L'x':
+            return ParseHex(2, ch);
+        case L'u':
+            return ParseHex(4, ch);
+        case L'c':
+            if (AtEnd() || !((Peek() >= L'a' && Peek() <= L'z') || (Peek() >= L'A' && Peek() <= L'Z')))
+            {
+                return false;
+            }
+            ch = static_cast<wchar_t>(m_pattern[m_pos++] % 32);
+            return true;
+        }
+
+        if (std::iswalnum(static_cast<wint_t>(e)))
+        {
+            return false; // 未知の英数字エスケープは std::wregex に判断させる
+        }
+        ch = e;
+        return true;
+    }
+
+    static int ClassEscapeFlag(wchar_t e)
+    {
+        switch (e)
+        {
+        case L'd': return CLASS_DIGIT;
+        case L'D': return CLASS_NOT_DIGIT;
+        case L'w': return CLASS_WORD;
+        case L'W': return CLASS_NOT_WORD;
+        case L's': return CLASS_SPACE;
+        case L'S': return CLASS_NOT_SPACE;
+        }
+        return 0;
+    }
+
+    // クラス内の1文字（範囲の端点）を読む。\d などの場合は flag を返す
+    bool ParseClassAtom(wchar_t& ch, int& flag)
+    {
+        flag = 0;
+        if (Peek() != L'\\')
+        {
+            ch = m_pattern[m_pos++];
+            return true;
+        }
+
+        ++m_pos;
+        if (AtEnd())
+        {
+            return false;
+        }
+        flag = ClassEscapeFlag(Peek());
+        if (flag)
+        {
+            ++m_pos;
+            return true;
+        }
+        if (Peek() == L'b')
+        {
+            ++m_pos;
+            ch = L'\b';
+            return true;
+        }
+        if (Peek() == L'-')
+        {
+            ++m_pos;
+            ch = L'-';
+            return true;
+        }
+        return ParseCharEscape(ch);
+    }
+
+    bool ParseClass(std::unique_ptr<RegexNode>& node)
+    {
+        ++m_pos; // '['
+        CharClass cls;
+        if (!AtEnd() && Peek() == L'^')
+        {
+            cls.negated = true;
+            ++m_pos;
+        }
+        if (!AtEnd() && Peek() == L']')
+        {
+            return false; // [] / [^] は実装間で解釈が分かれる
+        }
+
+        while (!AtEnd() && Peek() != L']')
+        {
+            wchar_t low = 0;
+            int flag = 0;
+            if (!ParseClassAtom(low, flag))
+            {
+                return false;
+            }
+
+            bool isRange = !flag && m_pos + 1 < m_pattern.length()
+                        && Peek() == L'-' && m_pattern[m_pos + 1] != L']';
+            if (flag)
+            {
+                cls.escapes |= flag;
+                if (m_pos + 1 < m_pattern.length() && Peek() == L'-' && m_pattern[m_pos + 1] != L']')
+                {
+                    return false; // [\d-z] のような範囲
+                }
+                continue;
+            }
+            if (!isRange)
+            {
+                cls.ranges.push_back(std::make_pair(low, low));
+                continue;
+            }
+
+            ++m_pos; // '-'
+            wchar_t high = 0;
+            if (!ParseClassAtom(high, flag) || flag || high < low)
+            {
+                return false;
+            }
+            cls.ranges.push_back(std::make_pair(low, high));
+        }
+
+        if (AtEnd())
+        {
+            return false;
+        }
+        ++m_pos; // ']'
+
+        node.reset(new RegexNode(NODE_CLASS));
+        node->index = static_cast<int>(m_classes.size());
+        m_classes.push_back(cls);
+        return true;
+    }
+
+    bool ParseAtom(std::unique_ptr<RegexNode>& node)
+    {
+        wchar_t ch = Peek();
+        switch (ch)
+        {
+        case L'(':
+        {
+            ++m_pos;
+            int groupIndex = -1;
+            if (!AtEnd() && Peek() == L'?')
+            {
+                // 先読み・後読み・名前付きグループは非対応
+                if (m_pos + 1 >= m_pattern.length() || m_pattern[m_pos + 1] != L':')
+                {
+                    return false;
+                }
+                m_pos += 2;
+            }
+            else
+            {
+                groupIndex = static_cast<int>(m_groupCount++);
+            }
+
+            std::unique_ptr<RegexNode> inner;
+            if (!ParseAlternation(inner) || AtEnd() || Peek() != L')')
+            {
+                return false;
+            }
+            ++m_pos;
+
+            node.reset(new RegexNode(NODE_GROUP));
+            node->index = groupIndex;
+            node->children.push_back(std::move(inner));
+            return true;
+        }
+        case L'[':
+            return ParseClass(node);
+        case L'.':
+            ++m_pos;
+            node.reset(new RegexNode(NODE_ANY));
+            return true;
+        case L'^':
+        case L'$':
+            ++m_pos;
+            node.reset(new RegexNode(NODE_ASSERT));
+            node->index = (ch == L'^') ? OP_LINE_START : OP_LINE_END;
+            return true;
+        case L'*':
+        case L'+':
+        case L'?':
+        case L'{':
+            return false;
+        case L'\\':
+        {
+            ++m_pos;
+            if (AtEnd())
+            {
+                return false;
+            }
+            wchar_t e = Peek();
+            if (e == L'b' || e == L'B')
+            {
+                ++m_pos;
+                node.reset(new RegexNode(NODE_ASSERT));
+                node->index = (e == L'b') ? OP_WORD_BOUNDARY : OP_NOT_WORD_BOUNDARY;
+                return true;
+            }
+            if (e >= L'1' && e <= L'9')
+            {
+                return false; // 後方参照
+            }
+            int flag = ClassEscapeFlag(e);
+            if (flag)
+            {
+                ++m_pos;
+                CharClass cls;
+                cls.escapes = flag;
+                node.reset(new RegexNode(NODE_CLASS));
+                node->index = static_cast<int>(m_classes.size());
+                m_classes.push_back(cls);
+                return true;
+            }
+
+            wchar_t literal = 0;
+            if (!ParseCharEscape(literal))
+            {
+                return false;
+            }
+            node.reset(new RegexNode(NODE_CHAR));
+            node->ch = literal;
+            return true;
+        }
+        default:
+            ++m_pos;
+            node.reset(new RegexNode(NODE_CHAR));
+            node->ch = ch;
+            return true;
+        }
+    }
+
+    const std::wstring& m_pattern;
+    size_t m_pos;
+    std::vector<CharClass>& m_classes;
+    size_t m_groupCount;
+    int m_depth;
+};
+
+// --- Code generation ---
+static int EmitInst(std::vector<RegexInst>& insts, RegexOp op, wchar_t ch = 0, int x = 0, int y = 0)
+{
+    RegexInst inst = { op, ch, x, y };
+    insts.push_back(inst);
+    return static_cast<int>(insts.size()) - 1;
+}
+
+// reverse では右から左へ読むプログラムを生成する（連接を逆順にし、^ と $ を入れ替え、キャプチャは省く）
+static bool EmitNode(const RegexNode* node, RegexProgram& program, bool reverse)
+{
+    std::vector<RegexInst>& insts = program.insts;
+    if (insts.size() > MAX_PROGRAM_SIZE)
+    {
+        return false;
+    }
+
+    switch (node->type)
+    {
+    case NODE_EMPTY:
+        return true;
+    case NODE_CHAR:
+        EmitInst(insts, OP_CHAR, program.caseSensitive ? node->ch : FoldCase(node->ch));
+        return true;
+    case NODE_ANY:
+        EmitInst(insts, OP_ANY);
+        return true;
+    case NODE_CLASS:
+        EmitInst(insts, OP_CLASS, 0, node->index);
+        return true;
+    case NODE_ASSERT:
+    {
+        RegexOp op = static_cast<RegexOp>(node->index);
+        if (reverse && op == OP_LINE_START)
+        {
+            op = OP_LINE_END;
+        }
+        else if (reverse && op == OP_LINE_END)
+        {
+            op = OP_LINE_START;
+        }
+        EmitInst(insts, op);
+        if (node->index == OP_WORD_BOUNDARY || node->index == OP_NOT_WORD_BOUNDARY)
+        {
+            program.hasWordBoundary = true;
+        }
+        return true;
+    }
+    case NODE_CONCAT:
+        for (size_t i = 0; i < node->children.size(); ++i)
+        {
+            const RegexNode* child = node->children[reverse ? node->children.size() - 1 - i : i].get();
+            if (!EmitNode(child, program, reverse))
+            {
+                return false;
+            }
+        }
+        return true;
+    case NODE_GROUP:
+        if (node->index < 0 || reverse)
+        {
+            return EmitNode(node->children[0].get(), program, reverse);
+        }
+        EmitInst(insts, OP_SAVE, 0, node->index * 2);
+        if (!EmitNode(node->children[0].get(), program, reverse))
+        {
+            return false;
+        }
+        EmitInst(insts, OP_SAVE, 0, node->index * 2 + 1);
+        return true;
+    case NODE_ALTERNATE:
+    {
+        std::vector<int> jumps;
+        for (size_t i = 0; i + 1 < node->children.size(); ++i)
+        {
+            int split = EmitInst(insts, OP_SPLIT);
+            insts[split].x = split + 1;
+            if (!EmitNode(node->children[i].get(), program, reverse))
+            {
+                return false;
+            }
+            jumps.push_back(EmitInst(insts, OP_JUMP));
+            insts[split].y = static_cast<int>(insts.size());
+        }
+        if (!EmitNode(node->children.back().get(), program, reverse))
+        {
+            return false;
+        }
+        for (int jump : jumps)
+        {
+            insts[jump].x = static_cast<int>(insts.size());
+        }
+        return true;
+    }
+    case NODE_REPEAT:
+    {
+        // 必須の回数は e をそのまま並べる。省略できる回は REPEAT_BEGIN と REPEAT_END で囲み、
+        // 何も読まずに終わった回だけを失敗させる（ECMAScript の RepeatMatcher と同じ規則）
+        const RegexNode* child = node->children[0].get();
+        for (int i = 0; i < node->min; ++i)
+        {
+            if (!EmitNode(child, program, reverse))
+            {
+                return false;
+            }
+        }
+
+        if (node->max == REPEAT_INFINITE)
+        {
+            // e{n,} は e{n} のあとに e*
+            int split = EmitInst(insts, OP_SPLIT);
+            EmitInst(insts, OP_REPEAT_BEGIN);
+            if (!EmitNode(child, program, reverse))
+            {
+                return false;
+            }
+            EmitInst(insts, OP_REPEAT_END);
+            EmitInst(insts, OP_JUMP, 0, split);
+            int exit = static_cast<int>(insts.size());
+            insts[split].x = node->greedy ? split + 1 : exit;
+            insts[split].y = node->greedy ? exit : split + 1;
+            return true;
+        }
+
+        // 任意部分は入れ子の e(e(e)?)? として生成し、省略時は末尾へ飛ぶ
+        std::vector<int> splits;
+        for (int i = node->min; i < node->max; ++i)
+        {
+            splits.push_back(EmitInst(insts, OP_SPLIT));
+            EmitInst(insts, OP_REPEAT_BEGIN);
+            if (!EmitNode(child, program, reverse))
+            {
+                return false;
+            }
+            EmitInst(insts, OP_REPEAT_END);
+        }
+        int exit = static_cast<int>(insts.size());
+        for (int split : splits)
+        {
+            insts[split].x = node->greedy ? split + 1 : exit;
+            insts[split].y = node->greedy ? exit : split + 1;
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+// --- Required literal extraction ---
+struct LiteralInfo
+{
+    bool exact;             // ノードが常にこの文字列そのものに一致する
+    std::wstring text;      // exact のときの文字列
+    std::wstring required;  // 一致に必ず含まれる文字列
+};
+
+static void KeepLonger(std::wstring& best, const std::wstring& candidate)
+{
+    if (candidate.length() > best.length())
+    {
+        best = candidate;
+    }
+}
+
+static LiteralInfo AnalyzeLiterals(const RegexNode* node)
+{
+    LiteralInfo info;
+    info.exact = false;
+
+    switch (node->type)
+    {
+    case NODE_EMPTY:
+    case NODE_ASSERT:
+        info.exact = true; // 幅0なので前後のリテラルをつなげられる
+        break;
+    case NODE_CHAR:
+        info.exact = true;
+        info.text.assign(1, node->ch);
+        info.required = info.text;
+        break;
+    case NODE_ANY:
+    case NODE_CLASS:
+        break;
+    case NODE_GROUP:
+        info = AnalyzeLiterals(node->children[0].get());
+        break;
+    case NODE_CONCAT:
+    {
+        std::wstring run;
+        info.exact = true;
+        for (const auto& child : node->children)
+        {
+            LiteralInfo sub = AnalyzeLiterals(child.get());
+            if (sub.exact && run.length() + sub.text.length() <= MAX_EXACT_LITERAL)
+            {
+                run += sub.text;
+                continue;
+            }
+            info.exact = false;
+            KeepLonger(info.required, run);
+            KeepLonger(info.required, sub.exact ? sub.text : sub.required);
+            run.clear();
+        }
+        KeepLonger(info.required, run);
+        if (info.exact)
+        {
+            info.text = run;
+        }
+        break;
+    }
+    case NODE_ALTERNATE:
+    {
+        LiteralInfo first = AnalyzeLiterals(node->children[0].get());
+        info.exact = first.exact;
+        for (size_t i = 1; info.exact && i < node->children.size(); ++i)
+        {
+            LiteralInfo sub = AnalyzeLiterals(node->children[i].get());
+            info.exact = sub.exact && sub.text == first.text;
+        }
+        if (info.exact)
+        {
+            info.text = first.text;
+            info.required = first.text;
+        }
+        break;
+    }
+    case NODE_REPEAT:
+    {
+        LiteralInfo sub = AnalyzeLiterals(node->children[0].get());
+        if (node->max == 0)
+        {
+            info.exact = true;
+            break;
+        }
+        if (node->min == 0)
+        {
+            break;
+        }
+        info.required = sub.exact ? sub.text : sub.required;
+        if (sub.exact && node->min == node->max
+            && sub.text.length() * static_cast<size_t>(node->min) <= MAX_EXACT_LITERAL)
+        {
+            info.exact = true;
+            for (int i = 0; i < node->min; ++i)
+            {
+                info.text += sub.text;
+            }
+            info.required = info.text;
+        }
+        break;
+    }
+    }
+    return info;
+}
+
+// --- Equivalence classes for the DFA ---
+template <typename Predicate>
+static void RefineClassMap(std::vector<unsigned short>& classMap, size_t& classCount, Predicate predicate)
+{
+    std::vector<int> remap(classCount * 2, -1);
+    int next = 0;
+    for (size_t code = 0; code < classMap.size(); ++code)
+    {
+        size_t key = static_cast<size_t>(classMap[code]) * 2 + (predicate(static_cast<wchar_t>(code)) ? 1 : 0);
+        if (remap[key] < 0)
+        {
+            remap[key] = next++;
+        }
+        classMap[code] = static_cast<unsigned short>(remap[key]);
+    }
+    classCount = static_cast<size_t>(next);
+}
+
+static void BuildClassMap(RegexProgram& program)
+{
+    // まずリテラル文字ごとに分け、クラス・'.'・単語文字の判定で細分化する
+    std::vector<unsigned short> literalIndex(0x10000, 0);
+    size_t classCount = 1;
+    for (const RegexInst& inst : program.insts)
+    {
+        unsigned long code = static_cast<unsigned long>(inst.ch);
+        if (inst.op == OP_CHAR && code < 0x10000 && literalIndex[code] == 0 && classCount < 0xFFFF)
+        {
+            literalIndex[code] = static_cast<unsigned short>(classCount++);
+        }
+    }
+
+    program.classMap.resize(0x10000);
+    for (unsigned long code = 0; code < 0x10000; ++code)
+    {
+        wchar_t ch = static_cast<wchar_t>(code);
+        wchar_t key = program.caseSensitive ? ch : FoldCase(ch);
+        program.classMap[code] = literalIndex[static_cast<unsigned long>(key) & 0xFFFF];
+    }
+
+    for (const CharClass& cls : program.classes)
+    {
+        bool caseSensitive = program.caseSensitive;
+        RefineClassMap(program.classMap, classCount,
+            [&cls, caseSensitive](wchar_t ch) { return ClassMatches(cls, ch, caseSensitive); });
+    }
+    RefineClassMap(program.classMap, classCount, IsLineTerminator);
+    if (program.hasWordBoundary)
+    {
+        RefineClassMap(program.classMap, classCount, IsRegexWordChar);
+    }
+
+    program.classRepresentative.assign(classCount, 0);
+    std::vector<bool> seen(classCount, false);
+    for (unsigned long code = 0; code < 0x10000; ++code)
+    {
+        unsigned short cls = program.classMap[code];
+        if (!seen[cls])
+        {
+            seen[cls] = true;
+            program.classRepresentative[cls] = static_cast<wchar_t>(code);
+        }
+    }
+}
+
+// 開始位置からε遷移で届く文字消費命令（位置条件はすべて成立するとみなす）から、
+// 先頭文字になり得るクラスを求める
+static void BuildStartSet(RegexProgram& program)
+{
+    std::vector<bool> visited(program.insts.size(), false);
+    std::vector<int> stack(1, 0);
+    std::vector<int> consumers;
+    program.startCanBeEmpty = false;
+
+    while (!stack.empty())
+    {
+        int pc = stack.back();
+        stack.pop_back();
+        if (visited[pc])
+        {
+            continue;
+        }
+        visited[pc] = true;
+
+        const RegexInst& inst = program.insts[pc];
+        switch (inst.op)
+        {
+        case OP_CHAR:
+        case OP_ANY:
+        case OP_CLASS:
+            consumers.push_back(pc);
+            break;
+        case OP_MATCH:
+            program.startCanBeEmpty = true;
+            break;
+        case OP_SPLIT:
+            stack.push_back(inst.x);
+            stack.push_back(inst.y);
+            break;
+        case OP_JUMP:
+            stack.push_back(inst.x);
+            break;
+        default:
+            stack.push_back(pc + 1);
+            break;
+        }
+    }
+
+    program.canStart.assign(program.classRepresentative.size(), false);
+    for (size_t cls = 0; cls < program.canStart.size(); ++cls)
+    {
+        for (int pc : consumers)
+        {
+            if (InstMatches(program, program.insts[pc], program.classRepresentative[cls]))
+            {
+                program.canStart[cls] = true;
+                break;
+            }
+        }
+    }
+}
+
+static bool CanStartWith(const RegexProgram& program, wchar_t ch)
+{
+    unsigned long code = static_cast<unsigned long>(ch);
+    return code >= 0x10000 || program.canStart[program.classMap[code]];
+}
+
+// --- Inputs ---
+// 照合対象へのアクセス。位置は照合開始の基準点からのオフセット
+class CSpanInput
+{
+public:
+    CSpanInput(const wchar_t* text, size_t length) : m_text(text), m_length(length) {}
+
+    bool AtEnd(size_t pos) const { return pos >= m_length; }
+    wchar_t At(size_t pos) const { return m_text[pos]; }
+
+private:
+    const wchar_t* m_text;
+    size_t m_length;
+};
+
+// 行の並びを '\n' で連結した1つのテキストとして読む。位置0は基準行の先頭。
+// 前方への逐次アクセスがほとんどなので、現在行を覚えておき行単位で移動する
+class CLineInput
+{
+public:
+    CLineInput(const IRegexLineSource& source, size_t baseLine)
+        : m_source(source)
+        , m_lineCount(source.GetLineCount())
+        , m_line(baseLine)
+        , m_lineStart(0)
+    {
+        Load();
+    }
+
+    bool AtEnd(size_t pos)
+    {
+        Seek(pos);
+        return m_line + 1 >= m_lineCount && pos - m_lineStart >= m_length;
+    }
+
+    wchar_t At(size_t pos)
+    {
+        Seek(pos);
+        size_t index = pos - m_lineStart;
+        return index < m_length ? m_data[index] : L'\n';
+    }
+
+    RegexLinePosition Locate(size_t pos)
+    {
+        RegexLinePosition result;
+        if (pos == REGEX_NO_POSITION)
+        {
+            result.line = REGEX_NO_POSITION;
+            result.column = REGEX_NO_POSITION;
+            return result;
+        }
+        Seek(pos);
+        result.line = m_line;
+        result.column = pos - m_lineStart;
+        return result;
+    }
+
+private:
+    void Load()
+    {
+        const std::wstring& line = m_source.GetLine(m_line);
+        m_data = line.data();
+        m_length = line.length();
+    }
+
+    void Seek(size_t pos)
+    {
+        while (pos < m_lineStart)
+        {
+            --m_line;
+            Load();
+            m_lineStart -= m_length + 1;
+        }
+        while (pos > m_lineStart + m_length && m_line + 1 < m_lineCount)
+        {
+            m_lineStart += m_length + 1;
+            ++m_line;
+            Load();
+        }
+    }
+
+    const IRegexLineSource& m_source;
+    size_t m_lineCount;
+    size_t m_line;
+    size_t m_lineStart;
+    const wchar_t* m_data;
+    size_t m_length;
+};
+
+template <typename Input>
+static bool IsLineStartAt(const RegexProgram& program, Input& input, size_t pos)
+{
+    return pos == 0 || (program.multiLine && IsLineTerminator(input.At(pos - 1)));
+}
+
+template <typename Input>
+static bool IsLineEndAt(const RegexProgram& program, Input& input, size_t pos)
+{
+    return input.AtEnd(pos) || (program.multiLine && IsLineTerminator(input.At(pos)));
+}
+
+// --- Scratch (DFA cache and Pike VM work area) ---
+static const int DFA_UNKNOWN = -1;
+static const int DFA_MATCH = -2;
+
+struct DfaState
+{
+    std::vector<int> kernel;   // 直前の文字を消費した直後のNFA位置
+    bool atStart;
+    bool prevWord;
+    int endMatch;              // 入力末尾で一致するか（-1: 未計算）
+};
+
+struct PikeFrame
+{
+    int pc;
+    int slot;       // 0以上ならキャプチャの復元
+    size_t value;
+    bool repeating; // この位置で省略できる繰り返しを始めている（REPEAT_END に来たら空の繰り返し）
+};
+
+struct PikeList
+{
+    std::vector<int> pcs;
+    std::vector<size_t> captures;
+};
+
+struct RegexScratch
+{
+    std::vector<DfaState> states;
+    std::vector<int> transitions;   // states.size() * クラス数
+    std::map<std::vector<int>, int> stateIndex;
+
+    std::vector<unsigned> marks;    // DFA は命令ごと、Pike VM は (命令, repeating) ごと
+    unsigned generation;
+    std::vector<int> stack;
+    std::vector<int> closure;
+    std::vector<int> kernel;
+
+    std::vector<PikeFrame> frames;
+    PikeList lists[2];
+    std::vector<size_t> threadCaptures;
+    std::vector<size_t> result;
+
+    explicit RegexScratch(const RegexProgram& program)
+        : marks(program.insts.size() * 2, 0)
+        , generation(0)
+    {
+    }
+
+    void NextGeneration()
+    {
+        if (++generation == 0)
+        {
+            std::fill(marks.begin(), marks.end(), 0u);
+            generation = 1;
+        }
+    }
+};
+
+// kernel（と非アンカー検索の開始位置）からε遷移で到達できる文字消費命令を集める。
+// MATCH に到達したらtrue。next は直後の文字（atEndなら無視）
+static bool ComputeClosure(const RegexProgram& program, RegexScratch& scratch, const std::vector<int>& kernel,
+                           bool atStart, bool prevWord, bool atEnd, wchar_t next)
+{
+    const bool nextWord = !atEnd && IsRegexWordChar(next);
+    const bool atLineEnd = atEnd || (program.multiLine && IsLineTerminator(next));
+    bool matched = false;
+
+    scratch.NextGeneration();
+    scratch.closure.clear();
+    scratch.stack.assign(kernel.begin(), kernel.end());
+    scratch.stack.push_back(0);
+
+    while (!scratch.stack.empty())
+    {
+        int pc = scratch.stack.back();
+        scratch.stack.pop_back();
+        if (scratch.marks[pc] == scratch.generation)
+        {
+            continue;
+        }
+        scratch.marks[pc] = scratch.generation;
+
+        const RegexInst& inst = program.insts[pc];
+        switch (inst.op)
+        {
+        case OP_CHAR:
+        case OP_ANY:
+        case OP_CLASS:
+            scratch.closure.push_back(pc);
+            break;
+        case OP_MATCH:
+            matched = true;
+            break;
+        case OP_SPLIT:
+            scratch.stack.push_back(inst.y);
+            scratch.stack.push_back(inst.x);
+            break;
+        case OP_JUMP:
+            scratch.stack.push_back(inst.x);
+            break;
+        case OP_SAVE:
+            scratch.stack.push_back(pc + 1);
+            break;
+        case OP_LINE_START:
+            if (atStart) scratch.stack.push_back(pc + 1);
+            break;
+        case OP_LINE_END:
+            if (atLineEnd) scratch.stack.push_back(pc + 1);
+            break;
+        case OP_WORD_BOUNDARY:
+            if (prevWord != nextWord) scratch.stack.push_back(pc + 1);
+            break;
+        case OP_NOT_WORD_BOUNDARY:
+            if (prevWord == nextWord) scratch.stack.push_back(pc + 1);
+            break;
+        case OP_REPEAT_BEGIN:
+        case OP_REPEAT_END:
+            // 空の繰り返しを除いても届く状態の集合は変わらないので、一致の有無だけを見る DFA では素通りする
+            scratch.stack.push_back(pc + 1);
+            break;
+        }
+    }
+    return matched;
+}
+
+static int AddDfaState(const RegexProgram& program, RegexScratch& scratch,
+                       const std::vector<int>& kernel, bool atStart, bool prevWord)
+{
+    std::vector<int> key(kernel);
+    key.push_back(atStart ? -1 : -2);
+    key.push_back(prevWord ? -1 : -2);
+
+    auto found = scratch.stateIndex.find(key);
+    if (found != scratch.stateIndex.end())
+    {
+        return found->second;
+    }
+
+    const size_t classCount = program.classRepresentative.size();
+    if ((scratch.states.size() + 1) * classCount * sizeof(int) > DFA_CACHE_LIMIT_BYTES)
+    {
+        // キャッシュ上限を超えたら作り直す（1文字あたり高々1状態なので線形時間は保たれる）
+        scratch.states.clear();
+        scratch.transitions.clear();
+        scratch.stateIndex.clear();
+    }
+
+    DfaState state;
+    state.kernel = kernel;
+    state.atStart = atStart;
+    state.prevWord = prevWord;
+    state.endMatch = -1;
+    scratch.states.push_back(state);
+    scratch.transitions.resize(scratch.states.size() * classCount, DFA_UNKNOWN);
+
+    int index = static_cast<int>(scratch.states.size()) - 1;
+    scratch.stateIndex[key] = index;
+    return index;
+}
+
+// 直前の ComputeClosure の結果から文字 ch を読んだ後の状態
+static int AdvanceClosure(const RegexProgram& program, RegexScratch& scratch, wchar_t ch)
+{
+    scratch.kernel.clear();
+    for (int pc : scratch.closure)
+    {
+        if (InstMatches(program, program.insts[pc], ch))
+        {
+            scratch.kernel.push_back(pc + 1);
+        }
+    }
+    std::sort(scratch.kernel.begin(), scratch.kernel.end());
+    scratch.kernel.erase(std::unique(scratch.kernel.begin(), scratch.kernel.end()), scratch.kernel.end());
+
+    bool atStart = program.multiLine && IsLineTerminator(ch);
+    bool prevWord = program.hasWordBoundary && IsRegexWordChar(ch);
+    return AddDfaState(program, scratch, scratch.kernel, atStart, prevWord);
+}
+
+// 状態 current から文字 ch を読んだ遷移先。消費前に一致が成立していれば DFA_MATCH
+static int ComputeTransition(const RegexProgram& program, RegexScratch& scratch, int current, wchar_t ch)
+{
+    const DfaState& state = scratch.states[current];
+    if (ComputeClosure(program, scratch, state.kernel, state.atStart, state.prevWord, false, ch))
+    {
+        return DFA_MATCH;
+    }
+    return AdvanceClosure(program, scratch, ch);
+}
+
+// text[from..length) から始まる一致が存在するか（位置は求めない）
+template <typename Input>
+static bool DfaHasMatch(const RegexProgram& program, RegexScratch& scratch, Input& input, size_t from)
+{
+    const size_t classCount = program.classRepresentative.size();
+    bool prevWord = program.hasWordBoundary && from > 0 && IsRegexWordChar(input.At(from - 1));
+    int current = AddDfaState(program, scratch, std::vector<int>(), IsLineStartAt(program, input, from), prevWord);
+
+    for (size_t pos = from; !input.AtEnd(pos); ++pos)
+    {
+        wchar_t ch = input.At(pos);
+        unsigned long code = static_cast<unsigned long>(ch);
+        int next;
+        if (code < 0x10000)
+        {
+            size_t cls = program.classMap[code];
+            next = scratch.transitions[current * classCount + cls];
+            if (next == DFA_UNKNOWN)
+            {
+                size_t before = scratch.states.size();
+                next = ComputeTransition(program, scratch, current, program.classRepresentative[cls]);
+                // キャッシュを作り直した場合は元の状態が消えているので記録しない
+                if (scratch.states.size() >= before)
+                {
+                    scratch.transitions[current * classCount + cls] = next;
+                }
+            }
+        }
+        else
+        {
+            next = ComputeTransition(program, scratch, current, ch); // BMP外はキャッシュしない
+        }
+
+        if (next == DFA_MATCH)
+        {
+            return true;
+        }
+        current = next;
+    }
+
+    DfaState& state = scratch.states[current];
+    if (state.endMatch < 0)
+    {
+        state.endMatch = ComputeClosure(program, scratch, state.kernel, state.atStart, state.prevWord, true, 0) ? 1 : 0;
+    }
+    return scratch.states[current].endMatch != 0;
+}
+
+// 後方検索の遷移表では、消費前に一致が成立したことを (DFA_MATCHED_BASE - 遷移先) で表す
+static const int DFA_MATCHED_BASE = -3;
+
+// 逆向きのプログラムで text を末尾から読み、始点が limit より前にある最後の一致の始点を求める。
+// 逆向きの一致がある位置で終わることは、元の向きの一致がそこから始まることと同じ
+static size_t DfaLastMatchStart(const RegexProgram& reversed, RegexScratch& scratch,
+                                const wchar_t* text, size_t length, size_t limit)
+{
+    const size_t classCount = reversed.classRepresentative.size();
+
+    // 末尾から読むので、テキストの末尾が逆向きの「行頭」になる
+    int current = AddDfaState(reversed, scratch, std::vector<int>(), true, false);
+
+    for (size_t pos = length; pos > 0; --pos)
+    {
+        wchar_t ch = text[pos - 1];
+        unsigned long code = static_cast<unsigned long>(ch);
+        bool matched = false;
+        int next;
+        if (code < 0x10000)
+        {
+            size_t cls = reversed.classMap[code];
+            int cached = scratch.transitions[current * classCount + cls];
+            if (cached == DFA_UNKNOWN)
+            {
+                const DfaState& state = scratch.states[current];
+                wchar_t representative = reversed.classRepresentative[cls];
+                size_t before = scratch.states.size();
+                matched = ComputeClosure(reversed, scratch, state.kernel, state.atStart, state.prevWord, false, representative);
+                next = AdvanceClosure(reversed, scratch, representative);
+                if (scratch.states.size() >= before)
+                {
+                    scratch.transitions[current * classCount + cls] = matched ? DFA_MATCHED_BASE - next : next;
+                }
+            }
+            else
+            {
+                matched = cached <= DFA_MATCHED_BASE;
+                next = matched ? DFA_MATCHED_BASE - cached : cached;
+            }
+        }
+        else
+        {
+            const DfaState& state = scratch.states[current];
+            matched = ComputeClosure(reversed, scratch, state.kernel, state.atStart, state.prevWord, false, ch);
+            next = AdvanceClosure(reversed, scratch, ch);
+        }
+
+        if (matched && pos < limit)
+        {
+            return pos;
+        }
+        current = next;
+    }
+
+    const DfaState& state = scratch.states[current];
+    if (ComputeClosure(reversed, scratch, state.kernel, state.atStart, state.prevWord, true, 0))
+    {
+        return 0;
+    }
+    return REGEX_NO_POSITION;
+}
+
+template <typename Input>
+static void AddPikeThread(const RegexProgram& program, RegexScratch& scratch, PikeList& list, int startPc,
+                          std::vector<size_t>& captures, Input& input, size_t pos)
+{
+    const size_t slotCount = captures.size();
+    std::vector<PikeFrame>& frames = scratch.frames;
+    frames.clear();
+    PikeFrame first = { startPc, -1, 0, false };
+    frames.push_back(first);
+
+    while (!frames.empty())
+    {
+        PikeFrame frame = frames.back();
+        frames.pop_back();
+        if (frame.slot >= 0)
+        {
+            captures[frame.slot] = frame.value;
+            continue;
+        }
+
+        // 文字を読む命令の先は repeating によらないので、命令だけで重複を除く
+        int pc = frame.pc;
+        const RegexInst& inst = program.insts[pc];
+        const bool consumes = inst.op == OP_CHAR || inst.op == OP_ANY || inst.op == OP_CLASS;
+        const size_t mark = (frame.repeating && !consumes) ? program.insts.size() + pc : pc;
+        if (scratch.marks[mark] == scratch.generation)
+        {
+            continue;
+        }
+        scratch.marks[mark] = scratch.generation;
+
+        PikeFrame next = { pc + 1, -1, 0, frame.repeating };
+        switch (inst.op)
+        {
+        case OP_JUMP:
+            next.pc = inst.x;
+            frames.push_back(next);
+            break;
+        case OP_SPLIT:
+            next.pc = inst.y;
+            frames.push_back(next);
+            next.pc = inst.x;
+            frames.push_back(next);
+            break;
+        case OP_SAVE:
+        {
+            if (static_cast<size_t>(inst.x) >= slotCount)
+            {
+                frames.push_back(next); // 記録しないグループ
+                break;
+            }
+            PikeFrame restore = { -1, inst.x, captures[inst.x], false };
+            frames.push_back(restore);
+            captures[inst.x] = pos;
+            frames.push_back(next);
+            break;
+        }
+        case OP_LINE_START:
+            if (IsLineStartAt(program, input, pos)) frames.push_back(next);
+            break;
+        case OP_LINE_END:
+            if (IsLineEndAt(program, input, pos)) frames.push_back(next);
+            break;
+        case OP_WORD_BOUNDARY:
+        case OP_NOT_WORD_BOUNDARY:
+        {
+            bool prevWord = pos > 0 && IsRegexWordChar(input.At(pos - 1));
+            bool nextWord = !input.AtEnd(pos) && IsRegexWordChar(input.At(pos));
+            if ((prevWord != nextWord) == (inst.op == OP_WORD_BOUNDARY))
+            {
+                frames.push_back(next);
+            }
+            break;
+        }
+        case OP_REPEAT_BEGIN:
+            next.repeating = true;
+            frames.push_back(next);
+            break;
+        case OP_REPEAT_END:
+            // repeating なら、いま終わる回（内側にある）もこの位置で始まっている
+            if (!frame.repeating) frames.push_back(next);
+            break;
+        default:
+            list.pcs.push_back(pc);
+            list.captures.insert(list.captures.end(), captures.begin(), captures.begin() + slotCount);
+            break;
+        }
+    }
+}
+
+// Pike VM: 優先順位付きのスレッド集合で最左・最優先の一致を求める。
+// allGroups がfalseならグループ0の範囲だけを記録する
+template <typename Input>
+static bool RunPike(const RegexProgram& program, RegexScratch& scratch, Input& input,
+                    size_t from, bool allGroups, std::vector<size_t>& captures)
+{
+    const size_t slotCount = allGroups ? program.groupCount * 2 : 2;
+    PikeList* current = &scratch.lists[0];
+    PikeList* next = &scratch.lists[1];
+    current->pcs.clear();
+    current->captures.clear();
+    std::vector<size_t>& threadCaptures = scratch.threadCaptures;
+
+    bool matched = false;
+    scratch.NextGeneration();
+    for (size_t pos = from; ; ++pos)
+    {
+        if (!matched)
+        {
+            if (current->pcs.empty() && !program.startCanBeEmpty)
+            {
+                // 生きているスレッドが無ければ、一致を始められる文字まで読み飛ばす
+                while (!input.AtEnd(pos) && !CanStartWith(program, input.At(pos)))
+                {
+                    ++pos;
+                }
+                if (input.AtEnd(pos))
+                {
+                    break;
+                }
+                // 前の位置で死んだスレッドが付けた印を、読み飛ばした先の開始スレッドに持ち込まない
+                scratch.NextGeneration();
+            }
+
+            // 新しい開始位置は既存スレッドより優先度が低い
+            threadCaptures.assign(slotCount, REGEX_NO_POSITION);
+            AddPikeThread(program, scratch, *current, 0, threadCaptures, input, pos);
+        }
+
+        const bool atEnd = input.AtEnd(pos);
+        if (current->pcs.empty())
+        {
+            if (matched || atEnd)
+            {
+                break;
+            }
+            scratch.NextGeneration();
+            continue;
+        }
+
+        scratch.NextGeneration();
+        next->pcs.clear();
+        next->captures.clear();
+        for (size_t i = 0; i < current->pcs.size(); ++i)
+        {
+            const RegexInst& inst = program.insts[current->pcs[i]];
+            const size_t* threadSlots = current->captures.data() + i * slotCount;
+            if (inst.op == OP_MATCH)
+            {
+                // 優先度の低いスレッドはここで打ち切る
+                captures.assign(threadSlots, threadSlots + slotCount);
+                matched = true;
+                break;
+            }
+            if (!atEnd && InstMatches(program, inst, input.At(pos)))
+            {
+                threadCaptures.assign(threadSlots, threadSlots + slotCount);
+                AddPikeThread(program, scratch, *next, current->pcs[i] + 1, threadCaptures, input, pos + 1);
+            }
+        }
+        std::swap(current, next);
+        if (atEnd)
+        {
+            break;
+        }
+    }
+    return matched;
+}
+
+// --- CRegexMatcher ---
+CRegexMatcher::CRegexMatcher()
+{
+}
+
+CRegexMatcher::CRegexMatcher(const CRegexMatcher& other)
+    : m_program(other.m_program)
+{
+}
+
+CRegexMatcher& CRegexMatcher::operator=(const CRegexMatcher& other)
+{
+    if (this != &other)
+    {
+        m_program = other.m_program;
+        m_scratch.reset();
+        m_reverseScratch.reset();
+    }
+    return *this;
+}
+
+CRegexMatcher::~CRegexMatcher()
+{
+}
+
+void CRegexMatcher::Reset()
+{
+    m_program.reset();
+    m_scratch.reset();
+    m_reverseScratch.reset();
+}
+
+bool CRegexMatcher::Compile(const std::wstring& pattern, bool caseSensitive, bool multiLine)
+{
+    Reset();
+
+    std::shared_ptr<RegexProgram> program = std::make_shared<RegexProgram>();
+    program->caseSensitive = caseSensitive;
+    program->multiLine = multiLine;
+
+    std::unique_ptr<RegexNode> root;
+    CRegexParser parser(pattern, program->classes);
+    if (!parser.Parse(root, program->groupCount))
+    {
+        return false;
+    }
+
+    EmitInst(program->insts, OP_SAVE, 0, 0);
+    if (!EmitNode(root.get(), *program, false))
+    {
+        return false;
+    }
+    EmitInst(program->insts, OP_SAVE, 0, 1);
+    EmitInst(program->insts, OP_MATCH);
+    if (program->insts.size() > MAX_PROGRAM_SIZE)
+    {
+        return false;
+    }
+
+    BuildClassMap(*program);
+    BuildStartSet(*program);
+
+    std::unique_ptr<RegexProgram> reversed(new RegexProgram());
+    reversed->caseSensitive = caseSensitive;
+    reversed->multiLine = multiLine;
+    reversed->classes = program->classes;
+    if (!EmitNode(root.get(), *reversed, true))
+    {
+        return false;
+    }
+    EmitInst(reversed->insts, OP_MATCH);
+    reversed->classMap = program->classMap;
+    reversed->classRepresentative = program->classRepresentative;
+    program->reversed = std::move(reversed);
+
+    LiteralInfo literals = AnalyzeLiterals(root.get());
+    program->requiredLiteral = literals.exact ? literals.text : literals.required;
+    if (!program->requiredLiteral.empty())
+    {
+        program->prefilter.Compile(program->requiredLiteral, caseSensitive, false);
+    }
+
+    m_program = program;
+    return true;
+}
+
+size_t CRegexMatcher::GetGroupCount() const
+{
+    return m_program ? m_program->groupCount : 0;
+}
+
+const std::wstring& CRegexMatcher::GetRequiredLiteral() const
+{
+    static const std::wstring empty;
+    return m_program ? m_program->requiredLiteral : empty;
+}
+
+bool CRegexMatcher::Search(const wchar_t* text, size_t length, size_t from,
+                          bool allGroups, std::vector<size_t>& captures) const
+{
+    if (!m_program || from > length)
+    {
+        return false;
+    }
+    const RegexProgram& program = *m_program;
+
+    // 必須リテラルが残りの範囲に無ければ一致しない
+    if (!program.requiredLiteral.empty())
+    {
+        size_t literalStart = 0;
+        size_t literalEnd = 0;
+        if (!program.prefilter.Find(text, length, from, literalStart, literalEnd))
+        {
+            return false;
+        }
+    }
+
+    if (!m_scratch)
+    {
+        m_scratch.reset(new RegexScratch(program));
+    }
+
+    // DFAで一致の有無を判定し、一致する場合のみPike VMで位置を求める
+    CSpanInput input(text, length);
+    if (!DfaHasMatch(program, *m_scratch, input, from))
+    {
+        return false;
+    }
+    return RunPike(program, *m_scratch, input, from, allGroups, captures);
+}
+
+bool CRegexMatcher::SearchLines(const IRegexLineSource& source, size_t line, size_t column,
+                               bool allGroups, std::vector<RegexLinePosition>& captures) const
+{
+    if (!m_program || line >= source.GetLineCount() || column > source.GetLine(line).length())
+    {
+        return false;
+    }
+    const RegexProgram& program = *m_program;
+
+    // 行をまたがない必須リテラルは、以降のどの行にも無ければ一致しない
+    const std::wstring& literal = program.requiredLiteral;
+    if (!literal.empty() && std::find_if(literal.begin(), literal.end(), IsLineTerminator) == literal.end())
+    {
+        bool found = false;
+        for (size_t i = line; i < source.GetLineCount() && !found; ++i)
+        {
+            const std::wstring& text = source.GetLine(i);
+            size_t literalStart = 0;
+            size_t literalEnd = 0;
+            found = program.prefilter.Find(text.data(), text.length(), (i == line) ? column : 0, literalStart, literalEnd);
+        }
+        if (!found)
+        {
+            return false;
+        }
+    }
+
+    if (!m_scratch)
+    {
+        m_scratch.reset(new RegexScratch(program));
+    }
+
+    CLineInput input(source, line);
+    if (!DfaHasMatch(program, *m_scratch, input, column)
+        || !RunPike(program, *m_scratch, input, column, allGroups, m_scratch->result))
+    {
+        return false;
+    }
+
+    captures.clear();
+    for (size_t offset : m_scratch->result)
+    {
+        captures.push_back(input.Locate(offset));
+    }
+    return true;
+}
+
+bool CRegexMatcher::FindInLines(const IRegexLineSource& source, size_t line, size_t column,
+                               std::vector<RegexLinePosition>& captures) const
+{
+    return SearchLines(source, line, column, true, captures);
+}
+
+bool CRegexMatcher::FindInLines(const IRegexLineSource& source, size_t line, size_t column,
+                               RegexLinePosition& matchStart, RegexLinePosition& matchEnd) const
+{
+    std::vector<RegexLinePosition> captures;
+    if (!SearchLines(source, line, column, false, captures))
+    {
+        return false;
+    }
+    matchStart = captures[0];
+    matchEnd = captures[1];
+    return true;
+}
+
+bool CRegexMatcher::Find(const wchar_t* text, size_t length, size_t from, std::vector<size_t>& captures) const
+{
+    return Search(text, length, from, true, captures);
+}
+
+bool CRegexMatcher::Find(const wchar_t* text, size_t length, size_t from, size_t& matchStart, size_t& matchEnd) const
+{
+    if (!m_scratch && m_program)
+    {
+        m_scratch.reset(new RegexScratch(*m_program));
+    }
+    if (!m_program || !Search(text, length, from, false, m_scratch->result))
+    {
+        return false;
+    }
+    matchStart = m_scratch->result[0];
+    matchEnd = m_scratch->result[1];
+    return true;
+}
+
+bool CRegexMatcher::FindLast(const wchar_t* text, size_t length, size_t limit, size_t& matchStart, size_t& matchEnd) const
+{
+    if (!m_program || limit == 0)
+    {
+        return false;
+    }
+    const RegexProgram& program = *m_program;
+
+    if (!program.requiredLiteral.empty())
+    {
+        size_t literalStart = 0;
+        size_t literalEnd = 0;
+        if (!program.prefilter.Find(text, length, 0, literalStart, literalEnd))
+        {
+            return false;
+        }
+    }
+
+    if (!m_reverseScratch)
+    {
+        m_reverseScratch.reset(new RegexScratch(*program.reversed));
+    }
+
+    // 始点だけを逆向きのDFAで求め、終点は前方の照合で決める（優先順位を前方検索と揃える）
+    size_t start = DfaLastMatchStart(*program.reversed, *m_reverseScratch, text, length, std::min(limit, length + 1));
+    if (start == REGEX_NO_POSITION)
+    {
+        return false;
+    }
+    return Find(text, length, start, matchStart, matchEnd);
+}
@@ -0,0 +1,75 @@
+// RegexMatcher.h - 線形時間の正規表現エンジン（Thompson NFA + 遅延構築DFA）
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+struct RegexProgram;
+struct RegexScratch;
+
+const size_t REGEX_NO_POSITION = static_cast<size_t>(-1);
+
+// 複数行照合の対象。行は '\n' で連結された1つのテキストとして扱われる
+class IRegexLineSource
+{
+public:
+    virtual ~IRegexLineSource() {}
+    virtual size_t GetLineCount() const = 0;
+    virtual const std::wstring& GetLine(size_t line) const = 0;
+};
+
+struct RegexLinePosition
+{
+    size_t line;
+    size_t column;
+};
+
+// CSearchEngineが受け付けるECMAScriptのサブセットをNFAにコンパイルする。
+// 一致の有無は遅延構築するDFAで、位置とキャプチャはPike VMで求める。
+// どちらもバックトラックせず、入力長に対して線形時間で終わる
+class CRegexMatcher
+{
+public:
+    CRegexMatcher();
+    CRegexMatcher(const CRegexMatcher& other);
+    CRegexMatcher& operator=(const CRegexMatcher& other);
+    ~CRegexMatcher();
+
+    // 後方参照・先読みなど線形時間で扱えない構文、または構文エラーの場合はfalse
+    // （呼び出し側で std::wregex にフォールバックする）。
+    // multiLine では ^ と $ が各行の先頭・末尾でも成立する
+    bool Compile(const std::wstring& pattern, bool caseSensitive, bool multiLine = false);
+    bool IsCompiled() const { return m_program != nullptr; }
+    void Reset();
+
+    // text[from..length) 内の最も左の一致（優先順位はECMAScriptのバックトラックと同じ）
+    bool Find(const wchar_t* text, size_t length, size_t from, size_t& matchStart, size_t& matchEnd) const;
+
+    // 始点が limit より前にある最後の一致（後方検索）。逆向きのDFAで始点を求めるので前方検索と同じく線形時間
+    bool FindLast(const wchar_t* text, size_t length, size_t limit, size_t& matchStart, size_t& matchEnd) const;
+
+    // キャプチャ付き。captures[2*i], captures[2*i+1] がグループiの範囲（不参加は REGEX_NO_POSITION）
+    bool Find(const wchar_t* text, size_t length, size_t from, std::vector<size_t>& captures) const;
+
+    // (line, column) から後ろを、行をまたいで照合する。一致の始点と終点は別の行になり得る
+    bool FindInLines(const IRegexLineSource& source, size_t line, size_t column,
+                     RegexLinePosition& matchStart, RegexLinePosition& matchEnd) const;
+    bool FindInLines(const IRegexLineSource& source, size_t line, size_t column,
+                     std::vector<RegexLinePosition>& captures) const;
+
+    // グループ0（一致全体）を含むグループ数
+    size_t GetGroupCount() const;
+
+    // すべての一致に含まれるリテラル（プレフィルタに使用。なければ空）
+    const std::wstring& GetRequiredLiteral() const;
+
+private:
+    bool Search(const wchar_t* text, size_t length, size_t from, bool allGroups, std::vector<size_t>& captures) const;
+    bool SearchLines(const IRegexLineSource& source, size_t line, size_t column,
+                     bool allGroups, std::vector<RegexLinePosition>& captures) const;
+
+    std::shared_ptr<const RegexProgram> m_program;    // 不変部分はコピー間で共有
+    mutable std::unique_ptr<RegexScratch> m_scratch;  // DFAキャッシュと作業領域（インスタンスごと）
+    mutable std::unique_ptr<RegexScratch> m_reverseScratch;  // 後方検索用
+};
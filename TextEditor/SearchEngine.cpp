@@ -1,8 +1,748 @@
 // SearchEngine.cpp - 検索・置換エンジン実装
 #include "SearchEngine.h"
+#include "IncrementalSearch.h"
+#include "WorkerPool.h"
 #include <algorithm>
+#include <iterator>
+
+// この行数未満のドキュメントは並列化しない（スレッドの起床待ちの方が高くつく）
+static const size_t PARALLEL_MIN_LINES = 20000;
+static const size_t PARALLEL_MIN_LINES_PER_CHUNK = 4096;
+static const size_t PARALLEL_CHUNKS_PER_THREAD = 4;
+// FindStream で一度に照合する行数（取り消しの確認と進捗の通知の間隔）
+static const size_t STREAM_CHUNK_LINES = 4096;
+// 複数行モードの FindStream で一度に通知する一致数
+static const size_t STREAM_BATCH_MATCHES = 1024;
+
+// 行範囲ごとの結果を範囲の順に連結する（範囲の順に並べれば文書順になる）
+template <typename T>
+static void MoveConcatenated(std::vector<std::vector<T>>& partial, std::vector<T>& results)
+{
+    size_t total = results.size();
+    for (const std::vector<T>& items : partial)
+    {
+        total += items.size();
+    }
+
+    results.reserve(total);
+    for (std::vector<T>& items : partial)
+    {
+        std::move(items.begin(), items.end(), std::back_inserter(results));
+    }
+}
+
+// ドキュメントの行をそのまま複数行照合に渡す（GetText() で連結しない）
+class CDocumentLineSource : public IRegexLineSource
+{
+public:
+    explicit CDocumentLineSource(const CTextDocument* pDocument) : m_pDocument(pDocument) {}
+
+    size_t GetLineCount() const override { return m_pDocument->GetLineCount(); }
+    const std::wstring& GetLine(size_t line) const override { return m_pDocument->GetLine(line); }
+
+private:
+    const CTextDocument* m_pDocument;
+};
+
+// 範囲の終点で打ち切ったドキュメントの行（選択範囲内を複数行モードで照合するため）。
+// 終点より前の行はそのまま渡すので、範囲の前の文字列は前後関係の判定に使われる
+class CRangeLineSource : public IRegexLineSource
+{
+public:
+    CRangeLineSource(const CTextDocument* pDocument, const TextPosition& end)
+        : m_pDocument(pDocument)
+        , m_endLine(end.line)
+        , m_lastLine(pDocument->GetLine(end.line), 0, end.column)
+    {}
+
+    size_t GetLineCount() const override { return m_endLine + 1; }
+    const std::wstring& GetLine(size_t line) const override
+    {
+        return (line == m_endLine) ? m_lastLine : m_pDocument->GetLine(line);
+    }
+
+private:
+    const CTextDocument* m_pDocument;
+    size_t m_endLine;
+    std::wstring m_lastLine;
+};
+
+// 行の [from, to) に収まる一致を順に visit(startCol, endCol, editDistance) へ渡す。
+// to を行末として照合する（from より前は前後関係の判定にのみ使う）。visit がfalseを返すと打ち切ってfalse
+template <typename Visit>
+static bool VisitMatchesInSegment(const CCompiledPattern& pattern, const std::wstring& lineText,
+                                  size_t from, size_t to, Visit visit)
+{
+    size_t searchPos = from;
+    while (searchPos < to)
+    {
+        size_t startCol = 0;
+        size_t endCol = 0;
+        size_t editDistance = 0;
+
+        if (!pattern.Match(lineText.data(), to, searchPos, startCol, endCol, editDistance))
+        {
+            break;
+        }
+        if (!visit(startCol, endCol, editDistance))
+        {
+            return false;
+        }
+
+        // 空一致での無限ループを避けつつ、直後から次の一致を探す
+        searchPos = (endCol > startCol) ? endCol : endCol + 1;
+    }
+    return true;
+}
+
+// 行範囲 [firstLine, lastLine) の一致を順に visit(line, lineText, startCol, endCol, editDistance) へ渡す
+template <typename Visit>
+static void VisitMatchesInLines(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                                size_t firstLine, size_t lastLine, Visit visit)
+{
+    for (size_t line = firstLine; line < lastLine; ++line)
+    {
+        const std::wstring& lineText = pDocument->GetLine(line);
+        VisitMatchesInSegment(pattern, lineText, 0, lineText.length(),
+            [&](size_t startCol, size_t endCol, size_t editDistance)
+        {
+            visit(line, lineText, startCol, endCol, editDistance);
+            return true;
+        });
+    }
+}
+
+// 範囲をドキュメント内に収める（空になった範囲も位置の対応のために残す）
+static std::vector<Selection> ClampRanges(const CTextDocument* pDocument, const std::vector<Selection>& ranges)
+{
+    std::vector<Selection> clamped;
+    clamped.reserve(ranges.size());
+    for (const Selection& range : ranges)
+    {
+        clamped.push_back(Selection(pDocument->ClampPosition(range.start), pDocument->ClampPosition(range.end)));
+    }
+    return clamped;
+}
+
+// 終点が from 以降の最初の範囲
+static std::vector<Selection>::const_iterator FindRangeFrom(const std::vector<Selection>& ranges, const TextPosition& from)
+{
+    return std::lower_bound(ranges.begin(), ranges.end(), from,
+        [](const Selection& range, const TextPosition& value) { return range.end < value; });
+}
+
+// 範囲内で from 以降に始まる最初の一致（ranges は ClampRanges 済みで文書順）。
+// 複数行モードでは、ドキュメント全体の検索で文書末に空一致があり得るのと同じく、範囲の終点での空一致もあり得る
+static bool FindFirstInRanges(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                              const std::vector<Selection>& ranges, const TextPosition& from, SearchResult& result)
+{
+    for (auto it = FindRangeFrom(ranges, from); it != ranges.end(); ++it)
+    {
+        const TextPosition start = std::max(it->start, from);
+        if (pattern.IsMultiLine())
+        {
+            CRangeLineSource source(pDocument, it->end);
+            RegexLinePosition matchStart;
+            RegexLinePosition matchEnd;
+            if (pattern.MatchLines(source, start.line, start.column, matchStart, matchEnd))
+            {
+                result.start = TextPosition(matchStart.line, matchStart.column);
+                result.end = TextPosition(matchEnd.line, matchEnd.column);
+                result.matchedText = pDocument->GetTextRange(result.start, result.end);
+                result.editDistance = 0;
+                return true;
+            }
+            continue;
+        }
+
+        for (size_t line = start.line; line <= it->end.line; ++line)
+        {
+            const std::wstring& lineText = pDocument->GetLine(line);
+            const size_t first = (line == start.line) ? start.column : 0;
+            const size_t last = (line == it->end.line) ? it->end.column : lineText.length();
+            bool found = false;
+            VisitMatchesInSegment(pattern, lineText, first, last,
+                [&](size_t startCol, size_t endCol, size_t editDistance)
+            {
+                result = SearchResult(TextPosition(line, startCol), TextPosition(line, endCol),
+                                      lineText.substr(startCol, endCol - startCol));
+                result.editDistance = editDistance;
+                found = true;
+                return false;
+            });
+            if (found)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void FindMatchesInLines(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                        size_t firstLine, size_t lastLine, std::vector<SearchResult>& results)
+{
+    VisitMatchesInLines(pDocument, pattern, firstLine, lastLine,
+        [&](size_t line, const std::wstring& lineText, size_t startCol, size_t endCol, size_t editDistance)
+    {
+        SearchResult result;
+        result.start = TextPosition(line, startCol);
+        result.end = TextPosition(line, endCol);
+        result.matchedText = lineText.substr(startCol, endCol - startCol);
+        result.editDistance = editDistance;
+        results.push_back(result);
+    });
+}
+
+// 行範囲の一致を位置だけで記録する（pSpans が nullptr なら数えるだけ）。戻り値は一致数
+static size_t FindSpansInLines(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                               size_t firstLine, size_t lastLine, std::vector<MatchSpan>* pSpans)
+{
+    size_t count = 0;
+    VisitMatchesInLines(pDocument, pattern, firstLine, lastLine,
+        [&](size_t line, const std::wstring&, size_t startCol, size_t endCol, size_t editDistance)
+    {
+        ++count;
+        if (pSpans)
+        {
+            MatchSpan span;
+            span.line = line;
+            span.column = startCol;
+            span.length = endCol - startCol;
+            span.editDistance = editDistance;
+            pSpans->push_back(span);
+        }
+    });
+    return count;
+}
+
+// [firstLine, lastLine) のうち候補の行範囲に重なる部分ごとに visit(first, last) を呼ぶ（候補がなければ全体）
+template <typename Visit>
+static void ForEachCandidateRange(const std::vector<LineRange>* pCandidates, size_t firstLine, size_t lastLine,
+                                  Visit visit)
+{
+    if (!pCandidates)
+    {
+        visit(firstLine, lastLine);
+        return;
+    }
+
+    auto it = std::upper_bound(pCandidates->begin(), pCandidates->end(), firstLine,
+        [](size_t line, const LineRange& range) { return line < range.lastLine; });
+    for (; it != pCandidates->end() && it->firstLine < lastLine; ++it)
+    {
+        visit(std::max(firstLine, it->firstLine), std::min(lastLine, it->lastLine));
+    }
+}
+
+// line を候補の行範囲内の最初の行（line 以降）に進める。なければfalse
+static bool SkipToCandidateLine(const std::vector<LineRange>& candidates, size_t& line)
+{
+    auto it = std::upper_bound(candidates.begin(), candidates.end(), line,
+        [](size_t value, const LineRange& range) { return value < range.lastLine; });
+    if (it == candidates.end())
+    {
+        return false;
+    }
+    line = std::max(line, it->firstLine);
+    return true;
+}
+
+bool FindMatchAcrossLines(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                          const TextPosition& from, SearchResult& result)
+{
+    CDocumentLineSource source(pDocument);
+    RegexLinePosition matchStart;
+    RegexLinePosition matchEnd;
+    if (!pattern.MatchLines(source, from.line, from.column, matchStart, matchEnd))
+    {
+        return false;
+    }
+
+    result.start = TextPosition(matchStart.line, matchStart.column);
+    result.end = TextPosition(matchEnd.line, matchEnd.column);
+    result.matchedText = pDocument->GetTextRange(result.start, result.end);
+    return true;
+}
+
+TextPosition GetNextSearchPosition(const CTextDocument* pDocument, const SearchResult& result)
+{
+    if (!(result.start == result.end))
+    {
+        return result.end;
+    }
+
+    // 空一致の場合は1文字（行末なら次の行頭へ）進める
+    if (result.end.column < pDocument->GetLine(result.end.line).length())
+    {
+        return TextPosition(result.end.line, result.end.column + 1);
+    }
+    return TextPosition(result.end.line + 1, 0);
+}
+
+// start から end までの文字数（行の区切りは1文字と数える）
+static size_t GetSpanLength(const CTextDocument* pDocument, const TextPosition& start, const TextPosition& end)
+{
+    if (start.line == end.line)
+    {
+        return end.column - start.column;
+    }
+
+    size_t length = pDocument->GetLine(start.line).length() - start.column + 1;
+    for (size_t line = start.line + 1; line < end.line; ++line)
+    {
+        length += pDocument->GetLine(line).length() + 1;
+    }
+    return length + end.column;
+}
+
+TextPosition GetMatchEnd(const CTextDocument* pDocument, const MatchSpan& match)
+{
+    size_t line = match.line;
+    size_t column = match.column;
+    size_t remaining = match.length;
+    while (line + 1 < pDocument->GetLineCount())
+    {
+        const size_t lineLength = pDocument->GetLine(line).length();
+        const size_t rest = (column < lineLength) ? lineLength - column : 0;
+        if (remaining <= rest)
+        {
+            break;
+        }
+        remaining -= rest + 1;
+        ++line;
+        column = 0;
+    }
+    return TextPosition(line, column + remaining);
+}
+
+SearchResult MaterializeMatch(const CTextDocument* pDocument, const MatchSpan& match)
+{
+    const TextPosition start(match.line, match.column);
+    const TextPosition end = GetMatchEnd(pDocument, match);
+    SearchResult result(start, end, pDocument->GetTextRange(start, end));
+    result.editDistance = match.editDistance;
+    return result;
+}
+
+static bool IsCancelRequested(const MatchStreamOptions& options)
+{
+    return options.pCancel && options.pCancel->IsCancelled();
+}
+
+// 一致のまとまりを通知する（maxResults を超える分は捨てる）。打ち切る場合はfalse
+static bool EmitMatches(const MatchStreamOptions& options, MatchStreamSummary& summary,
+                        const MatchSpan* matches, size_t count)
+{
+    if (options.maxResults != 0 && summary.matchCount + count >= options.maxResults)
+    {
+        count = options.maxResults - summary.matchCount;
+        summary.limitReached = true;
+    }
+
+    summary.matchCount += count;
+    if (!options.countOnly && count > 0 && options.onMatches && !options.onMatches(matches, count))
+    {
+        summary.cancelled = true;
+    }
+    return !summary.limitReached && !summary.cancelled;
+}
+
+// 置換文字列の構成要素（リテラル文字列か、キャプチャグループの参照）
+struct ReplacementPart
+{
+    std::wstring text;
+    size_t group;       // REGEX_NO_POSITION ならリテラル
+};
+
+static bool IsDigit(wchar_t ch)
+{
+    return ch >= L'0' && ch <= L'9';
+}
+
+// 置換文字列を解析する。存在しないグループの参照はそのまま文字列として残す
+static std::vector<ReplacementPart> ParseReplacement(const std::wstring& replacement, bool useRegex, size_t groupCount)
+{
+    std::vector<ReplacementPart> parts;
+    ReplacementPart literal;
+    literal.group = REGEX_NO_POSITION;
+
+    for (size_t i = 0; useRegex && i < replacement.length(); ++i)
+    {
+        wchar_t ch = replacement[i];
+        if (ch != L'$' || i + 1 >= replacement.length())
+        {
+            literal.text += ch;
+            continue;
+        }
+
+        wchar_t next = replacement[i + 1];
+        size_t group = REGEX_NO_POSITION;
+        size_t used = 1;
+        if (next == L'$')
+        {
+            literal.text += L'$';
+            ++i;
+            continue;
+        }
+        if (next == L'&')
+        {
+            group = 0;
+        }
+        else if (IsDigit(next))
+        {
+            // 2桁のグループが存在すればそちらを優先する（$10 と $1 の後の 0）
+            size_t one = next - L'0';
+            size_t two = (i + 2 < replacement.length() && IsDigit(replacement[i + 2]))
+                ? one * 10 + (replacement[i + 2] - L'0') : 0;
+            if (two >= 1 && two < groupCount)
+            {
+                group = two;
+                used = 2;
+            }
+            else if (one >= 1 && one < groupCount)
+            {
+                group = one;
+            }
+        }
+
+        if (group == REGEX_NO_POSITION)
+        {
+            literal.text += ch;
+            continue;
+        }
+        if (!literal.text.empty())
+        {
+            parts.push_back(literal);
+            literal.text.clear();
+        }
+        ReplacementPart reference;
+        reference.group = group;
+        parts.push_back(reference);
+        i += used;
+    }
+
+    if (!useRegex)
+    {
+        literal.text = replacement;
+    }
+    if (!literal.text.empty())
+    {
+        parts.push_back(literal);
+    }
+    return parts;
+}
+
+// $& 以外のグループを参照するか（参照しなければキャプチャなしの照合で済む）
+static bool UsesSubgroups(const std::vector<ReplacementPart>& parts)
+{
+    for (const ReplacementPart& part : parts)
+    {
+        if (part.group != REGEX_NO_POSITION && part.group > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void AppendReplacement(std::wstring& out, const std::vector<ReplacementPart>& parts,
+                              const wchar_t* text, const std::vector<size_t>& groups)
+{
+    for (const ReplacementPart& part : parts)
+    {
+        if (part.group == REGEX_NO_POSITION)
+        {
+            out += part.text;
+        }
+        else if (part.group * 2 + 1 < groups.size() && groups[part.group * 2] != REGEX_NO_POSITION)
+        {
+            out.append(text + groups[part.group * 2], groups[part.group * 2 + 1] - groups[part.group * 2]);
+        }
+    }
+}
+
+// from から to までの文書の文字列を、改行を '\n' として追加する
+static void AppendDocumentRange(std::wstring& out, const CTextDocument* pDocument,
+                                const TextPosition& from, const TextPosition& to)
+{
+    for (size_t line = from.line; line <= to.line; ++line)
+    {
+        const std::wstring& lineText = pDocument->GetLine(line);
+        size_t first = (line == from.line) ? std::min(from.column, lineText.length()) : 0;
+        size_t last = (line == to.line) ? std::min(to.column, lineText.length()) : lineText.length();
+        if (last > first)
+        {
+            out.append(lineText, first, last - first);
+        }
+        if (line != to.line)
+        {
+            out += L'\n';
+        }
+    }
+}
+
+static void AppendReplacementLines(std::wstring& out, const std::vector<ReplacementPart>& parts,
+                                   const CTextDocument* pDocument, const std::vector<RegexLinePosition>& groups)
+{
+    for (const ReplacementPart& part : parts)
+    {
+        if (part.group == REGEX_NO_POSITION)
+        {
+            out += part.text;
+        }
+        else if (part.group * 2 + 1 < groups.size() && groups[part.group * 2].line != REGEX_NO_POSITION)
+        {
+            const RegexLinePosition& start = groups[part.group * 2];
+            const RegexLinePosition& end = groups[part.group * 2 + 1];
+            AppendDocumentRange(out, pDocument, TextPosition(start.line, start.column),
+                                TextPosition(end.line, end.column));
+        }
+    }
+}
+
+// 一括置換の置換を文書順に記録し、置換前の位置を置換後の位置に写す。
+// 写す位置は、それより前の置換をすべて記録し、後ろの置換をまだ記録していない時点で渡すこと
+class CReplacementMap
+{
+public:
+    void Add(const TextPosition& start, const TextPosition& end, const std::wstring& text)
+    {
+        const TextPosition newStart = Map(start);
+        m_oldEnd = end;
+        m_newEnd = GetInsertEndPosition(newStart, text);
+    }
+
+    TextPosition Map(const TextPosition& pos) const
+    {
+        // 直前の置換より後ろは平行移動するだけ
+        if (pos.line == m_oldEnd.line)
+        {
+            return TextPosition(m_newEnd.line, m_newEnd.column + (pos.column - m_oldEnd.column));
+        }
+        return TextPosition(pos.line - m_oldEnd.line + m_newEnd.line, pos.column);
+    }
+
+private:
+    TextPosition m_oldEnd;
+    TextPosition m_newEnd;
+};
+
+// 置き換え後の文字列を行に分けてブロックにする（\r は捨てる。ドキュメントへの挿入と同じ扱い）
+static void AppendLineBlock(std::vector<LineBlock>& blocks, size_t firstLine, size_t lineCount, const std::wstring& text)
+{
+    LineBlock block;
+    block.firstLine = firstLine;
+    block.lineCount = lineCount;
+    block.lines.push_back(std::wstring());
+
+    // 改行を含まない区間はまとめて追加する
+    size_t pos = 0;
+    for (;;)
+    {
+        size_t next = text.find_first_of(L"\r\n", pos);
+        block.lines.back().append(text, pos, (next == std::wstring::npos) ? std::wstring::npos : next - pos);
+        if (next == std::wstring::npos)
+        {
+            break;
+        }
+        if (text[next] == L'\n')
+        {
+            block.lines.push_back(std::wstring());
+        }
+        pos = next + 1;
+    }
+    blocks.push_back(std::move(block));
+}
+
+// 行範囲 [firstLine, lastLine) を置換した行ブロックを追加する。照合は FindMatchesInLines と同じ順に進める
+static size_t ReplaceInLines(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                             const std::vector<ReplacementPart>& parts, size_t firstLine, size_t lastLine,
+                             std::vector<LineBlock>& blocks)
+{
+    const bool useGroups = UsesSubgroups(parts);
+    std::vector<size_t> groups(2);
+    std::wstring newText;
+    size_t count = 0;
+
+    for (size_t line = firstLine; line < lastLine; ++line)
+    {
+        const std::wstring& lineText = pDocument->GetLine(line);
+        size_t searchPos = 0;
+        size_t copied = 0;
+        size_t lineMatches = 0;
+
+        while (searchPos < lineText.length())
+        {
+            bool found = useGroups ? pattern.MatchGroups(lineText.data(), lineText.length(), searchPos, groups)
+                                   : pattern.Match(lineText.data(), lineText.length(), searchPos, groups[0], groups[1]);
+            if (!found)
+            {
+                break;
+            }
+
+            const size_t startCol = groups[0];
+            const size_t endCol = groups[1];
+            if (lineMatches++ == 0)
+            {
+                newText.clear();
+            }
+            newText.append(lineText, copied, startCol - copied);
+            AppendReplacement(newText, parts, lineText.data(), groups);
+            copied = endCol;
+
+            searchPos = (endCol > startCol) ? endCol : endCol + 1;
+        }
+
+        if (lineMatches > 0)
+        {
+            newText.append(lineText, copied, std::wstring::npos);
+            AppendLineBlock(blocks, line, 1, newText);
+            count += lineMatches;
+        }
+    }
+    return count;
+}
+
+// 範囲内の一括置換（単一行モード）。同じ行にかかる範囲の置換は1つのブロックにまとめる。
+// pNewRanges には各範囲を置換後の位置に写したものを追加する
+static size_t ReplaceInRanges(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                              const std::vector<ReplacementPart>& parts, const std::vector<Selection>& ranges,
+                              std::vector<LineBlock>& blocks, std::vector<Selection>* pNewRanges)
+{
+    const bool useGroups = UsesSubgroups(parts);
+    std::vector<size_t> groups(2);
+    CReplacementMap map;
+    size_t count = 0;
+
+    bool open = false;
+    size_t openLine = 0;
+    size_t copied = 0;
+    std::wstring newText;
+    for (const Selection& range : ranges)
+    {
+        const TextPosition newStart = map.Map(range.start);
+        for (size_t line = range.start.line; line <= range.end.line; ++line)
+        {
+            const std::wstring& lineText = pDocument->GetLine(line);
+            size_t searchPos = (line == range.start.line) ? range.start.column : 0;
+            const size_t last = (line == range.end.line) ? range.end.column : lineText.length();
+
+            while (searchPos < last)
+            {
+                bool found = useGroups ? pattern.MatchGroups(lineText.data(), last, searchPos, groups)
+                                       : pattern.Match(lineText.data(), last, searchPos, groups[0], groups[1]);
+                if (!found)
+                {
+                    break;
+                }
+
+                const size_t startCol = groups[0];
+                const size_t endCol = groups[1];
+                if (open && openLine != line)
+                {
+                    const std::wstring& openText = pDocument->GetLine(openLine);
+                    newText.append(openText, copied, std::wstring::npos);
+                    AppendLineBlock(blocks, openLine, 1, newText);
+                    open = false;
+                }
+                if (!open)
+                {
+                    open = true;
+                    openLine = line;
+                    copied = 0;
+                    newText.clear();
+                }
+
+                newText.append(lineText, copied, startCol - copied);
+                const size_t replacementStart = newText.length();
+                AppendReplacement(newText, parts, lineText.data(), groups);
+                map.Add(TextPosition(line, startCol), TextPosition(line, endCol), newText.substr(replacementStart));
+                copied = endCol;
+                ++count;
+
+                searchPos = (endCol > startCol) ? endCol : endCol + 1;
+            }
+        }
+        if (pNewRanges)
+        {
+            pNewRanges->push_back(Selection(newStart, map.Map(range.end)));
+        }
+    }
+
+    if (open)
+    {
+        newText.append(pDocument->GetLine(openLine), copied, std::wstring::npos);
+        AppendLineBlock(blocks, openLine, 1, newText);
+    }
+    return count;
+}
+
+// 複数行モードの一括置換。範囲ごとに範囲の終点で打ち切って照合し、
+// 同じ行にかかる一致は1つのブロックにまとめる（ブロックどうしが重ならないように）
+static size_t ReplaceAcrossLines(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                                 const std::vector<ReplacementPart>& parts, const std::vector<Selection>& ranges,
+                                 std::vector<LineBlock>& blocks, std::vector<Selection>* pNewRanges)
+{
+    std::vector<RegexLinePosition> groups;
+    CReplacementMap map;
+    size_t count = 0;
+
+    bool open = false;
+    size_t firstLine = 0;
+    TextPosition copied;
+    std::wstring newText;
+    for (const Selection& range : ranges)
+    {
+        const TextPosition newStart = map.Map(range.start);
+        CRangeLineSource source(pDocument, range.end);
+        TextPosition pos = range.start;
+        while (!(range.end < pos) && pattern.MatchLinesGroups(source, pos.line, pos.column, groups))
+        {
+            SearchResult match;
+            match.start = TextPosition(groups[0].line, groups[0].column);
+            match.end = TextPosition(groups[1].line, groups[1].column);
+
+            if (open && match.start.line > copied.line)
+            {
+                AppendDocumentRange(newText, pDocument, copied, TextPosition(copied.line, std::wstring::npos));
+                AppendLineBlock(blocks, firstLine, copied.line - firstLine + 1, newText);
+                open = false;
+            }
+            if (!open)
+            {
+                open = true;
+                firstLine = match.start.line;
+                copied = TextPosition(match.start.line, 0);
+                newText.clear();
+            }
+
+            AppendDocumentRange(newText, pDocument, copied, match.start);
+            const size_t replacementStart = newText.length();
+            AppendReplacementLines(newText, parts, pDocument, groups);
+            map.Add(match.start, match.end, newText.substr(replacementStart));
+            copied = match.end;
+            ++count;
+
+            pos = GetNextSearchPosition(pDocument, match);
+        }
+        if (pNewRanges)
+        {
+            pNewRanges->push_back(Selection(newStart, map.Map(range.end)));
+        }
+    }
+
+    if (open)
+    {
+        AppendDocumentRange(newText, pDocument, copied, TextPosition(copied.line, std::wstring::npos));
+        AppendLineBlock(blocks, firstLine, copied.line - firstLine + 1, newText);
+    }
+    return count;
+}
 
 CSearchEngine::CSearchEngine()
+    : m_threadCount(0)
+    , m_pTrigramIndex(nullptr)
 {
 }
 
@@ -10,6 +750,21 @@ CSearchEngine::~CSearchEngine()
 {
 }
 
+CIncrementalSearch& CSearchEngine::BeginIncrementalSearch(const CTextDocument* pDocument)
+{
+    if (!m_pIncremental)
+    {
+        m_pIncremental = std::make_unique<CIncrementalSearch>();
+    }
+    m_pIncremental->Start(pDocument, m_options);
+    return *m_pIncremental;
+}
+
+void CSearchEngine::EndIncrementalSearch()
+{
+    m_pIncremental.reset();
+}
+
 bool CSearchEngine::Find(CTextDocument* pDocument, const std::wstring& pattern, 
                         const TextPosition& startPos, SearchResult& result)
 {
@@ -18,40 +773,78 @@ bool CSearchEngine::Find(CTextDocument* pDocument, const std::wstring& pattern,
         return false;
     }
 
-    m_currentPattern = pattern;
-    m_lastSearchPos = startPos;
+    m_currentPattern = pattern;
+    m_lastMatchStart = startPos;
+    m_lastSearchPos = startPos;
+    if (!PrepareSearch(pattern))
+    {
+        return false;
+    }
+
+    if (m_compiled.IsMultiLine())
+    {
+        TextPosition from = pDocument->ClampPosition(startPos);
+        bool found = FindMatchAcrossLines(pDocument, m_compiled, from, result);
+        if (!found && m_options.wrapAround && TextPosition() < from)
+        {
+            found = FindMatchAcrossLines(pDocument, m_compiled, TextPosition(), result) && result.start < from;
+        }
+        if (found)
+        {
+            m_lastMatchStart = result.start;
+            m_lastSearchPos = result.end;
+        }
+        return found;
+    }
+
+    // 索引があれば一致を含みうる行だけを調べる
+    std::vector<LineRange> candidates;
+    const bool narrowed = GetCandidateLines(pDocument, candidates);
 
     // 開始位置から検索
     for (size_t line = startPos.line; line < pDocument->GetLineCount(); ++line)
     {
+        if (narrowed && !SkipToCandidateLine(candidates, line))
+        {
+            break;
+        }
         const std::wstring& lineText = pDocument->GetLine(line);
         size_t startCol = (line == startPos.line) ? startPos.column : 0;
         size_t endCol = 0;
+        size_t editDistance = 0;
 
-        if (SearchInLine(lineText, pattern, startCol, endCol))
+        if (SearchInLine(lineText, startCol, endCol, editDistance))
         {
-            result.start = TextPosition(line, startCol);
-            result.end = TextPosition(line, endCol);
-            result.matchedText = lineText.substr(startCol, endCol - startCol);
+            result = SearchResult(TextPosition(line, startCol), TextPosition(line, endCol),
+                                  lineText.substr(startCol, endCol - startCol));
+            result.editDistance = editDistance;
+            m_lastMatchStart = result.start;
             m_lastSearchPos = result.end;
             return true;
         }
     }
 
-    // ラップアラウンド
-    if (m_options.wrapAround && startPos.line > 0)
+    // ラップアラウンド（開始位置の行は開始位置より前で始まる一致のみ）
+    if (m_options.wrapAround)
     {
-        for (size_t line = 0; line < startPos.line; ++line)
+        for (size_t line = 0; line <= startPos.line && line < pDocument->GetLineCount(); ++line)
         {
+            if (narrowed && (!SkipToCandidateLine(candidates, line) || line > startPos.line))
+            {
+                break;
+            }
             const std::wstring& lineText = pDocument->GetLine(line);
             size_t startCol = 0;
             size_t endCol = 0;
+            size_t editDistance = 0;
 
-            if (SearchInLine(lineText, pattern, startCol, endCol))
+            if (SearchInLine(lineText, startCol, endCol, editDistance) &&
+                (line < startPos.line || startCol < startPos.column))
             {
-                result.start = TextPosition(line, startCol);
-                result.end = TextPosition(line, endCol);
-                result.matchedText = lineText.substr(startCol, endCol - startCol);
+                result = SearchResult(TextPosition(line, startCol), TextPosition(line, endCol),
+                                      lineText.substr(startCol, endCol - startCol));
+                result.editDistance = editDistance;
+                m_lastMatchStart = result.start;
                 m_lastSearchPos = result.end;
                 return true;
             }
@@ -63,13 +856,16 @@ bool CSearchEngine::Find(CTextDocument* pDocument, const std::wstring& pattern,
 
 bool CSearchEngine::FindNext(CTextDocument* pDocument, SearchResult& result)
 {
-    if (m_currentPattern.empty())
+    if (!pDocument || m_currentPattern.empty())
     {
         return false;
     }
 
-    TextPosition nextPos = m_lastSearchPos;
-    nextPos.column++; // 次の位置から検索
+    // 直前の一致の終点から検索する（空一致だった場合のみ1文字進める）
+    SearchResult last;
+    last.start = m_lastMatchStart;
+    last.end = m_lastSearchPos;
+    TextPosition nextPos = GetNextSearchPosition(pDocument, last);
 
     return Find(pDocument, m_currentPattern, nextPos, result);
 }
@@ -81,40 +877,66 @@ bool CSearchEngine::FindPrevious(CTextDocument* pDocument, SearchResult& result)
         return false;
     }
 
-    // 逆方向検索（簡易実装）
-    TextPosition searchPos = m_lastSearchPos;
-    
-    if (searchPos.column > 0)
+    return FindBackward(pDocument, m_currentPattern, m_lastMatchStart, result);
+}
+
+bool CSearchEngine::FindBackward(CTextDocument* pDocument, const std::wstring& pattern,
+                                 const TextPosition& startPos, SearchResult& result)
+{
+    if (!pDocument || pattern.empty())
     {
-        searchPos.column--;
+        return false;
     }
-    else if (searchPos.line > 0)
+
+    m_currentPattern = pattern;
+    if (!PrepareSearch(pattern))
     {
-        searchPos.line--;
-        searchPos.column = pDocument->GetLine(searchPos.line).length();
+        return false;
     }
-    else
+
+    TextPosition from = pDocument->ClampPosition(startPos);
+    bool found = m_compiled.IsMultiLine() ? FindLastAcrossLines(pDocument, from, result)
+                                          : FindLastInLines(pDocument, from, result);
+    if (found)
     {
-        return false;
+        m_lastMatchStart = result.start;
+        m_lastSearchPos = result.end;
     }
+    return found;
+}
+
+bool CSearchEngine::FindLastInLines(CTextDocument* pDocument, const TextPosition& from, SearchResult& result)
+{
+    size_t matchStart = 0;
+    size_t matchEnd = 0;
+    size_t editDistance = 0;
 
-    // 現在位置から前方を検索
-    for (int line = static_cast<int>(searchPos.line); line >= 0; --line)
+    // 開始位置の行から先頭の行へ向かって、各行を末尾側から照合する
+    for (size_t line = from.line + 1; line-- > 0;)
     {
         const std::wstring& lineText = pDocument->GetLine(line);
-        
-        // 行内を後ろから検索
-        for (int col = static_cast<int>(lineText.length()) - 1; col >= 0; --col)
+        size_t limit = (line == from.line) ? from.column : lineText.length() + 1;
+        if (m_compiled.MatchLast(lineText.data(), lineText.length(), limit, matchStart, matchEnd, editDistance))
         {
-            size_t startCol = static_cast<size_t>(col);
-            size_t endCol = 0;
+            result = SearchResult(TextPosition(line, matchStart), TextPosition(line, matchEnd),
+                                  lineText.substr(matchStart, matchEnd - matchStart));
+            result.editDistance = editDistance;
+            return true;
+        }
+    }
 
-            if (SearchInLine(lineText, m_currentPattern, startCol, endCol))
+    // ラップアラウンド（末尾の行から開始位置の行まで。開始位置より前の一致は上で調べ済み）
+    if (m_options.wrapAround)
+    {
+        for (size_t line = pDocument->GetLineCount(); line-- > from.line;)
+        {
+            const std::wstring& lineText = pDocument->GetLine(line);
+            if (m_compiled.MatchLast(lineText.data(), lineText.length(), lineText.length() + 1,
+                                     matchStart, matchEnd, editDistance))
             {
-                result.start = TextPosition(line, startCol);
-                result.end = TextPosition(line, endCol);
-                result.matchedText = lineText.substr(startCol, endCol - startCol);
-                m_lastSearchPos = result.start;
+                result = SearchResult(TextPosition(line, matchStart), TextPosition(line, matchEnd),
+                                      lineText.substr(matchStart, matchEnd - matchStart));
+                result.editDistance = editDistance;
                 return true;
             }
         }
@@ -123,6 +945,35 @@ bool CSearchEngine::FindPrevious(CTextDocument* pDocument, SearchResult& result)
     return false;
 }
 
+bool CSearchEngine::FindLastAcrossLines(CTextDocument* pDocument, const TextPosition& from, SearchResult& result)
+{
+    // 行をまたぐ一致は逆向きに照合できないため、先頭から前方照合して直前の一致を探す
+    bool found = false;
+    TextPosition pos;
+    SearchResult candidate;
+    bool more = FindMatchAcrossLines(pDocument, m_compiled, pos, candidate);
+    while (more && candidate.start < from)
+    {
+        result = candidate;
+        found = true;
+        pos = GetNextSearchPosition(pDocument, candidate);
+        more = FindMatchAcrossLines(pDocument, m_compiled, pos, candidate);
+    }
+
+    // ラップアラウンドでは文書の最後の一致
+    if (!found && m_options.wrapAround)
+    {
+        while (more)
+        {
+            result = candidate;
+            found = true;
+            pos = GetNextSearchPosition(pDocument, candidate);
+            more = FindMatchAcrossLines(pDocument, m_compiled, pos, candidate);
+        }
+    }
+    return found;
+}
+
 std::vector<SearchResult> CSearchEngine::FindAll(CTextDocument* pDocument, const std::wstring& pattern)
 {
     std::vector<SearchResult> results;
@@ -133,35 +984,293 @@ std::vector<SearchResult> CSearchEngine::FindAll(CTextDocument* pDocument, const
     }
 
     m_currentPattern = pattern;
+    if (!PrepareSearch(pattern))
+    {
+        return results;
+    }
 
-    for (size_t line = 0; line < pDocument->GetLineCount(); ++line)
+    if (m_compiled.IsMultiLine())
     {
-        const std::wstring& lineText = pDocument->GetLine(line);
-        size_t searchPos = 0;
+        SearchResult result;
+        TextPosition pos;
+        while (FindMatchAcrossLines(pDocument, m_compiled, pos, result))
+        {
+            results.push_back(result);
+            pos = GetNextSearchPosition(pDocument, result);
+        }
+        return results;
+    }
 
-        while (searchPos < lineText.length())
+    std::vector<LineRange> candidates;
+    const std::vector<LineRange>* pCandidates = GetCandidateLines(pDocument, candidates) ? &candidates : nullptr;
+
+    const size_t lineCount = pDocument->GetLineCount();
+    const size_t rangeCount = GetLineRangeCount(lineCount);
+    if (rangeCount <= 1)
+    {
+        ForEachCandidateRange(pCandidates, 0, lineCount, [&](size_t firstLine, size_t lastLine)
+        {
+            FindMatchesInLines(pDocument, m_compiled, firstLine, lastLine, results);
+        });
+        return results;
+    }
+
+    std::vector<std::vector<SearchResult>> partial(rangeCount);
+    const CTextDocument* pView = pDocument;
+    ForEachLineRange(lineCount, rangeCount,
+        [&](const CCompiledPattern& pattern, size_t range, size_t firstLine, size_t lastLine)
+    {
+        ForEachCandidateRange(pCandidates, firstLine, lastLine, [&](size_t first, size_t last)
+        {
+            FindMatchesInLines(pView, pattern, first, last, partial[range]);
+        });
+    });
+
+    MoveConcatenated(partial, results);
+    return results;
+}
+
+std::vector<SearchResult> CSearchEngine::FindAllPatterns(const CTextDocument* pDocument,
+                                                         const std::vector<std::wstring>& patterns)
+{
+    std::vector<SearchResult> results;
+    if (!pDocument)
+    {
+        return results;
+    }
+
+    // パターンの集合とオプションが前回と同じなら構築済みのオートマトンを使い回す
+    if (!m_multiMatcher.IsCompiledFor(patterns, m_options.caseSensitive, m_options.wholeWord) &&
+        !m_multiMatcher.Compile(patterns, m_options.caseSensitive, m_options.wholeWord))
+    {
+        return results;
+    }
+
+    // オートマトンは読み取り専用なので、行範囲ごとにコピーせず共有する
+    const size_t lineCount = pDocument->GetLineCount();
+    const size_t rangeCount = GetLineRangeCount(lineCount);
+    const CMultiPatternMatcher& matcher = m_multiMatcher;
+    std::vector<std::vector<SearchResult>> partial(rangeCount);
+    ForEachLineRange(lineCount, rangeCount,
+        [&](const CCompiledPattern&, size_t range, size_t firstLine, size_t lastLine)
+    {
+        for (size_t line = firstLine; line < lastLine; ++line)
         {
-            size_t startCol = searchPos;
+            const std::wstring& lineText = pDocument->GetLine(line);
+            size_t searchPos = 0;
+            size_t startCol = 0;
             size_t endCol = 0;
+            size_t patternIndex = 0;
+            while (matcher.Find(lineText.data(), lineText.length(), searchPos, startCol, endCol, patternIndex))
+            {
+                SearchResult result(TextPosition(line, startCol), TextPosition(line, endCol),
+                                    lineText.substr(startCol, endCol - startCol));
+                result.patternIndex = patternIndex;
+                partial[range].push_back(result);
+                searchPos = endCol;
+            }
+        }
+    });
+
+    MoveConcatenated(partial, results);
+    return results;
+}
+
+bool CSearchEngine::FindStream(const CTextDocument* pDocument, const std::wstring& pattern,
+                               const MatchStreamOptions& options, MatchStreamSummary& summary)
+{
+    summary = MatchStreamSummary();
+    if (!pDocument || pattern.empty())
+    {
+        return false;
+    }
+
+    m_currentPattern = pattern;
+    if (!PrepareSearch(pattern))
+    {
+        return false;
+    }
+
+    if (m_compiled.IsMultiLine())
+    {
+        StreamMultiLine(pDocument, options, summary);
+        return true;
+    }
+
+    // 行をまとまりごとに照合し、まとまりの順に通知する。
+    // 並列化する場合はスレッド数分のまとまりを同時に照合し、パターンの複製はスレッドごとに使い回す
+    std::vector<LineRange> candidates;
+    const std::vector<LineRange>* pCandidates = GetCandidateLines(pDocument, candidates) ? &candidates : nullptr;
+
+    const size_t lineCount = pDocument->GetLineCount();
+    const size_t chunksPerStep = (GetLineRangeCount(lineCount) > 1)
+        ? (m_threadCount ? m_threadCount : CWorkerPool::GetShared().GetThreadCount() + 1)
+        : 1;
+    std::vector<CCompiledPattern> copies(chunksPerStep - 1, m_compiled);
+    std::vector<std::vector<MatchSpan>> chunks(chunksPerStep);
+    std::vector<size_t> counts(chunksPerStep, 0);
+
+    size_t line = 0;
+    while (line < lineCount)
+    {
+        if (IsCancelRequested(options))
+        {
+            summary.cancelled = true;
+            return true;
+        }
 
-            if (SearchInLine(lineText, pattern, startCol, endCol))
+        const size_t stepEnd = std::min(lineCount, line + chunksPerStep * STREAM_CHUNK_LINES);
+        const size_t chunkCount = (stepEnd - line + STREAM_CHUNK_LINES - 1) / STREAM_CHUNK_LINES;
+        auto scanChunk = [&](size_t chunk)
+        {
+            const CCompiledPattern& compiled = (chunk == 0) ? m_compiled : copies[chunk - 1];
+            const size_t firstLine = line + chunk * STREAM_CHUNK_LINES;
+            const size_t lastLine = std::min(stepEnd, firstLine + STREAM_CHUNK_LINES);
+            chunks[chunk].clear();
+            counts[chunk] = 0;
+            ForEachCandidateRange(pCandidates, firstLine, lastLine, [&](size_t first, size_t last)
             {
-                SearchResult result;
-                result.start = TextPosition(line, startCol);
-                result.end = TextPosition(line, endCol);
-                result.matchedText = lineText.substr(startCol, endCol - startCol);
-                results.push_back(result);
-                
-                searchPos = endCol + 1;
+                counts[chunk] += FindSpansInLines(pDocument, compiled, first, last,
+                                                  options.countOnly ? nullptr : &chunks[chunk]);
+            });
+        };
+        if (chunkCount <= 1)
+        {
+            scanChunk(0);
+        }
+        else
+        {
+            CWorkerPool::GetShared().ParallelFor(chunkCount, scanChunk, chunkCount);
+        }
+
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            if (!EmitMatches(options, summary, chunks[chunk].data(), counts[chunk]))
+            {
+                summary.scannedLines = std::min(stepEnd, line + (chunk + 1) * STREAM_CHUNK_LINES);
+                return true;
+            }
+        }
+
+        line = stepEnd;
+        summary.scannedLines = line;
+        if (options.onProgress)
+        {
+            options.onProgress(line, lineCount, summary.matchCount);
+        }
+    }
+
+    summary.completed = true;
+    return true;
+}
+
+void CSearchEngine::StreamMultiLine(const CTextDocument* pDocument, const MatchStreamOptions& options,
+                                    MatchStreamSummary& summary)
+{
+    // 一致がまとまった数になるか、走査が一定の行数進むたびに通知する
+    CDocumentLineSource source(pDocument);
+    const size_t lineCount = pDocument->GetLineCount();
+    std::vector<MatchSpan> batch;
+    size_t batchCount = 0;
+    size_t nextProgressLine = STREAM_CHUNK_LINES;
+    SearchResult result;
+    RegexLinePosition matchStart;
+    RegexLinePosition matchEnd;
+    TextPosition pos;
+
+    for (;;)
+    {
+        if (IsCancelRequested(options))
+        {
+            summary.cancelled = true;
+            summary.scannedLines = std::min(pos.line, lineCount);
+            return;
+        }
+        if (!m_compiled.MatchLines(source, pos.line, pos.column, matchStart, matchEnd))
+        {
+            break;
+        }
+
+        result.start = TextPosition(matchStart.line, matchStart.column);
+        result.end = TextPosition(matchEnd.line, matchEnd.column);
+        ++batchCount;
+        if (!options.countOnly)
+        {
+            MatchSpan span;
+            span.line = result.start.line;
+            span.column = result.start.column;
+            span.length = GetSpanLength(pDocument, result.start, result.end);
+            batch.push_back(span);
+        }
+        pos = GetNextSearchPosition(pDocument, result);
+
+        const bool reachesLimit = options.maxResults != 0 && summary.matchCount + batchCount >= options.maxResults;
+        if (batchCount >= STREAM_BATCH_MATCHES || result.end.line >= nextProgressLine || reachesLimit)
+        {
+            summary.scannedLines = std::min(pos.line, lineCount);
+            if (!EmitMatches(options, summary, batch.data(), batchCount))
+            {
+                return;
             }
-            else
+            batch.clear();
+            batchCount = 0;
+            nextProgressLine = result.end.line + STREAM_CHUNK_LINES;
+            if (options.onProgress)
             {
-                break;
+                options.onProgress(summary.scannedLines, lineCount, summary.matchCount);
             }
         }
     }
 
-    return results;
+    summary.scannedLines = lineCount;
+    if (batchCount > 0 && !EmitMatches(options, summary, batch.data(), batchCount))
+    {
+        return;
+    }
+    summary.completed = true;
+    if (options.onProgress)
+    {
+        options.onProgress(lineCount, lineCount, summary.matchCount);
+    }
+}
+
+bool CSearchEngine::GetCandidateLines(const CTextDocument* pDocument, std::vector<LineRange>& ranges) const
+{
+    // 別のドキュメントの索引は使わない
+    return m_pTrigramIndex && m_pTrigramIndex->GetDocument() == pDocument &&
+           m_pTrigramIndex->GetCandidateLines(m_compiled, ranges);
+}
+
+size_t CSearchEngine::GetLineRangeCount(size_t lineCount) const
+{
+    // 行範囲をスレッド数より細かく分割し、空いたスレッドが次の範囲を取る
+    size_t concurrency = m_threadCount ? m_threadCount : CWorkerPool::GetShared().GetThreadCount() + 1;
+    if (concurrency <= 1 || lineCount < PARALLEL_MIN_LINES)
+    {
+        return 1;
+    }
+    size_t rangeCount = std::min(concurrency * PARALLEL_CHUNKS_PER_THREAD, lineCount / PARALLEL_MIN_LINES_PER_CHUNK);
+    return std::max<size_t>(rangeCount, 1);
+}
+
+void CSearchEngine::ForEachLineRange(size_t lineCount, size_t rangeCount, const LineRangeTask& task)
+{
+    if (rangeCount <= 1)
+    {
+        task(m_compiled, 0, 0, lineCount);
+        return;
+    }
+
+    size_t concurrency = m_threadCount ? m_threadCount : CWorkerPool::GetShared().GetThreadCount() + 1;
+    const CCompiledPattern& compiled = m_compiled;
+    CWorkerPool::GetShared().ParallelFor(rangeCount, [&](size_t range)
+    {
+        // 照合の作業領域（DFAキャッシュなど）はコピーごとに独立している
+        CCompiledPattern pattern(compiled);
+        size_t firstLine = lineCount * range / rangeCount;
+        size_t lastLine = lineCount * (range + 1) / rangeCount;
+        task(pattern, range, firstLine, lastLine);
+    }, concurrency);
 }
 
 bool CSearchEngine::Replace(CTextDocument* pDocument, const SearchResult& result, const std::wstring& replacement)
@@ -171,117 +1280,254 @@ bool CSearchEngine::Replace(CTextDocument* pDocument, const SearchResult& result
         return false;
     }
 
-    pDocument->ReplaceRange(result.start, result.end, replacement);
+    pDocument->ReplaceRange(result.start, result.end, ExpandReplacement(pDocument, result, replacement));
     return true;
 }
 
-int CSearchEngine::ReplaceAll(CTextDocument* pDocument, const std::wstring& pattern, const std::wstring& replacement)
+std::wstring CSearchEngine::ExpandReplacement(const CTextDocument* pDocument, const SearchResult& result,
+                                              const std::wstring& replacement)
 {
-    std::vector<SearchResult> results = FindAll(pDocument, pattern);
-    
-    // 後ろから置換して位置ずれを防ぐ
-    for (auto it = results.rbegin(); it != results.rend(); ++it)
+    if (!pDocument || !m_options.useRegex || replacement.find(L'$') == std::wstring::npos ||
+        m_currentPattern.empty() || !PrepareSearch(m_currentPattern))
     {
-        Replace(pDocument, *it, replacement);
+        return replacement;
     }
 
-    return static_cast<int>(results.size());
+    // 一致の位置で照合し直してグループの範囲を求める（位置がずれていれば展開しない）
+    std::vector<ReplacementPart> parts = ParseReplacement(replacement, true, m_compiled.GetGroupCount());
+    std::wstring expanded;
+    if (m_compiled.IsMultiLine())
+    {
+        CDocumentLineSource source(pDocument);
+        std::vector<RegexLinePosition> groups;
+        if (!m_compiled.MatchLinesGroups(source, result.start.line, result.start.column, groups) ||
+            groups[0].line != result.start.line || groups[0].column != result.start.column)
+        {
+            return replacement;
+        }
+        AppendReplacementLines(expanded, parts, pDocument, groups);
+        return expanded;
+    }
+
+    if (result.start.line >= pDocument->GetLineCount())
+    {
+        return replacement;
+    }
+    const std::wstring& lineText = pDocument->GetLine(result.start.line);
+    std::vector<size_t> groups;
+    if (!m_compiled.MatchGroups(lineText.data(), lineText.length(), result.start.column, groups) ||
+        groups[0] != result.start.column)
+    {
+        return replacement;
+    }
+    AppendReplacement(expanded, parts, lineText.data(), groups);
+    return expanded;
 }
 
-bool CSearchEngine::SearchInLine(const std::wstring& line, const std::wstring& pattern, 
-                                size_t& startCol, size_t& endCol)
+int CSearchEngine::ReplaceAll(CTextDocument* pDocument, const std::wstring& pattern, const std::wstring& replacement)
 {
-    if (m_options.useRegex)
+    std::vector<LineBlock> blocks;
+    int replaced = BuildReplaceAll(pDocument, pattern, replacement, blocks);
+    if (pDocument && !blocks.empty())
     {
-        // 正規表現検索
-        std::wstring searchText = line.substr(startCol);
-        size_t relativeStart = 0;
-        size_t relativeEnd = 0;
+        pDocument->SwapLineBlocks(blocks);
+    }
+    return replaced;
+}
 
-        if (SearchWithRegex(searchText, pattern, relativeStart, relativeEnd))
-        {
-            startCol += relativeStart;
-            endCol = startCol + (relativeEnd - relativeStart);
-            return true;
-        }
-        return false;
+int CSearchEngine::BuildReplaceAll(const CTextDocument* pDocument, const std::wstring& pattern,
+                                   const std::wstring& replacement, std::vector<LineBlock>& blocks)
+{
+    blocks.clear();
+    if (!pDocument || pattern.empty())
+    {
+        return 0;
     }
-    else
+
+    m_currentPattern = pattern;
+    if (!PrepareSearch(pattern))
     {
-        // 通常の検索
-        std::wstring searchPattern = pattern;
-        std::wstring searchText = line.substr(startCol);
+        return 0;
+    }
 
-        // 大文字小文字を区別しない場合
-        if (!m_options.caseSensitive)
-        {
-            std::transform(searchPattern.begin(), searchPattern.end(), searchPattern.begin(), ::towlower);
-            std::transform(searchText.begin(), searchText.end(), searchText.begin(), ::towlower);
-        }
+    // 置換後の行を1回の走査で組み立てる（一致ごとに ReplaceRange で行を詰め直さない）
+    std::vector<ReplacementPart> parts = ParseReplacement(replacement, m_options.useRegex, m_compiled.GetGroupCount());
+    if (m_compiled.IsMultiLine())
+    {
+        const size_t lastLine = pDocument->GetLineCount() - 1;
+        const std::vector<Selection> wholeDocument(1,
+            Selection(TextPosition(), TextPosition(lastLine, pDocument->GetLine(lastLine).length())));
+        return static_cast<int>(ReplaceAcrossLines(pDocument, m_compiled, parts, wholeDocument, blocks, nullptr));
+    }
 
-        size_t pos = searchText.find(searchPattern);
-        if (pos != std::wstring::npos)
-        {
-            startCol += pos;
-            endCol = startCol + pattern.length();
+    const size_t lineCount = pDocument->GetLineCount();
+    const size_t rangeCount = GetLineRangeCount(lineCount);
+    std::vector<std::vector<LineBlock>> partial(rangeCount);
+    std::vector<size_t> counts(rangeCount, 0);
+    ForEachLineRange(lineCount, rangeCount,
+        [&](const CCompiledPattern& compiled, size_t range, size_t firstLine, size_t lastLine)
+    {
+        counts[range] = ReplaceInLines(pDocument, compiled, parts, firstLine, lastLine, partial[range]);
+    });
 
-            // 単語単位検索のチェック
-            if (m_options.wholeWord)
-            {
-                bool startOk = (startCol == 0) || !iswalnum(line[startCol - 1]);
-                bool endOk = (endCol >= line.length()) || !iswalnum(line[endCol]);
-                
-                if (!startOk || !endOk)
-                {
-                    startCol = endCol;
-                    return SearchInLine(line, pattern, startCol, endCol);
-                }
-            }
+    size_t replaced = 0;
+    for (size_t count : counts)
+    {
+        replaced += count;
+    }
+    MoveConcatenated(partial, blocks);
+    return static_cast<int>(replaced);
+}
 
-            return true;
-        }
+bool CSearchEngine::FindInScope(const CTextDocument* pDocument, const std::wstring& pattern,
+                                const CSearchScope& scope, const TextPosition& startPos, SearchResult& result)
+{
+    if (!pDocument || pattern.empty())
+    {
+        return false;
     }
 
-    return false;
+    m_currentPattern = pattern;
+    m_lastMatchStart = startPos;
+    m_lastSearchPos = startPos;
+    if (!PrepareSearch(pattern))
+    {
+        return false;
+    }
+
+    const std::vector<Selection> ranges = ClampRanges(pDocument, scope.GetRanges());
+    const TextPosition from = pDocument->ClampPosition(startPos);
+    bool found = FindFirstInRanges(pDocument, m_compiled, ranges, from, result);
+    if (!found && m_options.wrapAround)
+    {
+        // 最初の範囲から、開始位置より前で始まる一致だけを探す
+        found = FindFirstInRanges(pDocument, m_compiled, ranges, TextPosition(), result) && result.start < from;
+    }
+    if (found)
+    {
+        m_lastMatchStart = result.start;
+        m_lastSearchPos = result.end;
+    }
+    return found;
 }
 
-bool CSearchEngine::SearchWithRegex(const std::wstring& text, const std::wstring& pattern,
-                                   size_t& start, size_t& end)
+std::vector<SearchResult> CSearchEngine::FindAllInScope(const CTextDocument* pDocument, const std::wstring& pattern,
+                                                        const CSearchScope& scope)
 {
-    try
+    std::vector<SearchResult> results;
+    if (!pDocument || pattern.empty())
+    {
+        return results;
+    }
+
+    m_currentPattern = pattern;
+    if (!PrepareSearch(pattern))
+    {
+        return results;
+    }
+
+    const std::vector<Selection> ranges = ClampRanges(pDocument, scope.GetRanges());
+    for (const Selection& range : ranges)
     {
-        std::wregex::flag_type flags = std::wregex::ECMAScript;
-        if (!m_options.caseSensitive)
+        if (m_compiled.IsMultiLine())
         {
-            flags |= std::wregex::icase;
+            CRangeLineSource source(pDocument, range.end);
+            RegexLinePosition matchStart;
+            RegexLinePosition matchEnd;
+            TextPosition pos = range.start;
+            while (!(range.end < pos) && m_compiled.MatchLines(source, pos.line, pos.column, matchStart, matchEnd))
+            {
+                SearchResult result;
+                result.start = TextPosition(matchStart.line, matchStart.column);
+                result.end = TextPosition(matchEnd.line, matchEnd.column);
+                result.matchedText = pDocument->GetTextRange(result.start, result.end);
+                results.push_back(result);
+                pos = GetNextSearchPosition(pDocument, result);
+            }
+            continue;
         }
 
-        std::wstring actualPattern = pattern;
-        if (m_options.wholeWord)
+        for (size_t line = range.start.line; line <= range.end.line; ++line)
         {
-            actualPattern = CreateWordBoundaryPattern(pattern);
+            const std::wstring& lineText = pDocument->GetLine(line);
+            const size_t first = (line == range.start.line) ? range.start.column : 0;
+            const size_t last = (line == range.end.line) ? range.end.column : lineText.length();
+            VisitMatchesInSegment(m_compiled, lineText, first, last,
+                [&](size_t startCol, size_t endCol, size_t editDistance)
+            {
+                SearchResult result(TextPosition(line, startCol), TextPosition(line, endCol),
+                                    lineText.substr(startCol, endCol - startCol));
+                result.editDistance = editDistance;
+                results.push_back(result);
+                return true;
+            });
         }
+    }
+    return results;
+}
 
-        std::wregex regex(actualPattern, flags);
-        std::wsmatch match;
+int CSearchEngine::BuildReplaceAllInScope(const CTextDocument* pDocument, const std::wstring& pattern,
+                                          const std::wstring& replacement, const CSearchScope& scope,
+                                          std::vector<LineBlock>& blocks, std::vector<Selection>& newRanges)
+{
+    blocks.clear();
+    newRanges = scope.GetRanges();
+    if (!pDocument || pattern.empty())
+    {
+        return 0;
+    }
 
-        if (std::regex_search(text, match, regex))
-        {
-            start = match.position();
-            end = start + match.length();
-            return true;
-        }
+    m_currentPattern = pattern;
+    if (!PrepareSearch(pattern))
+    {
+        return 0;
     }
-    catch (const std::regex_error&)
+
+    std::vector<ReplacementPart> parts = ParseReplacement(replacement, m_options.useRegex, m_compiled.GetGroupCount());
+    const std::vector<Selection> ranges = ClampRanges(pDocument, scope.GetRanges());
+    newRanges.clear();
+    size_t replaced = m_compiled.IsMultiLine()
+        ? ReplaceAcrossLines(pDocument, m_compiled, parts, ranges, blocks, &newRanges)
+        : ReplaceInRanges(pDocument, m_compiled, parts, ranges, blocks, &newRanges);
+    return static_cast<int>(replaced);
+}
+
+int CSearchEngine::ReplaceAllInScope(CTextDocument* pDocument, const std::wstring& pattern,
+                                     const std::wstring& replacement, CSearchScope& scope)
+{
+    std::vector<LineBlock> blocks;
+    std::vector<Selection> newRanges;
+    int replaced = BuildReplaceAllInScope(pDocument, pattern, replacement, scope, blocks, newRanges);
+    if (pDocument && !blocks.empty())
     {
-        // 正規表現エラーの場合は失敗
-        return false;
+        pDocument->SwapLineBlocks(blocks);
+        // 通知は各ブロックの変わった部分だけだが、同じ行の複数の一致はその間の範囲の端ごと1つの削除・挿入になり、
+        // 範囲が縮んだり残ったりするので、求めておいた置換後の範囲に置き直す
+        scope.SetRanges(newRanges);
     }
+    return replaced;
+}
 
-    return false;
+bool CSearchEngine::PrepareSearch(const std::wstring& pattern)
+{
+    // パターンと照合オプションが前回と同じなら構築済みのものを使い回す
+    if (!m_compiled.IsCompiledFor(pattern, m_options))
+    {
+        m_compiled.Compile(pattern, m_options);
+    }
+    return m_compiled.IsValid();
 }
 
-std::wstring CSearchEngine::CreateWordBoundaryPattern(const std::wstring& pattern)
+bool CSearchEngine::SearchInLine(const std::wstring& line, size_t& startCol, size_t& endCol, size_t& editDistance)
 {
-    return L"\\b" + pattern + L"\\b";
+    // 行をコピーせずにその場で照合
+    size_t matchStart = 0;
+    size_t matchEnd = 0;
+    if (m_compiled.Match(line.data(), line.length(), startCol, matchStart, matchEnd, editDistance))
+    {
+        startCol = matchStart;
+        endCol = matchEnd;
+        return true;
+    }
+    return false;
 }
@@ -1,26 +1,15 @@
 // SearchEngine.h - 検索・置換エンジン（正規表現対応）
 #pragma once
-#include <windows.h>
 #include <string>
 #include <vector>
-#include <regex>
+#include <memory>
+#include <functional>
+#include <atomic>
 #include "TextDocument.h"
-
-// 検索オプション
-struct SearchOptions
-{
-    bool useRegex;
-    bool caseSensitive;
-    bool wholeWord;
-    bool wrapAround;
-
-    SearchOptions()
-        : useRegex(false)
-        , caseSensitive(false)
-        , wholeWord(false)
-        , wrapAround(true)
-    {}
-};
+#include "SearchPattern.h"
+#include "MultiPatternMatcher.h"
+#include "TrigramIndex.h"
+#include "SearchScope.h"
 
 // 検索結果
 struct SearchResult
@@ -28,12 +17,92 @@ struct SearchResult
     TextPosition start;
     TextPosition end;
     std::wstring matchedText;
+    size_t patternIndex;    // FindAllPatterns で一致したパターンの番号（それ以外は0）
+    size_t editDistance;    // あいまい検索でのパターンとの編集距離（それ以外は0）
 
-    SearchResult() {}
+    SearchResult() : patternIndex(0), editDistance(0) {}
     SearchResult(const TextPosition& s, const TextPosition& e, const std::wstring& text)
-        : start(s), end(e), matchedText(text) {}
+        : start(s), end(e), matchedText(text), patternIndex(0), editDistance(0) {}
+};
+
+// 位置だけを持つ軽量な一致（一致文字列は MaterializeMatch で必要なときに取り出す）
+struct MatchSpan
+{
+    size_t line;
+    size_t column;
+    size_t length;          // 一致の文字数。行をまたぐ一致では行の区切りを1文字と数える
+    size_t editDistance;    // あいまい検索でのパターンとの編集距離（それ以外は0）
+
+    MatchSpan() : line(0), column(0), length(0), editDistance(0) {}
+};
+
+// 一致の終点と、文字列を含む SearchResult（FindAll の結果と同じ内容）
+TextPosition GetMatchEnd(const CTextDocument* pDocument, const MatchSpan& match);
+SearchResult MaterializeMatch(const CTextDocument* pDocument, const MatchSpan& match);
+
+// 検索の取り消し要求。UIスレッドなどから Cancel し、検索側は処理の区切りごとに確認する
+class CSearchCancelToken
+{
+public:
+    CSearchCancelToken() : m_cancelled(false) {}
+
+    void Cancel() { m_cancelled = true; }
+    void Reset() { m_cancelled = false; }
+    bool IsCancelled() const { return m_cancelled; }
+
+private:
+    std::atomic<bool> m_cancelled;
+};
+
+// FindStream の指定。コールバックはすべて FindStream を呼んだスレッドで呼ばれる
+struct MatchStreamOptions
+{
+    size_t maxResults;                  // この数に達したら打ち切る（0なら無制限）
+    bool countOnly;                     // 一致を記録せずに数えるだけ（onMatches は呼ばない）
+    const CSearchCancelToken* pCancel;  // 取り消し要求（nullptrなら取り消さない）
+
+    // 文書順の一致のまとまり。falseを返すとそこで打ち切る
+    std::function<bool(const MatchSpan* matches, size_t count)> onMatches;
+    // 走査済みの行数と、それまでの一致数
+    std::function<void(size_t scannedLines, size_t totalLines, size_t matchCount)> onProgress;
+
+    MatchStreamOptions()
+        : maxResults(0)
+        , countOnly(false)
+        , pCancel(nullptr)
+    {}
 };
 
+// FindStream の結果
+struct MatchStreamSummary
+{
+    size_t matchCount;      // 通知した（countOnly では数えた）一致数
+    size_t scannedLines;
+    bool completed;         // 最後まで走査した
+    bool cancelled;         // 取り消し要求か onMatches の戻り値で打ち切った
+    bool limitReached;      // maxResults に達して打ち切った
+
+    MatchStreamSummary()
+        : matchCount(0)
+        , scannedLines(0)
+        , completed(false)
+        , cancelled(false)
+        , limitReached(false)
+    {}
+};
+
+// 照合の下請け（CSearchEngine とインクリメンタル検索で共有）
+// 行範囲 [firstLine, lastLine) の一致を順に results へ追加する（単一行モード）
+void FindMatchesInLines(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                        size_t firstLine, size_t lastLine, std::vector<SearchResult>& results);
+// 複数行モード: from 以降の最初の一致（行をまたぐ）
+bool FindMatchAcrossLines(const CTextDocument* pDocument, const CCompiledPattern& pattern,
+                          const TextPosition& from, SearchResult& result);
+// 一致の直後の検索開始位置（空一致なら1文字、行末なら次の行頭へ進める）
+TextPosition GetNextSearchPosition(const CTextDocument* pDocument, const SearchResult& result);
+
+class CIncrementalSearch;
+
 class CSearchEngine
 {
 public:
@@ -45,11 +114,44 @@ public:
              const TextPosition& startPos, SearchResult& result);
     bool FindNext(CTextDocument* pDocument, SearchResult& result);
     bool FindPrevious(CTextDocument* pDocument, SearchResult& result);
+    // 始点が startPos より前にある最後の一致（ラップアラウンド時は文書末尾から続ける）
+    bool FindBackward(CTextDocument* pDocument, const std::wstring& pattern,
+                      const TextPosition& startPos, SearchResult& result);
     std::vector<SearchResult> FindAll(CTextDocument* pDocument, const std::wstring& pattern);
+    // 複数のリテラルのいずれかに一致する箇所を1回の走査で探す（正規表現・複数行の指定は無視）。
+    // 各位置では最も左から始まり、同じ位置なら最長のパターンを採る
+    std::vector<SearchResult> FindAllPatterns(const CTextDocument* pDocument, const std::vector<std::wstring>& patterns);
+    // FindAll と同じ一致を、走査の進み具合に合わせて文書順に少しずつ通知する。
+    // 一致は位置だけで保持するので、大量の一致でも一致文字列の分のメモリを使わない。
+    // パターンが不正ならfalse（理由は GetPatternError）
+    bool FindStream(const CTextDocument* pDocument, const std::wstring& pattern,
+                    const MatchStreamOptions& options, MatchStreamSummary& summary);
 
-    // 置換
+    // 置換。正規表現では置換文字列の $1〜$99 をグループ、$& を一致全体、$$ を $ に展開する
     bool Replace(CTextDocument* pDocument, const SearchResult& result, const std::wstring& replacement);
     int ReplaceAll(CTextDocument* pDocument, const std::wstring& pattern, const std::wstring& replacement);
+    // ReplaceAll の置き換え内容だけを求める（ドキュメントは変更しない）。戻り値は置換数。
+    // blocks を CReplaceLinesCommand に渡せば、一括置換を1回の操作として元に戻せる
+    int BuildReplaceAll(const CTextDocument* pDocument, const std::wstring& pattern,
+                        const std::wstring& replacement, std::vector<LineBlock>& blocks);
+    // result（現在のパターンの一致）に対する置換後の文字列
+    std::wstring ExpandReplacement(const CTextDocument* pDocument, const SearchResult& result,
+                                   const std::wstring& replacement);
+
+    // 選択範囲内の検索・置換。scope の範囲に収まる一致だけを対象とし、範囲の終点を行末として照合する
+    // （範囲より前の文字列は \b などの判定にのみ使う）。照合するのは範囲にかかる行だけなので、
+    // 範囲の大きさに比例した時間で終わる。startPos 以降で最初の一致（ラップアラウンド時は先頭の範囲から続ける）
+    bool FindInScope(const CTextDocument* pDocument, const std::wstring& pattern, const CSearchScope& scope,
+                     const TextPosition& startPos, SearchResult& result);
+    std::vector<SearchResult> FindAllInScope(const CTextDocument* pDocument, const std::wstring& pattern,
+                                             const CSearchScope& scope);
+    // BuildReplaceAll の範囲版。newRanges には置換後の範囲（置き換えた文字列を覆う）を返す
+    int BuildReplaceAllInScope(const CTextDocument* pDocument, const std::wstring& pattern,
+                               const std::wstring& replacement, const CSearchScope& scope,
+                               std::vector<LineBlock>& blocks, std::vector<Selection>& newRanges);
+    // 範囲内を置換し、scope の範囲を置換後の範囲に置き直す
+    int ReplaceAllInScope(CTextDocument* pDocument, const std::wstring& pattern,
+                          const std::wstring& replacement, CSearchScope& scope);
 
     // オプション設定
     void SetOptions(const SearchOptions& options) { m_options = options; }
@@ -59,14 +161,43 @@ public:
     void SetPattern(const std::wstring& pattern) { m_currentPattern = pattern; }
     const std::wstring& GetPattern() const { return m_currentPattern; }
 
+    // インクリメンタル検索（入力中の検索）。現在のオプションでセッションを開始する
+    CIncrementalSearch& BeginIncrementalSearch(const CTextDocument* pDocument);
+    CIncrementalSearch* GetIncrementalSearch() const { return m_pIncremental.get(); }
+    void EndIncrementalSearch();
+
+    // FindAll/ReplaceAll の最大同時実行スレッド数（0: 共有ワーカープールに合わせる、1: 並列化しない）。
+    // 大きなドキュメントでは行範囲を分割して並列に照合し、結果は文書順に連結する（複数行モードを除く）
+    void SetThreadCount(size_t threadCount) { m_threadCount = threadCount; }
+    size_t GetThreadCount() const { return m_threadCount; }
+
+    // 3文字組索引（nullptrで使わない）。検索対象のドキュメントに Attach された索引なら、
+    // 単一行モードの前方検索・FindAll・FindStream で候補の行だけを照合する
+    void SetTrigramIndex(const CTrigramIndex* pIndex) { m_pTrigramIndex = pIndex; }
+    const CTrigramIndex* GetTrigramIndex() const { return m_pTrigramIndex; }
+
+    // 直近の検索でパターンを構築できなかった場合（不正な正規表現など）の理由
+    bool HasPatternError() const { return !m_compiled.GetError().empty(); }
+    const std::wstring& GetPatternError() const { return m_compiled.GetError(); }
+
 private:
-    bool SearchInLine(const std::wstring& line, const std::wstring& pattern, 
-                     size_t& startCol, size_t& endCol);
-    bool SearchWithRegex(const std::wstring& text, const std::wstring& pattern,
-                        size_t& start, size_t& end);
-    std::wstring CreateWordBoundaryPattern(const std::wstring& pattern);
+    bool PrepareSearch(const std::wstring& pattern);
+    typedef std::function<void(const CCompiledPattern& pattern, size_t range, size_t firstLine, size_t lastLine)> LineRangeTask;
+    size_t GetLineRangeCount(size_t lineCount) const;
+    void ForEachLineRange(size_t lineCount, size_t rangeCount, const LineRangeTask& task);
+    bool SearchInLine(const std::wstring& line, size_t& startCol, size_t& endCol, size_t& editDistance);
+    bool FindLastInLines(CTextDocument* pDocument, const TextPosition& from, SearchResult& result);
+    bool FindLastAcrossLines(CTextDocument* pDocument, const TextPosition& from, SearchResult& result);
+    bool GetCandidateLines(const CTextDocument* pDocument, std::vector<LineRange>& ranges) const;
+    void StreamMultiLine(const CTextDocument* pDocument, const MatchStreamOptions& options, MatchStreamSummary& summary);
 
     SearchOptions m_options;
     std::wstring m_currentPattern;
-    TextPosition m_lastSearchPos;
+    CCompiledPattern m_compiled;
+    CMultiPatternMatcher m_multiMatcher;
+    TextPosition m_lastMatchStart;
+    TextPosition m_lastSearchPos;   // 直前の一致の終点
+    size_t m_threadCount;
+    const CTrigramIndex* m_pTrigramIndex;
+    std::unique_ptr<CIncrementalSearch> m_pIncremental;
 };
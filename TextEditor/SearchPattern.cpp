@@ -0,0 +1,299 @@
+// SearchPattern.cpp - コンパイル済み検索パターン実装
+#include "SearchPattern.h"
+
+static std::wstring CreateWordBoundaryPattern(const std::wstring& pattern)
+{
+    return L"\\b(?:" + pattern + L")\\b";
+}
+
+CCompiledPattern::CCompiledPattern()
+    : m_compiled(false)
+    , m_valid(false)
+    , m_useAutomaton(false)
+    , m_match(&MatchNone)
+{
+}
+
+void CCompiledPattern::Reset()
+{
+    m_pattern.clear();
+    m_error.clear();
+    m_compiled = false;
+    m_valid = false;
+    m_useAutomaton = false;
+    m_match = &MatchNone;
+    m_automaton.Reset();
+}
+
+bool CCompiledPattern::IsCompiledFor(const std::wstring& pattern, const SearchOptions& options) const
+{
+    return m_compiled && m_pattern == pattern && m_options.HasSameMatching(options);
+}
+
+bool CCompiledPattern::Compile(const std::wstring& pattern, const SearchOptions& options)
+{
+    m_pattern = pattern;
+    m_options = options;
+    m_compiled = true;
+    m_valid = false;
+    m_useAutomaton = false;
+    m_match = &MatchNone;
+    m_error.clear();
+    m_automaton.Reset();
+
+    if (pattern.empty())
+    {
+        m_error = L"検索文字列が空です。";
+        return false;
+    }
+
+    if (!options.useRegex)
+    {
+        if (options.maxEdits > 0)
+        {
+            m_fuzzy.Compile(pattern, options.caseSensitive, options.wholeWord, options.maxEdits);
+            m_match = &MatchFuzzy;
+        }
+        else
+        {
+            m_literal.Compile(pattern, options.caseSensitive, options.wholeWord);
+            m_match = &MatchLiteral;
+        }
+        m_valid = true;
+        return true;
+    }
+
+    const std::wstring source = options.wholeWord ? CreateWordBoundaryPattern(pattern) : pattern;
+    if (m_automaton.Compile(source, options.caseSensitive, options.multiLine))
+    {
+        m_useAutomaton = true;
+        m_match = &MatchAutomaton;
+        m_valid = true;
+        return true;
+    }
+
+    // 後方参照・先読みなど（または構文エラー）は std::wregex に任せる
+    try
+    {
+        std::wregex::flag_type flags = std::wregex::ECMAScript | std::wregex::optimize;
+        if (!options.caseSensitive)
+        {
+            flags |= std::wregex::icase;
+        }
+
+        m_regex.assign(source, flags);
+        m_match = &MatchStdRegex;
+        m_valid = true;
+
+        // std::wregex は行単位でしか使えないので、複数行照合には線形時間エンジンが必要
+        if (options.multiLine)
+        {
+            m_valid = false;
+            m_match = &MatchNone;
+            m_error = L"複数行検索では後方参照や先読みを使用できません。";
+        }
+    }
+    catch (const std::regex_error& e)
+    {
+        // 正規表現エラーは行ごとではなく構築時に一度だけ記録する
+        std::string what = e.what();
+        m_error = L"正規表現が正しくありません: " + std::wstring(what.begin(), what.end());
+    }
+    return m_valid;
+}
+
+bool CCompiledPattern::Match(const wchar_t* text, size_t length, size_t from,
+                             size_t& matchStart, size_t& matchEnd) const
+{
+    size_t editDistance = 0;
+    return Match(text, length, from, matchStart, matchEnd, editDistance);
+}
+
+bool CCompiledPattern::Match(const wchar_t* text, size_t length, size_t from,
+                             size_t& matchStart, size_t& matchEnd, size_t& editDistance) const
+{
+    editDistance = 0;
+    if (from > length)
+    {
+        return false;
+    }
+    return m_match(*this, text, length, from, matchStart, matchEnd, editDistance);
+}
+
+bool CCompiledPattern::MatchNone(const CCompiledPattern&, const wchar_t*, size_t, size_t,
+                                 size_t&, size_t&, size_t&)
+{
+    return false;
+}
+
+bool CCompiledPattern::MatchLiteral(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                                    size_t& matchStart, size_t& matchEnd, size_t&)
+{
+    return pattern.m_literal.Find(text, length, from, matchStart, matchEnd);
+}
+
+bool CCompiledPattern::MatchFuzzy(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                                  size_t& matchStart, size_t& matchEnd, size_t& editDistance)
+{
+    return pattern.m_fuzzy.Find(text, length, from, matchStart, matchEnd, editDistance);
+}
+
+bool CCompiledPattern::MatchAutomaton(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                                      size_t& matchStart, size_t& matchEnd, size_t&)
+{
+    return pattern.m_automaton.Find(text, length, from, matchStart, matchEnd);
+}
+
+bool CCompiledPattern::MatchStdRegex(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                                     size_t& matchStart, size_t& matchEnd, size_t&)
+{
+    // 行をコピーせず範囲で検索。開始位置より前の文字は \b の判定に使わせる
+    std::regex_constants::match_flag_type flags = std::regex_constants::match_default;
+    if (from > 0)
+    {
+        flags |= std::regex_constants::match_prev_avail;
+    }
+
+    std::wcmatch match;
+    if (std::regex_search(text + from, text + length, match, pattern.m_regex, flags))
+    {
+        matchStart = from + static_cast<size_t>(match.position(0));
+        matchEnd = matchStart + static_cast<size_t>(match.length(0));
+        return true;
+    }
+    return false;
+}
+
+bool CCompiledPattern::MatchGroups(const wchar_t* text, size_t length, size_t from,
+                                   std::vector<size_t>& groups) const
+{
+    if (!m_valid || from > length)
+    {
+        return false;
+    }
+
+    if (m_options.useRegex && m_useAutomaton)
+    {
+        return m_automaton.Find(text, length, from, groups);
+    }
+
+    if (m_options.useRegex)
+    {
+        std::regex_constants::match_flag_type flags = std::regex_constants::match_default;
+        if (from > 0)
+        {
+            flags |= std::regex_constants::match_prev_avail;
+        }
+
+        std::wcmatch match;
+        if (!std::regex_search(text + from, text + length, match, m_regex, flags))
+        {
+            return false;
+        }
+        groups.assign(match.size() * 2, REGEX_NO_POSITION);
+        for (size_t i = 0; i < match.size(); ++i)
+        {
+            if (match[i].matched)
+            {
+                groups[i * 2] = from + static_cast<size_t>(match.position(i));
+                groups[i * 2 + 1] = groups[i * 2] + static_cast<size_t>(match.length(i));
+            }
+        }
+        return true;
+    }
+
+    size_t matchStart = 0;
+    size_t matchEnd = 0;
+    if (!Match(text, length, from, matchStart, matchEnd))
+    {
+        return false;
+    }
+    groups.assign(2, matchStart);
+    groups[1] = matchEnd;
+    return true;
+}
+
+size_t CCompiledPattern::GetGroupCount() const
+{
+    if (!m_valid || !m_options.useRegex)
+    {
+        return 1;
+    }
+    return m_useAutomaton ? m_automaton.GetGroupCount() : m_regex.mark_count() + 1;
+}
+
+std::wstring CCompiledPattern::GetRequiredLiteral() const
+{
+    if (!m_valid || IsFuzzy())
+    {
+        return std::wstring();
+    }
+    if (!m_options.useRegex)
+    {
+        return m_pattern;
+    }
+    // std::wregex のパターンは解析していない
+    return m_useAutomaton ? m_automaton.GetRequiredLiteral() : std::wstring();
+}
+
+bool CCompiledPattern::MatchLast(const wchar_t* text, size_t length, size_t limit,
+                                 size_t& matchStart, size_t& matchEnd) const
+{
+    size_t editDistance = 0;
+    return MatchLast(text, length, limit, matchStart, matchEnd, editDistance);
+}
+
+bool CCompiledPattern::MatchLast(const wchar_t* text, size_t length, size_t limit,
+                                 size_t& matchStart, size_t& matchEnd, size_t& editDistance) const
+{
+    editDistance = 0;
+    if (!m_valid)
+    {
+        return false;
+    }
+
+    if (!m_options.useRegex && !IsFuzzy())
+    {
+        return m_literal.FindLast(text, length, limit, matchStart, matchEnd);
+    }
+    if (m_useAutomaton)
+    {
+        return m_automaton.FindLast(text, length, limit, matchStart, matchEnd);
+    }
+
+    // std::wregex とあいまい検索は逆向きに照合できないので、行頭から始点を1文字ずつ進めて最後の一致を探す
+    bool found = false;
+    size_t from = 0;
+    size_t start = 0;
+    size_t end = 0;
+    size_t distance = 0;
+    while (from < limit && Match(text, length, from, start, end, distance) && start < limit)
+    {
+        matchStart = start;
+        matchEnd = end;
+        editDistance = distance;
+        found = true;
+        from = start + 1;
+    }
+    return found;
+}
+
+bool CCompiledPattern::MatchLines(const IRegexLineSource& source, size_t line, size_t column,
+                                  RegexLinePosition& matchStart, RegexLinePosition& matchEnd) const
+{
+    if (!IsMultiLine() || !m_useAutomaton)
+    {
+        return false;
+    }
+    return m_automaton.FindInLines(source, line, column, matchStart, matchEnd);
+}
+
+bool CCompiledPattern::MatchLinesGroups(const IRegexLineSource& source, size_t line, size_t column,
+                                        std::vector<RegexLinePosition>& groups) const
+{
+    if (!IsMultiLine() || !m_useAutomaton)
+    {
+        return false;
+    }
+    return m_automaton.FindInLines(source, line, column, groups);
+}
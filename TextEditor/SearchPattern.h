@@ -0,0 +1,116 @@
+// SearchPattern.h - 検索オプションとコンパイル済み検索パターン
+#pragma once
+#include <string>
+#include <regex>
+#include "LiteralMatcher.h"
+#include "RegexMatcher.h"
+#include "FuzzyMatcher.h"
+
+// 検索オプション
+struct SearchOptions
+{
+    bool useRegex;
+    bool caseSensitive;
+    bool wholeWord;
+    bool wrapAround;
+    bool multiLine;     // 正規表現を行をまたいで照合する（行は '\n' で連結される）
+    size_t maxEdits;    // あいまい検索で許す編集（挿入・削除・置換）の回数。0なら完全一致（リテラル検索のみ）
+
+    SearchOptions()
+        : useRegex(false)
+        , caseSensitive(false)
+        , wholeWord(false)
+        , wrapAround(true)
+        , multiLine(false)
+        , maxEdits(0)
+    {}
+
+    // 照合結果に影響するオプションが同じか（wrapAroundは走査方法のみに影響）
+    bool HasSameMatching(const SearchOptions& other) const
+    {
+        return useRegex == other.useRegex
+            && caseSensitive == other.caseSensitive
+            && wholeWord == other.wholeWord
+            && multiLine == other.multiLine
+            && maxEdits == other.maxEdits;
+    }
+};
+
+// パターンとオプションの組からリテラルマッチャー/正規表現を一度だけ構築し、
+// Find/FindNext/FindPrevious/FindAll/ReplaceAll で使い回す。
+// 照合に使うエンジン（リテラル・あいまい・線形時間正規表現・std::wregex）は Compile で選んだ照合関数に固定し、
+// Match の呼び出しごとにはオプションを判定しない
+class CCompiledPattern
+{
+public:
+    CCompiledPattern();
+
+    // 構築に失敗した場合（不正な正規表現）はfalseを返し、GetError()に理由を保持
+    bool Compile(const std::wstring& pattern, const SearchOptions& options);
+    bool IsCompiledFor(const std::wstring& pattern, const SearchOptions& options) const;
+    void Reset();
+
+    bool IsValid() const { return m_valid; }
+    const std::wstring& GetError() const { return m_error; }
+    const std::wstring& GetPattern() const { return m_pattern; }
+    const SearchOptions& GetOptions() const { return m_options; }
+
+    // text[from..length) 内の最初の一致。text[0..from) は前後関係（\b など）の判定にのみ使う
+    bool Match(const wchar_t* text, size_t length, size_t from, size_t& matchStart, size_t& matchEnd) const;
+    // 一致の編集距離も返す（あいまい検索以外では常に0）
+    bool Match(const wchar_t* text, size_t length, size_t from,
+               size_t& matchStart, size_t& matchEnd, size_t& editDistance) const;
+
+    // キャプチャ付きの照合（置換文字列の $1 などの展開用）。
+    // groups[2*i], groups[2*i+1] がグループiの範囲で、参加しなかったグループは REGEX_NO_POSITION
+    bool MatchGroups(const wchar_t* text, size_t length, size_t from, std::vector<size_t>& groups) const;
+    // 一致全体を含むグループ数（リテラル検索では1）
+    size_t GetGroupCount() const;
+
+    // 始点が limit より前にある最後の一致（後方検索）。終点は limit を越えてもよい
+    bool MatchLast(const wchar_t* text, size_t length, size_t limit, size_t& matchStart, size_t& matchEnd) const;
+    bool MatchLast(const wchar_t* text, size_t length, size_t limit,
+                   size_t& matchStart, size_t& matchEnd, size_t& editDistance) const;
+
+    // すべての一致が含むリテラル（索引による絞り込み用）。分からなければ空
+    std::wstring GetRequiredLiteral() const;
+
+    // あいまい検索（リテラルかつ maxEdits > 0）
+    bool IsFuzzy() const { return m_valid && !m_options.useRegex && m_options.maxEdits > 0; }
+
+    // 複数行モード（正規表現かつ multiLine）では行単位ではなくこちらで照合する
+    bool IsMultiLine() const { return m_valid && m_options.useRegex && m_options.multiLine; }
+    bool MatchLines(const IRegexLineSource& source, size_t line, size_t column,
+                    RegexLinePosition& matchStart, RegexLinePosition& matchEnd) const;
+    bool MatchLinesGroups(const IRegexLineSource& source, size_t line, size_t column,
+                          std::vector<RegexLinePosition>& groups) const;
+
+private:
+    // Compile で選ぶ照合関数。コピーしても指す先のエンジンはコピー先のものになる
+    typedef bool (*MatchKernel)(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                                size_t& matchStart, size_t& matchEnd, size_t& editDistance);
+
+    static bool MatchNone(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                          size_t& matchStart, size_t& matchEnd, size_t& editDistance);
+    static bool MatchLiteral(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                             size_t& matchStart, size_t& matchEnd, size_t& editDistance);
+    static bool MatchFuzzy(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                           size_t& matchStart, size_t& matchEnd, size_t& editDistance);
+    static bool MatchAutomaton(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                               size_t& matchStart, size_t& matchEnd, size_t& editDistance);
+    static bool MatchStdRegex(const CCompiledPattern& pattern, const wchar_t* text, size_t length, size_t from,
+                              size_t& matchStart, size_t& matchEnd, size_t& editDistance);
+
+    std::wstring m_pattern;
+    SearchOptions m_options;
+    bool m_compiled;
+    bool m_valid;
+    std::wstring m_error;
+
+    CLiteralMatcher m_literal;
+    CFuzzyMatcher m_fuzzy;      // あいまい検索用（maxEdits > 0 のとき）
+    CRegexMatcher m_automaton;  // 線形時間エンジン（通常はこちら）
+    bool m_useAutomaton;
+    std::wregex m_regex;        // 後方参照・先読みを含むパターン用のフォールバック
+    MatchKernel m_match;
+};
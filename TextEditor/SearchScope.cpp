@@ -0,0 +1,160 @@
+// SearchScope.cpp - 選択範囲内の検索・置換の範囲の実装
+#include "SearchScope.h"
+#include <algorithm>
+
+TextPosition GetInsertEndPosition(const TextPosition& pos, const std::wstring& text)
+{
+    TextPosition end = pos;
+    for (wchar_t ch : text)
+    {
+        if (ch == L'\n')
+        {
+            ++end.line;
+            end.column = 0;
+        }
+        else if (ch != L'\r')
+        {
+            ++end.column;
+        }
+    }
+    return end;
+}
+
+// pos に text を挿入した後の位置。挿入位置と同じ位置は stickRight なら挿入した文字列の後ろへ動かす
+static TextPosition MapInserted(const TextPosition& pos, const TextPosition& insertPos,
+                                const TextPosition& insertEnd, bool stickRight)
+{
+    if (pos < insertPos || (pos == insertPos && !stickRight))
+    {
+        return pos;
+    }
+    if (pos.line == insertPos.line)
+    {
+        return TextPosition(insertEnd.line, insertEnd.column + (pos.column - insertPos.column));
+    }
+    return TextPosition(pos.line + (insertEnd.line - insertPos.line), pos.column);
+}
+
+// [start, end) を削除した後の位置。削除範囲の中の位置は削除範囲の始点に寄せる
+static TextPosition MapDeleted(const TextPosition& pos, const TextPosition& start, const TextPosition& end)
+{
+    if (!(start < pos))
+    {
+        return pos;
+    }
+    if (pos < end)
+    {
+        return start;
+    }
+    if (pos.line == end.line)
+    {
+        return TextPosition(start.line, start.column + (pos.column - end.column));
+    }
+    return TextPosition(pos.line - (end.line - start.line), pos.column);
+}
+
+CSearchScope::CSearchScope()
+    : m_pDocument(nullptr)
+{
+}
+
+CSearchScope::~CSearchScope()
+{
+    Detach();
+}
+
+void CSearchScope::SetRanges(const std::vector<Selection>& ranges)
+{
+    m_ranges.clear();
+    for (const Selection& range : ranges)
+    {
+        if (range.IsEmpty())
+        {
+            continue;
+        }
+        m_ranges.push_back(range.end < range.start ? Selection(range.end, range.start) : range);
+    }
+    std::sort(m_ranges.begin(), m_ranges.end(),
+        [](const Selection& a, const Selection& b) { return a.start < b.start; });
+
+    // 重なる範囲をまとめる（接しているだけの範囲は別のまま）
+    size_t count = 0;
+    for (size_t i = 0; i < m_ranges.size(); ++i)
+    {
+        if (count > 0 && m_ranges[i].start < m_ranges[count - 1].end)
+        {
+            if (m_ranges[count - 1].end < m_ranges[i].end)
+            {
+                m_ranges[count - 1].end = m_ranges[i].end;
+            }
+            continue;
+        }
+        m_ranges[count++] = m_ranges[i];
+    }
+    m_ranges.resize(count);
+}
+
+void CSearchScope::Attach(CTextDocument* pDocument)
+{
+    Detach();
+    m_pDocument = pDocument;
+    if (m_pDocument)
+    {
+        m_pDocument->AddEditListener(this);
+    }
+}
+
+void CSearchScope::Detach()
+{
+    if (m_pDocument)
+    {
+        m_pDocument->RemoveEditListener(this);
+        m_pDocument = nullptr;
+    }
+}
+
+size_t CSearchScope::FindFirstAffected(const TextPosition& pos) const
+{
+    // 終点が pos より前の範囲は編集の影響を受けない
+    auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), pos,
+        [](const Selection& range, const TextPosition& value) { return range.end < value; });
+    return static_cast<size_t>(it - m_ranges.begin());
+}
+
+void CSearchScope::OnTextInserted(const TextPosition& pos, const std::wstring& text)
+{
+    const TextPosition insertEnd = GetInsertEndPosition(pos, text);
+    const bool linesAdded = insertEnd.line != pos.line;
+    for (size_t i = FindFirstAffected(pos); i < m_ranges.size(); ++i)
+    {
+        Selection& range = m_ranges[i];
+        // 行数が変わらなければ、挿入した行より後ろの範囲は動かない
+        if (!linesAdded && range.start.line > pos.line)
+        {
+            break;
+        }
+        range.start = MapInserted(range.start, pos, insertEnd, false);
+        range.end = MapInserted(range.end, pos, insertEnd, true);
+    }
+}
+
+void CSearchScope::OnTextDeleted(const TextPosition& start, const TextPosition& end)
+{
+    const bool linesRemoved = end.line != start.line;
+    for (size_t i = FindFirstAffected(start); i < m_ranges.size(); ++i)
+    {
+        Selection& range = m_ranges[i];
+        if (!linesRemoved && range.start.line > end.line)
+        {
+            break;
+        }
+        range.start = MapDeleted(range.start, start, end);
+        range.end = MapDeleted(range.end, start, end);
+    }
+}
+
+void CSearchScope::OnDocumentReset()
+{
+    // 内容全体が置き換わったので、範囲は意味を持たない
+    m_ranges.clear();
+}
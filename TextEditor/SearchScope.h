@@ -0,0 +1,40 @@
+// SearchScope.h - 選択範囲内の検索・置換の範囲
+#pragma once
+#include <string>
+#include <vector>
+#include "TextDocument.h"
+
+// pos に text を挿入したときの、挿入した文字列の終わりの位置（\r はドキュメントと同じく捨てる）
+TextPosition GetInsertEndPosition(const TextPosition& pos, const std::wstring& text);
+
+// 選択範囲内の検索・置換に使う範囲の集まり。矩形選択は行ごとの範囲として渡す。
+// Attach したドキュメントの編集に合わせて範囲の端を動かす。範囲の始点にちょうど挿入された文字列は範囲に含め、
+// 終点にちょうど挿入された文字列も範囲に含める（範囲内の一致を置き換えても範囲が置き換え後の文字列を覆うように）。
+// Attach したドキュメントより先に破棄するか、Detach してからドキュメントを破棄すること
+class CSearchScope : public IDocumentEditListener
+{
+public:
+    CSearchScope();
+    ~CSearchScope();
+
+    // 始点と終点の向きをそろえて文書順に並べ、重なる範囲はまとめる（空の範囲は除く）
+    void SetRanges(const std::vector<Selection>& ranges);
+    const std::vector<Selection>& GetRanges() const { return m_ranges; }
+    bool IsEmpty() const { return m_ranges.empty(); }
+    void Clear() { m_ranges.clear(); }
+
+    void Attach(CTextDocument* pDocument);
+    void Detach();
+    bool IsAttached() const { return m_pDocument != nullptr; }
+
+    // IDocumentEditListener
+    void OnTextInserted(const TextPosition& pos, const std::wstring& text) override;
+    void OnTextDeleted(const TextPosition& start, const TextPosition& end) override;
+    void OnDocumentReset() override;
+
+private:
+    size_t FindFirstAffected(const TextPosition& pos) const;
+
+    CTextDocument* m_pDocument;
+    std::vector<Selection> m_ranges;    // 文書順で重ならない
+};
@@ -0,0 +1,501 @@
+// SimdScan.cpp - ベクトル化候補スキャナ実装
+#include "SimdScan.h"
+#include "CaseFold.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMDSCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(SIMDSCAN_X86) && !defined(_MSC_VER)
+#define SIMDSCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMDSCAN_TARGET_AVX2
+#endif
+
+// --- Rarity heuristic ---
+// ログ/ソースコードでのおおよその出現頻度（大きいほど頻出）。ASCIIのみ表で持つ
+static int GetUnitFrequency(wchar_t ch)
+{
+    static const unsigned char asciiFrequency[128] =
+    {
+        // 0x00-0x1F 制御文字（タブのみ頻出）
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 120, 1, 1, 1, 1, 1, 1,
+        1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+        // ' '  !    "    #    $    %    &    '    (    )    *    +    ,    -    .    /
+        255, 30, 110, 40, 35, 30, 35, 80, 110, 110, 50, 40, 140, 150, 170, 150,
+        // 0    1    2    3    4    5    6    7    8    9    :    ;    <    =    >    ?
+        180, 175, 170, 150, 145, 145, 140, 135, 135, 135, 160, 90, 60, 150, 60, 30,
+        // @    A    B    C    D    E    F    G    H    I    J    K    L    M    N    O
+        35, 110, 70, 95, 85, 110, 70, 60, 60, 100, 25, 35, 75, 70, 85, 90,
+        // P    Q    R    S    T    U    V    W    X    Y    Z    [    \    ]    ^    _
+        80, 20, 90, 100, 110, 60, 40, 50, 30, 30, 15, 90, 45, 90, 15, 110,
+        // `    a    b    c    d    e    f    g    h    i    j    k    l    m    n    o
+        15, 215, 120, 165, 170, 230, 130, 120, 160, 205, 30, 80, 175, 150, 205, 210,
+        // p    q    r    s    t    u    v    w    x    y    z    {    |    }    ~
+        130, 20, 195, 200, 220, 160, 90, 100, 50, 100, 25, 60, 40, 60, 15, 1
+    };
+
+    unsigned long code = static_cast<unsigned long>(ch);
+    if (code < 128)
+    {
+        return asciiFrequency[code];
+    }
+    if (code >= 0x3040 && code <= 0x30FF)
+    {
+        return 150; // ひらがな/カタカナは日本語テキストで頻出
+    }
+    if (code >= 0x3000 && code <= 0x303F)
+    {
+        return 140; // 和文句読点
+    }
+    if (code >= 0x4E00 && code <= 0x9FFF)
+    {
+        return 45;  // CJK統合漢字は個々の字としては比較的まれ
+    }
+    return 60;
+}
+
+// 畳み込み後に ch と等しくなるコード単位を最大2つ集める。3つ以上ならfalse
+static bool CollectCaseVariants(wchar_t folded, bool caseSensitive, wchar_t variants[2])
+{
+    if (caseSensitive)
+    {
+        variants[0] = variants[1] = folded;
+        return true;
+    }
+
+    // 逆引き表から引く（Compile のたびに表全体を走査しない）
+    size_t count = 0;
+    const wchar_t* codes = GetCaseVariants(folded, count);
+    if (count > 2)
+    {
+        return false;
+    }
+    if (count == 0)
+    {
+        variants[0] = variants[1] = folded; // BMP外の文字
+        return true;
+    }
+    variants[0] = codes[0];
+    variants[1] = codes[count - 1];
+    return true;
+}
+
+bool BuildCandidateSpec(const std::wstring& pattern, bool caseSensitive, CandidateSpec& spec)
+{
+    const size_t m = pattern.length();
+    if (m == 0)
+    {
+        return false;
+    }
+
+    // 頻度の低い順に候補位置を選ぶ（同じ文字は一度だけ評価）
+    size_t best = m;
+    size_t second = m;
+    int bestScore = 0x7FFFFFFF;
+    int secondScore = 0x7FFFFFFF;
+    for (size_t i = 0; i < m; ++i)
+    {
+        wchar_t ch = pattern[i];
+        int score = GetUnitFrequency(ch);
+        if (!caseSensitive)
+        {
+            // 大文字側も候補になるため両方の頻度を合算
+            wchar_t upper = static_cast<wchar_t>(std::towupper(static_cast<wint_t>(ch)));
+            if (upper != ch)
+            {
+                score += GetUnitFrequency(upper);
+            }
+        }
+
+        if (score < bestScore)
+        {
+            if (best < m && pattern[best] != ch)
+            {
+                second = best;
+                secondScore = bestScore;
+            }
+            best = i;
+            bestScore = score;
+        }
+        else if (score < secondScore && ch != pattern[best])
+        {
+            second = i;
+            secondScore = score;
+        }
+    }
+
+    if (!CollectCaseVariants(pattern[best], caseSensitive, spec.unit1))
+    {
+        return false;
+    }
+    spec.offset1 = best;
+
+    spec.hasPair = false;
+    if (second < m && CollectCaseVariants(pattern[second], caseSensitive, spec.unit2))
+    {
+        spec.hasPair = true;
+        spec.offset2 = second;
+    }
+    return true;
+}
+
+// --- Scanners ---
+static size_t ScanScalar(const wchar_t* text, size_t lastStart, size_t pos, const CandidateSpec& spec)
+{
+    for (; pos <= lastStart; ++pos)
+    {
+        wchar_t a = text[pos + spec.offset1];
+        if (a != spec.unit1[0] && a != spec.unit1[1])
+        {
+            continue;
+        }
+        if (spec.hasPair)
+        {
+            wchar_t b = text[pos + spec.offset2];
+            if (b != spec.unit2[0] && b != spec.unit2[1])
+            {
+                continue;
+            }
+        }
+        return pos;
+    }
+    return CANDIDATE_NOT_FOUND;
+}
+
+static size_t ScanBytesScalar(const char* text, size_t lastStart, size_t pos, const CandidateSpec& spec)
+{
+    for (; pos <= lastStart; ++pos)
+    {
+        const wchar_t a = static_cast<unsigned char>(text[pos + spec.offset1]);
+        if (a != spec.unit1[0] && a != spec.unit1[1])
+        {
+            continue;
+        }
+        if (spec.hasPair)
+        {
+            const wchar_t b = static_cast<unsigned char>(text[pos + spec.offset2]);
+            if (b != spec.unit2[0] && b != spec.unit2[1])
+            {
+                continue;
+            }
+        }
+        return pos;
+    }
+    return CANDIDATE_NOT_FOUND;
+}
+
+static size_t CountLineBreaksScalar(const char* text, size_t pos, size_t length)
+{
+    size_t count = 0;
+    for (; pos < length; ++pos)
+    {
+        if (text[pos] == '\n' || (text[pos] == '\r' && (pos + 1 == length || text[pos + 1] != '\n')))
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+#ifdef SIMDSCAN_X86
+static inline unsigned CountTrailingZeros(unsigned value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+}
+
+// wchar_tの幅（Windows:16bit / POSIX:32bit）に合わせた比較
+static inline __m128i Broadcast128(wchar_t ch)
+{
+    if (sizeof(wchar_t) == 2)
+        return _mm_set1_epi16(static_cast<short>(ch));
+    return _mm_set1_epi32(static_cast<int>(ch));
+}
+
+static inline __m128i CompareEqual128(__m128i a, __m128i b)
+{
+    if (sizeof(wchar_t) == 2)
+        return _mm_cmpeq_epi16(a, b);
+    return _mm_cmpeq_epi32(a, b);
+}
+
+static size_t ScanSse2(const wchar_t* text, size_t lastStart, size_t pos, const CandidateSpec& spec)
+{
+    const size_t step = sizeof(__m128i) / sizeof(wchar_t);
+    const __m128i a0 = Broadcast128(spec.unit1[0]);
+    const __m128i a1 = Broadcast128(spec.unit1[1]);
+    const __m128i b0 = Broadcast128(spec.unit2[0]);
+    const __m128i b1 = Broadcast128(spec.unit2[1]);
+
+    while (lastStart >= step - 1 && pos <= lastStart - (step - 1))
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos + spec.offset1));
+        __m128i mask = _mm_or_si128(CompareEqual128(x, a0), CompareEqual128(x, a1));
+        if (spec.hasPair)
+        {
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos + spec.offset2));
+            mask = _mm_and_si128(mask, _mm_or_si128(CompareEqual128(y, b0), CompareEqual128(y, b1)));
+        }
+
+        unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(mask));
+        if (bits)
+        {
+            return pos + CountTrailingZeros(bits) / sizeof(wchar_t);
+        }
+        pos += step;
+    }
+    return ScanScalar(text, lastStart, pos, spec);
+}
+
+static size_t ScanBytesSse2(const char* text, size_t lastStart, size_t pos, const CandidateSpec& spec)
+{
+    const size_t step = sizeof(__m128i);
+    const __m128i a0 = _mm_set1_epi8(static_cast<char>(spec.unit1[0]));
+    const __m128i a1 = _mm_set1_epi8(static_cast<char>(spec.unit1[1]));
+    const __m128i b0 = _mm_set1_epi8(static_cast<char>(spec.unit2[0]));
+    const __m128i b1 = _mm_set1_epi8(static_cast<char>(spec.unit2[1]));
+
+    while (lastStart >= step - 1 && pos <= lastStart - (step - 1))
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos + spec.offset1));
+        __m128i mask = _mm_or_si128(_mm_cmpeq_epi8(x, a0), _mm_cmpeq_epi8(x, a1));
+        if (spec.hasPair)
+        {
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos + spec.offset2));
+            mask = _mm_and_si128(mask, _mm_or_si128(_mm_cmpeq_epi8(y, b0), _mm_cmpeq_epi8(y, b1)));
+        }
+
+        unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(mask));
+        if (bits)
+        {
+            return pos + CountTrailingZeros(bits);
+        }
+        pos += step;
+    }
+    return ScanBytesScalar(text, lastStart, pos, spec);
+}
+
+// '\n' と、直後が '\n' でない '\r' のレーンを1ずつ数える。
+// レーンごとのカウンタ（8bit）があふれる前に _mm_sad_epu8 で合計へ移す
+static size_t CountLineBreaksSse2(const char* text, size_t pos, size_t length)
+{
+    const size_t step = sizeof(__m128i);
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i zero = _mm_setzero_si128();
+    size_t count = 0;
+    while (pos + step < length)
+    {
+        __m128i counters = zero;
+        for (int i = 0; i < 255 && pos + step < length; ++i, pos += step)
+        {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+            __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos + 1));
+            __m128i breaks = _mm_or_si128(_mm_cmpeq_epi8(x, lf),
+                                          _mm_andnot_si128(_mm_cmpeq_epi8(next, lf), _mm_cmpeq_epi8(x, cr)));
+            counters = _mm_sub_epi8(counters, breaks);
+        }
+        __m128i sums = _mm_sad_epu8(counters, zero);
+        count += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_extract_epi16(sums, 4));
+    }
+    return count + CountLineBreaksScalar(text, pos, length);
+}
+
+SIMDSCAN_TARGET_AVX2
+static inline __m256i Broadcast256(wchar_t ch)
+{
+    if (sizeof(wchar_t) == 2)
+        return _mm256_set1_epi16(static_cast<short>(ch));
+    return _mm256_set1_epi32(static_cast<int>(ch));
+}
+
+SIMDSCAN_TARGET_AVX2
+static inline __m256i CompareEqual256(__m256i a, __m256i b)
+{
+    if (sizeof(wchar_t) == 2)
+        return _mm256_cmpeq_epi16(a, b);
+    return _mm256_cmpeq_epi32(a, b);
+}
+
+SIMDSCAN_TARGET_AVX2
+static size_t ScanAvx2(const wchar_t* text, size_t lastStart, size_t pos, const CandidateSpec& spec)
+{
+    const size_t step = sizeof(__m256i) / sizeof(wchar_t);
+    const __m256i a0 = Broadcast256(spec.unit1[0]);
+    const __m256i a1 = Broadcast256(spec.unit1[1]);
+    const __m256i b0 = Broadcast256(spec.unit2[0]);
+    const __m256i b1 = Broadcast256(spec.unit2[1]);
+
+    while (lastStart >= step - 1 && pos <= lastStart - (step - 1))
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos + spec.offset1));
+        __m256i mask = _mm256_or_si256(CompareEqual256(x, a0), CompareEqual256(x, a1));
+        if (spec.hasPair)
+        {
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos + spec.offset2));
+            mask = _mm256_and_si256(mask, _mm256_or_si256(CompareEqual256(y, b0), CompareEqual256(y, b1)));
+        }
+
+        unsigned bits = static_cast<unsigned>(_mm256_movemask_epi8(mask));
+        if (bits)
+        {
+            return pos + CountTrailingZeros(bits) / sizeof(wchar_t);
+        }
+        pos += step;
+    }
+    return ScanSse2(text, lastStart, pos, spec);
+}
+
+SIMDSCAN_TARGET_AVX2
+static size_t ScanBytesAvx2(const char* text, size_t lastStart, size_t pos, const CandidateSpec& spec)
+{
+    const size_t step = sizeof(__m256i);
+    const __m256i a0 = _mm256_set1_epi8(static_cast<char>(spec.unit1[0]));
+    const __m256i a1 = _mm256_set1_epi8(static_cast<char>(spec.unit1[1]));
+    const __m256i b0 = _mm256_set1_epi8(static_cast<char>(spec.unit2[0]));
+    const __m256i b1 = _mm256_set1_epi8(static_cast<char>(spec.unit2[1]));
+
+    while (lastStart >= step - 1 && pos <= lastStart - (step - 1))
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos + spec.offset1));
+        __m256i mask = _mm256_or_si256(_mm256_cmpeq_epi8(x, a0), _mm256_cmpeq_epi8(x, a1));
+        if (spec.hasPair)
+        {
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos + spec.offset2));
+            mask = _mm256_and_si256(mask, _mm256_or_si256(_mm256_cmpeq_epi8(y, b0), _mm256_cmpeq_epi8(y, b1)));
+        }
+
+        unsigned bits = static_cast<unsigned>(_mm256_movemask_epi8(mask));
+        if (bits)
+        {
+            return pos + CountTrailingZeros(bits);
+        }
+        pos += step;
+    }
+    return ScanBytesSse2(text, lastStart, pos, spec);
+}
+
+SIMDSCAN_TARGET_AVX2
+static size_t CountLineBreaksAvx2(const char* text, size_t pos, size_t length)
+{
+    const size_t step = sizeof(__m256i);
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i zero = _mm256_setzero_si256();
+    size_t count = 0;
+    while (pos + step < length)
+    {
+        __m256i counters = zero;
+        for (int i = 0; i < 255 && pos + step < length; ++i, pos += step)
+        {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos));
+            __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + pos + 1));
+            __m256i breaks = _mm256_or_si256(_mm256_cmpeq_epi8(x, lf),
+                                             _mm256_andnot_si256(_mm256_cmpeq_epi8(next, lf), _mm256_cmpeq_epi8(x, cr)));
+            counters = _mm256_sub_epi8(counters, breaks);
+        }
+        __m256i sums = _mm256_sad_epu8(counters, zero);
+        __m128i halves = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        count += static_cast<size_t>(_mm_cvtsi128_si32(halves)) + static_cast<size_t>(_mm_extract_epi16(halves, 4));
+    }
+    return count + CountLineBreaksSse2(text, pos, length);
+}
+
+static bool CpuSupportsAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+typedef size_t (*CandidateScanner)(const wchar_t*, size_t, size_t, const CandidateSpec&);
+typedef size_t (*ByteCandidateScanner)(const char*, size_t, size_t, const CandidateSpec&);
+typedef size_t (*LineBreakCounter)(const char*, size_t, size_t);
+
+struct ScannerSelection
+{
+    CandidateScanner scanner;
+    ByteCandidateScanner byteScanner;
+    LineBreakCounter lineBreakCounter;
+    const char* name;
+    bool vectorized;
+};
+
+static const ScannerSelection& GetScanner()
+{
+    // CPU機能の判定は初回のみ
+    static const ScannerSelection selection = []
+    {
+#ifdef SIMDSCAN_X86
+        if (CpuSupportsAvx2())
+        {
+            return ScannerSelection{ ScanAvx2, ScanBytesAvx2, CountLineBreaksAvx2, "AVX2", true };
+        }
+        return ScannerSelection{ ScanSse2, ScanBytesSse2, CountLineBreaksSse2, "SSE2", true };
+#else
+        return ScannerSelection{ ScanScalar, ScanBytesScalar, CountLineBreaksScalar, "Scalar", false };
+#endif
+    }();
+    return selection;
+}
+
+size_t FindCandidate(const wchar_t* text, size_t lastStart, size_t from, const CandidateSpec& spec)
+{
+    if (from > lastStart)
+    {
+        return CANDIDATE_NOT_FOUND;
+    }
+    return GetScanner().scanner(text, lastStart, from, spec);
+}
+
+size_t FindByteCandidate(const char* text, size_t lastStart, size_t from, const CandidateSpec& spec)
+{
+    if (from > lastStart)
+    {
+        return CANDIDATE_NOT_FOUND;
+    }
+    return GetScanner().byteScanner(text, lastStart, from, spec);
+}
+
+size_t CountLineBreaks(const char* text, size_t length)
+{
+    return GetScanner().lineBreakCounter(text, 0, length);
+}
+
+bool IsVectorScanAvailable()
+{
+    return GetScanner().vectorized;
+}
+
+const char* GetCandidateScannerName()
+{
+    return GetScanner().name;
+}
@@ -0,0 +1,40 @@
+// SimdScan.h - リテラル検索用のベクトル化候補スキャナ（SSE2/AVX2 実行時選択）
+#pragma once
+#include <string>
+#include <cstddef>
+
+// 候補条件: text[pos + offset1] が unit1 のいずれか、
+// かつ hasPair なら text[pos + offset2] が unit2 のいずれか
+struct CandidateSpec
+{
+    size_t offset1;
+    wchar_t unit1[2];
+    bool hasPair;
+    size_t offset2;
+    wchar_t unit2[2];
+
+    CandidateSpec() : offset1(0), hasPair(false), offset2(0)
+    {
+        unit1[0] = unit1[1] = unit2[0] = unit2[1] = 0;
+    }
+};
+
+const size_t CANDIDATE_NOT_FOUND = static_cast<size_t>(-1);
+
+// パターン中で最も出現しにくいコード単位（と2番目）を選び、両方の大文字小文字を登録する。
+// 畳み込みで3文字以上が同じになる文字しかない場合はfalse
+bool BuildCandidateSpec(const std::wstring& pattern, bool caseSensitive, CandidateSpec& spec);
+
+// from <= pos <= lastStart の範囲で条件を満たす最初の pos を返す
+size_t FindCandidate(const wchar_t* text, size_t lastStart, size_t from, const CandidateSpec& spec);
+
+// FindCandidate のバイト列版（UTF-8のまま探す場合）。spec のコード単位はいずれも 0xFF 以下であること
+size_t FindByteCandidate(const char* text, size_t lastStart, size_t from, const CandidateSpec& spec);
+
+// text[0..length) 内の改行の数（'\n'、'\r'、および1つと数える "\r\n"）。
+// 末尾が '\r' なら、その後に '\n' が続かないものとして数える
+size_t CountLineBreaks(const char* text, size_t length);
+
+// ベクトル命令が使えるか、および選択された実装名（"AVX2" / "SSE2" / "Scalar"）
+bool IsVectorScanAvailable();
+const char* GetCandidateScannerName();
@@ -1,265 +1,84 @@
 // TextDocument.cpp - テキストドキュメント実装
 #include "TextDocument.h"
-#include <fstream>
-#include <sstream>
+#include "TextEncoding.h"
 #include <algorithm>
 #include <vector>
-#include <cstring>
-
-// --- Encoding helpers (save) ---
-static bool ConvertWideToUtf8(const std::wstring& text, std::string& out)
-{
-    out.clear();
-    if (text.empty())
-    {
-        out = "";
-        return true;
-    }
-
-    int needed = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), NULL, 0, NULL, NULL);
-    if (needed <= 0)
-    {
-        return false;
-    }
-    out.resize(static_cast<size_t>(needed));
-    int written = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), &out[0], needed, NULL, NULL);
-    if (written <= 0)
-    {
-        out.clear();
-        return false;
-    }
-    return true;
-}
-
-// --- Encoding helpers ---
-static bool TryConvertMultiByte(int codePage, DWORD flags, const char* bytes, int byteLen, std::wstring& out)
-{
-    out.clear();
-    if (byteLen == 0)
-    {
-        out = L"";
-        return true;
-    }
-
-    int needed = MultiByteToWideChar(codePage, flags, bytes, byteLen, NULL, 0);
-    if (needed <= 0)
-    {
-        return false;
-    }
-    out.resize(static_cast<size_t>(needed));
-    int written = MultiByteToWideChar(codePage, flags, bytes, byteLen, &out[0], needed);
-    if (written <= 0)
-    {
-        out.clear();
-        return false;
-    }
-    return true;
-}
-
-static std::wstring ConvertBytesToWide(const char* bytes, size_t len)
-{
-    // BOM check
-    if (len >= 3 && static_cast<unsigned char>(bytes[0]) == 0xEF && static_cast<unsigned char>(bytes[1]) == 0xBB && static_cast<unsigned char>(bytes[2]) == 0xBF)
-    {
-        std::wstring out;
-        if (TryConvertMultiByte(CP_UTF8, MB_ERR_INVALID_CHARS, bytes + 3, static_cast<int>(len - 3), out))
-            return out;
-        if (TryConvertMultiByte(CP_UTF8, 0, bytes + 3, static_cast<int>(len - 3), out))
-            return out;
-    }
-    if (len >= 2 && static_cast<unsigned char>(bytes[0]) == 0xFF && static_cast<unsigned char>(bytes[1]) == 0xFE)
-    {
-        // UTF-16LE
-        size_t wcharCount = (len - 2) / 2;
-        std::wstring out;
-        out.resize(wcharCount);
-        if (wcharCount > 0)
-        {
-            std::memcpy(&out[0], bytes + 2, wcharCount * sizeof(wchar_t));
-        }
-        return out;
-    }
-    if (len >= 2 && static_cast<unsigned char>(bytes[0]) == 0xFE && static_cast<unsigned char>(bytes[1]) == 0xFF)
-    {
-        // UTF-16BE → swap to LE
-        size_t wcharCount = (len - 2) / 2;
-        std::wstring out;
-        out.resize(wcharCount);
-        for (size_t i = 0; i < wcharCount; ++i)
-        {
-            unsigned char hi = static_cast<unsigned char>(bytes[2 + i * 2]);
-            unsigned char lo = static_cast<unsigned char>(bytes[2 + i * 2 + 1]);
-            wchar_t wc = static_cast<wchar_t>((lo << 8) | hi);
-            out[i] = wc;
-        }
-        return out;
-    }
-
-    // No BOM: try UTF-8 strict → lax → ANSI
-    std::wstring out;
-    if (TryConvertMultiByte(CP_UTF8, MB_ERR_INVALID_CHARS, bytes, static_cast<int>(len), out))
-        return out;
-    if (TryConvertMultiByte(CP_UTF8, 0, bytes, static_cast<int>(len), out))
-        return out;
-    if (TryConvertMultiByte(CP_ACP, 0, bytes, static_cast<int>(len), out))
-        return out;
-
-    return L"";
-}
 
 const size_t MEMORY_MAPPED_THRESHOLD = 10 * 1024 * 1024; // 10MB以上でメモリマップド使用
 
 CTextDocument::CTextDocument()
-    : m_hFile(INVALID_HANDLE_VALUE)
-    , m_hMapping(NULL)
-    , m_pView(nullptr)
-    , m_fileSize(0)
+    : m_fileSize(0)
 {
     m_lines.push_back(L""); // 空のドキュメントでも1行は存在
 }
 
 CTextDocument::~CTextDocument()
 {
-    if (m_pView)
-    {
-        UnmapViewOfFile(m_pView);
-    }
-    if (m_hMapping)
-    {
-        CloseHandle(m_hMapping);
-    }
-    if (m_hFile != INVALID_HANDLE_VALUE)
-    {
-        CloseHandle(m_hFile);
-    }
 }
 
 bool CTextDocument::LoadFromFile(const wchar_t* filePath)
 {
     // ファイルサイズを取得
-    WIN32_FILE_ATTRIBUTE_DATA fileInfo;
-    if (!GetFileAttributesEx(filePath, GetFileExInfoStandard, &fileInfo))
+    FileStat fileInfo;
+    if (!GetFileStat(filePath, fileInfo))
     {
         return false;
     }
 
-    ULARGE_INTEGER fileSize;
-    fileSize.LowPart = fileInfo.nFileSizeLow;
-    fileSize.HighPart = fileInfo.nFileSizeHigh;
-    m_fileSize = static_cast<size_t>(fileSize.QuadPart);
+    m_mappedFile.Close();
+    m_fileSize = static_cast<size_t>(fileInfo.size);
 
     // ファイルサイズに応じて読み込み方法を選択
-    if (m_fileSize > MEMORY_MAPPED_THRESHOLD)
-    {
-        LoadFromMemoryMappedFile(filePath);
-    }
-    else
+    bool loaded = (m_fileSize > MEMORY_MAPPED_THRESHOLD)
+        ? LoadFromMemoryMappedFile(filePath)
+        : LoadFromRegularFile(filePath);
+
+    if (loaded)
     {
-        LoadFromRegularFile(filePath);
+        NotifyReset();
     }
-
-    return true;
+    return loaded;
 }
 
-void CTextDocument::LoadFromMemoryMappedFile(const wchar_t* filePath)
+bool CTextDocument::LoadFromMemoryMappedFile(const wchar_t* filePath)
 {
-    // メモリマップドファイルを開く
-    m_hFile = CreateFile(
-        filePath,
-        GENERIC_READ,
-        FILE_SHARE_READ,
-        NULL,
-        OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL,
-        NULL
-    );
-
-    if (m_hFile == INVALID_HANDLE_VALUE)
+    // 行分割の間は先頭から順に読むため、シーケンシャルアクセスを指定
+    if (!m_mappedFile.Open(filePath, FileAccessHint::Sequential))
     {
-        return;
-    }
-
-    m_hMapping = CreateFileMapping(
-        m_hFile,
-        NULL,
-        PAGE_READONLY,
-        0,
-        0,
-        NULL
-    );
-
-    if (!m_hMapping)
-    {
-        CloseHandle(m_hFile);
-        m_hFile = INVALID_HANDLE_VALUE;
-        return;
-    }
-
-    m_pView = MapViewOfFile(
-        m_hMapping,
-        FILE_MAP_READ,
-        0,
-        0,
-        0
-    );
-
-    if (!m_pView)
-    {
-        CloseHandle(m_hMapping);
-        CloseHandle(m_hFile);
-        m_hMapping = NULL;
-        m_hFile = INVALID_HANDLE_VALUE;
-        return;
+        return false;
     }
+    m_fileSize = m_mappedFile.GetSize();
 
-    // UTF-8として読み込み（簡易実装）
-    const char* bytes = static_cast<const char*>(m_pView);
-    
     // UTF-8からUTF-16に変換
-    std::wstring wideText = ConvertBytesToWide(bytes, m_fileSize);
+    std::wstring wideText = ConvertBytesToWide(m_mappedFile.GetData(), m_fileSize);
 
     SplitIntoLines(wideText);
+
+    // 読み込み後のアクセスはランダム
+    m_mappedFile.Advise(FileAccessHint::Random);
+    return true;
 }
 
-void CTextDocument::LoadFromRegularFile(const wchar_t* filePath)
+bool CTextDocument::LoadFromRegularFile(const wchar_t* filePath)
 {
     // Byte-based load with encoding detection (BOM/UTF-8/ANSI)
-    std::ifstream s(filePath, std::ios::binary);
-    if (s.is_open()) {
-        s.seekg(0, std::ios::end);
-        std::streamoff sz = s.tellg();
-        s.seekg(0, std::ios::beg);
-        if (sz > 0) {
-            std::vector<char> buf(static_cast<size_t>(sz));
-            s.read(buf.data(), sz);
-            s.close();
-            std::wstring text = ConvertBytesToWide(buf.data(), buf.size());
-            SplitIntoLines(text);
-            return;
-        }
-        s.close();
-        SplitIntoLines(L"");
-        return;
-    }
-    std::wifstream file(filePath, std::ios::binary);
-    if (!file.is_open())
+    CFile file;
+    if (!file.Open(filePath, CFile::ReadOnly, FileAccessHint::Sequential))
     {
-        return;
+        return false;
     }
 
-    // BOMをチェック
-    wchar_t bom;
-    file.read(&bom, 1);
-    if (bom != 0xFEFF)
+    std::vector<char> buf(static_cast<size_t>(file.GetSize()));
+    size_t bytesRead = 0;
+    if (!buf.empty() && !file.Read(buf.data(), buf.size(), bytesRead))
     {
-        file.seekg(0); // BOMがない場合は先頭に戻る
+        return false;
     }
+    file.Close();
 
-    std::wstringstream buffer;
-    buffer << file.rdbuf();
-    file.close();
-
-    SplitIntoLines(buffer.str());
+    std::wstring text = ConvertBytesToWide(buf.data(), bytesRead);
+    SplitIntoLines(text);
+    return true;
 }
 
 void CTextDocument::SplitIntoLines(const std::wstring& text)
@@ -301,49 +120,46 @@ void CTextDocument::SplitIntoLines(const std::wstring& text)
 
 bool CTextDocument::SaveToFile(const wchar_t* filePath)
 {
-    std::ofstream file(filePath, std::ios::binary);
-    if (!file.is_open())
+    CFile file;
+    if (!file.Open(filePath, CFile::CreateAlways, FileAccessHint::Sequential))
     {
         return false;
     }
 
     // BOMを書き込み
-    const unsigned char bom[3] = { 0xEF, 0xBB, 0xBF };
-    file.write(reinterpret_cast<const char*>(bom), 3);
-    if (!file)
-    {
-        return false;
-    }
+    const size_t flushThreshold = 1024 * 1024;
+    std::string buffer = "\xEF\xBB\xBF";
+    std::string utf8;
 
-    // 各行を書き込み
+    // 各行をバッファにまとめて書き込み
     for (size_t i = 0; i < m_lines.size(); ++i)
     {
+        if (!ConvertWideToUtf8(m_lines[i], utf8))
         {
-            std::string utf8;
-            if (!ConvertWideToUtf8(m_lines[i], utf8))
-            {
-                return false;
-            }
-            if (!utf8.empty())
-            {
-                file.write(utf8.data(), static_cast<std::streamsize>(utf8.size()));
-                if (!file)
-                {
-                    return false;
-                }
-            }
+            return false;
         }
+        buffer += utf8;
         if (i < m_lines.size() - 1)
         {
-            file.write("\r\n", 2);
-            if (!file)
+            buffer += "\r\n";
+        }
+
+        if (buffer.size() >= flushThreshold)
+        {
+            if (!file.Write(buffer.data(), buffer.size()))
             {
                 return false;
             }
+            buffer.clear();
         }
     }
 
-    file.close();
+    if (!buffer.empty() && !file.Write(buffer.data(), buffer.size()))
+    {
+        return false;
+    }
+
+    file.Close();
     return true;
 }
 
@@ -351,6 +167,7 @@ void CTextDocument::Clear()
 {
     m_lines.clear();
     m_lines.push_back(L"");
+    NotifyReset();
 }
 
 const std::wstring& CTextDocument::GetLine(size_t index) const
@@ -378,24 +195,29 @@ std::wstring CTextDocument::GetText() const
 }
 
 std::wstring CTextDocument::GetTextRange(const TextPosition& start, const TextPosition& end) const
+{
+    std::wstring result;
+    AppendTextRange(start, end, result);
+    return result;
+}
+
+void CTextDocument::AppendTextRange(const TextPosition& start, const TextPosition& end, std::wstring& out) const
 {
     if (start == end)
     {
-        return L"";
+        return;
     }
 
     TextPosition actualStart = start < end ? start : end;
     TextPosition actualEnd = start < end ? end : start;
 
-    std::wstring result;
-
     if (actualStart.line == actualEnd.line)
     {
         // 同じ行内
         const std::wstring& line = GetLine(actualStart.line);
         size_t startCol = std::min(actualStart.column, line.length());
         size_t endCol = std::min(actualEnd.column, line.length());
-        result = line.substr(startCol, endCol - startCol);
+        out.append(line, startCol, endCol - startCol);
     }
     else
     {
@@ -407,31 +229,30 @@ std::wstring CTextDocument::GetTextRange(const TextPosition& start, const TextPo
             if (i == actualStart.line)
             {
                 size_t startCol = std::min(actualStart.column, line.length());
-                result += line.substr(startCol);
+                out.append(line, startCol, std::wstring::npos);
             }
             else if (i == actualEnd.line)
             {
                 size_t endCol = std::min(actualEnd.column, line.length());
-                result += line.substr(0, endCol);
+                out.append(line, 0, endCol);
             }
             else
             {
-                result += line;
+                out += line;
             }
             
             if (i < actualEnd.line)
             {
-                result += L"\r\n";
+                out += L"\r\n";
             }
         }
     }
-
-    return result;
 }
 
 void CTextDocument::InsertChar(const TextPosition& pos, wchar_t ch)
 {
     TextPosition clampedPos = ClampPosition(pos);
+    NotifyLinesChanging(clampedPos.line, clampedPos.line);
     
     if (ch == L'\r' || ch == L'\n')
     {
@@ -440,12 +261,14 @@ void CTextDocument::InsertChar(const TextPosition& pos, wchar_t ch)
         std::wstring newLine = line.substr(clampedPos.column);
         line = line.substr(0, clampedPos.column);
         m_lines.insert(m_lines.begin() + clampedPos.line + 1, newLine);
+        NotifyInserted(clampedPos, L"\n");
     }
     else
     {
         // 通常の文字
         std::wstring& line = m_lines[clampedPos.line];
         line.insert(clampedPos.column, 1, ch);
+        NotifyInserted(clampedPos, std::wstring(1, ch));
     }
 }
 
@@ -480,6 +303,7 @@ void CTextDocument::InsertText(const TextPosition& pos, const std::wstring& text
     newLines.push_back(line);
 
     // 挿入
+    NotifyLinesChanging(clampedPos.line, clampedPos.line);
     std::wstring& currentLine = m_lines[clampedPos.line];
     std::wstring beforeInsert = currentLine.substr(0, clampedPos.column);
     std::wstring afterInsert = currentLine.substr(clampedPos.column);
@@ -500,6 +324,8 @@ void CTextDocument::InsertText(const TextPosition& pos, const std::wstring& text
         m_lines.insert(m_lines.begin() + clampedPos.line + newLines.size() - 1, 
                       newLines.back() + afterInsert);
     }
+
+    NotifyInserted(clampedPos, text);
 }
 
 void CTextDocument::DeleteChar(const TextPosition& pos)
@@ -514,13 +340,17 @@ void CTextDocument::DeleteChar(const TextPosition& pos)
     if (pos.column < line.length())
     {
         // 行内の文字を削除
+        NotifyLinesChanging(pos.line, pos.line);
         line.erase(pos.column, 1);
+        NotifyDeleted(pos, TextPosition(pos.line, pos.column + 1));
     }
     else if (pos.line < m_lines.size() - 1)
     {
         // 次の行と結合
+        NotifyLinesChanging(pos.line, pos.line + 1);
         line += m_lines[pos.line + 1];
         m_lines.erase(m_lines.begin() + pos.line + 1);
+        NotifyDeleted(pos, TextPosition(pos.line + 1, 0));
     }
 }
 
@@ -531,16 +361,19 @@ void CTextDocument::DeleteRange(const TextPosition& start, const TextPosition& e
         return;
     }
 
-    TextPosition actualStart = start < end ? start : end;
-    TextPosition actualEnd = start < end ? end : start;
+    TextPosition actualStart = ClampPosition(start < end ? start : end);
+    TextPosition actualEnd = ClampPosition(start < end ? end : start);
+    if (actualStart == actualEnd)
+    {
+        return;
+    }
 
+    NotifyLinesChanging(actualStart.line, actualEnd.line);
     if (actualStart.line == actualEnd.line)
     {
         // 同じ行内
         std::wstring& line = m_lines[actualStart.line];
-        size_t startCol = std::min(actualStart.column, line.length());
-        size_t endCol = std::min(actualEnd.column, line.length());
-        line.erase(startCol, endCol - startCol);
+        line.erase(actualStart.column, actualEnd.column - actualStart.column);
     }
     else
     {
@@ -554,6 +387,8 @@ void CTextDocument::DeleteRange(const TextPosition& start, const TextPosition& e
         m_lines.erase(m_lines.begin() + actualStart.line + 1, 
                      m_lines.begin() + std::min(actualEnd.line + 1, m_lines.size()));
     }
+
+    NotifyDeleted(actualStart, actualEnd);
 }
 
 void CTextDocument::ReplaceRange(const TextPosition& start, const TextPosition& end, const std::wstring& text)
@@ -562,6 +397,156 @@ void CTextDocument::ReplaceRange(const TextPosition& start, const TextPosition&
     InsertText(start, text);
 }
 
+void CTextDocument::SwapLineBlocks(std::vector<LineBlock>& blocks)
+{
+    if (blocks.empty())
+    {
+        return;
+    }
+
+    bool sameLineCount = true;
+    for (const LineBlock& block : blocks)
+    {
+        sameLineCount = sameLineCount && block.lines.size() == block.lineCount;
+        // 書き換える前に、すべてのブロックを置き換え前の座標で知らせる
+        NotifyLinesChanging(block.firstLine, block.firstLine + block.lineCount - 1);
+    }
+
+    if (sameLineCount)
+    {
+        // 行数が変わらなければその場で入れ替える（影響する行だけに比例）
+        for (LineBlock& block : blocks)
+        {
+            for (size_t i = 0; i < block.lineCount; ++i)
+            {
+                m_lines[block.firstLine + i].swap(block.lines[i]);
+            }
+        }
+    }
+    else
+    {
+        // 変更のない行はムーブで詰め直し、新しい行配列を一度で組み立てる
+        size_t newLineCount = m_lines.size();
+        for (const LineBlock& block : blocks)
+        {
+            newLineCount = newLineCount - block.lineCount + block.lines.size();
+        }
+
+        std::vector<std::wstring> newLines;
+        newLines.reserve(newLineCount);
+        size_t next = 0;
+        for (LineBlock& block : blocks)
+        {
+            for (; next < block.firstLine; ++next)
+            {
+                newLines.push_back(std::move(m_lines[next]));
+            }
+
+            std::vector<std::wstring> oldLines;
+            oldLines.reserve(block.lineCount);
+            for (size_t i = 0; i < block.lineCount; ++i)
+            {
+                oldLines.push_back(std::move(m_lines[next++]));
+            }
+
+            size_t newFirst = newLines.size();
+            for (std::wstring& line : block.lines)
+            {
+                newLines.push_back(std::move(line));
+            }
+            block.firstLine = newFirst;
+            block.lineCount = block.lines.size();
+            block.lines.swap(oldLines);
+        }
+        for (; next < m_lines.size(); ++next)
+        {
+            newLines.push_back(std::move(m_lines[next]));
+        }
+        m_lines.swap(newLines);
+    }
+
+    if (m_listeners.empty())
+    {
+        return;
+    }
+
+    // 前のブロックから順に適用したものとして通知する（各ブロックの位置は置き換え後の座標）。
+    // 置き換え前後で先頭と末尾の共通する文字は除き、実際に変わった範囲だけを削除・挿入として知らせる
+    for (const LineBlock& block : blocks)
+    {
+        const size_t first = block.firstLine;
+        const std::vector<std::wstring>& oldLines = block.lines;
+        const size_t oldCount = oldLines.size();
+        const size_t newCount = block.lineCount;
+
+        // 共通する先頭の行と、違いが始まる行の中の桁
+        size_t head = 0;
+        while (head + 1 < oldCount && head + 1 < newCount && oldLines[head] == m_lines[first + head])
+        {
+            ++head;
+        }
+        const std::wstring& oldHead = oldLines[head];
+        const std::wstring& newHead = m_lines[first + head];
+        const size_t headLimit = std::min(oldHead.length(), newHead.length());
+        size_t headColumn = 0;
+        while (headColumn < headLimit && oldHead[headColumn] == newHead[headColumn])
+        {
+            ++headColumn;
+        }
+
+        // 共通する末尾の行と、違いが終わる行の末尾の桁数（先頭の共通部分とは重ねない）
+        size_t tail = 0;
+        while (head + tail + 1 < oldCount && head + tail + 1 < newCount &&
+               oldLines[oldCount - 1 - tail] == m_lines[first + newCount - 1 - tail])
+        {
+            ++tail;
+        }
+        const size_t oldLastLine = oldCount - 1 - tail;
+        const size_t newLastLine = newCount - 1 - tail;
+        const std::wstring& oldLast = oldLines[oldLastLine];
+        const std::wstring& newLast = m_lines[first + newLastLine];
+        size_t tailLimit = std::min(oldLast.length(), newLast.length());
+        if (oldLastLine == head)
+        {
+            tailLimit = std::min(tailLimit, oldLast.length() - headColumn);
+        }
+        if (newLastLine == head)
+        {
+            tailLimit = std::min(tailLimit, newLast.length() - headColumn);
+        }
+        size_t tailColumns = 0;
+        while (tailColumns < tailLimit &&
+               oldLast[oldLast.length() - 1 - tailColumns] == newLast[newLast.length() - 1 - tailColumns])
+        {
+            ++tailColumns;
+        }
+
+        const TextPosition changeStart(first + head, headColumn);
+        const TextPosition deleteEnd(first + oldLastLine, oldLast.length() - tailColumns);
+        if (!(deleteEnd == changeStart))
+        {
+            NotifyDeleted(changeStart, deleteEnd);
+        }
+
+        std::wstring inserted;
+        for (size_t i = head; i <= newLastLine; ++i)
+        {
+            const std::wstring& line = m_lines[first + i];
+            const size_t from = (i == head) ? headColumn : 0;
+            const size_t to = (i == newLastLine) ? line.length() - tailColumns : line.length();
+            if (i > head)
+            {
+                inserted += L'\n';
+            }
+            inserted.append(line, from, to - from);
+        }
+        if (!inserted.empty())
+        {
+            NotifyInserted(changeStart, inserted);
+        }
+    }
+}
+
 TextPosition CTextDocument::ClampPosition(const TextPosition& pos) const
 {
     TextPosition result = pos;
@@ -589,3 +574,49 @@ bool CTextDocument::IsValidPosition(const TextPosition& pos) const
     
     return pos.column <= m_lines[pos.line].length();
 }
+
+
+void CTextDocument::AddEditListener(IDocumentEditListener* pListener)
+{
+    if (pListener && std::find(m_listeners.begin(), m_listeners.end(), pListener) == m_listeners.end())
+    {
+        m_listeners.push_back(pListener);
+    }
+}
+
+void CTextDocument::RemoveEditListener(IDocumentEditListener* pListener)
+{
+    m_listeners.erase(std::remove(m_listeners.begin(), m_listeners.end(), pListener), m_listeners.end());
+}
+
+void CTextDocument::NotifyInserted(const TextPosition& pos, const std::wstring& text)
+{
+    for (IDocumentEditListener* pListener : m_listeners)
+    {
+        pListener->OnTextInserted(pos, text);
+    }
+}
+
+void CTextDocument::NotifyDeleted(const TextPosition& start, const TextPosition& end)
+{
+    for (IDocumentEditListener* pListener : m_listeners)
+    {
+        pListener->OnTextDeleted(start, end);
+    }
+}
+
+void CTextDocument::NotifyLinesChanging(size_t firstLine, size_t lastLine)
+{
+    for (IDocumentEditListener* pListener : m_listeners)
+    {
+        pListener->OnLinesChanging(firstLine, lastLine);
+    }
+}
+
+void CTextDocument::NotifyReset()
+{
+    for (IDocumentEditListener* pListener : m_listeners)
+    {
+        pListener->OnDocumentReset();
+    }
+}
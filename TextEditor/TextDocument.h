@@ -1,8 +1,8 @@
 // TextDocument.h - テキストドキュメント管理
 #pragma once
-#include <windows.h>
 #include <string>
 #include <vector>
+#include "FileIO.h"
 
 // テキスト位置を表す構造体
 struct TextPosition
@@ -26,6 +26,44 @@ struct TextPosition
     }
 };
 
+// 選択範囲を表す構造体
+struct Selection
+{
+    TextPosition start;
+    TextPosition end;
+
+    Selection() {}
+    Selection(const TextPosition& s, const TextPosition& e) : start(s), end(e) {}
+
+    bool IsEmpty() const { return start == end; }
+};
+
+// ドキュメント変更の通知を受け取るインターフェース
+class IDocumentEditListener
+{
+public:
+    virtual ~IDocumentEditListener() {}
+    // 位置はいずれも編集前のドキュメント座標
+    virtual void OnTextInserted(const TextPosition& pos, const std::wstring& text) = 0;
+    virtual void OnTextDeleted(const TextPosition& start, const TextPosition& end) = 0;
+    // 読み込みやクリアで内容全体が置き換わった
+    virtual void OnDocumentReset() = 0;
+    // 行 [firstLine, lastLine] をこれから書き換える（編集前の内容を読める最後の機会）。
+    // この後に同じ行の OnTextInserted・OnTextDeleted が届く
+    virtual void OnLinesChanging(size_t firstLine, size_t lastLine) { (void)firstLine; (void)lastLine; }
+};
+
+// 行単位の置き換え（一括置換で使用）。
+// SwapLineBlocks の後は置き換え前の行と置き換え後の位置を保持するので、もう一度適用すると元に戻る
+struct LineBlock
+{
+    size_t firstLine;
+    size_t lineCount;                   // 置き換えられる行数（1行以上）
+    std::vector<std::wstring> lines;    // 置き換える行（1行以上）
+
+    LineBlock() : firstLine(0), lineCount(0) {}
+};
+
 class CTextDocument
 {
 public:
@@ -42,6 +80,8 @@ public:
     const std::wstring& GetLine(size_t index) const;
     std::wstring GetText() const;
     std::wstring GetTextRange(const TextPosition& start, const TextPosition& end) const;
+    // GetTextRange と同じ文字列を out の末尾に追加する（一時的な文字列を作らない）
+    void AppendTextRange(const TextPosition& start, const TextPosition& end, std::wstring& out) const;
 
     // テキスト編集
     void InsertChar(const TextPosition& pos, wchar_t ch);
@@ -49,21 +89,32 @@ public:
     void DeleteChar(const TextPosition& pos);
     void DeleteRange(const TextPosition& start, const TextPosition& end);
     void ReplaceRange(const TextPosition& start, const TextPosition& end, const std::wstring& text);
+    // 昇順で重ならない行ブロックをまとめて置き換える（行の移動は全体で1回）。
+    // 変更の通知はブロックごとに前から順に、置き換え前後で実際に違う部分だけの削除と挿入として送る
+    void SwapLineBlocks(std::vector<LineBlock>& blocks);
 
     // ユーティリティ
     TextPosition ClampPosition(const TextPosition& pos) const;
     bool IsValidPosition(const TextPosition& pos) const;
 
+    // 変更通知
+    void AddEditListener(IDocumentEditListener* pListener);
+    void RemoveEditListener(IDocumentEditListener* pListener);
+
 private:
-    void LoadFromMemoryMappedFile(const wchar_t* filePath);
-    void LoadFromRegularFile(const wchar_t* filePath);
+    void NotifyInserted(const TextPosition& pos, const std::wstring& text);
+    void NotifyDeleted(const TextPosition& start, const TextPosition& end);
+    void NotifyReset();
+    void NotifyLinesChanging(size_t firstLine, size_t lastLine);
+
+    bool LoadFromMemoryMappedFile(const wchar_t* filePath);
+    bool LoadFromRegularFile(const wchar_t* filePath);
     void SplitIntoLines(const std::wstring& text);
 
     std::vector<std::wstring> m_lines;
-    
+    std::vector<IDocumentEditListener*> m_listeners;
+
     // メモリマップドファイル用
-    HANDLE m_hFile;
-    HANDLE m_hMapping;
-    LPVOID m_pView;
+    CMappedFile m_mappedFile;
     size_t m_fileSize;
 };
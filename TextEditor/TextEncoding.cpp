@@ -0,0 +1,269 @@
+// TextEncoding.cpp - 文字コード変換実装
+#include "TextEncoding.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static void AppendCodePoint(std::wstring& out, unsigned long cp)
+{
+    if (sizeof(wchar_t) == 2 && cp >= 0x10000)
+    {
+        cp -= 0x10000;
+        out += static_cast<wchar_t>(0xD800 + (cp >> 10));
+        out += static_cast<wchar_t>(0xDC00 + (cp & 0x3FF));
+    }
+    else
+    {
+        out += static_cast<wchar_t>(cp);
+    }
+}
+
+// UTF-16 コード単位列（エンディアン指定）をワイド文字列に変換
+static std::wstring DecodeUtf16(const unsigned char* bytes, size_t len, bool bigEndian)
+{
+    size_t unitCount = len / 2;
+    std::wstring out;
+    out.reserve(unitCount);
+    for (size_t i = 0; i < unitCount; ++i)
+    {
+        unsigned char b0 = bytes[i * 2];
+        unsigned char b1 = bytes[i * 2 + 1];
+        unsigned long unit = bigEndian ? ((b0 << 8) | b1) : ((b1 << 8) | b0);
+
+        // wchar_tが32bitの環境ではサロゲートペアを結合する
+        if (sizeof(wchar_t) > 2 && unit >= 0xD800 && unit < 0xDC00 && i + 1 < unitCount)
+        {
+            unsigned char c0 = bytes[(i + 1) * 2];
+            unsigned char c1 = bytes[(i + 1) * 2 + 1];
+            unsigned long low = bigEndian ? ((c0 << 8) | c1) : ((c1 << 8) | c0);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                AppendCodePoint(out, 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+                ++i;
+                continue;
+            }
+        }
+        out += static_cast<wchar_t>(unit);
+    }
+    return out;
+}
+
+#ifdef _WIN32
+static bool TryConvertMultiByte(int codePage, DWORD flags, const char* bytes, size_t byteLen, std::wstring& out)
+{
+    out.clear();
+    if (byteLen == 0)
+    {
+        return true;
+    }
+
+    int needed = MultiByteToWideChar(codePage, flags, bytes, static_cast<int>(byteLen), NULL, 0);
+    if (needed <= 0)
+    {
+        return false;
+    }
+    out.resize(static_cast<size_t>(needed));
+    int written = MultiByteToWideChar(codePage, flags, bytes, static_cast<int>(byteLen), &out[0], needed);
+    if (written <= 0)
+    {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+static bool TryDecodeUtf8(const char* bytes, size_t len, bool strict, std::wstring& out)
+{
+    return TryConvertMultiByte(CP_UTF8, strict ? MB_ERR_INVALID_CHARS : 0, bytes, len, out);
+}
+
+static bool TryDecodeAnsi(const char* bytes, size_t len, std::wstring& out)
+{
+    return TryConvertMultiByte(CP_ACP, 0, bytes, len, out);
+}
+#else
+static bool TryDecodeUtf8(const char* bytes, size_t len, bool strict, std::wstring& out)
+{
+    out.clear();
+    out.reserve(len);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(bytes);
+    size_t i = 0;
+    while (i < len)
+    {
+        unsigned char b = p[i];
+        if (b < 0x80)
+        {
+            out += static_cast<wchar_t>(b);
+            ++i;
+            continue;
+        }
+
+        size_t extra = 0;
+        unsigned long cp = 0;
+        unsigned long minValue = 0;
+        if ((b & 0xE0) == 0xC0) { extra = 1; cp = b & 0x1F; minValue = 0x80; }
+        else if ((b & 0xF0) == 0xE0) { extra = 2; cp = b & 0x0F; minValue = 0x800; }
+        else if ((b & 0xF8) == 0xF0) { extra = 3; cp = b & 0x07; minValue = 0x10000; }
+
+        bool valid = extra > 0;
+        if (valid)
+        {
+            for (size_t k = 1; k <= extra; ++k)
+            {
+                if (i + k >= len || (p[i + k] & 0xC0) != 0x80)
+                {
+                    valid = false;
+                    break;
+                }
+                cp = (cp << 6) | (p[i + k] & 0x3F);
+            }
+        }
+        if (valid && (cp < minValue || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000)))
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            if (strict)
+            {
+                out.clear();
+                return false;
+            }
+            out += static_cast<wchar_t>(0xFFFD);
+            ++i;
+            continue;
+        }
+
+        AppendCodePoint(out, cp);
+        i += extra + 1;
+    }
+    return true;
+}
+
+static bool TryDecodeAnsi(const char* bytes, size_t len, std::wstring& out)
+{
+    // POSIXではシステムのANSIコードページが無いためLatin-1として扱う
+    out.resize(len);
+    for (size_t i = 0; i < len; ++i)
+    {
+        out[i] = static_cast<wchar_t>(static_cast<unsigned char>(bytes[i]));
+    }
+    return true;
+}
+#endif
+
+std::wstring ConvertBytesToWide(const char* bytes, size_t len)
+{
+    const unsigned char* ubytes = reinterpret_cast<const unsigned char*>(bytes);
+
+    // BOM check
+    if (len >= 3 && ubytes[0] == 0xEF && ubytes[1] == 0xBB && ubytes[2] == 0xBF)
+    {
+        std::wstring out;
+        if (TryDecodeUtf8(bytes + 3, len - 3, true, out))
+            return out;
+        if (TryDecodeUtf8(bytes + 3, len - 3, false, out))
+            return out;
+    }
+    if (len >= 2 && ubytes[0] == 0xFF && ubytes[1] == 0xFE)
+    {
+        // UTF-16LE
+        return DecodeUtf16(ubytes + 2, len - 2, false);
+    }
+    if (len >= 2 && ubytes[0] == 0xFE && ubytes[1] == 0xFF)
+    {
+        // UTF-16BE → swap to LE
+        return DecodeUtf16(ubytes + 2, len - 2, true);
+    }
+
+    // No BOM: try UTF-8 strict → lax → ANSI
+    std::wstring out;
+    if (TryDecodeUtf8(bytes, len, true, out))
+        return out;
+    if (TryDecodeUtf8(bytes, len, false, out))
+        return out;
+    if (TryDecodeAnsi(bytes, len, out))
+        return out;
+
+    return L"";
+}
+
+bool ConvertUtf8ToWide(const char* bytes, size_t len, std::wstring& out)
+{
+    return TryDecodeUtf8(bytes, len, false, out);
+}
+
+bool ConvertWideToUtf8(const std::wstring& text, std::string& out)
+{
+    return ConvertWideToUtf8(text.data(), text.size(), out);
+}
+
+bool ConvertWideToUtf8(const wchar_t* text, size_t len, std::string& out)
+{
+    out.clear();
+    if (len == 0)
+    {
+        return true;
+    }
+
+#ifdef _WIN32
+    int needed = WideCharToMultiByte(CP_UTF8, 0, text, static_cast<int>(len), NULL, 0, NULL, NULL);
+    if (needed <= 0)
+    {
+        return false;
+    }
+    out.resize(static_cast<size_t>(needed));
+    int written = WideCharToMultiByte(CP_UTF8, 0, text, static_cast<int>(len), &out[0], needed, NULL, NULL);
+    if (written <= 0)
+    {
+        out.clear();
+        return false;
+    }
+    return true;
+#else
+    out.reserve(len);
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned long cp = static_cast<unsigned long>(text[i]);
+        if (sizeof(wchar_t) == 2 && cp >= 0xD800 && cp < 0xDC00 && i + 1 < len)
+        {
+            unsigned long low = static_cast<unsigned long>(text[i + 1]);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                ++i;
+            }
+        }
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000))
+        {
+            cp = 0xFFFD;
+        }
+
+        if (cp < 0x80)
+        {
+            out += static_cast<char>(cp);
+        }
+        else if (cp < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+    return true;
+#endif
+}
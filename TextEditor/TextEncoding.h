@@ -0,0 +1,13 @@
+// TextEncoding.h - 文字コード変換（UTF-8 / UTF-16 / ANSI）
+#pragma once
+#include <string>
+
+// バイト列をワイド文字列に変換（BOM/UTF-8/ANSI を自動判定）
+std::wstring ConvertBytesToWide(const char* bytes, size_t len);
+
+// UTF-8バイト列をワイド文字列に変換（BOM判定なし、不正なバイトはU+FFFD）
+bool ConvertUtf8ToWide(const char* bytes, size_t len, std::wstring& out);
+
+// ワイド文字列をUTF-8に変換
+bool ConvertWideToUtf8(const std::wstring& text, std::string& out);
+bool ConvertWideToUtf8(const wchar_t* text, size_t len, std::string& out);
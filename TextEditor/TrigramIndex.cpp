@@ -0,0 +1,475 @@
+// TrigramIndex.cpp - 行ブロックごとの3文字組索引実装
+#include "TrigramIndex.h"
+#include "CaseFold.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cstring>
+
+// ブロックの目安の文字数（行の区切りを含む）。編集でこの2倍を超えたら索引し直す前に分ける
+static const size_t BLOCK_CHARS = 64 * 1024;
+// ブロックごとのビット集合の大きさ（2のべき乗）
+static const size_t SIGNATURE_SHIFT = 15;
+static const size_t SIGNATURE_BITS = size_t(1) << SIGNATURE_SHIFT;
+static const size_t SIGNATURE_WORDS = SIGNATURE_BITS / 64;
+
+// ファイル形式
+//   ヘッダ: "AWT1" | 形式バージョン(u32) | 元ファイルサイズ(u64) | 元ファイル更新時刻(i64) |
+//           行数(u64) | ブロック数(u64) | ビット集合のビット数(u32)
+//   ブロックの行数(u64) × ブロック数
+//   ビット集合(u64 × SIGNATURE_WORDS) × ブロック数
+static const char INDEX_MAGIC[4] = { 'A', 'W', 'T', '1' };
+static const uint32_t INDEX_FORMAT_VERSION = 1;
+static const size_t INDEX_HEADER_SIZE = 44;
+
+static void AppendFixed(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+    {
+        out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+static uint64_t ReadFixed(const uint8_t* data, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        value |= static_cast<uint64_t>(data[i]) << (i * 8);
+    }
+    return value;
+}
+
+// 畳み込み済みの3文字をビット位置に写す
+static size_t TrigramBit(wchar_t a, wchar_t b, wchar_t c)
+{
+    uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(a)) << 42)
+                 ^ (static_cast<uint64_t>(static_cast<uint32_t>(b)) << 21)
+                 ^ static_cast<uint64_t>(static_cast<uint32_t>(c));
+    key *= 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(key >> (64 - SIGNATURE_SHIFT));
+}
+
+// 行 [firstLine, firstLine + lineCount) の3文字組を signature に立てる（行をまたぐ組は数えない）
+static void ComputeSignature(const CTextDocument* pDocument, size_t firstLine, size_t lineCount,
+                             std::vector<uint64_t>& signature)
+{
+    signature.assign(SIGNATURE_WORDS, 0);
+    for (size_t line = firstLine; line < firstLine + lineCount; ++line)
+    {
+        const std::wstring& text = pDocument->GetLine(line);
+        if (text.length() < 3)
+        {
+            continue;
+        }
+
+        wchar_t a = FoldCase(text[0]);
+        wchar_t b = FoldCase(text[1]);
+        for (size_t i = 2; i < text.length(); ++i)
+        {
+            const wchar_t c = FoldCase(text[i]);
+            const size_t bit = TrigramBit(a, b, c);
+            signature[bit / 64] |= uint64_t(1) << (bit % 64);
+            a = b;
+            b = c;
+        }
+    }
+}
+
+CTrigramIndex::CTrigramIndex()
+    : m_pDocument(nullptr)
+    , m_edited(false)
+{
+}
+
+CTrigramIndex::~CTrigramIndex()
+{
+    Detach();
+}
+
+void CTrigramIndex::Attach(CTextDocument* pDocument)
+{
+    Detach();
+    if (!pDocument)
+    {
+        return;
+    }
+
+    m_pDocument = pDocument;
+    m_pDocument->AddEditListener(this);
+    Partition();
+    m_edited = false;
+}
+
+void CTrigramIndex::Detach()
+{
+    if (m_pDocument)
+    {
+        m_pDocument->RemoveEditListener(this);
+        m_pDocument = nullptr;
+    }
+    m_blocks.clear();
+    m_edited = false;
+}
+
+void CTrigramIndex::Partition()
+{
+    // 行をおよそ BLOCK_CHARS 文字ずつのブロックにまとめる（長い行は1行で1ブロック）
+    m_blocks.clear();
+    IndexBlock block;
+    block.lineCount = 0;
+    size_t chars = 0;
+    const size_t lineCount = m_pDocument->GetLineCount();
+    for (size_t line = 0; line < lineCount; ++line)
+    {
+        ++block.lineCount;
+        chars += m_pDocument->GetLine(line).length() + 1;
+        if (chars >= BLOCK_CHARS)
+        {
+            m_blocks.push_back(block);
+            block.lineCount = 0;
+            chars = 0;
+        }
+    }
+    if (block.lineCount > 0 || m_blocks.empty())
+    {
+        m_blocks.push_back(block);
+    }
+}
+
+bool CTrigramIndex::IsComplete() const
+{
+    for (const IndexBlock& block : m_blocks)
+    {
+        if (block.signature.empty())
+        {
+            return false;
+        }
+    }
+    return m_pDocument != nullptr;
+}
+
+bool CTrigramIndex::Continue(size_t maxBlocks)
+{
+    if (!m_pDocument)
+    {
+        return false;
+    }
+
+    size_t indexed = 0;
+    size_t blockFirstLine = 0;
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+    {
+        if (m_blocks[i].signature.empty())
+        {
+            if (maxBlocks != 0 && indexed == maxBlocks)
+            {
+                return false;
+            }
+            SplitBlock(i, blockFirstLine);
+            ComputeSignature(m_pDocument, blockFirstLine, m_blocks[i].lineCount, m_blocks[i].signature);
+            ++indexed;
+        }
+        blockFirstLine += m_blocks[i].lineCount;
+    }
+    return true;
+}
+
+void CTrigramIndex::Build(size_t threadCount)
+{
+    if (!m_pDocument)
+    {
+        return;
+    }
+
+    // 分割でブロックの並びが変わるので、先に分けてから未索引のブロックを集める
+    std::vector<size_t> pending;
+    std::vector<size_t> pendingFirstLine;
+    size_t blockFirstLine = 0;
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+    {
+        if (m_blocks[i].signature.empty())
+        {
+            SplitBlock(i, blockFirstLine);
+            pending.push_back(i);
+            pendingFirstLine.push_back(blockFirstLine);
+        }
+        blockFirstLine += m_blocks[i].lineCount;
+    }
+
+    // 各ブロックのビット集合は別々の領域なので、そのまま並列に求められる
+    const CTextDocument* pDocument = m_pDocument;
+    CWorkerPool::GetShared().ParallelFor(pending.size(), [&](size_t task)
+    {
+        IndexBlock& block = m_blocks[pending[task]];
+        ComputeSignature(pDocument, pendingFirstLine[task], block.lineCount, block.signature);
+    }, threadCount);
+}
+
+void CTrigramIndex::SplitBlock(size_t blockIndex, size_t blockFirstLine)
+{
+    // 編集で目安の2倍を超えたブロックは、先頭の目安の大きさ分だけを残す（残りは未索引の次のブロックになる）
+    const size_t lineCount = m_blocks[blockIndex].lineCount;
+    size_t chars = 0;
+    size_t splitLine = 0;
+    for (size_t i = 0; i < lineCount && chars < BLOCK_CHARS * 2; ++i)
+    {
+        chars += m_pDocument->GetLine(blockFirstLine + i).length() + 1;
+        if (splitLine == 0 && chars >= BLOCK_CHARS)
+        {
+            splitLine = i + 1;
+        }
+    }
+    if (chars < BLOCK_CHARS * 2 || splitLine == 0 || splitLine >= lineCount)
+    {
+        return;
+    }
+
+    IndexBlock tail;
+    tail.lineCount = lineCount - splitLine;
+    m_blocks[blockIndex].lineCount = splitLine;
+    m_blocks.insert(m_blocks.begin() + blockIndex + 1, tail);
+}
+
+bool CTrigramIndex::GetCandidateLines(const CCompiledPattern& pattern, std::vector<LineRange>& ranges) const
+{
+    ranges.clear();
+    if (!m_pDocument || !pattern.IsValid() || pattern.IsMultiLine())
+    {
+        return false;
+    }
+
+    const std::wstring literal = pattern.GetRequiredLiteral();
+    if (literal.length() < 3)
+    {
+        return false;
+    }
+
+    std::vector<size_t> bits;
+    for (size_t i = 2; i < literal.length(); ++i)
+    {
+        bits.push_back(TrigramBit(FoldCase(literal[i - 2]), FoldCase(literal[i - 1]), FoldCase(literal[i])));
+    }
+    std::sort(bits.begin(), bits.end());
+    bits.erase(std::unique(bits.begin(), bits.end()), bits.end());
+
+    // 未索引のブロックと、リテラルの3文字組がすべて立っているブロックが候補
+    size_t firstLine = 0;
+    for (const IndexBlock& block : m_blocks)
+    {
+        bool candidate = true;
+        if (!block.signature.empty())
+        {
+            for (size_t bit : bits)
+            {
+                if ((block.signature[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+                {
+                    candidate = false;
+                    break;
+                }
+            }
+        }
+
+        if (candidate && block.lineCount > 0)
+        {
+            if (!ranges.empty() && ranges.back().lastLine == firstLine)
+            {
+                ranges.back().lastLine += block.lineCount;
+            }
+            else
+            {
+                ranges.push_back(LineRange(firstLine, firstLine + block.lineCount));
+            }
+        }
+        firstLine += block.lineCount;
+    }
+    return true;
+}
+
+std::wstring CTrigramIndex::GetIndexPath(const wchar_t* filePath)
+{
+    return std::wstring(filePath) + L".awtrigram";
+}
+
+bool CTrigramIndex::SaveToFile(const wchar_t* indexPath, const FileStat& sourceStat) const
+{
+    // 編集後の索引はファイルの内容と食い違うので保存しない
+    if (!m_pDocument || m_edited || !IsComplete())
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> buffer(INDEX_MAGIC, INDEX_MAGIC + 4);
+    AppendFixed(buffer, INDEX_FORMAT_VERSION, 4);
+    AppendFixed(buffer, sourceStat.size, 8);
+    AppendFixed(buffer, static_cast<uint64_t>(sourceStat.lastWriteTime), 8);
+    AppendFixed(buffer, m_pDocument->GetLineCount(), 8);
+    AppendFixed(buffer, m_blocks.size(), 8);
+    AppendFixed(buffer, SIGNATURE_BITS, 4);
+    for (const IndexBlock& block : m_blocks)
+    {
+        AppendFixed(buffer, block.lineCount, 8);
+    }
+
+    CFile file;
+    if (!file.Open(indexPath, CFile::CreateAlways, FileAccessHint::Sequential) ||
+        !file.Write(buffer.data(), buffer.size()))
+    {
+        return false;
+    }
+
+    // ビット集合はブロックごとに書き出す
+    for (const IndexBlock& block : m_blocks)
+    {
+        buffer.clear();
+        for (uint64_t word : block.signature)
+        {
+            AppendFixed(buffer, word, 8);
+        }
+        if (!file.Write(buffer.data(), buffer.size()))
+        {
+            file.Close();
+            DeleteFilePath(indexPath);
+            return false;
+        }
+    }
+    return file.Flush();
+}
+
+bool CTrigramIndex::LoadFromFile(const wchar_t* indexPath, const FileStat& sourceStat)
+{
+    if (!m_pDocument)
+    {
+        return false;
+    }
+
+    CMappedFile file;
+    if (!file.Open(indexPath, FileAccessHint::Sequential) || file.GetSize() < INDEX_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    // 元ファイルが索引を作った後に変更されていれば使えない
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(file.GetData());
+    const uint64_t lineCount = ReadFixed(data + 24, 8);
+    const uint64_t blockCount = ReadFixed(data + 32, 8);
+    if (std::memcmp(data, INDEX_MAGIC, 4) != 0 || ReadFixed(data + 4, 4) != INDEX_FORMAT_VERSION ||
+        ReadFixed(data + 8, 8) != sourceStat.size ||
+        static_cast<int64_t>(ReadFixed(data + 16, 8)) != sourceStat.lastWriteTime ||
+        lineCount != m_pDocument->GetLineCount() || ReadFixed(data + 40, 4) != SIGNATURE_BITS ||
+        blockCount == 0 || blockCount > lineCount + 1 ||
+        file.GetSize() != INDEX_HEADER_SIZE + blockCount * (8 + SIGNATURE_WORDS * 8))
+    {
+        return false;
+    }
+
+    std::vector<IndexBlock> blocks(static_cast<size_t>(blockCount));
+    const uint8_t* pos = data + INDEX_HEADER_SIZE;
+    uint64_t totalLines = 0;
+    for (IndexBlock& block : blocks)
+    {
+        block.lineCount = static_cast<size_t>(ReadFixed(pos, 8));
+        totalLines += block.lineCount;
+        pos += 8;
+    }
+    if (totalLines != lineCount)
+    {
+        return false;
+    }
+
+    for (IndexBlock& block : blocks)
+    {
+        block.signature.resize(SIGNATURE_WORDS);
+        for (uint64_t& word : block.signature)
+        {
+            word = ReadFixed(pos, 8);
+            pos += 8;
+        }
+    }
+
+    m_blocks.swap(blocks);
+    m_edited = false;
+    return true;
+}
+
+void CTrigramIndex::OnTextInserted(const TextPosition& pos, const std::wstring& text)
+{
+    // 挿入位置の行が、改行の数だけ増えた行に置き換わる（\r はドキュメント側で捨てられる）
+    size_t newLines = static_cast<size_t>(std::count(text.begin(), text.end(), L'\n'));
+    ReplaceLines(pos.line, 1, newLines + 1);
+}
+
+void CTrigramIndex::OnTextDeleted(const TextPosition& start, const TextPosition& end)
+{
+    // 削除範囲にかかる行が1行にまとまる
+    ReplaceLines(start.line, end.line - start.line + 1, 1);
+}
+
+void CTrigramIndex::OnDocumentReset()
+{
+    // 内容全体が変わったので分け直す（どのブロックも未索引になる）
+    Partition();
+    m_edited = true;
+}
+
+void CTrigramIndex::ReplaceLines(size_t firstLine, size_t oldLineCount, size_t newLineCount)
+{
+    if (m_blocks.empty())
+    {
+        return;
+    }
+    m_edited = true;
+
+    // 取り除く行がかかるブロックの行数を減らし、索引し直すまで候補にする
+    size_t remaining = oldLineCount;
+    size_t blockFirstLine = 0;
+    for (size_t i = 0; i < m_blocks.size() && remaining > 0; ++i)
+    {
+        IndexBlock& block = m_blocks[i];
+        const size_t blockEnd = blockFirstLine + block.lineCount;
+        if (firstLine >= blockEnd)
+        {
+            blockFirstLine = blockEnd;
+            continue;
+        }
+
+        const size_t count = std::min(remaining, blockEnd - firstLine);
+        block.lineCount -= count;
+        block.signature.clear();
+        remaining -= count;
+        blockFirstLine += block.lineCount;
+    }
+
+    // 空いた位置に新しい行を差し込む
+    size_t insertFirstLine = 0;
+    IndexBlock& block = m_blocks[FindBlock(firstLine, insertFirstLine)];
+    block.lineCount += newLineCount;
+    block.signature.clear();
+
+    // 空になったブロックは取り除く
+    for (size_t i = 0; i < m_blocks.size() && m_blocks.size() > 1;)
+    {
+        if (m_blocks[i].lineCount == 0)
+        {
+            m_blocks.erase(m_blocks.begin() + i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+size_t CTrigramIndex::FindBlock(size_t line, size_t& blockFirstLine) const
+{
+    // 最後のブロックより後ろの行は最後のブロックに含める（末尾への追加）
+    blockFirstLine = 0;
+    for (size_t i = 0; i + 1 < m_blocks.size(); ++i)
+    {
+        if (line < blockFirstLine + m_blocks[i].lineCount)
+        {
+            return i;
+        }
+        blockFirstLine += m_blocks[i].lineCount;
+    }
+    return m_blocks.size() - 1;
+}
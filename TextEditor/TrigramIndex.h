@@ -0,0 +1,77 @@
+// TrigramIndex.h - 行ブロックごとの3文字組（トライグラム）索引
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "TextDocument.h"
+#include "SearchPattern.h"
+#include "FileIO.h"
+
+// 行範囲 [firstLine, lastLine)
+struct LineRange
+{
+    size_t firstLine;
+    size_t lastLine;
+
+    LineRange() : firstLine(0), lastLine(0) {}
+    LineRange(size_t first, size_t last) : firstLine(first), lastLine(last) {}
+};
+
+// 何度も検索する大きなドキュメント用の索引。行をおよそ一定の文字数のブロックに分け、
+// ブロック内の各行に現れる3文字組（大文字小文字を畳み込んだもの）をハッシュしたビット集合で持つ。
+// 一致が必ず含むリテラルの3文字組がすべて立っているブロックだけを照合すればよい
+// （ハッシュの衝突で余分なブロックが候補になることはあるが、一致を含むブロックを落とすことはない）。
+// 編集されたブロックは索引し直すまで常に候補とし、行数の増減はブロックの行数だけで追従する。
+// 索引の構築は Continue で少しずつ進めるか、Build でワーカープールを使って一度に行う。
+// Attach したドキュメントより先に破棄するか、Detach してからドキュメントを破棄すること
+class CTrigramIndex : public IDocumentEditListener
+{
+public:
+    CTrigramIndex();
+    ~CTrigramIndex();
+
+    // ドキュメントの行をブロックに分け、以後の編集を追跡する（どのブロックもまだ索引していない）
+    void Attach(CTextDocument* pDocument);
+    void Detach();
+    bool IsAttached() const { return m_pDocument != nullptr; }
+    const CTextDocument* GetDocument() const { return m_pDocument; }
+
+    // 未索引のブロックを最大 maxBlocks 個（0ならすべて）索引する。すべて索引済みならtrue。
+    // UIスレッドのタイマーなどから少しずつ呼べば、編集を妨げずに索引を作れる
+    bool Continue(size_t maxBlocks = 0);
+    // 未索引のブロックを共有ワーカープールで並列に索引する（threadCount は ParallelFor の同時実行数）
+    void Build(size_t threadCount = 0);
+    bool IsComplete() const;
+
+    // pattern の一致を含みうる行範囲を文書順に求める。
+    // 複数行モードや、3文字以上の必須リテラルが無いパターンでは絞り込めないのでfalse
+    bool GetCandidateLines(const CCompiledPattern& pattern, std::vector<LineRange>& ranges) const;
+
+    // 索引の保存と読み込み。sourceStat は索引のもとになったファイルの情報で、読み込み時に一致を確認する。
+    // 保存できるのはすべて索引済みで、Attach（または読み込み）以降に編集されていない場合のみ
+    bool SaveToFile(const wchar_t* indexPath, const FileStat& sourceStat) const;
+    bool LoadFromFile(const wchar_t* indexPath, const FileStat& sourceStat);
+    // ファイルの隣に置く索引ファイルのパス
+    static std::wstring GetIndexPath(const wchar_t* filePath);
+
+    // IDocumentEditListener
+    void OnTextInserted(const TextPosition& pos, const std::wstring& text) override;
+    void OnTextDeleted(const TextPosition& start, const TextPosition& end) override;
+    void OnDocumentReset() override;
+
+private:
+    struct IndexBlock
+    {
+        size_t lineCount;
+        std::vector<uint64_t> signature;    // 3文字組のビット集合（空なら未索引）
+    };
+
+    void Partition();
+    void ReplaceLines(size_t firstLine, size_t oldLineCount, size_t newLineCount);
+    size_t FindBlock(size_t line, size_t& blockFirstLine) const;
+    void SplitBlock(size_t blockIndex, size_t blockFirstLine);
+
+    CTextDocument* m_pDocument;
+    std::vector<IndexBlock> m_blocks;
+    bool m_edited;  // Attach（または読み込み）以降に編集された
+};
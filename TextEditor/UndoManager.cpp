@@ -1,41 +1,98 @@
 // UndoManager.cpp - Undo/Redo管理実装
 #include "UndoManager.h"
+#include <cstdint>
+#include <algorithm>
+#include <cwctype>
+#include <iterator>
 
-// CInsertTextCommand実装
-void CInsertTextCommand::Execute(CTextDocument* pDocument)
+// この時間より間が空いたタイプ入力は別の履歴にする
+static const int COALESCE_TIMEOUT_MS = 1000;
+
+// 一時ファイルに退避したコマンドの種類
+static const size_t COMMAND_INSERT_TEXT = 1;
+static const size_t COMMAND_DELETE_TEXT = 2;
+static const size_t COMMAND_REPLACE_TEXT = 3;
+static const size_t COMMAND_REPLACE_LINES = 4;
+static const size_t COMMAND_COMPOUND = 5;
+
+// 記録した文字列の領域を詰めるのは、この文字数を超えてから
+static const size_t PAYLOAD_COMPACT_MIN = 4096;
+
+// 文字列が確保している領域のバイト数（短い文字列がオブジェクトの中に収まっていれば0）
+static size_t GetHeapBytes(const std::wstring& text)
 {
-    if (pDocument)
+    const uintptr_t data = reinterpret_cast<uintptr_t>(text.data());
+    const uintptr_t object = reinterpret_cast<uintptr_t>(&text);
+    if (data >= object && data < object + sizeof(text))
     {
-        pDocument->InsertText(m_position, m_text);
-        
-        // 挿入後の終了位置を計算
-        m_endPosition = m_position;
-        size_t lineCount = 0;
-        size_t lastLineLength = 0;
-        
-        for (wchar_t ch : m_text)
+        return 0;
+    }
+    return (text.capacity() + 1) * sizeof(wchar_t);
+}
+
+static bool ContainsLineBreak(const wchar_t* text, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (text[i] == L'\r' || text[i] == L'\n')
         {
-            if (ch == L'\n')
-            {
-                lineCount++;
-                lastLineLength = 0;
-            }
-            else if (ch != L'\r')
-            {
-                lastLineLength++;
-            }
+            return true;
         }
-        
-        if (lineCount > 0)
+    }
+    return false;
+}
+
+static bool ContainsLineBreak(const std::wstring& text)
+{
+    return ContainsLineBreak(text.data(), text.length());
+}
+
+// start に text を挿入した後の終了位置
+static TextPosition GetEndPosition(const TextPosition& start, const wchar_t* text, size_t length)
+{
+    TextPosition end = start;
+    size_t lineCount = 0;
+    size_t lastLineLength = 0;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (text[i] == L'\n')
         {
-            m_endPosition.line += lineCount;
-            m_endPosition.column = lastLineLength;
+            lineCount++;
+            lastLineLength = 0;
         }
-        else
+        else if (text[i] != L'\r')
         {
-            m_endPosition.column += m_text.length();
+            lastLineLength++;
         }
     }
+
+    if (lineCount > 0)
+    {
+        end.line += lineCount;
+        end.column = lastLineLength;
+    }
+    else
+    {
+        end.column += length;
+    }
+    return end;
+}
+
+// left の直後に right が続く位置が単語の始まりか（空白の後の空白以外の文字）。タイプ入力のまとまりの区切り
+static bool IsWordStart(wchar_t left, wchar_t right)
+{
+    return std::iswspace(static_cast<wint_t>(left)) != 0 && std::iswspace(static_cast<wint_t>(right)) == 0;
+}
+
+// CInsertTextCommand実装
+void CInsertTextCommand::Execute(CTextDocument* pDocument)
+{
+    if (pDocument)
+    {
+        pDocument->InsertText(m_position, m_text);
+        m_endPosition = GetEndPosition(m_position, m_text.data(), m_text.length());
+    }
 }
 
 void CInsertTextCommand::Undo(CTextDocument* pDocument)
@@ -51,6 +108,48 @@ void CInsertTextCommand::Redo(CTextDocument* pDocument)
     Execute(pDocument);
 }
 
+size_t CInsertTextCommand::GetMemoryUsage() const
+{
+    return sizeof(*this) + GetHeapBytes(m_text);
+}
+
+void CInsertTextCommand::Serialize(CUndoRecordWriter& writer) const
+{
+    writer.WriteSize(COMMAND_INSERT_TEXT);
+    writer.WritePosition(m_position);
+    writer.WritePosition(m_endPosition);
+    writer.WriteString(m_text);
+}
+
+std::unique_ptr<ICommand> CInsertTextCommand::Deserialize(CUndoRecordReader& reader)
+{
+    TextPosition position;
+    TextPosition endPosition;
+    std::wstring text;
+    if (!reader.ReadPosition(position) || !reader.ReadPosition(endPosition) || !reader.ReadString(text))
+    {
+        return nullptr;
+    }
+    std::unique_ptr<CInsertTextCommand> command = std::make_unique<CInsertTextCommand>(position, text);
+    command->m_endPosition = endPosition;
+    return command;
+}
+
+bool CInsertTextCommand::MergeWith(const ICommand* pNext)
+{
+    // 同じ行で挿入した文字列の直後に続けて挿入した場合だけまとめる（改行は1つの履歴にする）
+    const CInsertTextCommand* pInsert = dynamic_cast<const CInsertTextCommand*>(pNext);
+    if (!pInsert || m_text.empty() || pInsert->m_text.empty() || !(pInsert->m_position == m_endPosition) ||
+        ContainsLineBreak(m_text) || ContainsLineBreak(pInsert->m_text) ||
+        IsWordStart(m_text.back(), pInsert->m_text.front()))
+    {
+        return false;
+    }
+    m_text += pInsert->m_text;
+    m_endPosition = pInsert->m_endPosition;
+    return true;
+}
+
 // CDeleteTextCommand実装
 void CDeleteTextCommand::Execute(CTextDocument* pDocument)
 {
@@ -77,6 +176,67 @@ void CDeleteTextCommand::Redo(CTextDocument* pDocument)
     }
 }
 
+size_t CDeleteTextCommand::GetMemoryUsage() const
+{
+    return sizeof(*this) + GetHeapBytes(m_deletedText);
+}
+
+void CDeleteTextCommand::Serialize(CUndoRecordWriter& writer) const
+{
+    writer.WriteSize(COMMAND_DELETE_TEXT);
+    writer.WritePosition(m_start);
+    writer.WritePosition(m_end);
+    writer.WriteString(m_deletedText);
+}
+
+std::unique_ptr<ICommand> CDeleteTextCommand::Deserialize(CUndoRecordReader& reader)
+{
+    TextPosition start;
+    TextPosition end;
+    std::wstring deletedText;
+    if (!reader.ReadPosition(start) || !reader.ReadPosition(end) || !reader.ReadString(deletedText))
+    {
+        return nullptr;
+    }
+    std::unique_ptr<CDeleteTextCommand> command = std::make_unique<CDeleteTextCommand>(start, end);
+    command->m_deletedText = std::move(deletedText);
+    return command;
+}
+
+bool CDeleteTextCommand::MergeWith(const ICommand* pNext)
+{
+    // 行をまたがない削除を、Backspace（直前）と Delete（同じ位置）の向きに続けた場合だけまとめる
+    const CDeleteTextCommand* pDelete = dynamic_cast<const CDeleteTextCommand*>(pNext);
+    if (!pDelete || m_deletedText.empty() || pDelete->m_deletedText.empty() ||
+        ContainsLineBreak(m_deletedText) || ContainsLineBreak(pDelete->m_deletedText))
+    {
+        return false;
+    }
+
+    if (pDelete->m_end == m_start)
+    {
+        if (IsWordStart(pDelete->m_deletedText.back(), m_deletedText.front()))
+        {
+            return false;
+        }
+        m_deletedText.insert(0, pDelete->m_deletedText);
+        m_start = pDelete->m_start;
+        return true;
+    }
+    if (pDelete->m_start == m_start)
+    {
+        if (IsWordStart(m_deletedText.back(), pDelete->m_deletedText.front()))
+        {
+            return false;
+        }
+        // 削除前の座標では、続けて削除した文字は元の範囲の直後にある
+        m_deletedText += pDelete->m_deletedText;
+        m_end.column += pDelete->m_end.column - pDelete->m_start.column;
+        return true;
+    }
+    return false;
+}
+
 // CReplaceTextCommand実装
 void CReplaceTextCommand::Execute(CTextDocument* pDocument)
 {
@@ -91,34 +251,7 @@ void CReplaceTextCommand::Undo(CTextDocument* pDocument)
 {
     if (pDocument)
     {
-        // 新しいテキストの終了位置を計算
-        TextPosition newEnd = m_start;
-        size_t lineCount = 0;
-        size_t lastLineLength = 0;
-        
-        for (wchar_t ch : m_newText)
-        {
-            if (ch == L'\n')
-            {
-                lineCount++;
-                lastLineLength = 0;
-            }
-            else if (ch != L'\r')
-            {
-                lastLineLength++;
-            }
-        }
-        
-        if (lineCount > 0)
-        {
-            newEnd.line += lineCount;
-            newEnd.column = lastLineLength;
-        }
-        else
-        {
-            newEnd.column += m_newText.length();
-        }
-        
+        const TextPosition newEnd = GetEndPosition(m_start, m_newText.data(), m_newText.length());
         pDocument->ReplaceRange(m_start, newEnd, m_oldText);
     }
 }
@@ -131,100 +264,1144 @@ void CReplaceTextCommand::Redo(CTextDocument* pDocument)
     }
 }
 
-// CUndoManager実装
-CUndoManager::CUndoManager()
-    : m_currentIndex(0)
-    , m_maxMemoryUsage(100 * 1024 * 1024) // デフォルト100MB
-    , m_estimatedMemoryUsage(0)
+size_t CReplaceTextCommand::GetMemoryUsage() const
 {
+    return sizeof(*this) + GetHeapBytes(m_oldText) + GetHeapBytes(m_newText);
 }
 
-CUndoManager::~CUndoManager()
+void CReplaceTextCommand::Serialize(CUndoRecordWriter& writer) const
 {
+    writer.WriteSize(COMMAND_REPLACE_TEXT);
+    writer.WritePosition(m_start);
+    writer.WritePosition(m_end);
+    writer.WriteString(m_oldText);
+    writer.WriteString(m_newText);
 }
 
-void CUndoManager::ExecuteCommand(std::unique_ptr<ICommand> command, CTextDocument* pDocument)
+std::unique_ptr<ICommand> CReplaceTextCommand::Deserialize(CUndoRecordReader& reader)
 {
-    if (!command || !pDocument)
+    TextPosition start;
+    TextPosition end;
+    std::wstring oldText;
+    std::wstring newText;
+    if (!reader.ReadPosition(start) || !reader.ReadPosition(end) ||
+        !reader.ReadString(oldText) || !reader.ReadString(newText))
     {
-        return;
+        return nullptr;
     }
+    std::unique_ptr<CReplaceTextCommand> command = std::make_unique<CReplaceTextCommand>(start, end, newText);
+    command->m_oldText = std::move(oldText);
+    return command;
+}
 
-    // 現在位置より後ろのコマンドを削除
-    if (m_currentIndex < m_commands.size())
+// CReplaceLinesCommand実装
+void CReplaceLinesCommand::Execute(CTextDocument* pDocument)
+{
+    if (pDocument)
     {
-        m_commands.erase(m_commands.begin() + m_currentIndex, m_commands.end());
+        pDocument->SwapLineBlocks(m_blocks);
     }
+}
 
-    // コマンドを実行
-    command->Execute(pDocument);
+void CReplaceLinesCommand::Undo(CTextDocument* pDocument)
+{
+    Execute(pDocument);
+}
 
-    // コマンドを履歴に追加
-    m_estimatedMemoryUsage += EstimateCommandSize(command.get());
-    m_commands.push_back(std::move(command));
-    m_currentIndex++;
+void CReplaceLinesCommand::Redo(CTextDocument* pDocument)
+{
+    Execute(pDocument);
+}
 
-    // メモリ制限チェック
-    TrimMemoryIfNeeded();
+size_t CReplaceLinesCommand::GetMemoryUsage() const
+{
+    // 置き換え前後が入れ替わるので、元に戻す・やり直すたびに変わる
+    size_t bytes = sizeof(*this) + m_blocks.capacity() * sizeof(LineBlock);
+    for (const LineBlock& block : m_blocks)
+    {
+        bytes += block.lines.capacity() * sizeof(std::wstring);
+        for (const std::wstring& line : block.lines)
+        {
+            bytes += GetHeapBytes(line);
+        }
+    }
+    return bytes;
 }
 
-bool CUndoManager::CanUndo() const
+void CReplaceLinesCommand::Serialize(CUndoRecordWriter& writer) const
 {
-    return m_currentIndex > 0;
+    writer.WriteSize(COMMAND_REPLACE_LINES);
+    writer.WriteSize(m_blocks.size());
+    for (const LineBlock& block : m_blocks)
+    {
+        writer.WriteSize(block.firstLine);
+        writer.WriteSize(block.lineCount);
+        writer.WriteSize(block.lines.size());
+        for (const std::wstring& line : block.lines)
+        {
+            writer.WriteString(line);
+        }
+    }
 }
 
-bool CUndoManager::CanRedo() const
+std::unique_ptr<ICommand> CReplaceLinesCommand::Deserialize(CUndoRecordReader& reader)
 {
-    return m_currentIndex < m_commands.size();
+    size_t blockCount = 0;
+    if (!reader.ReadSize(blockCount))
+    {
+        return nullptr;
+    }
+    std::vector<LineBlock> blocks;
+    for (size_t i = 0; i < blockCount; ++i)
+    {
+        LineBlock block;
+        size_t lineCount = 0;
+        if (!reader.ReadSize(block.firstLine) || !reader.ReadSize(block.lineCount) || !reader.ReadSize(lineCount))
+        {
+            return nullptr;
+        }
+        for (size_t line = 0; line < lineCount; ++line)
+        {
+            std::wstring text;
+            if (!reader.ReadString(text))
+            {
+                return nullptr;
+            }
+            block.lines.push_back(std::move(text));
+        }
+        blocks.push_back(std::move(block));
+    }
+    return std::make_unique<CReplaceLinesCommand>(std::move(blocks));
 }
 
-void CUndoManager::Undo(CTextDocument* pDocument)
+// CCompoundCommand実装
+void CCompoundCommand::Execute(CTextDocument* pDocument)
 {
-    if (!CanUndo() || !pDocument)
+    for (auto& command : m_commands)
     {
-        return;
+        command->Execute(pDocument);
     }
+}
 
-    m_currentIndex--;
-    m_commands[m_currentIndex]->Undo(pDocument);
+void CCompoundCommand::Undo(CTextDocument* pDocument)
+{
+    for (auto it = m_commands.rbegin(); it != m_commands.rend(); ++it)
+    {
+        (*it)->Undo(pDocument);
+    }
 }
 
-void CUndoManager::Redo(CTextDocument* pDocument)
+void CCompoundCommand::Redo(CTextDocument* pDocument)
 {
-    if (!CanRedo() || !pDocument)
+    for (auto& command : m_commands)
     {
-        return;
+        command->Redo(pDocument);
     }
+}
 
-    m_commands[m_currentIndex]->Redo(pDocument);
-    m_currentIndex++;
+size_t CCompoundCommand::GetMemoryUsage() const
+{
+    size_t bytes = sizeof(*this) + m_commands.capacity() * sizeof(std::unique_ptr<ICommand>);
+    for (const auto& command : m_commands)
+    {
+        bytes += command->GetMemoryUsage();
+    }
+    return bytes;
 }
 
-void CUndoManager::Clear()
+void CCompoundCommand::Serialize(CUndoRecordWriter& writer) const
 {
-    m_commands.clear();
-    m_currentIndex = 0;
-    m_estimatedMemoryUsage = 0;
+    writer.WriteSize(COMMAND_COMPOUND);
+    writer.WriteSize(m_commands.size());
+    for (const auto& command : m_commands)
+    {
+        command->Serialize(writer);
+    }
 }
 
-void CUndoManager::TrimMemoryIfNeeded()
+std::unique_ptr<ICommand> CCompoundCommand::Deserialize(CUndoRecordReader& reader)
 {
-    // メモリ使用量が制限を超えた場合、古いコマンドを削除
-    while (m_estimatedMemoryUsage > m_maxMemoryUsage && !m_commands.empty())
+    size_t count = 0;
+    if (!reader.ReadSize(count))
     {
-        m_estimatedMemoryUsage -= EstimateCommandSize(m_commands.front().get());
-        m_commands.erase(m_commands.begin());
-        
-        if (m_currentIndex > 0)
+        return nullptr;
+    }
+    std::vector<std::unique_ptr<ICommand>> commands;
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::unique_ptr<ICommand> command = DeserializeCommand(reader);
+        if (!command)
+        {
+            return nullptr;
+        }
+        commands.push_back(std::move(command));
+    }
+    return std::make_unique<CCompoundCommand>(std::move(commands));
+}
+
+std::unique_ptr<ICommand> DeserializeCommand(CUndoRecordReader& reader)
+{
+    size_t type = 0;
+    if (!reader.ReadSize(type))
+    {
+        return nullptr;
+    }
+    switch (type)
+    {
+    case COMMAND_INSERT_TEXT:
+        return CInsertTextCommand::Deserialize(reader);
+    case COMMAND_DELETE_TEXT:
+        return CDeleteTextCommand::Deserialize(reader);
+    case COMMAND_REPLACE_TEXT:
+        return CReplaceTextCommand::Deserialize(reader);
+    case COMMAND_REPLACE_LINES:
+        return CReplaceLinesCommand::Deserialize(reader);
+    case COMMAND_COMPOUND:
+        return CCompoundCommand::Deserialize(reader);
+    default:
+        return nullptr;
+    }
+}
+
+// トランザクション中に編集された行を、編集前の行番号と現在の行番号の組で記録する。
+// 重ならない範囲を現在の行番号の順に持つ。範囲の外の行は編集前の行がそのまま（ずれて）残っている
+class CLineChangeTracker : public IDocumentEditListener
+{
+public:
+    struct Block
+    {
+        size_t originalFirst;
+        size_t originalCount;
+        size_t currentFirst;
+        size_t currentCount;
+        std::vector<std::wstring> originalLines;    // 編集前の行（originalCount 行）
+    };
+
+    explicit CLineChangeTracker(const CTextDocument* pDocument) : m_pDocument(pDocument), m_reset(false) {}
+
+    // 初めて編集される行は、書き換えられる前にここで内容を取っておく
+    void OnLinesChanging(size_t firstLine, size_t lastLine) override
+    {
+        Touch(firstLine, lastLine, 0, 0, true);
+    }
+
+    void OnTextInserted(const TextPosition& pos, const std::wstring& text) override
+    {
+        size_t added = 0;
+        for (wchar_t ch : text)
+        {
+            if (ch == L'\n')
+            {
+                ++added;
+            }
+        }
+        Touch(pos.line, pos.line, added, 0, false);
+    }
+
+    void OnTextDeleted(const TextPosition& start, const TextPosition& end) override
+    {
+        Touch(start.line, end.line, 0, end.line - start.line, false);
+    }
+
+    void OnDocumentReset() override
+    {
+        m_reset = true;
+    }
+
+    std::vector<Block>& GetBlocks() { return m_blocks; }
+    // 内容全体が置き換わったか、編集前の行を取れなかった
+    bool WasReset() const { return m_reset; }
+
+private:
+    // 現在の行 [first, last] が編集され、added 行増えて removed 行減った。
+    // どの範囲にも入っていない行は、snapshot なら（まだ書き換えられていないので）ドキュメントから取る
+    void Touch(size_t first, size_t last, size_t added, size_t removed, bool snapshot)
+    {
+        // 範囲の外の行の編集前の行番号は、それより前の範囲の行数の差でずれている
+        size_t originalLines = 0;
+        size_t currentLines = 0;
+        size_t i = 0;
+        while (i < m_blocks.size() && m_blocks[i].currentFirst + m_blocks[i].currentCount <= first)
+        {
+            originalLines += m_blocks[i].originalCount;
+            currentLines += m_blocks[i].currentCount;
+            ++i;
+        }
+
+        Block merged;
+        merged.currentFirst = first;
+        merged.originalFirst = first - currentLines + originalLines;
+        if (i < m_blocks.size() && m_blocks[i].currentFirst < first)
+        {
+            merged.currentFirst = m_blocks[i].currentFirst;
+            merged.originalFirst = m_blocks[i].originalFirst;
+        }
+
+        // 編集した行と重なる範囲を1つにまとめる
+        size_t currentEnd = last + 1;
+        size_t j = i;
+        while (j < m_blocks.size() && m_blocks[j].currentFirst <= last)
+        {
+            currentEnd = std::max(currentEnd, m_blocks[j].currentFirst + m_blocks[j].currentCount);
+            originalLines += m_blocks[j].originalCount;
+            currentLines += m_blocks[j].currentCount;
+            ++j;
+        }
+        const size_t originalEnd = currentEnd - currentLines + originalLines;
+        merged.originalCount = originalEnd - merged.originalFirst;
+        merged.currentCount = currentEnd - merged.currentFirst + added - removed;
+
+        // 範囲の間と前後の行を編集前の行として補い、重なった範囲の編集前の行とつなげる
+        merged.originalLines.reserve(merged.originalCount);
+        size_t line = merged.currentFirst;
+        for (size_t k = i; k < j; ++k)
+        {
+            for (; line < m_blocks[k].currentFirst; ++line)
+            {
+                AppendOriginalLine(merged, line, snapshot);
+            }
+            std::move(m_blocks[k].originalLines.begin(), m_blocks[k].originalLines.end(),
+                      std::back_inserter(merged.originalLines));
+            line = m_blocks[k].currentFirst + m_blocks[k].currentCount;
+        }
+        for (; line < currentEnd; ++line)
+        {
+            AppendOriginalLine(merged, line, snapshot);
+        }
+
+        for (size_t k = j; k < m_blocks.size(); ++k)
+        {
+            m_blocks[k].currentFirst = m_blocks[k].currentFirst + added - removed;
+        }
+        m_blocks.erase(m_blocks.begin() + i, m_blocks.begin() + j);
+        m_blocks.insert(m_blocks.begin() + i, merged);
+    }
+
+    void AppendOriginalLine(Block& block, size_t line, bool snapshot)
+    {
+        if (!snapshot || line >= m_pDocument->GetLineCount())
+        {
+            m_reset = true; // 書き換えの前に知らされなかった
+            block.originalLines.emplace_back();
+            return;
+        }
+        block.originalLines.push_back(m_pDocument->GetLine(line));
+    }
+
+    const CTextDocument* m_pDocument;
+    std::vector<Block> m_blocks;
+    bool m_reset;
+};
+
+// CUndoManager::CHistoryLog実装
+void CUndoManager::CHistoryLog::PushBack(HistoryEntry&& entry)
+{
+    if (m_count == m_entries.size())
+    {
+        // 容量を2倍にし、先頭から順に並べ直す（容量は常に2の累乗）
+        std::vector<HistoryEntry> entries(std::max<size_t>(16, m_entries.size() * 2));
+        for (size_t i = 0; i < m_count; ++i)
         {
-            m_currentIndex--;
+            entries[i] = std::move((*this)[i]);
         }
+        m_entries.swap(entries);
+        m_head = 0;
+    }
+    m_entries[(m_head + m_count) & (m_entries.size() - 1)] = std::move(entry);
+    ++m_count;
+}
+
+void CUndoManager::CHistoryLog::PopFront()
+{
+    // 要素の持つコマンドなどはすぐに解放する
+    m_entries[m_head] = HistoryEntry();
+    m_head = (m_head + 1) & (m_entries.size() - 1);
+    --m_count;
+}
+
+void CUndoManager::CHistoryLog::PopBack()
+{
+    Back() = HistoryEntry();
+    --m_count;
+}
+
+void CUndoManager::CHistoryLog::Clear()
+{
+    std::vector<HistoryEntry>().swap(m_entries);
+    m_head = 0;
+    m_count = 0;
+}
+
+// CUndoManager実装
+CUndoManager::CUndoManager()
+    : m_payloadLive(0)
+    , m_currentIndex(0)
+    , m_maxMemoryUsage(100 * 1024 * 1024) // デフォルト100MB
+    , m_estimatedMemoryUsage(0)
+    , m_canCoalesce(false)
+    , m_transactionDepth(0)
+    , m_pTransactionDocument(nullptr)
+    , m_spillEnabled(true)
+    , m_spillScanStart(0)
+{
+}
+
+CUndoManager::~CUndoManager()
+{
+    if (m_pTransactionDocument)
+    {
+        m_pTransactionDocument->RemoveEditListener(m_pTracker.get());
     }
 }
 
-size_t CUndoManager::EstimateCommandSize(const ICommand* pCommand) const
+void CUndoManager::ExecuteCommand(std::unique_ptr<ICommand> command, CTextDocument* pDocument, bool coalesce)
 {
-    // コマンドのメモリ使用量を推定（簡易実装）
-    // 実際にはコマンドの種類に応じてより正確な計算が必要
-    return sizeof(ICommand) + 1024; // 基本サイズ + バッファ
+    if (!command || !pDocument)
+    {
+        return;
+    }
+
+    // 現在位置より後ろのコマンドを削除
+    while (m_currentIndex < m_commands.GetCount())
+    {
+        PopBack();
+    }
+
+    // コマンドを実行
+    command->Execute(pDocument);
+
+    // トランザクション中は EndTransaction でまとめて履歴に積む
+    if (m_transactionDepth > 0)
+    {
+        m_transactionCommands.push_back(std::move(command));
+        return;
+    }
+
+    // 続けて入力した文字は末尾の履歴にまとめる
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (coalesce && m_canCoalesce && !m_commands.IsEmpty() && m_commands.Back().command &&
+        now - m_lastCoalesceTime <= std::chrono::milliseconds(COALESCE_TIMEOUT_MS) &&
+        m_commands.Back().command->MergeWith(command.get()))
+    {
+        m_lastCoalesceTime = now;
+        ReleaseSpill(m_commands.Back());
+        UpdateMemoryUsage(m_commands.Back());
+        TrimMemoryIfNeeded();
+        return;
+    }
+    m_canCoalesce = coalesce;
+    m_lastCoalesceTime = now;
+
+    AddToHistory(std::move(command));
+}
+
+void CUndoManager::ExecuteInsert(const TextPosition& pos, const std::wstring& text, CTextDocument* pDocument,
+                                 bool coalesce)
+{
+    if (!pDocument)
+    {
+        return;
+    }
+    if (m_transactionDepth > 0)
+    {
+        ExecuteCommand(std::make_unique<CInsertTextCommand>(pos, text), pDocument, coalesce);
+        return;
+    }
+
+    while (m_currentIndex < m_commands.GetCount())
+    {
+        PopBack();
+    }
+
+    HistoryEntry entry;
+    entry.kind = HISTORY_INSERT;
+    entry.start = pos;
+    entry.end = GetEndPosition(pos, text.data(), text.length());
+    entry.payloadOffset = m_payload.size();
+    entry.newLength = text.length();
+    m_payload += text;
+    m_payloadLive += entry.newLength;
+
+    pDocument->InsertText(pos, text);
+    AddRecord(entry, coalesce);
+}
+
+void CUndoManager::ExecuteDelete(const TextPosition& start, const TextPosition& end, CTextDocument* pDocument,
+                                 bool coalesce)
+{
+    if (!pDocument)
+    {
+        return;
+    }
+    if (m_transactionDepth > 0)
+    {
+        ExecuteCommand(std::make_unique<CDeleteTextCommand>(start, end), pDocument, coalesce);
+        return;
+    }
+
+    while (m_currentIndex < m_commands.GetCount())
+    {
+        PopBack();
+    }
+
+    // 削除する文字列は一時的な文字列を作らずに直接 m_payload に取る
+    HistoryEntry entry;
+    entry.kind = HISTORY_DELETE;
+    entry.start = start;
+    entry.end = end;
+    entry.payloadOffset = m_payload.size();
+    pDocument->AppendTextRange(start, end, m_payload);
+    entry.oldLength = m_payload.size() - entry.payloadOffset;
+    m_payloadLive += entry.oldLength;
+
+    pDocument->DeleteRange(start, end);
+    AddRecord(entry, coalesce);
+}
+
+void CUndoManager::ExecuteReplace(const TextPosition& start, const TextPosition& end, const std::wstring& text,
+                                  CTextDocument* pDocument)
+{
+    if (!pDocument)
+    {
+        return;
+    }
+    if (m_transactionDepth > 0)
+    {
+        ExecuteCommand(std::make_unique<CReplaceTextCommand>(start, end, text), pDocument);
+        return;
+    }
+
+    while (m_currentIndex < m_commands.GetCount())
+    {
+        PopBack();
+    }
+
+    HistoryEntry entry;
+    entry.kind = HISTORY_REPLACE;
+    entry.start = start;
+    entry.end = end;
+    entry.payloadOffset = m_payload.size();
+    pDocument->AppendTextRange(start, end, m_payload);
+    entry.oldLength = m_payload.size() - entry.payloadOffset;
+    entry.newLength = text.length();
+    m_payload += text;
+    m_payloadLive += entry.oldLength + entry.newLength;
+
+    pDocument->ReplaceRange(start, end, text);
+    AddRecord(entry, false);
+}
+
+void CUndoManager::AddToHistory(std::unique_ptr<ICommand> command)
+{
+    // コマンドを履歴に追加（実行して初めて削除した文字列などが揃う）
+    HistoryEntry entry;
+    entry.command = std::move(command);
+    PushEntry(entry);
+}
+
+void CUndoManager::AddRecord(HistoryEntry& entry, bool coalesce)
+{
+    // 続けて入力した文字は末尾の履歴にまとめる（ExecuteCommand と同じ条件）
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (coalesce && m_canCoalesce && !m_commands.IsEmpty() &&
+        now - m_lastCoalesceTime <= std::chrono::milliseconds(COALESCE_TIMEOUT_MS) &&
+        MergeRecord(m_commands.Back(), entry))
+    {
+        m_lastCoalesceTime = now;
+        ReleaseSpill(m_commands.Back());
+        UpdateMemoryUsage(m_commands.Back());
+        TrimMemoryIfNeeded();
+        return;
+    }
+    m_canCoalesce = coalesce;
+    m_lastCoalesceTime = now;
+
+    PushEntry(entry);
+}
+
+void CUndoManager::PushEntry(HistoryEntry& entry)
+{
+    entry.memoryUsage = GetMemoryUsage(entry);
+    m_estimatedMemoryUsage += entry.memoryUsage;
+    m_commands.PushBack(std::move(entry));
+    m_currentIndex++;
+
+    // メモリ制限チェック
+    TrimMemoryIfNeeded();
+}
+
+bool CUndoManager::MergeRecord(HistoryEntry& entry, const HistoryEntry& next)
+{
+    // CInsertTextCommand::MergeWith・CDeleteTextCommand::MergeWith と同じ条件でまとめる。
+    // next の文字列は m_payload 上で entry の文字列の直後に置かれている
+    if (entry.kind != next.kind || entry.payloadOffset + entry.oldLength + entry.newLength != next.payloadOffset)
+    {
+        return false;
+    }
+    const wchar_t* text = m_payload.data() + entry.payloadOffset;
+    const wchar_t* nextText = m_payload.data() + next.payloadOffset;
+
+    if (entry.kind == HISTORY_INSERT)
+    {
+        if (entry.newLength == 0 || next.newLength == 0 || !(next.start == entry.end) ||
+            ContainsLineBreak(text, entry.newLength) || ContainsLineBreak(nextText, next.newLength) ||
+            IsWordStart(text[entry.newLength - 1], nextText[0]))
+        {
+            return false;
+        }
+        entry.newLength += next.newLength;
+        entry.end = next.end;
+        return true;
+    }
+
+    if (entry.kind != HISTORY_DELETE || entry.oldLength == 0 || next.oldLength == 0 ||
+        ContainsLineBreak(text, entry.oldLength) || ContainsLineBreak(nextText, next.oldLength))
+    {
+        return false;
+    }
+    if (next.end == entry.start)
+    {
+        if (IsWordStart(nextText[next.oldLength - 1], text[0]))
+        {
+            return false;
+        }
+        // Backspace で続けて削除した文字は、まとめた文字列の先頭に移す
+        std::rotate(m_payload.begin() + entry.payloadOffset, m_payload.begin() + next.payloadOffset,
+                    m_payload.begin() + next.payloadOffset + next.oldLength);
+        entry.oldLength += next.oldLength;
+        entry.start = next.start;
+        return true;
+    }
+    if (next.start == entry.start)
+    {
+        if (IsWordStart(text[entry.oldLength - 1], nextText[0]))
+        {
+            return false;
+        }
+        // 削除前の座標では、続けて削除した文字は元の範囲の直後にある
+        entry.oldLength += next.oldLength;
+        entry.end.column += next.end.column - next.start.column;
+        return true;
+    }
+    return false;
+}
+
+void CUndoManager::UndoRecord(const HistoryEntry& entry, CTextDocument* pDocument) const
+{
+    const wchar_t* oldText = m_payload.data() + entry.payloadOffset;
+    const wchar_t* newText = oldText + entry.oldLength;
+    switch (entry.kind)
+    {
+    case HISTORY_INSERT:
+        pDocument->DeleteRange(entry.start, entry.end);
+        break;
+    case HISTORY_DELETE:
+        pDocument->InsertText(entry.start, std::wstring(oldText, entry.oldLength));
+        break;
+    case HISTORY_REPLACE:
+        pDocument->ReplaceRange(entry.start, GetEndPosition(entry.start, newText, entry.newLength),
+                                std::wstring(oldText, entry.oldLength));
+        break;
+    default:
+        break;
+    }
+}
+
+void CUndoManager::RedoRecord(const HistoryEntry& entry, CTextDocument* pDocument) const
+{
+    const wchar_t* oldText = m_payload.data() + entry.payloadOffset;
+    const wchar_t* newText = oldText + entry.oldLength;
+    switch (entry.kind)
+    {
+    case HISTORY_INSERT:
+        pDocument->InsertText(entry.start, std::wstring(newText, entry.newLength));
+        break;
+    case HISTORY_DELETE:
+        pDocument->DeleteRange(entry.start, entry.end);
+        break;
+    case HISTORY_REPLACE:
+        pDocument->ReplaceRange(entry.start, entry.end, std::wstring(newText, entry.newLength));
+        break;
+    default:
+        break;
+    }
+}
+
+void CUndoManager::SerializeRecord(const HistoryEntry& entry, CUndoRecordWriter& writer) const
+{
+    // 対応するコマンドの Serialize と同じ形で書き、読み戻すときはコマンドとして復元する
+    const wchar_t* oldText = m_payload.data() + entry.payloadOffset;
+    const wchar_t* newText = oldText + entry.oldLength;
+    switch (entry.kind)
+    {
+    case HISTORY_INSERT:
+        writer.WriteSize(COMMAND_INSERT_TEXT);
+        writer.WritePosition(entry.start);
+        writer.WritePosition(entry.end);
+        writer.WriteString(newText, entry.newLength);
+        break;
+    case HISTORY_DELETE:
+        writer.WriteSize(COMMAND_DELETE_TEXT);
+        writer.WritePosition(entry.start);
+        writer.WritePosition(entry.end);
+        writer.WriteString(oldText, entry.oldLength);
+        break;
+    case HISTORY_REPLACE:
+        writer.WriteSize(COMMAND_REPLACE_TEXT);
+        writer.WritePosition(entry.start);
+        writer.WritePosition(entry.end);
+        writer.WriteString(oldText, entry.oldLength);
+        writer.WriteString(newText, entry.newLength);
+        break;
+    default:
+        break;
+    }
+}
+
+void CUndoManager::BeginTransaction(CTextDocument* pDocument)
+{
+    if (m_transactionDepth++ > 0 || !pDocument)
+    {
+        return;
+    }
+    m_canCoalesce = false;
+    m_pTransactionDocument = pDocument;
+    m_pTracker = std::make_unique<CLineChangeTracker>(pDocument);
+    m_pTransactionDocument->AddEditListener(m_pTracker.get());
+}
+
+void CUndoManager::EndTransaction()
+{
+    if (m_transactionDepth == 0 || --m_transactionDepth > 0)
+    {
+        return;
+    }
+
+    if (m_pTransactionDocument)
+    {
+        m_pTransactionDocument->RemoveEditListener(m_pTracker.get());
+    }
+    std::unique_ptr<ICommand> command = BuildTransactionCommand();
+    m_transactionCommands.clear();
+    m_pTransactionDocument = nullptr;
+    m_pTracker.reset();
+
+    if (command)
+    {
+        AddToHistory(std::move(command));
+    }
+}
+
+std::unique_ptr<ICommand> CUndoManager::BuildTransactionCommand()
+{
+    if (m_transactionCommands.empty())
+    {
+        return nullptr;
+    }
+    if (m_transactionCommands.size() == 1)
+    {
+        return std::move(m_transactionCommands.front());
+    }
+
+    // 編集を追えなかった場合（内容全体の置き換えなど）は、コマンドを順に元に戻す・やり直す
+    CTextDocument* pDocument = m_pTransactionDocument;
+    bool canReplaceLines = pDocument && m_pTracker && !m_pTracker->WasReset();
+    if (canReplaceLines)
+    {
+        for (const CLineChangeTracker::Block& change : m_pTracker->GetBlocks())
+        {
+            if (change.currentFirst + change.currentCount > pDocument->GetLineCount())
+            {
+                canReplaceLines = false;
+            }
+        }
+    }
+    if (!canReplaceLines)
+    {
+        return std::make_unique<CCompoundCommand>(std::move(m_transactionCommands));
+    }
+    std::vector<CLineChangeTracker::Block>& changes = m_pTracker->GetBlocks();
+
+    // 初めて編集されたときに取っておいた編集前の行と、編集後の位置から、実行済みの CReplaceLinesCommand と
+    // 同じ状態（SwapLineBlocks の後の blocks）を組み立てる。ドキュメントには触れない
+    std::vector<LineBlock> blocks(changes.size());
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        blocks[i].firstLine = changes[i].currentFirst;
+        blocks[i].lineCount = changes[i].currentCount;
+        blocks[i].lines.swap(changes[i].originalLines);
+    }
+    return std::make_unique<CReplaceLinesCommand>(std::move(blocks));
+}
+
+bool CUndoManager::CanUndo() const
+{
+    return m_currentIndex > 0 && m_transactionDepth == 0;
+}
+
+bool CUndoManager::CanRedo() const
+{
+    return m_currentIndex < m_commands.GetCount() && m_transactionDepth == 0;
+}
+
+void CUndoManager::Undo(CTextDocument* pDocument)
+{
+    if (!CanUndo() || !pDocument)
+    {
+        return;
+    }
+
+    m_canCoalesce = false;
+    if (!LoadEntry(m_currentIndex - 1))
+    {
+        // 読み戻せなかった履歴より前には戻れないので、それらを捨てる
+        while (m_currentIndex > 0)
+        {
+            PopFront();
+        }
+        return;
+    }
+
+    m_currentIndex--;
+    HistoryEntry& entry = m_commands[m_currentIndex];
+    if (entry.kind == HISTORY_COMMAND)
+    {
+        entry.command->Undo(pDocument);
+    }
+    else
+    {
+        UndoRecord(entry, pDocument);
+    }
+    UpdateMemoryUsage(entry);
+    TrimMemoryIfNeeded();
+}
+
+void CUndoManager::Redo(CTextDocument* pDocument)
+{
+    if (!CanRedo() || !pDocument)
+    {
+        return;
+    }
+
+    m_canCoalesce = false;
+    if (!LoadEntry(m_currentIndex))
+    {
+        // 読み戻せなかった履歴から先はやり直せないので、それらを捨てる
+        while (m_currentIndex < m_commands.GetCount())
+        {
+            PopBack();
+        }
+        return;
+    }
+
+    HistoryEntry& entry = m_commands[m_currentIndex];
+    if (entry.kind == HISTORY_COMMAND)
+    {
+        entry.command->Redo(pDocument);
+    }
+    else
+    {
+        RedoRecord(entry, pDocument);
+    }
+    m_currentIndex++;
+    UpdateMemoryUsage(entry);
+    TrimMemoryIfNeeded();
+}
+
+void CUndoManager::Clear()
+{
+    if (m_pTransactionDocument)
+    {
+        m_pTransactionDocument->RemoveEditListener(m_pTracker.get());
+    }
+    m_transactionDepth = 0;
+    m_pTransactionDocument = nullptr;
+    m_transactionCommands.clear();
+    m_pTracker.reset();
+
+    m_commands.Clear();
+    std::wstring().swap(m_payload);
+    m_payloadLive = 0;
+    m_currentIndex = 0;
+    m_estimatedMemoryUsage = 0;
+    m_canCoalesce = false;
+    m_spillFile.Close();
+    m_spillScanStart = 0;
+}
+
+size_t CUndoManager::GetEstimatedMemoryUsage() const
+{
+    // m_payload はヒープに確保した分だけを数える（空のときに上限0で履歴をすべて捨てないように）
+    return m_estimatedMemoryUsage + GetHeapBytes(m_payload);
+}
+
+void CUndoManager::SetMaxMemoryUsage(size_t bytes)
+{
+    m_maxMemoryUsage = bytes;
+    TrimMemoryIfNeeded();
+}
+
+size_t CUndoManager::GetMemoryUsage(const HistoryEntry& entry)
+{
+    if (entry.kind == HISTORY_COMMAND)
+    {
+        return entry.command ? entry.command->GetMemoryUsage() : 0;
+    }
+    // 文字列は m_payload に置いているので、捨てた部分や確保の余りも含めて m_payload の確保量として計上する
+    return sizeof(HistoryEntry);
+}
+
+void CUndoManager::UpdateMemoryUsage(HistoryEntry& entry)
+{
+    const size_t usage = GetMemoryUsage(entry);
+    m_estimatedMemoryUsage = m_estimatedMemoryUsage - entry.memoryUsage + usage;
+    entry.memoryUsage = usage;
+}
+
+void CUndoManager::PopFront()
+{
+    HistoryEntry& front = m_commands.Front();
+    ReleaseSpill(front);
+    const size_t payloadOffset = front.payloadOffset;
+    const size_t payloadLength = front.oldLength + front.newLength;
+    m_estimatedMemoryUsage -= front.memoryUsage;
+    m_commands.PopFront();
+    if (m_currentIndex > 0)
+    {
+        m_currentIndex--;
+    }
+    if (m_spillScanStart > 0)
+    {
+        m_spillScanStart--;
+    }
+    if (m_commands.IsEmpty())
+    {
+        m_spillFile.Close();
+    }
+    else
+    {
+        CompactSpillFileIfNeeded();
+    }
+    ReleasePayload(payloadOffset, payloadLength);
+}
+
+void CUndoManager::PopBack()
+{
+    HistoryEntry& back = m_commands.Back();
+    ReleaseSpill(back);
+    const size_t payloadOffset = back.payloadOffset;
+    const size_t payloadLength = back.oldLength + back.newLength;
+    m_estimatedMemoryUsage -= back.memoryUsage;
+    m_commands.PopBack();
+    m_canCoalesce = false;
+    if (m_currentIndex > m_commands.GetCount())
+    {
+        m_currentIndex = m_commands.GetCount();
+    }
+    if (m_spillScanStart > m_commands.GetCount())
+    {
+        m_spillScanStart = m_commands.GetCount();
+    }
+    if (m_commands.IsEmpty())
+    {
+        m_spillFile.Close();
+    }
+    else
+    {
+        CompactSpillFileIfNeeded();
+    }
+    ReleasePayload(payloadOffset, payloadLength);
+}
+
+void CUndoManager::ReleaseSpill(HistoryEntry& entry)
+{
+    if (!entry.spill.IsEmpty())
+    {
+        m_spillFile.Release(entry.spill);
+        entry.spill = UndoSpillRecord();
+    }
+}
+
+void CUndoManager::CompactSpillFileIfNeeded()
+{
+    if (!m_spillFile.NeedsCompaction())
+    {
+        return;
+    }
+    std::vector<UndoSpillRecord*> records;
+    for (size_t i = 0; i < m_commands.GetCount(); ++i)
+    {
+        if (!m_commands[i].spill.IsEmpty())
+        {
+            records.push_back(&m_commands[i].spill);
+        }
+    }
+    m_spillFile.Compact(records);
+}
+
+void CUndoManager::ReleasePayload(size_t offset, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+    m_payloadLive -= length;
+    if (m_payloadLive == 0)
+    {
+        std::wstring().swap(m_payload);
+        return;
+    }
+    // 末尾の文字列（捨てたやり直しの履歴など）はその場で縮め、途中が空いたら半分を超えてから詰める
+    if (offset + length == m_payload.size())
+    {
+        m_payload.resize(offset);
+    }
+    if (m_payload.size() > PAYLOAD_COMPACT_MIN && m_payloadLive * 2 < m_payload.size())
+    {
+        CompactPayload();
+    }
+}
+
+void CUndoManager::CompactPayload()
+{
+    // 詰めた直後の追記ですぐに確保し直さないよう、少し余裕を持たせる
+    std::wstring payload;
+    payload.reserve(m_payloadLive + m_payloadLive / 8);
+    // m_spillScanStart より前は退避済みで文字列を持たない
+    for (size_t i = m_spillScanStart; i < m_commands.GetCount(); ++i)
+    {
+        HistoryEntry& entry = m_commands[i];
+        if (entry.kind != HISTORY_COMMAND)
+        {
+            const size_t offset = payload.size();
+            payload.append(m_payload, entry.payloadOffset, entry.oldLength + entry.newLength);
+            entry.payloadOffset = offset;
+        }
+    }
+    m_payload.swap(payload);
+}
+
+bool CUndoManager::SpillOneEntry()
+{
+    // 古い元に戻す履歴から退避する
+    while (m_spillScanStart < m_currentIndex)
+    {
+        HistoryEntry& entry = m_commands[m_spillScanStart];
+        if (entry.IsResident())
+        {
+            return SpillEntry(m_spillScanStart);
+        }
+        ++m_spillScanStart;
+    }
+    // 元に戻す履歴がすべて退避済みなら、やり直しの履歴を現在位置から遠い方から退避する
+    for (size_t i = m_commands.GetCount(); i-- > m_currentIndex;)
+    {
+        if (m_commands[i].IsResident())
+        {
+            return SpillEntry(i);
+        }
+    }
+    return false;
+}
+
+bool CUndoManager::SpillEntry(size_t index)
+{
+    HistoryEntry& entry = m_commands[index];
+    const bool applied = index < m_currentIndex;
+    // 読み戻してから適用状態が変わっていなければ、書き出す内容は前の記録と同じ
+    if (entry.spill.IsEmpty() || entry.spillApplied != applied)
+    {
+        CUndoRecordWriter writer;
+        if (entry.kind == HISTORY_COMMAND)
+        {
+            entry.command->Serialize(writer);
+        }
+        else
+        {
+            SerializeRecord(entry, writer);
+        }
+        UndoSpillRecord record;
+        if (!m_spillFile.Write(writer.GetData(), record))
+        {
+            return false;
+        }
+        ReleaseSpill(entry);
+        entry.spill = record;
+        entry.spillApplied = applied;
+        CompactSpillFileIfNeeded();
+    }
+
+    // 読み戻すときはコマンドとして復元するので、記録はコマンドの退避中と同じ状態にする
+    const size_t payloadLength = entry.oldLength + entry.newLength;
+    m_estimatedMemoryUsage -= entry.memoryUsage;
+    entry.memoryUsage = 0;
+    entry.command.reset();
+    entry.kind = HISTORY_COMMAND;
+    entry.oldLength = 0;
+    entry.newLength = 0;
+    ReleasePayload(entry.payloadOffset, payloadLength);
+    if (&entry == &m_commands.Back())
+    {
+        m_canCoalesce = false;
+    }
+    return true;
+}
+
+bool CUndoManager::LoadEntry(size_t index)
+{
+    HistoryEntry& entry = m_commands[index];
+    if (entry.IsResident())
+    {
+        return true;
+    }
+
+    std::vector<uint8_t> data;
+    if (!m_spillFile.Read(entry.spill, data))
+    {
+        return false;
+    }
+    CUndoRecordReader reader(data.data(), data.size());
+    std::unique_ptr<ICommand> command = DeserializeCommand(reader);
+    if (!command || !reader.IsAtEnd())
+    {
+        return false;
+    }
+
+    entry.command = std::move(command);
+    entry.memoryUsage = entry.command->GetMemoryUsage();
+    m_estimatedMemoryUsage += entry.memoryUsage;
+    if (index < m_spillScanStart)
+    {
+        m_spillScanStart = index;
+    }
+    return true;
+}
+
+void CUndoManager::TrimMemoryIfNeeded()
+{
+    // メモリ使用量が制限を超えた場合、古いコマンドから一時ファイルへ退避する。
+    // 退避できなければ古いコマンドを削除し、元に戻せる履歴が無くなったら、
+    // やり直しの履歴を現在位置から遠い方から削除する（残りの履歴の前提を崩さない）
+    while (GetEstimatedMemoryUsage() > m_maxMemoryUsage && !m_commands.IsEmpty())
+    {
+        // 使われていない部分（捨てた履歴の文字列と確保の余り）が4分の1を超えていれば、履歴を減らす前に詰める
+        const size_t capacity = m_payload.capacity();
+        if (capacity > PAYLOAD_COMPACT_MIN && (capacity - m_payloadLive) * 4 > capacity)
+        {
+            CompactPayload();
+            continue;
+        }
+        if (m_spillEnabled && SpillOneEntry())
+        {
+            continue;
+        }
+        if (m_currentIndex > 0)
+        {
+            PopFront();
+        }
+        else
+        {
+            PopBack();
+        }
+    }
 }
@@ -1,9 +1,10 @@
 // UndoManager.h - Undo/Redo管理（無制限対応）
 #pragma once
-#include <windows.h>
 #include <memory>
 #include <vector>
+#include <chrono>
 #include "TextDocument.h"
+#include "UndoSpill.h"
 
 // コマンドの基底クラス
 class ICommand
@@ -13,8 +14,19 @@ public:
     virtual void Execute(CTextDocument* pDocument) = 0;
     virtual void Undo(CTextDocument* pDocument) = 0;
     virtual void Redo(CTextDocument* pDocument) = 0;
+    // 履歴に保持しているバイト数（オブジェクト自身と、確保している文字列などの領域）
+    virtual size_t GetMemoryUsage() const = 0;
+    // 直後に実行された pNext を自分に取り込めればtrue（続けて入力・削除した文字を1つの履歴にまとめる）。
+    // 取り込まれた pNext は履歴に積まれずに破棄される
+    virtual bool MergeWith(const ICommand* /*pNext*/) { return false; }
+    // 一時ファイルへの退避用に、現在の状態（実行済みか元に戻した後か）をそのまま書き出す。
+    // 先頭に種類を書き、DeserializeCommand で同じ状態のコマンドに戻す
+    virtual void Serialize(CUndoRecordWriter& writer) const = 0;
 };
 
+// Serialize で書き出したコマンドを読み戻す。データが壊れていればnullptr
+std::unique_ptr<ICommand> DeserializeCommand(CUndoRecordReader& reader);
+
 // テキスト挿入コマンド
 class CInsertTextCommand : public ICommand
 {
@@ -25,6 +37,10 @@ public:
     void Execute(CTextDocument* pDocument) override;
     void Undo(CTextDocument* pDocument) override;
     void Redo(CTextDocument* pDocument) override;
+    size_t GetMemoryUsage() const override;
+    bool MergeWith(const ICommand* pNext) override;
+    void Serialize(CUndoRecordWriter& writer) const override;
+    static std::unique_ptr<ICommand> Deserialize(CUndoRecordReader& reader);
 
 private:
     TextPosition m_position;
@@ -42,6 +58,10 @@ public:
     void Execute(CTextDocument* pDocument) override;
     void Undo(CTextDocument* pDocument) override;
     void Redo(CTextDocument* pDocument) override;
+    size_t GetMemoryUsage() const override;
+    bool MergeWith(const ICommand* pNext) override;
+    void Serialize(CUndoRecordWriter& writer) const override;
+    static std::unique_ptr<ICommand> Deserialize(CUndoRecordReader& reader);
 
 private:
     TextPosition m_start;
@@ -59,6 +79,9 @@ public:
     void Execute(CTextDocument* pDocument) override;
     void Undo(CTextDocument* pDocument) override;
     void Redo(CTextDocument* pDocument) override;
+    size_t GetMemoryUsage() const override;
+    void Serialize(CUndoRecordWriter& writer) const override;
+    static std::unique_ptr<ICommand> Deserialize(CUndoRecordReader& reader);
 
 private:
     TextPosition m_start;
@@ -67,6 +90,44 @@ private:
     std::wstring m_newText;
 };
 
+// 行ブロック置換コマンド（一括置換をまとめて1回で元に戻す）
+class CReplaceLinesCommand : public ICommand
+{
+public:
+    explicit CReplaceLinesCommand(std::vector<LineBlock> blocks)
+        : m_blocks(std::move(blocks)) {}
+
+    void Execute(CTextDocument* pDocument) override;
+    void Undo(CTextDocument* pDocument) override;
+    void Redo(CTextDocument* pDocument) override;
+    size_t GetMemoryUsage() const override;
+    void Serialize(CUndoRecordWriter& writer) const override;
+    static std::unique_ptr<ICommand> Deserialize(CUndoRecordReader& reader);
+
+private:
+    std::vector<LineBlock> m_blocks;    // 適用するたびに置き換え前後が入れ替わる
+};
+
+// 複数のコマンドを順に実行し、逆順に元に戻すコマンド
+class CCompoundCommand : public ICommand
+{
+public:
+    explicit CCompoundCommand(std::vector<std::unique_ptr<ICommand>> commands)
+        : m_commands(std::move(commands)) {}
+
+    void Execute(CTextDocument* pDocument) override;
+    void Undo(CTextDocument* pDocument) override;
+    void Redo(CTextDocument* pDocument) override;
+    size_t GetMemoryUsage() const override;
+    void Serialize(CUndoRecordWriter& writer) const override;
+    static std::unique_ptr<ICommand> Deserialize(CUndoRecordReader& reader);
+
+private:
+    std::vector<std::unique_ptr<ICommand>> m_commands;
+};
+
+class CLineChangeTracker;
+
 // Undo/Redo管理クラス
 class CUndoManager
 {
@@ -74,8 +135,26 @@ public:
     CUndoManager();
     ~CUndoManager();
 
-    // コマンド実行
-    void ExecuteCommand(std::unique_ptr<ICommand> command, CTextDocument* pDocument);
+    // コマンド実行。coalesce がtrueなら、直前のコマンドも coalesce 付きで、間が空いておらず、
+    // 位置が続いていれば1つの履歴にまとめる（1文字ずつのタイプ入力・削除用）
+    void ExecuteCommand(std::unique_ptr<ICommand> command, CTextDocument* pDocument, bool coalesce = false);
+    // 次のコマンドを直前の履歴にまとめない（カーソルを動かしたときなど）
+    void BreakCoalescing() { m_canCoalesce = false; }
+
+    // 文字列の挿入・削除・置換を実行して記録する（CInsertTextCommand などを ExecuteCommand するのと同じ）。
+    // コマンドのオブジェクトを作らずに履歴の要素へ種類と位置を書き、文字列は共有の領域に続けて置くので、
+    // 記録ごとのヒープ確保が無い。トランザクション中はコマンドとして記録する
+    void ExecuteInsert(const TextPosition& pos, const std::wstring& text, CTextDocument* pDocument, bool coalesce = false);
+    void ExecuteDelete(const TextPosition& start, const TextPosition& end, CTextDocument* pDocument, bool coalesce = false);
+    void ExecuteReplace(const TextPosition& start, const TextPosition& end, const std::wstring& text,
+                        CTextDocument* pDocument);
+
+    // トランザクション。BeginTransaction から EndTransaction までに実行したコマンドを1つの履歴にまとめる。
+    // 編集された行を置き換える1つの CReplaceLinesCommand に変換するので、元に戻す・やり直すは1回の一括編集になる。
+    // 入れ子にでき、一番外側の EndTransaction で確定する。トランザクション中は Undo/Redo できない
+    void BeginTransaction(CTextDocument* pDocument);
+    void EndTransaction();
+    bool IsInTransaction() const { return m_transactionDepth > 0; }
 
     // Undo/Redo
     bool CanUndo() const;
@@ -86,18 +165,109 @@ public:
     // 履歴管理
     void Clear();
     size_t GetUndoCount() const { return m_currentIndex; }
-    size_t GetRedoCount() const { return m_commands.size() - m_currentIndex; }
+    size_t GetRedoCount() const { return m_commands.GetCount() - m_currentIndex; }
 
-    // メモリ管理
-    void SetMaxMemoryUsage(size_t bytes) { m_maxMemoryUsage = bytes; }
-    size_t GetEstimatedMemoryUsage() const { return m_estimatedMemoryUsage; }
+    // メモリ管理。メモリ上の履歴が保持するバイト数（各コマンドの GetMemoryUsage と、記録した文字列の領域の確保量）を上限以下に保つ。
+    // 上限を超えたら古い履歴から圧縮して一時ファイルへ退避し（元に戻せる履歴が無ければ、遠いやり直しの履歴から）、
+    // 元に戻す・やり直すときに必要になったものだけ読み戻す。読み戻した履歴を再び退避するときは、変わっていなければ同じ記録を使う。
+    // 退避できなければ履歴を捨てる
+    void SetMaxMemoryUsage(size_t bytes);
+    size_t GetMaxMemoryUsage() const { return m_maxMemoryUsage; }
+    size_t GetEstimatedMemoryUsage() const;
+    void SetSpillEnabled(bool enabled) { m_spillEnabled = enabled; }
+    bool IsSpillEnabled() const { return m_spillEnabled; }
+    uint64_t GetSpillFileSize() const { return m_spillFile.GetFileSize(); }
 
 private:
+    enum HistoryKind
+    {
+        HISTORY_COMMAND,    // command を実行する（退避中は command がnullptr）
+        HISTORY_INSERT,     // m_payload の newLength 文字を start に挿入した。end は挿入後の終了位置
+        HISTORY_DELETE,     // [start, end) の oldLength 文字を削除した
+        HISTORY_REPLACE,    // [start, end) の oldLength 文字を、続く newLength 文字で置き換えた
+    };
+
+    // 履歴の1件。文字列の挿入・削除・置換はコマンドを作らずに種類と位置だけを記録し、それ以外はコマンドを持つ
+    struct HistoryEntry
+    {
+        HistoryKind kind;
+        TextPosition start;
+        TextPosition end;
+        size_t payloadOffset;   // 文字列の m_payload 上の位置（削除・置換された文字列、挿入・置換した文字列の順）
+        size_t oldLength;
+        size_t newLength;
+        std::unique_ptr<ICommand> command;
+        size_t memoryUsage;     // 最後に計上したときのバイト数（退避中は0）
+        UndoSpillRecord spill;  // 退避先（読み戻した後も、変わるまでは残す）
+        bool spillApplied;      // spill を書いたときに適用済みだったか（コマンドの書き出す内容は適用済みかどうかで決まる）
+
+        HistoryEntry()
+            : kind(HISTORY_COMMAND), payloadOffset(0), oldLength(0), newLength(0), memoryUsage(0), spillApplied(false)
+        {
+        }
+        bool IsResident() const { return kind != HISTORY_COMMAND || command; }
+    };
+
+    // 履歴を1つの配列に環状に並べる。先頭・末尾からの削除と末尾への追加は定数時間（追加は償却）で、
+    // 要素ごとにヒープを確保せず、履歴を連続した領域でたどれる
+    class CHistoryLog
+    {
+    public:
+        CHistoryLog() : m_head(0), m_count(0) {}
+
+        size_t GetCount() const { return m_count; }
+        bool IsEmpty() const { return m_count == 0; }
+        HistoryEntry& operator[](size_t index) { return m_entries[(m_head + index) & (m_entries.size() - 1)]; }
+        HistoryEntry& Front() { return (*this)[0]; }
+        HistoryEntry& Back() { return (*this)[m_count - 1]; }
+
+        void PushBack(HistoryEntry&& entry);
+        void PopFront();
+        void PopBack();
+        void Clear();
+
+    private:
+        std::vector<HistoryEntry> m_entries;    // 容量は2の累乗
+        size_t m_head;
+        size_t m_count;
+    };
+
+    void AddToHistory(std::unique_ptr<ICommand> command);
+    void AddRecord(HistoryEntry& entry, bool coalesce);
+    void PushEntry(HistoryEntry& entry);
+    bool MergeRecord(HistoryEntry& entry, const HistoryEntry& next);
+    void UndoRecord(const HistoryEntry& entry, CTextDocument* pDocument) const;
+    void RedoRecord(const HistoryEntry& entry, CTextDocument* pDocument) const;
+    void SerializeRecord(const HistoryEntry& entry, CUndoRecordWriter& writer) const;
+    void ReleasePayload(size_t offset, size_t length);
+    void CompactPayload();
+    std::unique_ptr<ICommand> BuildTransactionCommand();
     void TrimMemoryIfNeeded();
-    size_t EstimateCommandSize(const ICommand* pCommand) const;
+    void UpdateMemoryUsage(HistoryEntry& entry);
+    static size_t GetMemoryUsage(const HistoryEntry& entry);
+    void PopFront();
+    void PopBack();
+    bool SpillOneEntry();
+    bool SpillEntry(size_t index);
+    bool LoadEntry(size_t index);
+    void ReleaseSpill(HistoryEntry& entry);
+    void CompactSpillFileIfNeeded();
 
-    std::vector<std::unique_ptr<ICommand>> m_commands;
+    CHistoryLog m_commands;
+    std::wstring m_payload;     // 記録した文字列を履歴の順に続けて置く。使われなくなった部分が半分を超えたら詰める
+    size_t m_payloadLive;       // m_payload のうち履歴が使っている文字数
     size_t m_currentIndex;
     size_t m_maxMemoryUsage;
-    size_t m_estimatedMemoryUsage;
+    size_t m_estimatedMemoryUsage;  // 履歴の各件の分（m_payload の確保量は含めない）
+    bool m_canCoalesce;     // 末尾の履歴が次の coalesce 付きのコマンドを取り込める
+    std::chrono::steady_clock::time_point m_lastCoalesceTime;
+
+    size_t m_transactionDepth;
+    CTextDocument* m_pTransactionDocument;
+    std::vector<std::unique_ptr<ICommand>> m_transactionCommands;   // 実行済みで、まだ履歴に積んでいない
+    std::unique_ptr<CLineChangeTracker> m_pTracker;
+
+    bool m_spillEnabled;
+    CUndoSpillFile m_spillFile;
+    size_t m_spillScanStart;    // これより前の元に戻す履歴はすべて退避済み
 };
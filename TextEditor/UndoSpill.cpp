@@ -0,0 +1,369 @@
+// UndoSpill.cpp - 元に戻す履歴の退避の実装
+#include "UndoSpill.h"
+#include <algorithm>
+#include <cstring>
+
+// LZ77系の簡易圧縮。LZ4のブロック形式と同じく、トークン（上位4bit: リテラル長、下位4bit: 一致長-4）、
+// リテラル、2バイトの距離、の並びで表す。最後の並びはリテラルのみ
+static const size_t LZ_MIN_MATCH = 4;
+static const size_t LZ_MAX_DISTANCE = 0xFFFF;
+static const int LZ_HASH_BITS = 12;
+
+// これより小さい一時ファイルは詰めない
+static const uint64_t SPILL_COMPACT_MIN = 64 * 1024;
+
+static uint32_t ReadUint32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static size_t HashUint32(uint32_t value)
+{
+    return static_cast<size_t>((value * 2654435761u) >> (32 - LZ_HASH_BITS));
+}
+
+// 15以上の長さの残りを255の並びで書く
+static void WriteLengthExtension(std::vector<uint8_t>& out, size_t length)
+{
+    while (length >= 255)
+    {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+static void WriteSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalLength,
+                          size_t distance, size_t matchLength)
+{
+    const size_t matchCode = matchLength > 0 ? matchLength - LZ_MIN_MATCH : 0;
+    out.push_back(static_cast<uint8_t>(((literalLength < 15 ? literalLength : 15) << 4) |
+                                       (matchCode < 15 ? matchCode : 15)));
+    if (literalLength >= 15)
+    {
+        WriteLengthExtension(out, literalLength - 15);
+    }
+    out.insert(out.end(), literals, literals + literalLength);
+    if (matchLength == 0)
+    {
+        return;
+    }
+    out.push_back(static_cast<uint8_t>(distance & 0xFF));
+    out.push_back(static_cast<uint8_t>(distance >> 8));
+    if (matchCode >= 15)
+    {
+        WriteLengthExtension(out, matchCode - 15);
+    }
+}
+
+static void CompressBytes(const uint8_t* src, size_t size, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.reserve(size / 2 + 16);
+
+    // 各ハッシュ値に最後に現れた位置+1（0は未出現）
+    std::vector<size_t> table(static_cast<size_t>(1) << LZ_HASH_BITS, 0);
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + LZ_MIN_MATCH <= size)
+    {
+        const uint32_t value = ReadUint32(src + pos);
+        size_t& slot = table[HashUint32(value)];
+        const size_t candidate = slot;
+        slot = pos + 1;
+        if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_DISTANCE || ReadUint32(src + candidate - 1) != value)
+        {
+            ++pos;
+            continue;
+        }
+
+        const size_t matchStart = candidate - 1;
+        size_t length = LZ_MIN_MATCH;
+        while (pos + length < size && src[matchStart + length] == src[pos + length])
+        {
+            ++length;
+        }
+        WriteSequence(out, src + anchor, pos - anchor, pos - matchStart, length);
+        pos += length;
+        anchor = pos;
+    }
+    WriteSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+static bool ReadLengthExtension(const uint8_t*& pos, const uint8_t* end, size_t& length)
+{
+    for (;;)
+    {
+        if (pos == end)
+        {
+            return false;
+        }
+        const uint8_t byte = *pos++;
+        length += byte;
+        if (byte != 255)
+        {
+            return true;
+        }
+    }
+}
+
+static bool DecompressBytes(const uint8_t* src, size_t size, size_t rawSize, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.reserve(rawSize);
+
+    const uint8_t* pos = src;
+    const uint8_t* end = src + size;
+    while (pos < end)
+    {
+        const uint8_t token = *pos++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLengthExtension(pos, end, literalLength))
+        {
+            return false;
+        }
+        if (static_cast<size_t>(end - pos) < literalLength || rawSize - out.size() < literalLength)
+        {
+            return false;
+        }
+        out.insert(out.end(), pos, pos + literalLength);
+        pos += literalLength;
+        if (pos == end)
+        {
+            break;
+        }
+
+        if (end - pos < 2)
+        {
+            return false;
+        }
+        const size_t distance = static_cast<size_t>(pos[0]) | (static_cast<size_t>(pos[1]) << 8);
+        pos += 2;
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !ReadLengthExtension(pos, end, matchLength))
+        {
+            return false;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if (distance == 0 || distance > out.size() || rawSize - out.size() < matchLength)
+        {
+            return false;
+        }
+        // 一致は自分自身と重なり得るので1バイトずつ写す
+        size_t from = out.size() - distance;
+        for (size_t i = 0; i < matchLength; ++i)
+        {
+            out.push_back(out[from + i]);
+        }
+    }
+    return out.size() == rawSize;
+}
+
+// CUndoRecordWriter実装
+void CUndoRecordWriter::WriteSize(size_t value)
+{
+    while (value >= 0x80)
+    {
+        m_data.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    m_data.push_back(static_cast<uint8_t>(value));
+}
+
+void CUndoRecordWriter::WritePosition(const TextPosition& pos)
+{
+    WriteSize(pos.line);
+    WriteSize(pos.column);
+}
+
+void CUndoRecordWriter::WriteString(const std::wstring& text)
+{
+    WriteString(text.data(), text.length());
+}
+
+void CUndoRecordWriter::WriteString(const wchar_t* text, size_t length)
+{
+    WriteSize(length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        WriteSize(static_cast<size_t>(static_cast<unsigned long>(text[i])));
+    }
+}
+
+// CUndoRecordReader実装
+bool CUndoRecordReader::ReadSize(size_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < sizeof(size_t) * 8; shift += 7)
+    {
+        if (m_pos == m_end)
+        {
+            return false;
+        }
+        const uint8_t byte = *m_pos++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CUndoRecordReader::ReadPosition(TextPosition& pos)
+{
+    return ReadSize(pos.line) && ReadSize(pos.column);
+}
+
+bool CUndoRecordReader::ReadString(std::wstring& text)
+{
+    size_t length = 0;
+    // 1文字は少なくとも1バイトなので、残りより長い長さは壊れている
+    if (!ReadSize(length) || length > static_cast<size_t>(m_end - m_pos))
+    {
+        return false;
+    }
+    text.clear();
+    text.reserve(length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        size_t code = 0;
+        if (!ReadSize(code))
+        {
+            return false;
+        }
+        text.push_back(static_cast<wchar_t>(code));
+    }
+    return true;
+}
+
+// CUndoSpillFile実装
+CUndoSpillFile::CUndoSpillFile()
+    : m_fileSize(0)
+    , m_liveBytes(0)
+    , m_failed(false)
+{
+}
+
+CUndoSpillFile::~CUndoSpillFile()
+{
+    Close();
+}
+
+bool CUndoSpillFile::Write(const std::vector<uint8_t>& data, UndoSpillRecord& record)
+{
+    if (m_failed)
+    {
+        return false;
+    }
+    if (!m_file.IsOpen())
+    {
+        if (!CreateTempFile(L"und", m_filePath) || !m_file.Open(m_filePath.c_str(), CFile::OpenOrCreate))
+        {
+            if (!m_filePath.empty())
+            {
+                DeleteFilePath(m_filePath.c_str());
+                m_filePath.clear();
+            }
+            m_failed = true;
+            return false;
+        }
+        m_fileSize = 0;
+        m_liveBytes = 0;
+    }
+
+    std::vector<uint8_t> compressed;
+    CompressBytes(data.data(), data.size(), compressed);
+    if (!m_file.Seek(m_fileSize) || !m_file.Write(compressed.data(), compressed.size()))
+    {
+        return false;
+    }
+
+    record.offset = m_fileSize;
+    record.compressedSize = compressed.size();
+    record.rawSize = data.size();
+    m_fileSize += compressed.size();
+    m_liveBytes += compressed.size();
+    return true;
+}
+
+bool CUndoSpillFile::Read(const UndoSpillRecord& record, std::vector<uint8_t>& data)
+{
+    if (!m_file.IsOpen() || record.offset + record.compressedSize > m_fileSize)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> compressed(record.compressedSize);
+    size_t bytesRead = 0;
+    if (!m_file.Seek(record.offset) || !m_file.Read(compressed.data(), compressed.size(), bytesRead) ||
+        bytesRead != compressed.size())
+    {
+        return false;
+    }
+    return DecompressBytes(compressed.data(), compressed.size(), record.rawSize, data);
+}
+
+void CUndoSpillFile::Release(const UndoSpillRecord& record)
+{
+    m_liveBytes -= std::min<uint64_t>(record.compressedSize, m_liveBytes);
+}
+
+bool CUndoSpillFile::NeedsCompaction() const
+{
+    // 使われなくなった記録が半分を超えたら詰める
+    return m_file.IsOpen() && m_fileSize > SPILL_COMPACT_MIN && m_fileSize - m_liveBytes > m_liveBytes;
+}
+
+bool CUndoSpillFile::Compact(const std::vector<UndoSpillRecord*>& records)
+{
+    if (!m_file.IsOpen())
+    {
+        return false;
+    }
+
+    // 位置の順に前へ写す。写し先が元の記録と重なるときは写さないので、書き込みが途中で失敗しても
+    // 上書きするのは使われていない範囲だけで、どの記録も読める
+    std::vector<UndoSpillRecord*> sorted(records);
+    std::sort(sorted.begin(), sorted.end(),
+              [](const UndoSpillRecord* a, const UndoSpillRecord* b) { return a->offset < b->offset; });
+
+    std::vector<uint8_t> buffer;
+    uint64_t writePos = 0;
+    for (UndoSpillRecord* record : sorted)
+    {
+        if (writePos + record->compressedSize > record->offset)
+        {
+            writePos = record->offset + record->compressedSize;
+            continue;
+        }
+        buffer.resize(record->compressedSize);
+        size_t bytesRead = 0;
+        if (!m_file.Seek(record->offset) || !m_file.Read(buffer.data(), buffer.size(), bytesRead) ||
+            bytesRead != buffer.size() || !m_file.Seek(writePos) || !m_file.Write(buffer.data(), buffer.size()))
+        {
+            return false;
+        }
+        record->offset = writePos;
+        writePos += record->compressedSize;
+    }
+
+    // 切り詰めに失敗しても、末尾が使われないだけで記録は読める
+    m_file.Truncate(writePos);
+    m_fileSize = writePos;
+    return true;
+}
+
+void CUndoSpillFile::Close()
+{
+    m_file.Close();
+    if (!m_filePath.empty())
+    {
+        DeleteFilePath(m_filePath.c_str());
+        m_filePath.clear();
+    }
+    m_fileSize = 0;
+    m_liveBytes = 0;
+}
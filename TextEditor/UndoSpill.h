@@ -0,0 +1,81 @@
+// UndoSpill.h - メモリの上限を超えた元に戻す履歴の一時ファイルへの退避
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "FileIO.h"
+#include "TextDocument.h"
+
+// 履歴のコマンドを詰めて書き出すためのバイト列（数値と文字のコード単位は可変長で書く）
+class CUndoRecordWriter
+{
+public:
+    void WriteSize(size_t value);
+    void WritePosition(const TextPosition& pos);
+    void WriteString(const std::wstring& text);
+    void WriteString(const wchar_t* text, size_t length);
+
+    const std::vector<uint8_t>& GetData() const { return m_data; }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+// CUndoRecordWriter で書いたバイト列の読み出し。壊れたデータや途中で終わるデータではfalseを返す
+class CUndoRecordReader
+{
+public:
+    CUndoRecordReader(const uint8_t* data, size_t size)
+        : m_pos(data), m_end(data + size) {}
+
+    bool ReadSize(size_t& value);
+    bool ReadPosition(TextPosition& pos);
+    bool ReadString(std::wstring& text);
+    bool IsAtEnd() const { return m_pos == m_end; }
+
+private:
+    const uint8_t* m_pos;
+    const uint8_t* m_end;
+};
+
+// 一時ファイルに退避した1件の位置
+struct UndoSpillRecord
+{
+    uint64_t offset;
+    size_t compressedSize;
+    size_t rawSize;
+
+    UndoSpillRecord() : offset(0), compressedSize(0), rawSize(0) {}
+
+    bool IsEmpty() const { return compressedSize == 0; }
+};
+
+// 退避した履歴を圧縮して追記する一時ファイル。最初に書き出すときに作り、Close で消す。
+// 使われなくなった記録は Release で知らせ、その分が増えたら Compact で前に詰める
+class CUndoSpillFile
+{
+public:
+    CUndoSpillFile();
+    ~CUndoSpillFile();
+
+    bool Write(const std::vector<uint8_t>& data, UndoSpillRecord& record);
+    bool Read(const UndoSpillRecord& record, std::vector<uint8_t>& data);
+    void Release(const UndoSpillRecord& record);
+    bool NeedsCompaction() const;
+    bool Compact(const std::vector<UndoSpillRecord*>& records);
+    void Close();
+
+    bool IsOpen() const { return m_file.IsOpen(); }
+    uint64_t GetFileSize() const { return m_fileSize; }
+    uint64_t GetLiveBytes() const { return m_liveBytes; }
+
+private:
+    CUndoSpillFile(const CUndoSpillFile&) = delete;
+    CUndoSpillFile& operator=(const CUndoSpillFile&) = delete;
+
+    CFile m_file;
+    std::wstring m_filePath;
+    uint64_t m_fileSize;
+    uint64_t m_liveBytes;   // まだ使われている記録の合計
+    bool m_failed;          // 作成に失敗したら以後は退避しない
+};
@@ -0,0 +1,127 @@
+// WorkerPool.cpp - ワーカースレッドプール実装
+#include "WorkerPool.h"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+CWorkerPool::CWorkerPool(size_t threadCount)
+    : m_stopRequested(false)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        m_threads.push_back(std::thread(&CWorkerPool::WorkerThread, this));
+    }
+}
+
+CWorkerPool::~CWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopRequested = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+CWorkerPool& CWorkerPool::GetShared()
+{
+    static CWorkerPool pool;
+    return pool;
+}
+
+void CWorkerPool::Enqueue(const std::function<void()>& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+    m_wake.notify_one();
+}
+
+void CWorkerPool::WorkerThread()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopRequested || !m_jobs.empty(); });
+            if (m_jobs.empty())
+            {
+                return;
+            }
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void CWorkerPool::ParallelFor(size_t taskCount, const std::function<void(size_t)>& task, size_t maxConcurrency)
+{
+    if (taskCount == 0)
+    {
+        return;
+    }
+
+    size_t helpers = std::min(m_threads.size(), taskCount - 1);
+    if (maxConcurrency != 0)
+    {
+        helpers = std::min(helpers, maxConcurrency - 1);
+    }
+    if (helpers == 0)
+    {
+        for (size_t i = 0; i < taskCount; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    // タスク番号は共有カウンタから取り出すので、処理の速いスレッドが多くを受け持つ
+    struct SharedState
+    {
+        std::atomic<size_t> next;
+        size_t remainingHelpers;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    std::shared_ptr<SharedState> state = std::make_shared<SharedState>();
+    state->next = 0;
+    state->remainingHelpers = helpers;
+
+    const std::function<void(size_t)>* pTask = &task;
+    auto drain = [state, pTask, taskCount]
+    {
+        for (size_t i = state->next++; i < taskCount; i = state->next++)
+        {
+            (*pTask)(i);
+        }
+    };
+
+    for (size_t i = 0; i < helpers; ++i)
+    {
+        Enqueue([state, drain]
+        {
+            drain();
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (--state->remainingHelpers == 0)
+            {
+                state->finished.notify_one();
+            }
+        });
+    }
+
+    drain();
+
+    // task は呼び出し元の参照なので、ヘルパーがすべて抜けるまで戻らない
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state] { return state->remainingHelpers == 0; });
+}
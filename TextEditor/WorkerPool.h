@@ -0,0 +1,39 @@
+// WorkerPool.h - 検索などの並列処理に使うワーカースレッドプール
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+// 固定数のワーカースレッドでタスクを実行する。
+// ParallelFor は呼び出しスレッドも処理に加わり、すべてのタスクの完了を待って戻る。
+// タスクの中から同じプールの ParallelFor を呼ばないこと（入れ子にすると待ち合わせが詰まる）
+class CWorkerPool
+{
+public:
+    // threadCount が0ならハードウェアスレッド数に合わせる
+    explicit CWorkerPool(size_t threadCount = 0);
+    ~CWorkerPool();
+
+    size_t GetThreadCount() const { return m_threads.size(); }
+
+    // task(0) ... task(taskCount - 1) を並列に実行する。
+    // maxConcurrency が0以外なら、呼び出しスレッドを含めた同時実行数をその値までに抑える
+    void ParallelFor(size_t taskCount, const std::function<void(size_t)>& task, size_t maxConcurrency = 0);
+
+    // アプリケーション全体で共有するプール
+    static CWorkerPool& GetShared();
+
+private:
+    void Enqueue(const std::function<void()>& job);
+    void WorkerThread();
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::function<void()>> m_jobs;
+    bool m_stopRequested;
+};